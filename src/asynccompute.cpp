@@ -0,0 +1,192 @@
+#include "asynccompute.h"
+#include "hostallocator.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <assert.h>
+
+AsyncCompute::~AsyncCompute()
+{
+    destroy();
+}
+
+
+bool AsyncCompute::init(VkPhysicalDevice physicalDevice, const std::vector<VkQueueFamilyProperties>& queueFamilies, VkDevice device,
+    unsigned int computeFamily, VkQueue computeQueue, unsigned int graphicsFamily, unsigned int frameCount)
+{
+    assert(frameCount > 0);
+    mDevice = device;
+    mQueue = computeQueue;
+    mAsync = computeFamily != graphicsFamily;
+    mFrames.resize(frameCount);
+
+    // Timestamps are only compared when both queues support them
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    uint32_t valid_bits = std::min(queueFamilies[computeFamily].timestampValidBits, queueFamilies[graphicsFamily].timestampValidBits);
+    mTimestamps = valid_bits > 0;
+    mTimestampMask = valid_bits >= 64 ? ~0ULL : (1ULL << valid_bits) - 1;
+    mTimestampPeriod = static_cast<double>(properties.limits.timestampPeriod);
+    if (!mTimestamps)
+        LOG_WARNING(Render) << "timestamps not supported, async compute overlap is not measured";
+
+    for (auto& frame : mFrames)
+    {
+        VkCommandPoolCreateInfo pool_info = {};
+        pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        pool_info.queueFamilyIndex = computeFamily;
+        if (vkCreateCommandPool(device, &pool_info, getHostCallbacks(EHostScope::Device), &frame.mCommandPool) != VK_SUCCESS)
+        {
+            LOG_ERROR(Render) << "unable to create compute command pool";
+            return false;
+        }
+
+        VkCommandBufferAllocateInfo buffer_info = {};
+        buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        buffer_info.commandPool = frame.mCommandPool;
+        buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        buffer_info.commandBufferCount = 1;
+        if (vkAllocateCommandBuffers(device, &buffer_info, &frame.mCommandBuffer) != VK_SUCCESS)
+        {
+            LOG_ERROR(Render) << "unable to allocate compute command buffer";
+            return false;
+        }
+
+        VkSemaphoreCreateInfo semaphore_info = {};
+        semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        if (vkCreateSemaphore(device, &semaphore_info, getHostCallbacks(EHostScope::Device), &frame.mSemaphore) != VK_SUCCESS)
+        {
+            LOG_ERROR(Render) << "unable to create compute semaphore";
+            return false;
+        }
+    }
+
+    if (!mTimestamps)
+        return true;
+
+    VkQueryPoolCreateInfo query_info = {};
+    query_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    query_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    query_info.queryCount = frameCount * EQuery::Count;
+    if (vkCreateQueryPool(device, &query_info, getHostCallbacks(EHostScope::Device), &mQueryPool) != VK_SUCCESS)
+    {
+        LOG_ERROR(Render) << "unable to create timestamp query pool";
+        return false;
+    }
+    return true;
+}
+
+
+void AsyncCompute::destroy()
+{
+    if (mDevice == VK_NULL_HANDLE)
+        return;
+
+    for (auto& frame : mFrames)
+    {
+        vkDestroySemaphore(mDevice, frame.mSemaphore, getHostCallbacks(EHostScope::Device));
+        vkDestroyCommandPool(mDevice, frame.mCommandPool, getHostCallbacks(EHostScope::Device));
+    }
+    mFrames.clear();
+
+    vkDestroyQueryPool(mDevice, mQueryPool, getHostCallbacks(EHostScope::Device));
+    mQueryPool = VK_NULL_HANDLE;
+    mDevice = VK_NULL_HANDLE;
+}
+
+
+void AsyncCompute::collect(unsigned int frameIndex)
+{
+    Frame& frame = mFrames[frameIndex];
+    if (!mTimestamps || !frame.mSubmitted)
+        return;
+    frame.mSubmitted = false;
+
+    uint64_t stamps[EQuery::Count];
+    if (vkGetQueryPoolResults(mDevice, mQueryPool, frameIndex * EQuery::Count, EQuery::Count, sizeof(stamps), stamps,
+        sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+        return;
+
+    for (auto& stamp : stamps)
+        stamp &= mTimestampMask;
+
+    mStats.mComputeTime = static_cast<double>(stamps[ComputeEnd] - stamps[ComputeBegin]) * mTimestampPeriod;
+    mStats.mGraphicsTime = static_cast<double>(stamps[GraphicsEnd] - stamps[GraphicsBegin]) * mTimestampPeriod;
+
+    // Compute work of this frame against graphics work of the previous frame
+    mStats.mOverlapTime = 0.0;
+    if (mLastGraphicsEnd != 0)
+    {
+        uint64_t begin = std::max(stamps[ComputeBegin], mLastGraphicsBegin);
+        uint64_t end = std::min(stamps[ComputeEnd], mLastGraphicsEnd);
+        if (end > begin)
+        {
+            mStats.mOverlapTime = static_cast<double>(end - begin) * mTimestampPeriod;
+            mStats.mOverlappedFrames++;
+            mStats.mTotalOverlapTime += mStats.mOverlapTime;
+        }
+    }
+    mLastGraphicsBegin = stamps[GraphicsBegin];
+    mLastGraphicsEnd = stamps[GraphicsEnd];
+    mStats.mFrames++;
+}
+
+
+bool AsyncCompute::submit(unsigned int frameIndex, const AsyncComputeRecordFunction& record)
+{
+    Frame& frame = mFrames[frameIndex];
+    vkResetCommandPool(mDevice, frame.mCommandPool, 0);
+
+    VkCommandBufferBeginInfo begin_info = {};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(frame.mCommandBuffer, &begin_info);
+
+    uint32_t query = frameIndex * EQuery::Count;
+    if (mTimestamps)
+    {
+        vkCmdResetQueryPool(frame.mCommandBuffer, mQueryPool, query + ComputeBegin, 2);
+        vkCmdWriteTimestamp(frame.mCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, mQueryPool, query + ComputeBegin);
+    }
+
+    record(frame.mCommandBuffer);
+
+    if (mTimestamps)
+        vkCmdWriteTimestamp(frame.mCommandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, mQueryPool, query + ComputeEnd);
+    vkEndCommandBuffer(frame.mCommandBuffer);
+
+    VkSubmitInfo submit_info = {};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &frame.mCommandBuffer;
+    submit_info.signalSemaphoreCount = 1;
+    submit_info.pSignalSemaphores = &frame.mSemaphore;
+    if (vkQueueSubmit(mQueue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS)
+    {
+        LOG_ERROR(Render) << "unable to submit compute work";
+        return false;
+    }
+    frame.mSubmitted = true;
+    return true;
+}
+
+
+void AsyncCompute::beginGraphics(VkCommandBuffer commandBuffer, unsigned int frameIndex)
+{
+    if (!mTimestamps)
+        return;
+
+    uint32_t query = frameIndex * EQuery::Count;
+    vkCmdResetQueryPool(commandBuffer, mQueryPool, query + GraphicsBegin, 2);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, mQueryPool, query + GraphicsBegin);
+}
+
+
+void AsyncCompute::endGraphics(VkCommandBuffer commandBuffer, unsigned int frameIndex)
+{
+    if (!mTimestamps)
+        return;
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, mQueryPool, frameIndex * EQuery::Count + GraphicsEnd);
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "inplacefunction.h"
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+/**
+ * Records the compute work of a single frame, created every frame: captures are stored inline
+ */
+using AsyncComputeRecordFunction = InplaceFunction<void(VkCommandBuffer commandBuffer), 64>;
+
+
+/**
+ * GPU timings of the most recently completed frame, in nanoseconds.
+ * Timestamps of different queues are compared directly, which assumes they share a time domain.
+ */
+struct AsyncComputeStats
+{
+    double      mComputeTime = 0.0;         ///< Duration of the compute work of the last completed frame
+    double      mGraphicsTime = 0.0;        ///< Duration of the graphics work of the last completed frame
+    double      mOverlapTime = 0.0;         ///< Time the compute work of that frame overlapped the graphics work of the frame before
+    uint64_t    mFrames = 0;                ///< Number of frames with valid timings
+    uint64_t    mOverlappedFrames = 0;      ///< Number of frames where compute and graphics overlapped
+    double      mTotalOverlapTime = 0.0;    ///< Sum of all measured overlap
+};
+
+
+/**
+ * Runs work that prepares a frame, ie: culling, on a dedicated compute queue.
+ * The compute work of frame N+1 is submitted before the graphics work of frame N+1, which only waits on it
+ * at the stage that consumes the result: the compute queue runs while graphics is still busy with frame N.
+ * Every frame in flight owns a command buffer and a semaphore signaled by the compute submission.
+ *
+ * Both queues write timestamps at the start and end of their work, the overlap between the compute work
+ * of a frame and the graphics work of the previous frame is measured from those timestamps.
+ * When no dedicated compute family is available the work is submitted to the graphics queue, without overlap.
+ */
+class AsyncCompute
+{
+public:
+    AsyncCompute() = default;
+    ~AsyncCompute();
+
+    AsyncCompute(const AsyncCompute&) = delete;
+    AsyncCompute& operator=(const AsyncCompute&) = delete;
+
+    /**
+     * @param physicalDevice gpu, used to query the timestamp period
+     * @param queueFamilies queue families of the gpu, used for timestamp support
+     * @param device the device the queues belong to
+     * @param computeFamily queue family of the compute queue
+     * @param computeQueue queue compute work is submitted to
+     * @param graphicsFamily queue family of the graphics queue, used for timestamp support only
+     * @param frameCount number of frames in flight
+     */
+    bool init(VkPhysicalDevice physicalDevice, const std::vector<VkQueueFamilyProperties>& queueFamilies, VkDevice device,
+        unsigned int computeFamily, VkQueue computeQueue, unsigned int graphicsFamily, unsigned int frameCount);
+
+    /**
+     * Destroys all command pools, semaphores and queries, the device must be idle
+     */
+    void destroy();
+
+    /**
+     * Reads the timings of the frame that last used these resources, call after the fence of the frame signaled
+     */
+    void collect(unsigned int frameIndex);
+
+    /**
+     * Records and submits the compute work of a frame, the graphics submission of the frame must wait on getSemaphore()
+     * @return if the work was submitted
+     */
+    bool submit(unsigned int frameIndex, const AsyncComputeRecordFunction& record);
+
+    /**
+     * @return semaphore signaled when the compute work of the frame completed
+     */
+    VkSemaphore getSemaphore(unsigned int frameIndex) const             { return mFrames[frameIndex].mSemaphore; }
+
+    /**
+     * Writes the graphics start timestamp of a frame, call at the start of its command buffer
+     */
+    void beginGraphics(VkCommandBuffer commandBuffer, unsigned int frameIndex);
+
+    /**
+     * Writes the graphics end timestamp of a frame, call at the end of its command buffer
+     */
+    void endGraphics(VkCommandBuffer commandBuffer, unsigned int frameIndex);
+
+    /**
+     * @return if compute work runs on a different queue family than graphics
+     */
+    bool isAsync() const                                                { return mAsync; }
+
+    /**
+     * @return timings
+     */
+    const AsyncComputeStats& getStats() const                           { return mStats; }
+
+private:
+    enum EQuery : uint32_t
+    {
+        ComputeBegin = 0,
+        ComputeEnd,
+        GraphicsBegin,
+        GraphicsEnd,
+        Count
+    };
+
+    struct Frame
+    {
+        VkCommandPool       mCommandPool = VK_NULL_HANDLE;
+        VkCommandBuffer     mCommandBuffer = VK_NULL_HANDLE;
+        VkSemaphore         mSemaphore = VK_NULL_HANDLE;
+        bool                mSubmitted = false;             ///< If timestamps were written since the last collect
+    };
+
+    VkDevice                mDevice = VK_NULL_HANDLE;
+    VkQueue                 mQueue = VK_NULL_HANDLE;
+    VkQueryPool             mQueryPool = VK_NULL_HANDLE;
+    std::vector<Frame>      mFrames;
+    bool                    mAsync = false;
+    bool                    mTimestamps = false;
+    double                  mTimestampPeriod = 1.0;         ///< Nanoseconds per timestamp tick
+    uint64_t                mTimestampMask = 0;
+    uint64_t                mLastGraphicsBegin = 0;         ///< Graphics interval of the previously collected frame
+    uint64_t                mLastGraphicsEnd = 0;
+    AsyncComputeStats       mStats;
+};
@@ -0,0 +1,290 @@
+#include "capabilitycache.h"
+#include "logger.h"
+
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <assert.h>
+
+/**
+ * Identifies a snapshot file, the version changes whenever the layout does
+ */
+static const uint32_t gSnapshotMagic = 0x53434B56;     // VKCS
+static const uint32_t gSnapshotVersion = 1;
+
+/**
+ * Smallest number of bytes a device takes in a snapshot: ids, driver version, UUID and two empty arrays
+ */
+static const size_t gMinDeviceSize = 3 * sizeof(uint32_t) + VK_UUID_SIZE + 2 * sizeof(uint32_t);
+
+
+uint32_t getInstanceApiVersion()
+{
+    auto enumerate_version = reinterpret_cast<PFN_vkEnumerateInstanceVersion>(vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion"));
+    uint32_t api_version(VK_API_VERSION_1_0);
+    if (enumerate_version == nullptr || enumerate_version(&api_version) != VK_SUCCESS)
+        return VK_API_VERSION_1_0;
+    return api_version;
+}
+
+
+/**
+ * Appends a trivially copyable value to a snapshot
+ */
+template<typename T>
+static void writeValue(std::vector<char>& ioData, const T& value)
+{
+    const char* bytes = reinterpret_cast<const char*>(&value);
+    ioData.insert(ioData.end(), bytes, bytes + sizeof(T));
+}
+
+
+/**
+ * Appends the number of elements followed by the elements
+ */
+template<typename T>
+static void writeArray(std::vector<char>& ioData, const std::vector<T>& values)
+{
+    writeValue(ioData, static_cast<uint32_t>(values.size()));
+    const char* bytes = reinterpret_cast<const char*>(values.data());
+    ioData.insert(ioData.end(), bytes, bytes + values.size() * sizeof(T));
+}
+
+
+/**
+ * Reads values from a snapshot, every read fails once the data is exhausted
+ */
+struct SnapshotReader
+{
+    const std::vector<char>&    mData;
+    size_t                      mOffset = 0;
+
+    template<typename T>
+    bool readValue(T& outValue)
+    {
+        if (mData.size() - mOffset < sizeof(T))
+            return false;
+        std::memcpy(&outValue, mData.data() + mOffset, sizeof(T));
+        mOffset += sizeof(T);
+        return true;
+    }
+
+    size_t getRemaining() const
+    {
+        return mData.size() - mOffset;
+    }
+
+    template<typename T>
+    bool readArray(std::vector<T>& outValues)
+    {
+        uint32_t count(0);
+        if (!readValue(count) || (mData.size() - mOffset) / sizeof(T) < count)
+            return false;
+        outValues.resize(count);
+        std::memcpy(outValues.data(), mData.data() + mOffset, count * sizeof(T));
+        mOffset += count * sizeof(T);
+        return true;
+    }
+};
+
+
+void CapabilityCache::init(const std::string& path, bool refresh)
+{
+    mPath = path;
+    mStats.mLoaded = !mPath.empty() && !refresh && read(mPath);
+    if (!mStats.mLoaded)
+    {
+        mLayers.clear();
+        mInstanceExtensions.clear();
+        mDevices.clear();
+    }
+
+    // The instance section is stale when the loader changed or layers or extensions were installed or removed
+    uint32_t api_version = getInstanceApiVersion();
+    uint32_t layer_count(0), extension_count(0);
+    vkEnumerateInstanceLayerProperties(&layer_count, nullptr);
+    vkEnumerateInstanceExtensionProperties(nullptr, &extension_count, nullptr);
+    mInstanceValid = mStats.mLoaded && api_version == mApiVersion && layer_count == mLayers.size() &&
+        extension_count == mInstanceExtensions.size();
+    mStats.mInstanceCached = mInstanceValid;
+    mApiVersion = api_version;
+}
+
+
+void CapabilityCache::setInstance(VkInstance instance, bool physicalDeviceProperties2)
+{
+    mGetProperties2 = !physicalDeviceProperties2 ? nullptr :
+        reinterpret_cast<PFN_vkGetPhysicalDeviceProperties2KHR>(vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceProperties2KHR"));
+}
+
+
+const std::vector<VkLayerProperties>& CapabilityCache::getLayers()
+{
+    if (!mInstanceValid)
+        queryInstance();
+    return mLayers;
+}
+
+
+const std::vector<VkExtensionProperties>& CapabilityCache::getInstanceExtensions()
+{
+    if (!mInstanceValid)
+        queryInstance();
+    return mInstanceExtensions;
+}
+
+
+const DeviceCapabilities& CapabilityCache::getDevice(VkPhysicalDevice physicalDevice)
+{
+    // A device matches when it's the same device with the same driver, and the driver still reports as many extensions
+    DeviceCapabilities key;
+    getDeviceKey(physicalDevice, key);
+    uint32_t extension_count(0);
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extension_count, nullptr);
+    auto it = std::find_if(mDevices.begin(), mDevices.end(), [&key](const DeviceCapabilities& device)
+    {
+        return device.mVendorID == key.mVendorID && device.mDeviceID == key.mDeviceID && std::memcmp(device.mUUID, key.mUUID, VK_UUID_SIZE) == 0;
+    });
+    if (it != mDevices.end() && it->mDriverVersion == key.mDriverVersion && it->mExtensions.size() == extension_count)
+    {
+        if (it->mCached)
+            mStats.mDeviceHits++;
+        return *it;
+    }
+
+    // Stale or unknown, query the device and replace the old snapshot of it
+    mStats.mDeviceMisses++;
+    uint32_t family_count(0);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &family_count, nullptr);
+    key.mQueueFamilies.resize(family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &family_count, key.mQueueFamilies.data());
+    key.mExtensions.resize(extension_count);
+    if (vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extension_count, key.mExtensions.data()) != VK_SUCCESS)
+        key.mExtensions.clear();
+    key.mExtensions.resize(extension_count);
+
+    mDirty = true;
+    if (it == mDevices.end())
+        it = mDevices.emplace(mDevices.end());
+    *it = key;
+    return *it;
+}
+
+
+bool CapabilityCache::save()
+{
+    if (mPath.empty() || !mDirty)
+        return true;
+
+    // Struct sizes guard against headers that changed the layout of the stored properties
+    std::vector<char> data;
+    writeValue(data, gSnapshotMagic);
+    writeValue(data, gSnapshotVersion);
+    writeValue(data, static_cast<uint32_t>(sizeof(VkLayerProperties)));
+    writeValue(data, static_cast<uint32_t>(sizeof(VkExtensionProperties)));
+    writeValue(data, static_cast<uint32_t>(sizeof(VkQueueFamilyProperties)));
+    writeValue(data, mApiVersion);
+    writeArray(data, mLayers);
+    writeArray(data, mInstanceExtensions);
+    writeValue(data, static_cast<uint32_t>(mDevices.size()));
+    for (const auto& device : mDevices)
+    {
+        writeValue(data, device.mVendorID);
+        writeValue(data, device.mDeviceID);
+        writeValue(data, device.mDriverVersion);
+        data.insert(data.end(), device.mUUID, device.mUUID + VK_UUID_SIZE);
+        writeArray(data, device.mQueueFamilies);
+        writeArray(data, device.mExtensions);
+    }
+
+    std::ofstream file(mPath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open() || !file.write(data.data(), data.size()))
+    {
+        LOG_ERROR(Device) << "unable to write capability snapshot: " << mPath;
+        return false;
+    }
+    mDirty = false;
+    return true;
+}
+
+
+bool CapabilityCache::read(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open())
+        return false;
+    std::streamsize size = file.tellg();
+    if (size <= 0)
+        return false;
+    std::vector<char> data(static_cast<size_t>(size));
+    file.seekg(0, std::ios::beg);
+    if (!file.read(data.data(), size))
+        return false;
+
+    SnapshotReader reader = { data };
+    uint32_t magic(0), version(0), layer_size(0), extension_size(0), family_size(0);
+    if (!reader.readValue(magic) || !reader.readValue(version) || magic != gSnapshotMagic || version != gSnapshotVersion ||
+        !reader.readValue(layer_size) || !reader.readValue(extension_size) || !reader.readValue(family_size) ||
+        layer_size != sizeof(VkLayerProperties) || extension_size != sizeof(VkExtensionProperties) || family_size != sizeof(VkQueueFamilyProperties))
+    {
+        LOG_WARNING(Device) << "capability snapshot " << path << " has an unknown layout, querying all capabilities";
+        return false;
+    }
+
+    // A corrupt count must not allocate more devices than the remaining data can hold
+    uint32_t device_count(0);
+    if (!reader.readValue(mApiVersion) || !reader.readArray(mLayers) || !reader.readArray(mInstanceExtensions) || !reader.readValue(device_count) ||
+        reader.getRemaining() / gMinDeviceSize < device_count)
+        return false;
+    mDevices.resize(device_count);
+    for (auto& device : mDevices)
+    {
+        if (!reader.readValue(device.mVendorID) || !reader.readValue(device.mDeviceID) || !reader.readValue(device.mDriverVersion) ||
+            !reader.readValue(device.mUUID) || !reader.readArray(device.mQueueFamilies) || !reader.readArray(device.mExtensions))
+            return false;
+        device.mCached = true;
+    }
+    return true;
+}
+
+
+void CapabilityCache::queryInstance()
+{
+    uint32_t layer_count(0);
+    vkEnumerateInstanceLayerProperties(&layer_count, nullptr);
+    mLayers.resize(layer_count);
+    if (vkEnumerateInstanceLayerProperties(&layer_count, mLayers.data()) != VK_SUCCESS)
+        layer_count = 0;
+    mLayers.resize(layer_count);
+
+    uint32_t extension_count(0);
+    vkEnumerateInstanceExtensionProperties(nullptr, &extension_count, nullptr);
+    mInstanceExtensions.resize(extension_count);
+    if (vkEnumerateInstanceExtensionProperties(nullptr, &extension_count, mInstanceExtensions.data()) != VK_SUCCESS)
+        extension_count = 0;
+    mInstanceExtensions.resize(extension_count);
+
+    mInstanceValid = true;
+    mDirty = true;
+}
+
+
+void CapabilityCache::getDeviceKey(VkPhysicalDevice physicalDevice, DeviceCapabilities& outKey) const
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    outKey.mVendorID = properties.vendorID;
+    outKey.mDeviceID = properties.deviceID;
+    outKey.mDriverVersion = properties.driverVersion;
+    std::memcpy(outKey.mUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+    if (mGetProperties2 == nullptr)
+        return;
+
+    VkPhysicalDeviceIDPropertiesKHR id_properties = {};
+    id_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES_KHR;
+    VkPhysicalDeviceProperties2KHR properties2 = {};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR;
+    properties2.pNext = &id_properties;
+    mGetProperties2(physicalDevice, &properties2);
+    std::memcpy(outKey.mUUID, id_properties.deviceUUID, VK_UUID_SIZE);
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
+
+/**
+ * Snapshot of a physical device, identified by its driver version and device UUID
+ */
+struct DeviceCapabilities
+{
+    uint32_t                                mVendorID = 0;
+    uint32_t                                mDeviceID = 0;
+    uint32_t                                mDriverVersion = 0;
+    uint8_t                                 mUUID[VK_UUID_SIZE] = {};       ///< Device UUID, the pipeline cache UUID without VK_KHR_get_physical_device_properties2
+    std::vector<VkQueueFamilyProperties>    mQueueFamilies;
+    std::vector<VkExtensionProperties>      mExtensions;
+    bool                                    mCached = false;                ///< If the snapshot was read from disk, not stored
+};
+
+
+/**
+ * Capability cache counters
+ */
+struct CapabilityCacheStats
+{
+    bool        mLoaded = false;            ///< If a snapshot file was read
+    bool        mInstanceCached = false;    ///< If layers and instance extensions came from the snapshot
+    uint64_t    mDeviceHits = 0;            ///< Number of device lookups served from the snapshot
+    uint64_t    mDeviceMisses = 0;          ///< Number of device lookups that queried the device, absent from the snapshot or stale
+};
+
+
+/**
+ * Vulkan 1.0 loaders don't export vkEnumerateInstanceVersion, it is looked up instead of linked
+ * @return the instance version supported by the loader, 1.0 when the entry point is missing
+ */
+uint32_t getInstanceApiVersion();
+
+
+/**
+ * Stores the results of the capability queries made on startup on disk: instance layers, instance extensions and
+ * per device the queue families and extensions.
+ *
+ * Every launch otherwise enumerates and prints all of them again. On load the snapshot is validated cheaply: the
+ * instance section against the loader version and the number of layers and instance extensions, every device against
+ * its vendor, device id, driver version and UUID and its number of extensions. Each of those is a single call that
+ * doesn't copy any properties. A driver update therefore refreshes the device, a newly installed layer the instance
+ * section. Surface formats and present modes are not part of the snapshot, they follow the display a window is on
+ * and are cached for the session by SurfaceInfoCache.
+ *
+ * The snapshot is written by save() when anything was queried.
+ */
+class CapabilityCache
+{
+public:
+    /**
+     * Reads the snapshot and validates its instance section
+     * @param path snapshot file, nothing is read or written when empty
+     * @param refresh if the snapshot is ignored and everything is queried again
+     */
+    void init(const std::string& path, bool refresh);
+
+    /**
+     * Device UUIDs are queried through vkGetPhysicalDeviceProperties2KHR when available, call before getDevice()
+     * @param instance the created instance
+     * @param physicalDeviceProperties2 if VK_KHR_get_physical_device_properties2 is enabled on the instance
+     */
+    void setInstance(VkInstance instance, bool physicalDeviceProperties2);
+
+    /**
+     * @return available instance layers, from the snapshot when valid
+     */
+    const std::vector<VkLayerProperties>& getLayers();
+
+    /**
+     * @return available instance extensions, from the snapshot when valid
+     */
+    const std::vector<VkExtensionProperties>& getInstanceExtensions();
+
+    /**
+     * @return the capabilities of a physical device, queried and stored when the snapshot has none or they are stale.
+     * Valid until the next call.
+     */
+    const DeviceCapabilities& getDevice(VkPhysicalDevice physicalDevice);
+
+    /**
+     * Writes the snapshot when anything was queried since it was read
+     * @return if the snapshot is up to date on disk
+     */
+    bool save();
+
+    /**
+     * @return cache counters
+     */
+    const CapabilityCacheStats& getStats() const                        { return mStats; }
+
+private:
+    bool read(const std::string& path);
+    void queryInstance();
+    void getDeviceKey(VkPhysicalDevice physicalDevice, DeviceCapabilities& outKey) const;
+
+    std::string                                 mPath;
+    PFN_vkGetPhysicalDeviceProperties2KHR       mGetProperties2 = nullptr;
+    uint32_t                                    mApiVersion = 0;            ///< Instance version reported by the loader
+    std::vector<VkLayerProperties>              mLayers;
+    std::vector<VkExtensionProperties>          mInstanceExtensions;
+    std::vector<DeviceCapabilities>             mDevices;
+    bool                                        mInstanceValid = false;     ///< If the instance section matches the loader
+    bool                                        mDirty = false;             ///< If anything was queried since the snapshot was read
+    CapabilityCacheStats                        mStats;
+};
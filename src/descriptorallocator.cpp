@@ -0,0 +1,251 @@
+#include "descriptorallocator.h"
+#include "hostallocator.h"
+#include "hash.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <assert.h>
+
+/**
+ * Number of descriptors of every type a pool reserves per set
+ */
+static const std::vector<std::pair<VkDescriptorType, float>>& getPoolRatios()
+{
+    static std::vector<std::pair<VkDescriptorType, float>> ratios;
+    if (ratios.empty())
+    {
+        ratios.emplace_back(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2.0f);
+        ratios.emplace_back(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f);
+        ratios.emplace_back(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.0f);
+        ratios.emplace_back(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4.0f);
+        ratios.emplace_back(VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1.0f);
+        ratios.emplace_back(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.0f);
+        ratios.emplace_back(VK_DESCRIPTOR_TYPE_SAMPLER, 0.5f);
+        ratios.emplace_back(VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 0.5f);
+    }
+    return ratios;
+}
+
+
+/**
+ * Pools double in size with every growth step, up to this many times the initial size
+ */
+static const uint32_t gMaxPoolGrowthShift = 4;
+
+
+//////////////////////////////////////////////////////////////////////////
+// DescriptorLayoutKey
+//////////////////////////////////////////////////////////////////////////
+
+bool DescriptorLayoutKey::operator==(const DescriptorLayoutKey& other) const
+{
+    if (mBindings.size() != other.mBindings.size())
+        return false;
+
+    for (size_t i = 0; i < mBindings.size(); i++)
+    {
+        const auto& l = mBindings[i];
+        const auto& r = other.mBindings[i];
+        if (l.binding != r.binding || l.descriptorType != r.descriptorType || l.descriptorCount != r.descriptorCount ||
+            l.stageFlags != r.stageFlags || l.pImmutableSamplers != r.pImmutableSamplers)
+            return false;
+    }
+    return true;
+}
+
+
+size_t DescriptorLayoutKeyHasher::operator()(const DescriptorLayoutKey& key) const
+{
+    uint64_t hash = gHashSeed;
+    for (const auto& binding : key.mBindings)
+    {
+        hashValue(hash, binding.binding);
+        hashValue(hash, binding.descriptorType);
+        hashValue(hash, binding.descriptorCount);
+        hashValue(hash, binding.stageFlags);
+        hashValue(hash, binding.pImmutableSamplers);
+    }
+    return static_cast<size_t>(hash);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// DescriptorAllocator
+//////////////////////////////////////////////////////////////////////////
+
+DescriptorAllocator::~DescriptorAllocator()
+{
+    destroy();
+}
+
+
+bool DescriptorAllocator::init(VkDevice device, unsigned int frameCount, uint32_t setsPerPool)
+{
+    assert(frameCount > 0 && setsPerPool > 0);
+    mDevice = device;
+    mSetsPerPool = setsPerPool;
+    mFrameIndex = 0;
+    mFrames.clear();
+    mFrames.resize(frameCount);
+
+    // Every frame starts with one pool, more are added on demand
+    for (auto& frame : mFrames)
+    {
+        VkDescriptorPool pool;
+        if (!createPool(mSetsPerPool, pool))
+            return false;
+        frame.mPools.emplace_back(pool);
+    }
+    return true;
+}
+
+
+void DescriptorAllocator::destroy()
+{
+    if (mDevice == VK_NULL_HANDLE)
+        return;
+
+    for (auto& frame : mFrames)
+    {
+        for (auto& pool : frame.mPools)
+            vkDestroyDescriptorPool(mDevice, pool, getHostCallbacks(EHostScope::Device));
+    }
+    mFrames.clear();
+
+    for (auto& it : mLayouts)
+        vkDestroyDescriptorSetLayout(mDevice, it.second, getHostCallbacks(EHostScope::Device));
+    mLayouts.clear();
+    mDevice = VK_NULL_HANDLE;
+}
+
+
+void DescriptorAllocator::beginFrame(unsigned int frameIndex)
+{
+    assert(frameIndex < mFrames.size());
+
+    // Sets handed out the last time this frame was recorded are no longer in use, release them all at once
+    FramePools& frame = mFrames[frameIndex];
+    for (size_t i = 0; i <= frame.mCurrent && i < frame.mPools.size(); i++)
+    {
+        vkResetDescriptorPool(mDevice, frame.mPools[i], 0);
+        mStats.mPoolResets++;
+    }
+
+    mStats.mAllocationsLastFrame = mStats.mAllocationsThisFrame;
+    mStats.mPoolGrowthLastFrame = mFrames[mFrameIndex].mGrowth;
+    mStats.mAllocationsThisFrame = 0;
+
+    frame.mCurrent = 0;
+    frame.mAllocations = 0;
+    frame.mGrowth = 0;
+    mFrameIndex = frameIndex;
+}
+
+
+bool DescriptorAllocator::allocate(VkDescriptorSetLayout layout, VkDescriptorSet& outSet)
+{
+    FramePools& frame = mFrames[mFrameIndex];
+
+    VkDescriptorSetAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorSetCount = 1;
+    alloc_info.pSetLayouts = &layout;
+
+    while (true)
+    {
+        alloc_info.descriptorPool = frame.mPools[frame.mCurrent];
+        VkResult res = vkAllocateDescriptorSets(mDevice, &alloc_info, &outSet);
+        if (res == VK_SUCCESS)
+        {
+            frame.mAllocations++;
+            mStats.mAllocationsThisFrame++;
+            mStats.mTotalAllocations++;
+            return true;
+        }
+
+        if (res != VK_ERROR_OUT_OF_POOL_MEMORY && res != VK_ERROR_FRAGMENTED_POOL)
+        {
+            LOG_ERROR(Memory) << "unable to allocate descriptor set";
+            return false;
+        }
+
+        // Current pool is exhausted, move on to the next one (already reset) or grow the list
+        frame.mCurrent++;
+        if (frame.mCurrent < frame.mPools.size())
+            continue;
+
+        uint32_t shift = std::min<uint32_t>(static_cast<uint32_t>(frame.mPools.size()), gMaxPoolGrowthShift);
+        VkDescriptorPool pool;
+        if (!createPool(mSetsPerPool << shift, pool))
+        {
+            frame.mCurrent--;
+            return false;
+        }
+        frame.mPools.emplace_back(pool);
+        frame.mGrowth++;
+    }
+}
+
+
+VkDescriptorSetLayout DescriptorAllocator::getLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings)
+{
+    // Binding order doesn't change the layout, sort to share the same entry
+    DescriptorLayoutKey key;
+    key.mBindings = bindings;
+    std::sort(key.mBindings.begin(), key.mBindings.end(), [](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b)
+    {
+        return a.binding < b.binding;
+    });
+
+    auto it = mLayouts.find(key);
+    if (it != mLayouts.end())
+    {
+        mStats.mLayoutHits++;
+        return it->second;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layout_info = {};
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.bindingCount = static_cast<uint32_t>(key.mBindings.size());
+    layout_info.pBindings = key.mBindings.data();
+
+    VkDescriptorSetLayout layout;
+    if (vkCreateDescriptorSetLayout(mDevice, &layout_info, getHostCallbacks(EHostScope::Device), &layout) != VK_SUCCESS)
+    {
+        LOG_ERROR(Memory) << "unable to create descriptor set layout";
+        return VK_NULL_HANDLE;
+    }
+
+    mLayouts.emplace(std::move(key), layout);
+    mStats.mLayoutsCreated++;
+    return layout;
+}
+
+
+bool DescriptorAllocator::createPool(uint32_t maxSets, VkDescriptorPool& outPool)
+{
+    std::vector<VkDescriptorPoolSize> sizes;
+    for (const auto& ratio : getPoolRatios())
+    {
+        VkDescriptorPoolSize size;
+        size.type = ratio.first;
+        size.descriptorCount = std::max<uint32_t>(1, static_cast<uint32_t>(ratio.second * static_cast<float>(maxSets)));
+        sizes.emplace_back(size);
+    }
+
+    // No FREE_DESCRIPTOR_SET flag: sets are only ever released by resetting the whole pool
+    VkDescriptorPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.flags = 0;
+    pool_info.maxSets = maxSets;
+    pool_info.poolSizeCount = static_cast<uint32_t>(sizes.size());
+    pool_info.pPoolSizes = sizes.data();
+
+    if (vkCreateDescriptorPool(mDevice, &pool_info, getHostCallbacks(EHostScope::Device), &outPool) != VK_SUCCESS)
+    {
+        LOG_ERROR(Memory) << "unable to create descriptor pool";
+        return false;
+    }
+    mStats.mPoolsCreated++;
+    return true;
+}
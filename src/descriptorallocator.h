@@ -0,0 +1,113 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <unordered_map>
+
+/**
+ * Sorted set of bindings, key of a cached descriptor set layout
+ */
+struct DescriptorLayoutKey
+{
+    std::vector<VkDescriptorSetLayoutBinding> mBindings;
+
+    bool operator==(const DescriptorLayoutKey& other) const;
+};
+
+
+/**
+ * Allows a layout key to be used in an unordered container
+ */
+struct DescriptorLayoutKeyHasher
+{
+    size_t operator()(const DescriptorLayoutKey& key) const;
+};
+
+
+/**
+ * Descriptor allocator counters
+ */
+struct DescriptorAllocatorStats
+{
+    uint64_t    mPoolsCreated = 0;          ///< Total number of descriptor pools created, every pool after the first per frame is growth
+    uint64_t    mPoolGrowthLastFrame = 0;   ///< Number of pools created during the last completed frame
+    uint64_t    mAllocationsLastFrame = 0;  ///< Number of descriptor sets allocated during the last completed frame
+    uint64_t    mAllocationsThisFrame = 0;  ///< Number of descriptor sets allocated during the current frame
+    uint64_t    mTotalAllocations = 0;      ///< Number of descriptor sets allocated since init
+    uint64_t    mPoolResets = 0;            ///< Number of vkResetDescriptorPool calls
+    uint64_t    mLayoutsCreated = 0;        ///< Number of unique descriptor set layouts
+    uint64_t    mLayoutHits = 0;            ///< Number of layout requests served from the cache
+};
+
+
+/**
+ * Hands out descriptor sets that are valid for a single frame.
+ * Every frame in flight owns a growable list of descriptor pools, sets are allocated linearly
+ * from the current pool and a new pool is added when it runs out. Sets are never freed individually:
+ * when the fence of a frame signals all its pools are reset in one call by beginFrame().
+ * Descriptor set layouts are cached by a hash of their bindings and live as long as the allocator.
+ * Not thread safe, use one allocator per recording thread.
+ */
+class DescriptorAllocator
+{
+public:
+    DescriptorAllocator() = default;
+    ~DescriptorAllocator();
+
+    DescriptorAllocator(const DescriptorAllocator&) = delete;
+    DescriptorAllocator& operator=(const DescriptorAllocator&) = delete;
+
+    /**
+     * @param device the device to allocate descriptors from
+     * @param frameCount number of frames in flight
+     * @param setsPerPool number of sets the first pool of every frame can hold, later pools double in size
+     * @return if the first pool of every frame could be created
+     */
+    bool init(VkDevice device, unsigned int frameCount, uint32_t setsPerPool);
+
+    /**
+     * Destroys all pools and cached layouts, the device must be idle
+     */
+    void destroy();
+
+    /**
+     * Starts allocating for the given frame and resets all pools owned by that frame.
+     * Only call this after the fence of the frame has signaled.
+     */
+    void beginFrame(unsigned int frameIndex);
+
+    /**
+     * Allocates a descriptor set for the current frame, valid until beginFrame() is called for the same frame again
+     * @return if the set was allocated
+     */
+    bool allocate(VkDescriptorSetLayout layout, VkDescriptorSet& outSet);
+
+    /**
+     * Returns a descriptor set layout for the given bindings, created only once for every unique set of bindings
+     * @return the layout, VK_NULL_HANDLE when creation failed
+     */
+    VkDescriptorSetLayout getLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings);
+
+    /**
+     * @return allocator counters
+     */
+    const DescriptorAllocatorStats& getStats() const                    { return mStats; }
+
+private:
+    struct FramePools
+    {
+        std::vector<VkDescriptorPool>   mPools;
+        size_t                          mCurrent = 0;
+        uint64_t                        mAllocations = 0;
+        uint64_t                        mGrowth = 0;
+    };
+
+    bool createPool(uint32_t maxSets, VkDescriptorPool& outPool);
+
+    VkDevice                                                                        mDevice = VK_NULL_HANDLE;
+    uint32_t                                                                        mSetsPerPool = 0;
+    std::vector<FramePools>                                                         mFrames;
+    unsigned int                                                                    mFrameIndex = 0;
+    std::unordered_map<DescriptorLayoutKey, VkDescriptorSetLayout, DescriptorLayoutKeyHasher>  mLayouts;
+    DescriptorAllocatorStats                                                        mStats;
+};
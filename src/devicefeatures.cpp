@@ -0,0 +1,337 @@
+#include "devicefeatures.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <cstring>
+#include <assert.h>
+
+/**
+ * Extension a feature depends on
+ */
+struct FeatureExtension
+{
+    const char* mName = nullptr;
+    uint32_t    mCoreVersion = 0;           ///< Version the extension was promoted to core in, 0 when it wasn't
+    bool        mInstance = false;          ///< If it's an instance extension
+};
+
+
+/**
+ * A feature and the extensions it depends on
+ */
+struct FeatureInfo
+{
+    const char*         mName;
+    FeatureExtension    mExtensions[6];     ///< Extension of the feature first, followed by its dependencies, ends at a null name
+};
+
+
+/**
+ * Every feature in order of EDeviceFeature, the feature structures of all of them are queried through properties2
+ */
+static const FeatureInfo gFeatureInfo[] =
+{
+    { "synchronization2",
+    {
+        { VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME, VK_API_VERSION_1_3, false },
+        { VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME, VK_API_VERSION_1_1, true }
+    } },
+    { "timeline semaphores",
+    {
+        { VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME, VK_API_VERSION_1_2, false },
+        { VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME, VK_API_VERSION_1_1, true }
+    } },
+    { "descriptor indexing",
+    {
+        { VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME, VK_API_VERSION_1_2, false },
+        { VK_KHR_MAINTENANCE_3_EXTENSION_NAME, VK_API_VERSION_1_1, false },
+        { VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME, VK_API_VERSION_1_1, true }
+    } },
+    { "dynamic rendering",
+    {
+        { VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME, VK_API_VERSION_1_3, false },
+        { VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME, VK_API_VERSION_1_2, false },
+        { VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME, VK_API_VERSION_1_2, false },
+        { VK_KHR_MULTIVIEW_EXTENSION_NAME, VK_API_VERSION_1_1, false },
+        { VK_KHR_MAINTENANCE_2_EXTENSION_NAME, VK_API_VERSION_1_1, false },
+        { VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME, VK_API_VERSION_1_1, true }
+    } },
+    { "16 bit storage",
+    {
+        { VK_KHR_16BIT_STORAGE_EXTENSION_NAME, VK_API_VERSION_1_1, false },
+        { VK_KHR_STORAGE_BUFFER_STORAGE_CLASS_EXTENSION_NAME, VK_API_VERSION_1_1, false },
+        { VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME, VK_API_VERSION_1_1, true }
+    } },
+    { "buffer device address",
+    {
+        { VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME, VK_API_VERSION_1_2, false },
+        { VK_KHR_DEVICE_GROUP_EXTENSION_NAME, VK_API_VERSION_1_1, false },
+        { VK_KHR_DEVICE_GROUP_CREATION_EXTENSION_NAME, VK_API_VERSION_1_1, true },
+        { VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME, VK_API_VERSION_1_1, true }
+    } },
+    { "swap chain maintenance",
+    {
+        { VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME, 0, false },
+        { VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME, 0, true },
+        { VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME, VK_API_VERSION_1_1, true }
+    } }
+};
+static_assert(sizeof(gFeatureInfo) / sizeof(gFeatureInfo[0]) == static_cast<size_t>(EDeviceFeature::Count), "missing device feature info");
+
+
+/**
+ * Prepends a feature structure to a chain
+ */
+static void link(void* structure, void*& ioChain)
+{
+    VkBaseOutStructure* base = reinterpret_cast<VkBaseOutStructure*>(structure);
+    base->pNext = reinterpret_cast<VkBaseOutStructure*>(ioChain);
+    ioChain = structure;
+}
+
+
+DeviceFeatureBuilder::DeviceFeatureBuilder()
+{
+    resetStructures();
+}
+
+
+void DeviceFeatureBuilder::require(EDeviceFeature feature)
+{
+    mRequired[static_cast<size_t>(feature)] = true;
+}
+
+
+void DeviceFeatureBuilder::request(EDeviceFeature feature)
+{
+    mRequested[static_cast<size_t>(feature)] = true;
+}
+
+
+bool DeviceFeatureBuilder::negotiate(VkInstance instance, uint32_t instanceVersion, const std::vector<std::string>& instanceExtensions,
+    VkPhysicalDevice physicalDevice, const std::vector<VkExtensionProperties>& deviceExtensions)
+{
+    // Device functionality is limited by the version of the instance, even when the device supports a newer one
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    mFeatures = DeviceFeatures();
+    mFeatures.mApiVersion = std::min(instanceVersion, properties.apiVersion);
+    mExtensions.clear();
+    mChain = nullptr;
+
+    // An extension is available when it's core at the device version or supported
+    auto is_core = [this](const FeatureExtension& extension)
+    {
+        return extension.mCoreVersion != 0 && mFeatures.mApiVersion >= extension.mCoreVersion;
+    };
+    auto is_available = [&](const FeatureExtension& extension)
+    {
+        if (is_core(extension))
+            return true;
+        if (extension.mInstance)
+            return std::find(instanceExtensions.begin(), instanceExtensions.end(), extension.mName) != instanceExtensions.end();
+        return std::find_if(deviceExtensions.begin(), deviceExtensions.end(), [&extension](const VkExtensionProperties& property)
+        {
+            return std::strcmp(property.extensionName, extension.mName) == 0;
+        }) != deviceExtensions.end();
+    };
+
+    // Features are only queried when all extensions they depend on are available
+    bool available[gFeatureCount] = {};
+    for (size_t i = 0; i < gFeatureCount; i++)
+    {
+        if (!mRequired[i] && !mRequested[i])
+            continue;
+        available[i] = true;
+        for (const FeatureExtension& extension : gFeatureInfo[i].mExtensions)
+        {
+            if (extension.mName != nullptr && !is_available(extension))
+                available[i] = false;
+        }
+    }
+
+    // Query the feature structures of the available features in a single chain
+    // vkGetPhysicalDeviceFeatures2 is core on a 1.1 instance, an extension before that
+    PFN_vkGetPhysicalDeviceFeatures2KHR get_features2 = nullptr;
+    if (instanceVersion >= VK_API_VERSION_1_1)
+        get_features2 = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2KHR>(vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2"));
+    else if (std::find(instanceExtensions.begin(), instanceExtensions.end(), VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) != instanceExtensions.end())
+        get_features2 = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2KHR>(vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2KHR"));
+
+    resetStructures();
+    void* query_chain = nullptr;
+    for (size_t i = 0; i < gFeatureCount; i++)
+    {
+        if (available[i])
+            link(getStructure(static_cast<EDeviceFeature>(i)), query_chain);
+    }
+    if (get_features2 != nullptr)
+    {
+        mFeatures2.pNext = query_chain;
+        get_features2(physicalDevice, &mFeatures2);
+    }
+
+    // Without the query only required features are enabled, their extensions make the negotiated bits mandatory
+    bool supported[gFeatureCount] = {};
+    bool complete = true;
+    for (size_t i = 0; i < gFeatureCount; i++)
+    {
+        supported[i] = available[i] && (get_features2 != nullptr ? isSupported(static_cast<EDeviceFeature>(i)) : mRequired[i]);
+        if (mRequired[i] && !supported[i])
+        {
+            LOG_ERROR(Device) << "required device feature not supported: " << gFeatureInfo[i].mName;
+            complete = false;
+        }
+    }
+    if (!complete)
+        return false;
+
+    // Enable the supported features, together with the extensions they depend on that aren't core
+    resetStructures();
+    for (size_t i = 0; i < gFeatureCount; i++)
+    {
+        if (!mRequired[i] && !mRequested[i])
+            continue;
+        if (!supported[i])
+        {
+            LOG_INFO(Device) << "device feature " << gFeatureInfo[i].mName << ": unsupported";
+            continue;
+        }
+
+        EDeviceFeature feature = static_cast<EDeviceFeature>(i);
+        enable(feature);
+        link(getStructure(feature), mChain);
+        for (const FeatureExtension& extension : gFeatureInfo[i].mExtensions)
+        {
+            if (extension.mName == nullptr || extension.mInstance || is_core(extension))
+                continue;
+            if (std::find_if(mExtensions.begin(), mExtensions.end(), [&extension](const char* name) { return std::strcmp(name, extension.mName) == 0; }) == mExtensions.end())
+                mExtensions.emplace_back(extension.mName);
+        }
+        LOG_INFO(Device) << "device feature " << gFeatureInfo[i].mName << ": " << (is_core(gFeatureInfo[i].mExtensions[0]) ? "core" : "extension");
+    }
+
+    // Core features are part of the chain when it starts with VkPhysicalDeviceFeatures2, none are enabled
+    if (get_features2 != nullptr)
+    {
+        mFeatures2.pNext = mChain;
+        mChain = &mFeatures2;
+    }
+    return true;
+}
+
+
+void DeviceFeatureBuilder::resetStructures()
+{
+    mFeatures2 = {};
+    mFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+    mSynchronization2 = {};
+    mSynchronization2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR;
+    mTimelineSemaphore = {};
+    mTimelineSemaphore.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+    mDescriptorIndexing = {};
+    mDescriptorIndexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+    mDynamicRendering = {};
+    mDynamicRendering.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+    mStorage16Bit = {};
+    mStorage16Bit.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_16BIT_STORAGE_FEATURES_KHR;
+    mBufferDeviceAddress = {};
+    mBufferDeviceAddress.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES_KHR;
+    mSwapchainMaintenance = {};
+    mSwapchainMaintenance.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_EXT;
+}
+
+
+void* DeviceFeatureBuilder::getStructure(EDeviceFeature feature)
+{
+    switch (feature)
+    {
+    case EDeviceFeature::Synchronization2:
+        return &mSynchronization2;
+    case EDeviceFeature::TimelineSemaphore:
+        return &mTimelineSemaphore;
+    case EDeviceFeature::DescriptorIndexing:
+        return &mDescriptorIndexing;
+    case EDeviceFeature::DynamicRendering:
+        return &mDynamicRendering;
+    case EDeviceFeature::Storage16Bit:
+        return &mStorage16Bit;
+    case EDeviceFeature::BufferDeviceAddress:
+        return &mBufferDeviceAddress;
+    case EDeviceFeature::SwapchainMaintenance:
+        return &mSwapchainMaintenance;
+    default:
+        assert(false);
+        return nullptr;
+    }
+}
+
+
+bool DeviceFeatureBuilder::isSupported(EDeviceFeature feature) const
+{
+    switch (feature)
+    {
+    case EDeviceFeature::Synchronization2:
+        return mSynchronization2.synchronization2 == VK_TRUE;
+    case EDeviceFeature::TimelineSemaphore:
+        return mTimelineSemaphore.timelineSemaphore == VK_TRUE;
+    case EDeviceFeature::DescriptorIndexing:
+        return mDescriptorIndexing.shaderSampledImageArrayNonUniformIndexing == VK_TRUE &&
+            mDescriptorIndexing.descriptorBindingPartiallyBound == VK_TRUE &&
+            mDescriptorIndexing.descriptorBindingUpdateUnusedWhilePending == VK_TRUE &&
+            mDescriptorIndexing.runtimeDescriptorArray == VK_TRUE;
+    case EDeviceFeature::DynamicRendering:
+        return mDynamicRendering.dynamicRendering == VK_TRUE;
+    case EDeviceFeature::Storage16Bit:
+        return mStorage16Bit.storageBuffer16BitAccess == VK_TRUE;
+    case EDeviceFeature::BufferDeviceAddress:
+        return mBufferDeviceAddress.bufferDeviceAddress == VK_TRUE;
+    case EDeviceFeature::SwapchainMaintenance:
+        return mSwapchainMaintenance.swapchainMaintenance1 == VK_TRUE;
+    default:
+        return false;
+    }
+}
+
+
+void DeviceFeatureBuilder::enable(EDeviceFeature feature)
+{
+    // Only the bits the renderer uses, capture replay and multi device addresses aren't
+    switch (feature)
+    {
+    case EDeviceFeature::Synchronization2:
+        mSynchronization2.synchronization2 = VK_TRUE;
+        mFeatures.mSynchronization2 = true;
+        break;
+    case EDeviceFeature::TimelineSemaphore:
+        mTimelineSemaphore.timelineSemaphore = VK_TRUE;
+        mFeatures.mTimelineSemaphore = true;
+        break;
+    case EDeviceFeature::DescriptorIndexing:
+        mDescriptorIndexing.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+        mDescriptorIndexing.descriptorBindingPartiallyBound = VK_TRUE;
+        mDescriptorIndexing.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+        mDescriptorIndexing.runtimeDescriptorArray = VK_TRUE;
+        mFeatures.mDescriptorIndexing = true;
+        break;
+    case EDeviceFeature::DynamicRendering:
+        mDynamicRendering.dynamicRendering = VK_TRUE;
+        mFeatures.mDynamicRendering = true;
+        break;
+    case EDeviceFeature::Storage16Bit:
+        mStorage16Bit.storageBuffer16BitAccess = VK_TRUE;
+        mFeatures.mStorage16Bit = true;
+        break;
+    case EDeviceFeature::BufferDeviceAddress:
+        mBufferDeviceAddress.bufferDeviceAddress = VK_TRUE;
+        mFeatures.mBufferDeviceAddress = true;
+        break;
+    case EDeviceFeature::SwapchainMaintenance:
+        mSwapchainMaintenance.swapchainMaintenance1 = VK_TRUE;
+        mFeatures.mSwapchainMaintenance = true;
+        break;
+    default:
+        assert(false);
+        break;
+    }
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
+
+/**
+ * Device features that are negotiated when the device is created
+ */
+enum class EDeviceFeature : uint8_t
+{
+    Synchronization2,       ///< vkCmdPipelineBarrier2 and the stage and access flags of synchronization2
+    TimelineSemaphore,      ///< Semaphores with a 64 bit counter that can be waited on and signalled from the host
+    DescriptorIndexing,     ///< Partially bound, runtime sized descriptor arrays indexed non uniformly
+    DynamicRendering,       ///< Rendering without render pass and framebuffer objects
+    Storage16Bit,           ///< 16 bit types in storage buffers
+    BufferDeviceAddress,    ///< 64 bit buffer addresses in shaders
+    SwapchainMaintenance,   ///< Present fences, present scaling and releasing acquired images
+    Count
+};
+
+
+/**
+ * Outcome of the feature negotiation, fixed once the device is created.
+ * Setup code branches on these once, not every time the feature is used.
+ */
+struct DeviceFeatures
+{
+    uint32_t    mApiVersion = VK_API_VERSION_1_0;       ///< Version device functionality is used at, the lowest of the instance and device version
+    bool        mSynchronization2 = false;
+    bool        mTimelineSemaphore = false;
+    bool        mDescriptorIndexing = false;
+    bool        mDynamicRendering = false;
+    bool        mStorage16Bit = false;
+    bool        mBufferDeviceAddress = false;
+    bool        mSwapchainMaintenance = false;
+};
+
+
+/**
+ * Negotiates device features and builds the chain of feature structures the device is created with.
+ *
+ * Features are required or requested. negotiate() checks every feature against the device: the extensions it
+ * depends on must be available or promoted to core at the version the device is used at, and the feature bits must
+ * be reported by vkGetPhysicalDeviceFeatures2. Required features must all be supported, every supported requested
+ * feature is enabled as well. Features that are core at the device version are enabled without their extension.
+ *
+ * Without vkGetPhysicalDeviceFeatures2, on a 1.0 instance without VK_KHR_get_physical_device_properties2, feature
+ * bits can't be queried: required features are assumed supported when their extensions are, the extensions make
+ * the negotiated bits mandatory, and requested features are not enabled.
+ *
+ * The chain points into the builder, it must outlive vkCreateDevice().
+ */
+class DeviceFeatureBuilder
+{
+public:
+    DeviceFeatureBuilder();
+
+    DeviceFeatureBuilder(const DeviceFeatureBuilder&) = delete;
+    DeviceFeatureBuilder& operator=(const DeviceFeatureBuilder&) = delete;
+
+    /**
+     * Device creation fails when the feature isn't supported
+     */
+    void require(EDeviceFeature feature);
+
+    /**
+     * The feature is enabled when supported
+     */
+    void request(EDeviceFeature feature);
+
+    /**
+     * Checks which required and requested features the device supports and enables them
+     * @param instanceVersion api version the instance was created with
+     * @param instanceExtensions extensions enabled on the instance
+     * @param deviceExtensions extensions the device supports
+     * @return if all required features are supported
+     */
+    bool negotiate(VkInstance instance, uint32_t instanceVersion, const std::vector<std::string>& instanceExtensions,
+        VkPhysicalDevice physicalDevice, const std::vector<VkExtensionProperties>& deviceExtensions);
+
+    /**
+     * @return device extensions the enabled features depend on, extensions that are core at the device version excluded
+     */
+    const std::vector<const char*>& getExtensions() const               { return mExtensions; }
+
+    /**
+     * @return first structure of the feature chain for VkDeviceCreateInfo::pNext, null when nothing is enabled.
+     * Starts with VkPhysicalDeviceFeatures2 when vkGetPhysicalDeviceFeatures2 is available, pEnabledFeatures must be null.
+     */
+    void* getChain() const                                              { return mChain; }
+
+    /**
+     * @return negotiated features
+     */
+    const DeviceFeatures& getFeatures() const                           { return mFeatures; }
+
+private:
+    void resetStructures();
+    void* getStructure(EDeviceFeature feature);
+    bool isSupported(EDeviceFeature feature) const;
+    void enable(EDeviceFeature feature);
+
+    static constexpr size_t gFeatureCount = static_cast<size_t>(EDeviceFeature::Count);
+
+    bool                                                mRequired[gFeatureCount] = {};
+    bool                                                mRequested[gFeatureCount] = {};
+    VkPhysicalDeviceFeatures2KHR                        mFeatures2;
+    VkPhysicalDeviceSynchronization2FeaturesKHR         mSynchronization2;
+    VkPhysicalDeviceTimelineSemaphoreFeaturesKHR        mTimelineSemaphore;
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT       mDescriptorIndexing;
+    VkPhysicalDeviceDynamicRenderingFeaturesKHR         mDynamicRendering;
+    VkPhysicalDevice16BitStorageFeaturesKHR             mStorage16Bit;
+    VkPhysicalDeviceBufferDeviceAddressFeaturesKHR      mBufferDeviceAddress;
+    VkPhysicalDeviceSwapchainMaintenance1FeaturesEXT    mSwapchainMaintenance;
+    std::vector<const char*>                            mExtensions;
+    void*                                               mChain = nullptr;
+    DeviceFeatures                                      mFeatures;
+};
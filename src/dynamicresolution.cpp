@@ -0,0 +1,72 @@
+#include "dynamicresolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+/**
+ * Scale changes are quantized to this step
+ */
+static const float gScaleStep = 1.0f / 16.0f;
+
+/**
+ * The scale is only raised when the GPU time is below this fraction of the target
+ */
+static const double gRaiseRatio = 0.85;
+
+/**
+ * Weight of a new measurement in the smoothed GPU time
+ */
+static const double gSmoothing = 0.1;
+
+/**
+ * Frames to wait after a change, measurements lag behind by the number of frames in flight
+ */
+static const unsigned int gCooldownFrames = 30;
+
+
+DynamicResolution::DynamicResolution(double targetTime, float minScale, float maxScale) :
+    mTargetTime(targetTime),
+    mMinScale(minScale),
+    mMaxScale(maxScale)
+{
+    mStats.mScale = maxScale;
+}
+
+
+bool DynamicResolution::update(double gpuTime)
+{
+    if (gpuTime <= 0.0)
+        return false;
+
+    mStats.mGpuTime = mStats.mGpuTime == 0.0 ? gpuTime : mStats.mGpuTime + (gpuTime - mStats.mGpuTime) * gSmoothing;
+    if (mCooldown > 0)
+    {
+        mCooldown--;
+        return false;
+    }
+
+    // Within budget without enough headroom to go up
+    double time = mStats.mGpuTime;
+    if (time <= mTargetTime && time >= mTargetTime * gRaiseRatio)
+        return false;
+
+    float desired = mStats.mScale * static_cast<float>(std::sqrt(mTargetTime / time));
+    desired = std::floor(desired / gScaleStep) * gScaleStep;
+    desired = std::min(std::max(desired, mMinScale), mMaxScale);
+    if (desired == mStats.mScale)
+        return false;
+
+    mStats.mScale = desired;
+    mStats.mChanges++;
+    mCooldown = gCooldownFrames;
+    return true;
+}
+
+
+VkExtent2D DynamicResolution::getExtent(VkExtent2D outputExtent) const
+{
+    VkExtent2D extent;
+    extent.width = std::max(static_cast<uint32_t>(static_cast<float>(outputExtent.width) * mStats.mScale), 1u);
+    extent.height = std::max(static_cast<uint32_t>(static_cast<float>(outputExtent.height) * mStats.mScale), 1u);
+    return extent;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+
+/**
+ * Dynamic resolution state
+ */
+struct DynamicResolutionStats
+{
+    float       mScale = 1.0f;              ///< Current render scale, relative to the output extent
+    double      mGpuTime = 0.0;             ///< Smoothed GPU frame time in ms
+    uint64_t    mChanges = 0;               ///< Number of times the scale changed
+};
+
+
+/**
+ * Scales the internal render resolution to hold the GPU frame time at a target.
+ *
+ * GPU time is assumed to scale with the number of rendered pixels, the new scale is therefore derived from the square
+ * root of the ratio between the target and the smoothed GPU time. The scale is quantized to fixed steps and only raised
+ * when there is clear headroom, after every change the controller waits for new measurements to settle.
+ * This keeps the number of intermediate image reallocations low.
+ */
+class DynamicResolution
+{
+public:
+    /**
+     * @param targetTime GPU frame time to hold in ms
+     * @param minScale lowest allowed render scale
+     * @param maxScale highest allowed render scale, 1.0 renders at output resolution
+     */
+    DynamicResolution(double targetTime, float minScale, float maxScale);
+
+    /**
+     * Feeds the GPU time of the last completed frame and updates the scale
+     * @param gpuTime GPU frame time in ms, ignored when 0
+     * @return if the scale changed
+     */
+    bool update(double gpuTime);
+
+    /**
+     * @return the render extent for the given output extent at the current scale, never 0
+     */
+    VkExtent2D getExtent(VkExtent2D outputExtent) const;
+
+    /**
+     * @return controller state
+     */
+    const DynamicResolutionStats& getStats() const                      { return mStats; }
+
+private:
+    double                  mTargetTime;
+    float                   mMinScale;
+    float                   mMaxScale;
+    unsigned int            mCooldown = 0;      ///< Frames to wait before the scale can change again
+    DynamicResolutionStats  mStats;
+};
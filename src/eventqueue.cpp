@@ -0,0 +1,76 @@
+#include "eventqueue.h"
+
+#include <algorithm>
+#include <assert.h>
+
+EventQueue::EventQueue(uint32_t capacity) :
+    mHead(0),
+    mTail(0)
+{
+    assert(capacity > 0);
+    uint32_t size = 1;
+    while (size < capacity)
+        size <<= 1;
+    mEvents.resize(size);
+    mMask = size - 1;
+}
+
+
+void EventQueue::post(const RenderEvent& event)
+{
+    mStats.mPosted++;
+    for (auto& pending : mPending)
+    {
+        if (pending.mType != event.mType || pending.mWindowID != event.mWindowID)
+            continue;
+
+        // Only the latest size matters, deltas accumulate, all other events are flags
+        if (event.mType == ERenderEventType::MouseDrag)
+        {
+            pending.mX += event.mX;
+            pending.mY += event.mY;
+        }
+        else
+        {
+            pending.mX = event.mX;
+            pending.mY = event.mY;
+        }
+        mStats.mCoalesced++;
+        return;
+    }
+    mPending.emplace_back(event);
+}
+
+
+bool EventQueue::flush()
+{
+    uint32_t tail = mTail.load(std::memory_order_relaxed);
+    uint32_t head = mHead.load(std::memory_order_acquire);
+    uint32_t free = static_cast<uint32_t>(mEvents.size()) - (tail - head);
+    uint32_t count = std::min(free, static_cast<uint32_t>(mPending.size()));
+    for (uint32_t i = 0; i < count; i++)
+        mEvents[(tail + i) & mMask] = mPending[i];
+
+    // Publish all events at once, the consumer sees them after the release
+    mTail.store(tail + count, std::memory_order_release);
+    mPending.erase(mPending.begin(), mPending.begin() + count);
+    mStats.mPushed += count;
+    if (mPending.empty())
+        return true;
+
+    mStats.mDeferred++;
+    return false;
+}
+
+
+bool EventQueue::pop(RenderEvent& outEvent)
+{
+    uint32_t head = mHead.load(std::memory_order_relaxed);
+    uint32_t tail = mTail.load(std::memory_order_acquire);
+    if (head == tail)
+        return false;
+
+    outEvent = mEvents[head & mMask];
+    mHead.store(head + 1, std::memory_order_release);
+    return true;
+}
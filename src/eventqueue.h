@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <stdint.h>
+
+/**
+ * Kinds of events handed from the event thread to the render thread
+ */
+enum class ERenderEventType : uint8_t
+{
+    Quit,               ///< Stop rendering
+    Resize,             ///< Drawable size of a window changed, only the latest size is kept
+    DisplayChanged,     ///< Window moved to another display, its surface properties are invalid
+    DisplaysChanged,    ///< Displays were added or removed, all surface properties are invalid
+    MouseDrag           ///< Mouse moved with the left button down, deltas are accumulated
+};
+
+
+/**
+ * An event as seen by the render thread, already coalesced
+ */
+struct RenderEvent
+{
+    ERenderEventType    mType = ERenderEventType::Quit;
+    uint32_t            mWindowID = 0;          ///< SDL id of the window the event belongs to, 0 for global events
+    int32_t             mX = 0;                 ///< Drawable width or accumulated horizontal mouse delta
+    int32_t             mY = 0;                 ///< Drawable height or accumulated vertical mouse delta
+};
+
+
+/**
+ * Event queue counters, maintained by the producer
+ */
+struct EventQueueStats
+{
+    uint64_t    mPosted = 0;                ///< Number of events posted
+    uint64_t    mCoalesced = 0;             ///< Number of posted events merged into a pending event
+    uint64_t    mPushed = 0;                ///< Number of events handed to the consumer
+    uint64_t    mDeferred = 0;              ///< Number of times the queue was full on flush, events were kept for the next flush
+};
+
+
+/**
+ * Lock free single producer, single consumer queue of render events.
+ *
+ * The producer (event thread) posts events, which are coalesced with pending events of the same kind and window:
+ * a resize replaces the pending size and mouse deltas add up, a burst of OS events therefore results in a handful
+ * of render events. flush() moves the pending events into a fixed size ring the consumer (render thread) pops from.
+ * Neither side ever blocks: when the ring is full pending events stay with the producer until the next flush.
+ */
+class EventQueue
+{
+public:
+    /**
+     * @param capacity number of events the ring holds, rounded up to a power of two
+     */
+    explicit EventQueue(uint32_t capacity);
+
+    EventQueue(const EventQueue&) = delete;
+    EventQueue& operator=(const EventQueue&) = delete;
+
+    /**
+     * Adds an event, merged into a pending event when possible. Producer only.
+     */
+    void post(const RenderEvent& event);
+
+    /**
+     * Hands pending events to the consumer in posting order. Producer only.
+     * @return if all pending events were handed over
+     */
+    bool flush();
+
+    /**
+     * Takes the oldest event. Consumer only.
+     * @param outEvent the event
+     * @return if an event was available
+     */
+    bool pop(RenderEvent& outEvent);
+
+    /**
+     * @return queue counters, only read by the producer or after both threads stopped
+     */
+    const EventQueueStats& getStats() const                             { return mStats; }
+
+private:
+    std::vector<RenderEvent>    mEvents;                    ///< Ring of events, indexed by head and tail modulo capacity
+    uint32_t                    mMask = 0;
+    alignas(64) std::atomic<uint32_t> mHead;                ///< Next event to pop, written by the consumer
+    alignas(64) std::atomic<uint32_t> mTail;                ///< Next event to push, written by the producer
+    std::vector<RenderEvent>    mPending;                   ///< Coalesced events not yet pushed, producer only
+    EventQueueStats             mStats;
+};
@@ -0,0 +1,393 @@
+#include "framecapture.h"
+#include "hostallocator.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <assert.h>
+
+/**
+ * Selects a host visible memory type, cached memory is preferred because the writer thread reads every byte
+ * @return if a memory type was found
+ */
+static bool findReadbackMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeBits, uint32_t& outTypeIndex, bool& outCoherent)
+{
+    VkPhysicalDeviceMemoryProperties properties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &properties);
+    const VkMemoryPropertyFlags preferred[] =
+    {
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+    };
+
+    for (VkMemoryPropertyFlags flags : preferred)
+    {
+        for (uint32_t i = 0; i < properties.memoryTypeCount; i++)
+        {
+            VkMemoryPropertyFlags type_flags = properties.memoryTypes[i].propertyFlags;
+            if ((typeBits & (1u << i)) != 0 && (type_flags & flags) == flags)
+            {
+                if ((type_flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) == 0)
+                    LOG_WARNING(Capture) << "no cached host memory available, frame capture reads uncached memory";
+                outTypeIndex = i;
+                outCoherent = (type_flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+
+/**
+ * @return size of a pixel of the captured formats, 16 bit formats are the only ones that aren't 32 bit
+ */
+static uint32_t getBytesPerPixel(VkFormat format)
+{
+    return format == VK_FORMAT_R5G6B5_UNORM_PACK16 || format == VK_FORMAT_B5G6R5_UNORM_PACK16 ? 2 : 4;
+}
+
+
+/**
+ * Finds the byte offset of the red and blue channel of an 8 bit per channel format
+ * @return if the format can be converted to Y4M
+ */
+static bool getChannelOffsets(VkFormat format, uint32_t& outRed, uint32_t& outBlue)
+{
+    switch (format)
+    {
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+    case VK_FORMAT_A8B8G8R8_UNORM_PACK32:
+    case VK_FORMAT_A8B8G8R8_SRGB_PACK32:
+        outRed = 0;
+        outBlue = 2;
+        return true;
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+        outRed = 2;
+        outBlue = 0;
+        return true;
+    default:
+        return false;
+    }
+}
+
+
+FrameCapture::~FrameCapture()
+{
+    destroy();
+}
+
+
+bool FrameCapture::init(VkPhysicalDevice physicalDevice, VkDevice device, VkFormat format, VkExtent2D extent, unsigned int bufferCount,
+    const std::string& path, ECaptureFormat fileFormat, unsigned int frameRate)
+{
+    assert(bufferCount > 0);
+    uint32_t red(0), blue(0);
+    if (fileFormat == ECaptureFormat::Y4M && !getChannelOffsets(format, red, blue))
+    {
+        LOG_ERROR(Capture) << "Y4M capture requires an 8 bit per channel RGBA or BGRA format";
+        return false;
+    }
+
+    mFile.open(path, std::ios::binary | std::ios::trunc);
+    if (!mFile.is_open())
+    {
+        LOG_ERROR(Capture) << "unable to open capture file: " << path;
+        return false;
+    }
+
+    // Every slot starts at a multiple of the non coherent atom size, slots are invalidated individually
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    VkDeviceSize alignment = std::max<VkDeviceSize>(properties.limits.nonCoherentAtomSize, 16);
+    mFrameSize = static_cast<VkDeviceSize>(extent.width) * extent.height * getBytesPerPixel(format);
+    mSlotSize = (mFrameSize + alignment - 1) / alignment * alignment;
+
+    VkBufferCreateInfo buffer_info = {};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = mSlotSize * bufferCount;
+    buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (vkCreateBuffer(device, &buffer_info, getHostCallbacks(EHostScope::Device), &mBuffer) != VK_SUCCESS)
+    {
+        LOG_ERROR(Capture) << "unable to create capture buffer";
+        return false;
+    }
+    mDevice = device;
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(device, mBuffer, &requirements);
+    VkMemoryAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.allocationSize = requirements.size;
+    if (!findReadbackMemoryType(physicalDevice, requirements.memoryTypeBits, alloc_info.memoryTypeIndex, mCoherent))
+    {
+        LOG_ERROR(Capture) << "unable to find host visible memory for frame capture";
+        return false;
+    }
+
+    if (vkAllocateMemory(device, &alloc_info, getHostCallbacks(EHostScope::Device), &mMemory) != VK_SUCCESS ||
+        vkBindBufferMemory(device, mBuffer, mMemory, 0) != VK_SUCCESS)
+    {
+        LOG_ERROR(Capture) << "unable to allocate capture memory";
+        return false;
+    }
+
+    void* mapped = nullptr;
+    if (vkMapMemory(device, mMemory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS)
+    {
+        LOG_ERROR(Capture) << "unable to map capture memory";
+        return false;
+    }
+    mMapped = static_cast<uint8_t*>(mapped);
+
+    mFormat = format;
+    mExtent = extent;
+    mFileFormat = fileFormat;
+    mSlots.assign(bufferCount, Slot());
+    mQueue.clear();
+    mQueue.reserve(bufferCount);
+    mCompleted.reserve(bufferCount);
+    mRanges.reserve(bufferCount);
+    mSequence = 0;
+    mStop = false;
+    mStats = FrameCaptureStats();
+
+    if (fileFormat == ECaptureFormat::Y4M)
+    {
+        // Full range BT.601, chroma planes are rounded up for odd sizes. Readers assume limited range unless told otherwise
+        uint32_t chroma_size = ((extent.width + 1) / 2) * ((extent.height + 1) / 2);
+        mConverted.resize(extent.width * extent.height + 2 * chroma_size);
+        mFile << "YUV4MPEG2 W" << extent.width << " H" << extent.height << " F" << frameRate << ":1 Ip A1:1 C420jpeg XCOLORRANGE=FULL\n";
+    }
+
+    mWriter = std::thread(&FrameCapture::writerLoop, this);
+    LOG_INFO(Capture) << "capturing " << extent.width << "x" << extent.height << " frames to " << path << " using " << bufferCount << " buffers of " <<
+        mFrameSize / 1024 << "KB";
+    return true;
+}
+
+
+void FrameCapture::destroy()
+{
+    if (mDevice == VK_NULL_HANDLE)
+        return;
+
+    // The device is idle, all recorded copies completed
+    if (mWriter.joinable())
+    {
+        std::vector<int> remaining;
+        for (int i = 0; i < static_cast<int>(mSlots.size()); i++)
+        {
+            if (mSlots[i].mState == ESlotState::Copying)
+                remaining.emplace_back(i);
+        }
+        std::sort(remaining.begin(), remaining.end(), [this](int a, int b) { return mSlots[a].mSequence < mSlots[b].mSequence; });
+        for (int slot : remaining)
+            collect(mSlots[slot].mFrameIndex);
+
+        // Stop the writer once the queue is empty
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStop = true;
+        }
+        mWorkCondition.notify_all();
+        mWriter.join();
+    }
+
+    if (mMapped != nullptr)
+        vkUnmapMemory(mDevice, mMemory);
+    vkDestroyBuffer(mDevice, mBuffer, getHostCallbacks(EHostScope::Device));
+    vkFreeMemory(mDevice, mMemory, getHostCallbacks(EHostScope::Device));
+    mMapped = nullptr;
+    mBuffer = VK_NULL_HANDLE;
+    mMemory = VK_NULL_HANDLE;
+    mDevice = VK_NULL_HANDLE;
+    mFile.close();
+    mSlots.clear();
+}
+
+
+void FrameCapture::collect(unsigned int frameIndex)
+{
+    if (mDevice == VK_NULL_HANDLE)
+        return;
+
+    // Lists are members reserved for all slots, collecting doesn't allocate
+    mCompleted.clear();
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (int i = 0; i < static_cast<int>(mSlots.size()); i++)
+        {
+            if (mSlots[i].mState == ESlotState::Copying && mSlots[i].mFrameIndex == frameIndex)
+                mCompleted.emplace_back(i);
+        }
+    }
+    if (mCompleted.empty())
+        return;
+    std::sort(mCompleted.begin(), mCompleted.end(), [this](int a, int b) { return mSlots[a].mSequence < mSlots[b].mSequence; });
+
+    // The barrier made the copy available to the host, non coherent memory must be invalidated before reading it
+    if (!mCoherent)
+    {
+        mRanges.clear();
+        for (int slot : mCompleted)
+        {
+            VkMappedMemoryRange range = {};
+            range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+            range.memory = mMemory;
+            range.offset = mSlotSize * slot;
+            range.size = mSlotSize;
+            mRanges.emplace_back(range);
+        }
+        vkInvalidateMappedMemoryRanges(mDevice, static_cast<uint32_t>(mRanges.size()), mRanges.data());
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (int slot : mCompleted)
+        {
+            mSlots[slot].mState = ESlotState::Writing;
+            mQueue.emplace_back(slot);
+        }
+    }
+    mWorkCondition.notify_one();
+}
+
+
+int FrameCapture::beginCapture(unsigned int frameIndex, VkExtent2D extent)
+{
+    if (mDevice == VK_NULL_HANDLE)
+        return -1;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (extent.width != mExtent.width || extent.height != mExtent.height)
+    {
+        mStats.mSkipped++;
+        return -1;
+    }
+
+    // Buffers are used in turn, the oldest one is written first and becomes free first
+    int slot = static_cast<int>(mSequence % mSlots.size());
+    if (mSlots[slot].mState != ESlotState::Free)
+    {
+        mStats.mDropped++;
+        return -1;
+    }
+
+    mSlots[slot].mState = ESlotState::Copying;
+    mSlots[slot].mFrameIndex = frameIndex;
+    mSlots[slot].mSequence = mSequence++;
+    mStats.mCaptured++;
+    return slot;
+}
+
+
+void FrameCapture::recordCopy(VkCommandBuffer commandBuffer, VkImage image, int slot) const
+{
+    assert(slot >= 0 && slot < static_cast<int>(mSlots.size()));
+    VkBufferImageCopy region = {};
+    region.bufferOffset = mSlotSize * slot;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = { mExtent.width, mExtent.height, 1 };
+    vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, mBuffer, 1, &region);
+
+    // Make the copy available to the host, it's read after the fence of the frame signaled
+    VkBufferMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = mBuffer;
+    barrier.offset = region.bufferOffset;
+    barrier.size = mFrameSize;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+
+FrameCaptureStats FrameCapture::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mStats;
+}
+
+
+void FrameCapture::writerLoop()
+{
+    while (true)
+    {
+        int slot = -1;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mWorkCondition.wait(lock, [this]() { return mStop || !mQueue.empty(); });
+            if (mQueue.empty())
+                return;
+            slot = mQueue.front();
+            mQueue.erase(mQueue.begin());
+        }
+
+        // The slot is owned by this thread until it's marked free
+        auto start = std::chrono::steady_clock::now();
+        writeFrame(mMapped + mSlotSize * slot);
+        double time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        mSlots[slot].mState = ESlotState::Free;
+        mStats.mWritten++;
+        mStats.mWriteTime += time;
+        mStats.mBytesWritten += mFileFormat == ECaptureFormat::Y4M ? mConverted.size() + 6 : mFrameSize;
+    }
+}
+
+
+void FrameCapture::writeFrame(const uint8_t* pixels)
+{
+    if (mFileFormat == ECaptureFormat::Raw)
+    {
+        mFile.write(reinterpret_cast<const char*>(pixels), static_cast<std::streamsize>(mFrameSize));
+        return;
+    }
+
+    uint32_t red(0), blue(0);
+    getChannelOffsets(mFormat, red, blue);
+    uint32_t width = mExtent.width;
+    uint32_t height = mExtent.height;
+    uint32_t chroma_width = (width + 1) / 2;
+    uint32_t chroma_height = (height + 1) / 2;
+    uint8_t* y_plane = mConverted.data();
+    uint8_t* u_plane = y_plane + width * height;
+    uint8_t* v_plane = u_plane + chroma_width * chroma_height;
+
+    // Luma of every pixel, fixed point BT.601 full range
+    for (uint32_t i = 0; i < width * height; i++)
+    {
+        const uint8_t* p = pixels + i * 4;
+        y_plane[i] = static_cast<uint8_t>((77 * p[red] + 150 * p[1] + 29 * p[blue] + 128) >> 8);
+    }
+
+    // Chroma of every 2x2 block, edges repeat the last row and column
+    for (uint32_t cy = 0; cy < chroma_height; cy++)
+    {
+        const uint8_t* row0 = pixels + (cy * 2) * width * 4;
+        const uint8_t* row1 = pixels + std::min(cy * 2 + 1, height - 1) * width * 4;
+        for (uint32_t cx = 0; cx < chroma_width; cx++)
+        {
+            uint32_t x0 = cx * 2 * 4;
+            uint32_t x1 = std::min(cx * 2 + 1, width - 1) * 4;
+            int r = row0[x0 + red] + row0[x1 + red] + row1[x0 + red] + row1[x1 + red];
+            int g = row0[x0 + 1] + row0[x1 + 1] + row1[x0 + 1] + row1[x1 + 1];
+            int b = row0[x0 + blue] + row0[x1 + blue] + row1[x0 + blue] + row1[x1 + blue];
+            int u = (-43 * r - 85 * g + 128 * b + 4 * 32896) >> 10;
+            int v = (128 * r - 107 * g - 21 * b + 4 * 32896) >> 10;
+            u_plane[cy * chroma_width + cx] = static_cast<uint8_t>(std::min(u, 255));
+            v_plane[cy * chroma_width + cx] = static_cast<uint8_t>(std::min(v, 255));
+        }
+    }
+
+    mFile << "FRAME\n";
+    mFile.write(reinterpret_cast<const char*>(mConverted.data()), static_cast<std::streamsize>(mConverted.size()));
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
+
+/**
+ * How captured frames are stored on disk
+ */
+enum class ECaptureFormat : uint8_t
+{
+    Raw,            ///< Frames as copied from the image, tightly packed in the format of the image
+    Y4M             ///< YUV4MPEG2 video with 4:2:0 chroma, requires an 8 bit per channel RGBA or BGRA format
+};
+
+
+/**
+ * Frame capture counters
+ */
+struct FrameCaptureStats
+{
+    uint64_t    mCaptured = 0;          ///< Number of frames copied to a host buffer
+    uint64_t    mWritten = 0;           ///< Number of frames written to disk
+    uint64_t    mDropped = 0;           ///< Number of frames not captured because all buffers were in use
+    uint64_t    mSkipped = 0;           ///< Number of frames not captured because their size didn't match the capture
+    uint64_t    mBytesWritten = 0;      ///< Total number of bytes written to disk
+    double      mWriteTime = 0.0;       ///< Total time the writer thread spent converting and writing, in ms
+};
+
+
+/**
+ * Captures rendered frames to disk without blocking the render loop.
+ *
+ * Frames are copied into a ring of persistently mapped host buffers at the end of the frame. A copy is handed
+ * to the writer thread when its frame in flight is reused, at which point its fence signaled and the copy completed.
+ * The writer thread converts and streams the frame to disk and returns the buffer to the ring.
+ * When the writer falls behind and no buffer is free the frame isn't captured, rendering never waits on the writer.
+ *
+ * The capture size is fixed at initialization, frames of another size (ie: after a resize) are skipped.
+ */
+class FrameCapture
+{
+public:
+    FrameCapture() = default;
+    ~FrameCapture();
+
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture& operator=(const FrameCapture&) = delete;
+
+    /**
+     * Allocates the buffers, opens the output file and starts the writer thread
+     * @param physicalDevice gpu, used to select a host visible memory type
+     * @param device the device the buffers are created on
+     * @param format format of the captured image
+     * @param extent size of the captured image
+     * @param bufferCount number of host buffers, must exceed the number of frames in flight to keep the writer busy
+     * @param path file the frames are written to
+     * @param fileFormat raw or Y4M
+     * @param frameRate frame rate stored in the Y4M header
+     * @return if capturing can start
+     */
+    bool init(VkPhysicalDevice physicalDevice, VkDevice device, VkFormat format, VkExtent2D extent, unsigned int bufferCount,
+        const std::string& path, ECaptureFormat fileFormat, unsigned int frameRate);
+
+    /**
+     * Writes all completed frames, stops the writer thread and destroys the buffers, the device must be idle
+     */
+    void destroy();
+
+    /**
+     * Hands all frames copied by the given frame in flight to the writer thread,
+     * call after waiting on the fence of that frame
+     */
+    void collect(unsigned int frameIndex);
+
+    /**
+     * Reserves a buffer for a frame that is about to be rendered
+     * @param frameIndex frame in flight the copy is recorded in
+     * @param extent size of the image that is captured
+     * @return the reserved buffer, -1 when the frame isn't captured
+     */
+    int beginCapture(unsigned int frameIndex, VkExtent2D extent);
+
+    /**
+     * Records the copy of the image into a reserved buffer, the image must be in VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+     * @param commandBuffer command buffer of the frame the buffer was reserved for
+     * @param image the image to capture
+     * @param slot buffer returned by beginCapture()
+     */
+    void recordCopy(VkCommandBuffer commandBuffer, VkImage image, int slot) const;
+
+    /**
+     * @return if frames are being captured
+     */
+    bool isActive() const                                               { return mDevice != VK_NULL_HANDLE; }
+
+    /**
+     * @return capture counters
+     */
+    FrameCaptureStats getStats() const;
+
+private:
+    enum class ESlotState : uint8_t
+    {
+        Free,           ///< Available for a new frame
+        Copying,        ///< Copy recorded, GPU might still be busy
+        Writing         ///< Owned by the writer thread
+    };
+
+    struct Slot
+    {
+        ESlotState      mState = ESlotState::Free;
+        unsigned int    mFrameIndex = 0;            ///< Frame in flight the copy was recorded in
+        uint64_t        mSequence = 0;              ///< Capture order, frames are written in this order
+    };
+
+    void writerLoop();
+    void writeFrame(const uint8_t* pixels);
+
+    VkDevice                    mDevice = VK_NULL_HANDLE;
+    VkBuffer                    mBuffer = VK_NULL_HANDLE;       ///< Holds all slots, one frame each
+    VkDeviceMemory              mMemory = VK_NULL_HANDLE;
+    uint8_t*                    mMapped = nullptr;
+    bool                        mCoherent = false;
+    VkDeviceSize                mSlotSize = 0;                  ///< Aligned size of a single frame in the buffer
+    VkDeviceSize                mFrameSize = 0;                 ///< Size of a tightly packed frame
+    VkFormat                    mFormat = VK_FORMAT_UNDEFINED;
+    VkExtent2D                  mExtent = { 0, 0 };
+    ECaptureFormat              mFileFormat = ECaptureFormat::Raw;
+    std::ofstream               mFile;
+    std::vector<uint8_t>        mConverted;                     ///< Y4M planes, only used by the writer thread
+    std::vector<Slot>           mSlots;
+    uint64_t                    mSequence = 0;
+    std::vector<int>            mQueue;                         ///< Slots to write, in capture order, reserved for all slots
+    std::vector<int>            mCompleted;                     ///< Slots handed over by collect(), reused every frame
+    std::vector<VkMappedMemoryRange> mRanges;                   ///< Ranges invalidated by collect(), reused every frame
+    std::thread                 mWriter;
+    mutable std::mutex          mMutex;
+    std::condition_variable     mWorkCondition;
+    bool                        mStop = false;
+    FrameCaptureStats           mStats;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+/**
+ * FNV-1a offset basis, start value of every hash
+ */
+constexpr uint64_t gHashSeed = 0xcbf29ce484222325ULL;
+
+/**
+ * FNV-1a, folds size bytes of data into hash
+ */
+inline void hashBytes(uint64_t& hash, const void* data, size_t size)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+}
+
+
+/**
+ * Folds a single value into hash, only valid for types without padding
+ */
+template<typename T>
+void hashValue(uint64_t& hash, const T& value)
+{
+    hashBytes(hash, &value, sizeof(T));
+}
+
+
+/**
+ * Folds the size and contents of an array into hash, only valid for types without padding
+ */
+template<typename T>
+void hashArray(uint64_t& hash, const std::vector<T>& values)
+{
+    hashValue(hash, values.size());
+    if (!values.empty())
+        hashBytes(hash, values.data(), sizeof(T) * values.size());
+}
@@ -0,0 +1,260 @@
+#include "highlightcompute.h"
+#include "descriptorallocator.h"
+#include "hostallocator.h"
+#include "logger.h"
+#include <assert.h>
+
+/**
+ * Number of invocations of a workgroup, matches local_size_x of the shader
+ */
+static const uint32_t gWorkgroupSize = 64;
+
+
+/**
+ * Values pushed to the shader
+ */
+struct HighlightParams
+{
+    uint32_t    mColor;
+    uint32_t    mCount;     ///< Number of 4 byte values to write
+};
+
+
+/**
+ * Values pushed to the shader that writes through a buffer device address
+ */
+struct HighlightAddressParams
+{
+    VkDeviceAddress mPixels;
+    uint32_t        mColor;
+    uint32_t        mCount;
+};
+
+
+/**
+ * highlight.comp, compiled to SPIR-V 1.0:
+ *
+ *     #version 450
+ *     layout(local_size_x = 64) in;
+ *     layout(set = 0, binding = 0) writeonly buffer Highlight { uint pixels[]; } highlight;
+ *     layout(push_constant) uniform Params { uint color; uint count; } params;
+ *
+ *     void main()
+ *     {
+ *         uint index = gl_GlobalInvocationID.x;
+ *         if (index < params.count)
+ *             highlight.pixels[index] = params.color;
+ *     }
+ */
+static const uint32_t gHighlightShader[] =
+{
+    0x07230203, 0x00010000, 0x00000000, 0x00000021, 0x00000000, 0x00020011, 0x00000001, 0x0003000e,
+    0x00000000, 0x00000001, 0x0006000f, 0x00000005, 0x00000001, 0x6e69616d, 0x00000000, 0x00000002,
+    0x00060010, 0x00000001, 0x00000011, 0x00000040, 0x00000001, 0x00000001, 0x00040047, 0x00000002,
+    0x0000000b, 0x0000001c, 0x00040047, 0x00000003, 0x00000006, 0x00000004, 0x00040048, 0x00000004,
+    0x00000000, 0x00000019, 0x00050048, 0x00000004, 0x00000000, 0x00000023, 0x00000000, 0x00030047,
+    0x00000004, 0x00000003, 0x00040047, 0x00000005, 0x00000022, 0x00000000, 0x00040047, 0x00000005,
+    0x00000021, 0x00000000, 0x00050048, 0x00000006, 0x00000000, 0x00000023, 0x00000000, 0x00050048,
+    0x00000006, 0x00000001, 0x00000023, 0x00000004, 0x00030047, 0x00000006, 0x00000002, 0x00020013,
+    0x00000007, 0x00030021, 0x00000008, 0x00000007, 0x00020014, 0x00000009, 0x00040015, 0x0000000a,
+    0x00000020, 0x00000000, 0x00040015, 0x0000000b, 0x00000020, 0x00000001, 0x00040017, 0x0000000c,
+    0x0000000a, 0x00000003, 0x00040020, 0x0000000d, 0x00000001, 0x0000000c, 0x0004003b, 0x0000000d,
+    0x00000002, 0x00000001, 0x0004002b, 0x0000000b, 0x0000000e, 0x00000000, 0x0004002b, 0x0000000b,
+    0x0000000f, 0x00000001, 0x0004002b, 0x0000000b, 0x00000010, 0x00000002, 0x0003001d, 0x00000003,
+    0x0000000a, 0x00040020, 0x00000011, 0x00000009, 0x0000000a, 0x0003001e, 0x00000004, 0x00000003,
+    0x00040020, 0x00000012, 0x00000002, 0x00000004, 0x0004003b, 0x00000012, 0x00000005, 0x00000002,
+    0x00040020, 0x00000013, 0x00000002, 0x0000000a, 0x0004001e, 0x00000006, 0x0000000a, 0x0000000a,
+    0x00040020, 0x00000014, 0x00000009, 0x00000006, 0x0004003b, 0x00000014, 0x00000015, 0x00000009,
+    0x00050036, 0x00000007, 0x00000001, 0x00000000, 0x00000008, 0x000200f8, 0x00000016, 0x0004003d,
+    0x0000000c, 0x00000017, 0x00000002, 0x00050051, 0x0000000a, 0x00000018, 0x00000017, 0x00000000,
+    0x00050041, 0x00000011, 0x00000019, 0x00000015, 0x0000000f, 0x0004003d, 0x0000000a, 0x0000001a,
+    0x00000019, 0x000500b0, 0x00000009, 0x0000001b, 0x00000018, 0x0000001a, 0x000300f7, 0x0000001c,
+    0x00000000, 0x000400fa, 0x0000001b, 0x0000001d, 0x0000001c, 0x000200f8, 0x0000001d, 0x00050041,
+    0x00000011, 0x0000001e, 0x00000015, 0x0000000e, 0x0004003d, 0x0000000a, 0x0000001f, 0x0000001e,
+    0x00060041, 0x00000013, 0x00000020, 0x00000005, 0x0000000e, 0x00000018, 0x0003003e, 0x00000020,
+    0x0000001f, 0x000200f9, 0x0000001c, 0x000200f8, 0x0000001c, 0x000100fd, 0x00010038,
+};
+
+
+/**
+ * highlight_address.comp, compiled to SPIR-V 1.0:
+ *
+ *     #version 450
+ *     #extension GL_EXT_buffer_reference : require
+ *     layout(local_size_x = 64) in;
+ *     layout(buffer_reference, std430, buffer_reference_align = 4) writeonly buffer Pixels { uint pixels[]; };
+ *     layout(push_constant) uniform Params { Pixels pixels; uint color; uint count; } params;
+ *
+ *     void main()
+ *     {
+ *         uint index = gl_GlobalInvocationID.x;
+ *         if (index < params.count)
+ *             params.pixels.pixels[index] = params.color;
+ *     }
+ */
+static const uint32_t gHighlightAddressShader[] =
+{
+    0x07230203, 0x00010000, 0x00000000, 0x00000023, 0x00000000, 0x00020011, 0x00000001, 0x00020011,
+    0x000014e3, 0x0009000a, 0x5f565053, 0x5f52484b, 0x73796870, 0x6c616369, 0x6f74735f, 0x65676172,
+    0x6675625f, 0x00726566, 0x0003000e, 0x000014e4, 0x00000001, 0x0006000f, 0x00000005, 0x00000001,
+    0x6e69616d, 0x00000000, 0x00000002, 0x00060010, 0x00000001, 0x00000011, 0x00000040, 0x00000001,
+    0x00000001, 0x00040047, 0x00000002, 0x0000000b, 0x0000001c, 0x00040047, 0x00000003, 0x00000006,
+    0x00000004, 0x00040048, 0x00000004, 0x00000000, 0x00000019, 0x00050048, 0x00000004, 0x00000000,
+    0x00000023, 0x00000000, 0x00030047, 0x00000004, 0x00000002, 0x00050048, 0x00000005, 0x00000000,
+    0x00000023, 0x00000000, 0x00050048, 0x00000005, 0x00000001, 0x00000023, 0x00000008, 0x00050048,
+    0x00000005, 0x00000002, 0x00000023, 0x0000000c, 0x00030047, 0x00000005, 0x00000002, 0x00020013,
+    0x00000006, 0x00030021, 0x00000007, 0x00000006, 0x00020014, 0x00000008, 0x00040015, 0x00000009,
+    0x00000020, 0x00000000, 0x00040015, 0x0000000a, 0x00000020, 0x00000001, 0x00040017, 0x0000000b,
+    0x00000009, 0x00000003, 0x00040020, 0x0000000c, 0x00000001, 0x0000000b, 0x0004003b, 0x0000000c,
+    0x00000002, 0x00000001, 0x0004002b, 0x0000000a, 0x0000000d, 0x00000000, 0x0004002b, 0x0000000a,
+    0x0000000e, 0x00000001, 0x0004002b, 0x0000000a, 0x0000000f, 0x00000002, 0x0003001d, 0x00000003,
+    0x00000009, 0x00040020, 0x00000010, 0x00000009, 0x00000009, 0x0003001e, 0x00000004, 0x00000003,
+    0x00040020, 0x00000011, 0x000014e5, 0x00000004, 0x00040020, 0x00000012, 0x000014e5, 0x00000009,
+    0x0005001e, 0x00000005, 0x00000011, 0x00000009, 0x00000009, 0x00040020, 0x00000013, 0x00000009,
+    0x00000005, 0x00040020, 0x00000014, 0x00000009, 0x00000011, 0x0004003b, 0x00000013, 0x00000015,
+    0x00000009, 0x00050036, 0x00000006, 0x00000001, 0x00000000, 0x00000007, 0x000200f8, 0x00000016,
+    0x0004003d, 0x0000000b, 0x00000017, 0x00000002, 0x00050051, 0x00000009, 0x00000018, 0x00000017,
+    0x00000000, 0x00050041, 0x00000010, 0x00000019, 0x00000015, 0x0000000f, 0x0004003d, 0x00000009,
+    0x0000001a, 0x00000019, 0x000500b0, 0x00000008, 0x0000001b, 0x00000018, 0x0000001a, 0x000300f7,
+    0x0000001c, 0x00000000, 0x000400fa, 0x0000001b, 0x0000001d, 0x0000001c, 0x000200f8, 0x0000001d,
+    0x00050041, 0x00000014, 0x0000001e, 0x00000015, 0x0000000d, 0x0004003d, 0x00000011, 0x0000001f,
+    0x0000001e, 0x00050041, 0x00000010, 0x00000020, 0x00000015, 0x0000000e, 0x0004003d, 0x00000009,
+    0x00000021, 0x00000020, 0x00060041, 0x00000012, 0x00000022, 0x0000001f, 0x0000000d, 0x00000018,
+    0x0005003e, 0x00000022, 0x00000021, 0x00000002, 0x00000004, 0x000200f9, 0x0000001c, 0x000200f8,
+    0x0000001c, 0x000100fd, 0x00010038,
+};
+
+
+HighlightCompute::~HighlightCompute()
+{
+    destroy();
+}
+
+
+bool HighlightCompute::init(VkDevice device, PipelineRegistry& pipelineRegistry, DescriptorAllocator& descriptorAllocator, bool bufferDeviceAddress)
+{
+    mDevice = device;
+    mPipelineRegistry = &pipelineRegistry;
+    mDescriptorAllocator = &descriptorAllocator;
+    mAddressed = bufferDeviceAddress;
+    mStats = HighlightComputeStats();
+
+    VkShaderModuleCreateInfo shader_info = {};
+    shader_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    shader_info.codeSize = mAddressed ? sizeof(gHighlightAddressShader) : sizeof(gHighlightShader);
+    shader_info.pCode = mAddressed ? gHighlightAddressShader : gHighlightShader;
+    if (vkCreateShaderModule(device, &shader_info, getHostCallbacks(EHostScope::Pipeline), &mShader) != VK_SUCCESS)
+    {
+        LOG_ERROR(Render) << "unable to create highlight shader";
+        return false;
+    }
+
+    // The addressed shader has no descriptors, the address is part of the push constants
+    if (!mAddressed)
+    {
+        VkDescriptorSetLayoutBinding binding = {};
+        binding.binding = 0;
+        binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        binding.descriptorCount = 1;
+        binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        mSetLayout = descriptorAllocator.getLayout({ binding });
+        if (mSetLayout == VK_NULL_HANDLE)
+            return false;
+    }
+
+    VkPushConstantRange push_range = {};
+    push_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    push_range.size = mAddressed ? sizeof(HighlightAddressParams) : sizeof(HighlightParams);
+    VkPipelineLayoutCreateInfo layout_info = {};
+    layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layout_info.setLayoutCount = mAddressed ? 0 : 1;
+    layout_info.pSetLayouts = mAddressed ? nullptr : &mSetLayout;
+    layout_info.pushConstantRangeCount = 1;
+    layout_info.pPushConstantRanges = &push_range;
+    if (vkCreatePipelineLayout(device, &layout_info, getHostCallbacks(EHostScope::Pipeline), &mLayout) != VK_SUCCESS)
+    {
+        LOG_ERROR(Render) << "unable to create highlight pipeline layout";
+        return false;
+    }
+
+    // Compiled by the registry on first use
+    PipelineShaderStage stage;
+    stage.mStage = VK_SHADER_STAGE_COMPUTE_BIT;
+    stage.mModule = mShader;
+    mDescription = PipelineDescription();
+    mDescription.mStages.emplace_back(stage);
+    mDescription.mLayout = mLayout;
+    return true;
+}
+
+
+void HighlightCompute::destroy()
+{
+    if (mDevice == VK_NULL_HANDLE)
+        return;
+
+    vkDestroyPipelineLayout(mDevice, mLayout, getHostCallbacks(EHostScope::Pipeline));
+    vkDestroyShaderModule(mDevice, mShader, getHostCallbacks(EHostScope::Pipeline));
+    mLayout = VK_NULL_HANDLE;
+    mShader = VK_NULL_HANDLE;
+    mSetLayout = VK_NULL_HANDLE;
+    mDevice = VK_NULL_HANDLE;
+}
+
+
+void HighlightCompute::record(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceAddress address, VkDeviceSize size, uint32_t color)
+{
+    // Filled by a transfer until the registry compiled the pipeline
+    VkPipeline pipeline = mPipelineRegistry->acquire(mDescription, VK_NULL_HANDLE);
+    if (pipeline == VK_NULL_HANDLE)
+    {
+        vkCmdFillBuffer(commandBuffer, buffer, 0, size, color);
+        mStats.mFallbackFills++;
+        return;
+    }
+
+    uint32_t count = static_cast<uint32_t>(size / 4);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+    // The address is read from the residency manager every frame, a moved buffer needs no descriptor update
+    if (mAddressed)
+    {
+        assert(address != 0);
+        HighlightAddressParams params;
+        params.mPixels = address;
+        params.mColor = color;
+        params.mCount = count;
+        vkCmdPushConstants(commandBuffer, mLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(HighlightAddressParams), &params);
+        vkCmdDispatch(commandBuffer, (count + gWorkgroupSize - 1) / gWorkgroupSize, 1, 1);
+        mStats.mDispatches++;
+        return;
+    }
+
+    // The set only lives as long as the frame, it's written once and never updated afterwards
+    VkDescriptorSet set = VK_NULL_HANDLE;
+    if (!mDescriptorAllocator->allocate(mSetLayout, set))
+    {
+        LOG_ERROR(Render) << "unable to allocate highlight descriptor set";
+        return;
+    }
+
+    VkDescriptorBufferInfo buffer_info = {};
+    buffer_info.buffer = buffer;
+    buffer_info.range = size;
+    VkWriteDescriptorSet write = {};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = set;
+    write.dstBinding = 0;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    write.pBufferInfo = &buffer_info;
+    vkUpdateDescriptorSets(mDevice, 1, &write, 0, nullptr);
+
+    HighlightParams params;
+    params.mColor = color;
+    params.mCount = count;
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, mLayout, 0, 1, &set, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, mLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(HighlightParams), &params);
+    vkCmdDispatch(commandBuffer, (count + gWorkgroupSize - 1) / gWorkgroupSize, 1, 1);
+    mStats.mDispatches++;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "pipelineregistry.h"
+
+#include <vulkan/vulkan.h>
+
+class DescriptorAllocator;
+
+
+/**
+ * Highlight counters
+ */
+struct HighlightComputeStats
+{
+    uint64_t    mDispatches = 0;            ///< Number of frames filled by the compute shader
+    uint64_t    mFallbackFills = 0;         ///< Number of frames filled by a transfer while the pipeline was compiling
+};
+
+
+/**
+ * Fills the highlight buffer of a frame with a compute shader, recorded with the compute work of the frame.
+ * Every 4 bytes of the buffer receive the packed highlight color, 16 bit formats therefore hold two pixels per value.
+ * The buffer is bound as storage buffer through a descriptor set allocated from the descriptor allocator
+ * every frame, it's released together with all other sets of the frame once the fence of that frame signaled.
+ * With buffer device addresses no descriptor is written: the address of the buffer is pushed to the shader,
+ * a buffer that moved only has a different address in the next frame.
+ * The pipeline is compiled in the background by the pipeline registry, until it's ready the buffer is filled
+ * with a transfer command instead.
+ */
+class HighlightCompute
+{
+public:
+    HighlightCompute() = default;
+    ~HighlightCompute();
+
+    HighlightCompute(const HighlightCompute&) = delete;
+    HighlightCompute& operator=(const HighlightCompute&) = delete;
+
+    /**
+     * @param device the device the shader and pipeline layout are created on
+     * @param pipelineRegistry compiles and owns the pipeline, must be destroyed before the highlight
+     * @param descriptorAllocator allocates the descriptor set of every frame and owns its layout
+     * @param bufferDeviceAddress if the bufferDeviceAddress feature is enabled, the buffer is passed by address instead
+     * @return if the shader and pipeline layout were created
+     */
+    bool init(VkDevice device, PipelineRegistry& pipelineRegistry, DescriptorAllocator& descriptorAllocator, bool bufferDeviceAddress);
+
+    /**
+     * Destroys the pipeline layout and shader, the device must be idle
+     */
+    void destroy();
+
+    /**
+     * Records filling a buffer with the highlight color, call while recording the compute work of the current frame
+     * @param commandBuffer command buffer of a compute capable queue
+     * @param buffer storage buffer that is filled
+     * @param address device address of the buffer, required with buffer device addresses, ignored otherwise
+     * @param size number of bytes to fill, a multiple of 4
+     * @param color value written to every 4 bytes, see packColor()
+     */
+    void record(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceAddress address, VkDeviceSize size, uint32_t color);
+
+    /**
+     * @return if the buffer is passed to the shader by device address
+     */
+    bool isAddressed() const                                            { return mAddressed; }
+
+    /**
+     * @return highlight counters
+     */
+    const HighlightComputeStats& getStats() const                       { return mStats; }
+
+private:
+    VkDevice                mDevice = VK_NULL_HANDLE;
+    PipelineRegistry*       mPipelineRegistry = nullptr;
+    DescriptorAllocator*    mDescriptorAllocator = nullptr;
+    VkShaderModule          mShader = VK_NULL_HANDLE;
+    VkDescriptorSetLayout   mSetLayout = VK_NULL_HANDLE;        ///< Owned by the descriptor allocator, none when addressed
+    VkPipelineLayout        mLayout = VK_NULL_HANDLE;
+    bool                    mAddressed = false;
+    PipelineDescription     mDescription;                       ///< Compute stage and layout, the pipeline is owned by the registry
+    HighlightComputeStats   mStats;
+};
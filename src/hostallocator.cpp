@@ -0,0 +1,246 @@
+#include "hostallocator.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <assert.h>
+
+/**
+ * Size of the smallest size class, every next class is twice as large
+ */
+static const size_t gMinClassSize = 64;
+
+/**
+ * Size of a chunk arenas carve slots from
+ */
+static const size_t gChunkSize = 64 * 1024;
+
+/**
+ * Marks allocations that were taken from the global heap
+ */
+static const uint32_t gNoClass = 0xFFFFFFFF;
+
+
+/**
+ * Stored in front of every allocation
+ */
+struct AllocationHeader
+{
+    void*       mRaw = nullptr;         ///< Start of the slot or heap allocation the user memory lives in
+    uint64_t    mSize = 0;              ///< Size requested by the driver
+    uint32_t    mClass = gNoClass;      ///< Size class the slot belongs to
+};
+
+
+/**
+ * @return the smallest size class that fits the given number of bytes, gClassCount when none does
+ */
+static uint32_t getSizeClass(size_t size, uint32_t classCount)
+{
+    uint32_t size_class = 0;
+    size_t class_size = gMinClassSize;
+    while (size_class < classCount && class_size < size)
+    {
+        class_size *= 2;
+        size_class++;
+    }
+    return size_class;
+}
+
+
+HostAllocator::HostAllocator()
+{
+    for (auto& scope : mScopes)
+    {
+        scope.mAllocator = this;
+        scope.mCallbacks.pUserData = &scope;
+        scope.mCallbacks.pfnAllocation = &HostAllocator::allocation;
+        scope.mCallbacks.pfnReallocation = &HostAllocator::reallocation;
+        scope.mCallbacks.pfnFree = &HostAllocator::deallocation;
+        scope.mCallbacks.pfnInternalAllocation = &HostAllocator::internalAllocation;
+        scope.mCallbacks.pfnInternalFree = &HostAllocator::internalFree;
+    }
+}
+
+
+HostAllocator::~HostAllocator()
+{
+    for (auto& arena : mArenas)
+    {
+        for (void* chunk : arena.mChunks)
+            std::free(chunk);
+    }
+}
+
+
+HostAllocatorStats HostAllocator::getStats() const
+{
+    HostAllocatorStats stats;
+    for (size_t i = 0; i < static_cast<size_t>(EHostScope::Count); i++)
+    {
+        const Scope& scope = mScopes[i];
+        HostScopeStats& scope_stats = stats.mScopes[i];
+        scope_stats.mAllocations = scope.mAllocations.load(std::memory_order_relaxed);
+        scope_stats.mFrees = scope.mFrees.load(std::memory_order_relaxed);
+        scope_stats.mReallocations = scope.mReallocations.load(std::memory_order_relaxed);
+        scope_stats.mPooled = scope.mPooled.load(std::memory_order_relaxed);
+        scope_stats.mLiveBytes = scope.mLiveBytes.load(std::memory_order_relaxed);
+        scope_stats.mPeakBytes = scope.mPeakBytes.load(std::memory_order_relaxed);
+        scope_stats.mInternalBytes = scope.mInternalBytes.load(std::memory_order_relaxed);
+    }
+    stats.mArenaBytes = mArenaBytes.load(std::memory_order_relaxed);
+    return stats;
+}
+
+
+void* VKAPI_PTR HostAllocator::allocation(void* userData, size_t size, size_t alignment, VkSystemAllocationScope)
+{
+    Scope& scope = *static_cast<Scope*>(userData);
+    return scope.mAllocator->allocate(scope, size, alignment);
+}
+
+
+void* VKAPI_PTR HostAllocator::reallocation(void* userData, void* original, size_t size, size_t alignment, VkSystemAllocationScope)
+{
+    // Follows realloc: a null original allocates, a size of 0 frees
+    Scope& scope = *static_cast<Scope*>(userData);
+    if (original == nullptr)
+        return scope.mAllocator->allocate(scope, size, alignment);
+    if (size == 0)
+    {
+        scope.mAllocator->release(scope, original);
+        return nullptr;
+    }
+
+    // The original is left untouched when the new allocation fails
+    void* memory = scope.mAllocator->allocate(scope, size, alignment);
+    if (memory == nullptr)
+        return nullptr;
+    const AllocationHeader* header = static_cast<const AllocationHeader*>(original) - 1;
+    std::memcpy(memory, original, std::min(static_cast<size_t>(header->mSize), size));
+    scope.mAllocator->release(scope, original);
+    scope.mReallocations.fetch_add(1, std::memory_order_relaxed);
+    return memory;
+}
+
+
+void VKAPI_PTR HostAllocator::deallocation(void* userData, void* memory)
+{
+    if (memory == nullptr)
+        return;
+    Scope& scope = *static_cast<Scope*>(userData);
+    scope.mAllocator->release(scope, memory);
+}
+
+
+void VKAPI_PTR HostAllocator::internalAllocation(void* userData, size_t size, VkInternalAllocationType, VkSystemAllocationScope)
+{
+    static_cast<Scope*>(userData)->mInternalBytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+
+void VKAPI_PTR HostAllocator::internalFree(void* userData, size_t size, VkInternalAllocationType, VkSystemAllocationScope)
+{
+    static_cast<Scope*>(userData)->mInternalBytes.fetch_sub(size, std::memory_order_relaxed);
+}
+
+
+void* HostAllocator::allocate(Scope& scope, size_t size, size_t alignment)
+{
+    // Room for the header and for aligning the user memory, the header sits right in front of it
+    alignment = std::max(alignment, alignof(std::max_align_t));
+    size_t required = size + sizeof(AllocationHeader) + alignment - 1;
+    uint32_t size_class = getSizeClass(required, gClassCount);
+    void* raw = size_class < gClassCount ? takeSlot(size_class) : std::malloc(required);
+    if (raw == nullptr)
+        return nullptr;
+
+    uintptr_t user = (reinterpret_cast<uintptr_t>(raw) + sizeof(AllocationHeader) + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+    AllocationHeader* header = reinterpret_cast<AllocationHeader*>(user) - 1;
+    header->mRaw = raw;
+    header->mSize = size;
+    header->mClass = size_class < gClassCount ? size_class : gNoClass;
+
+    scope.mAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (size_class < gClassCount)
+        scope.mPooled.fetch_add(1, std::memory_order_relaxed);
+    uint64_t live = scope.mLiveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+    uint64_t peak = scope.mPeakBytes.load(std::memory_order_relaxed);
+    while (live > peak && !scope.mPeakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+        ;
+    return reinterpret_cast<void*>(user);
+}
+
+
+void HostAllocator::release(Scope& scope, void* memory)
+{
+    const AllocationHeader* header = static_cast<const AllocationHeader*>(memory) - 1;
+    scope.mFrees.fetch_add(1, std::memory_order_relaxed);
+    scope.mLiveBytes.fetch_sub(header->mSize, std::memory_order_relaxed);
+    if (header->mClass == gNoClass)
+        std::free(header->mRaw);
+    else
+        returnSlot(header->mClass, header->mRaw);
+}
+
+
+void* HostAllocator::takeSlot(uint32_t sizeClass)
+{
+    assert(sizeClass < gClassCount);
+    Arena& arena = mArenas[sizeClass];
+    std::lock_guard<std::mutex> lock(arena.mMutex);
+    if (arena.mFree == nullptr)
+    {
+        // Carve a new chunk into slots, linked in address order
+        char* chunk = static_cast<char*>(std::malloc(gChunkSize));
+        if (chunk == nullptr)
+            return nullptr;
+        arena.mChunks.emplace_back(chunk);
+        mArenaBytes.fetch_add(gChunkSize, std::memory_order_relaxed);
+
+        size_t slot_size = gMinClassSize << sizeClass;
+        size_t slot_count = gChunkSize / slot_size;
+        for (size_t i = 0; i < slot_count; i++)
+        {
+            void* next = i + 1 < slot_count ? chunk + (i + 1) * slot_size : nullptr;
+            std::memcpy(chunk + i * slot_size, &next, sizeof(next));
+        }
+        arena.mFree = chunk;
+    }
+
+    void* slot = arena.mFree;
+    std::memcpy(&arena.mFree, slot, sizeof(arena.mFree));
+    return slot;
+}
+
+
+void HostAllocator::returnSlot(uint32_t sizeClass, void* slot)
+{
+    Arena& arena = mArenas[sizeClass];
+    std::lock_guard<std::mutex> lock(arena.mMutex);
+    std::memcpy(slot, &arena.mFree, sizeof(arena.mFree));
+    arena.mFree = slot;
+}
+
+
+/**
+ * Created on first use, outlives every Vulkan object and is destroyed when the process exits
+ */
+static HostAllocator& getHostAllocatorInstance()
+{
+    static HostAllocator allocator;
+    return allocator;
+}
+
+
+const VkAllocationCallbacks* getHostCallbacks(EHostScope scope)
+{
+    return getHostAllocatorInstance().getCallbacks(scope);
+}
+
+
+HostAllocatorStats getHostAllocatorStats()
+{
+    return getHostAllocatorInstance().getStats();
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+/**
+ * Engine scopes driver host allocations are attributed to, every scope has its own allocation callbacks
+ */
+enum class EHostScope : uint8_t
+{
+    Instance,       ///< Instance, surfaces and debug callbacks
+    Device,         ///< Device and all objects created on it that don't belong to another scope
+    Swapchain,      ///< Swap chains and the views, framebuffers and attachments created per swap image
+    Pipeline,       ///< Pipelines, pipeline caches, pipeline layouts and render passes
+    Count
+};
+
+
+/**
+ * Host allocation counters of a single scope, sizes in bytes as requested by the driver
+ */
+struct HostScopeStats
+{
+    uint64_t    mAllocations = 0;           ///< Number of allocations, including the new allocation of a reallocation
+    uint64_t    mFrees = 0;                 ///< Number of frees, including the old allocation of a reallocation
+    uint64_t    mReallocations = 0;
+    uint64_t    mPooled = 0;                ///< Number of allocations served by a size class arena
+    uint64_t    mLiveBytes = 0;             ///< Bytes allocated and not yet freed
+    uint64_t    mPeakBytes = 0;             ///< Highest number of live bytes
+    uint64_t    mInternalBytes = 0;         ///< Live bytes the driver allocated itself, reported through internal notifications
+};
+
+
+/**
+ * Host allocator counters, a snapshot
+ */
+struct HostAllocatorStats
+{
+    HostScopeStats  mScopes[static_cast<size_t>(EHostScope::Count)];
+    uint64_t        mArenaBytes = 0;        ///< Memory reserved by all size class arenas
+};
+
+
+/**
+ * Serves host allocations of the Vulkan driver, loader and layers.
+ *
+ * Small allocations are taken from size class arenas: chunks carved into fixed size slots that are handed out from
+ * a free list, every size class has its own lock. Drivers allocate and free a lot of small objects, the arenas keep
+ * those away from the global heap and spread contention over the size classes. Allocations larger than the
+ * biggest size class go to the global heap. Arena chunks are kept until the allocator is destroyed.
+ *
+ * Every allocation is attributed to a scope, through the user data of the callbacks of that scope, which makes it
+ * possible to find which part of the engine drives host allocations in the driver.
+ * Counters are updated from any thread the driver allocates on.
+ */
+class HostAllocator
+{
+public:
+    HostAllocator();
+    ~HostAllocator();
+
+    HostAllocator(const HostAllocator&) = delete;
+    HostAllocator& operator=(const HostAllocator&) = delete;
+
+    /**
+     * @return the callbacks of a scope, objects must be destroyed with the callbacks they were created with
+     */
+    const VkAllocationCallbacks* getCallbacks(EHostScope scope) const   { return &mScopes[static_cast<size_t>(scope)].mCallbacks; }
+
+    /**
+     * @return counters of every scope, gathered on request
+     */
+    HostAllocatorStats getStats() const;
+
+private:
+    struct Scope
+    {
+        HostAllocator*          mAllocator = nullptr;
+        VkAllocationCallbacks   mCallbacks = {};
+        std::atomic<uint64_t>   mAllocations { 0 };
+        std::atomic<uint64_t>   mFrees { 0 };
+        std::atomic<uint64_t>   mReallocations { 0 };
+        std::atomic<uint64_t>   mPooled { 0 };
+        std::atomic<uint64_t>   mLiveBytes { 0 };
+        std::atomic<uint64_t>   mPeakBytes { 0 };
+        std::atomic<uint64_t>   mInternalBytes { 0 };
+    };
+
+    struct Arena
+    {
+        std::mutex              mMutex;
+        std::vector<void*>      mChunks;
+        void*                   mFree = nullptr;        ///< First free slot, every free slot points to the next one
+    };
+
+    static void* VKAPI_PTR allocation(void* userData, size_t size, size_t alignment, VkSystemAllocationScope allocationScope);
+    static void* VKAPI_PTR reallocation(void* userData, void* original, size_t size, size_t alignment, VkSystemAllocationScope allocationScope);
+    static void VKAPI_PTR deallocation(void* userData, void* memory);
+    static void VKAPI_PTR internalAllocation(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope allocationScope);
+    static void VKAPI_PTR internalFree(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope allocationScope);
+
+    void* allocate(Scope& scope, size_t size, size_t alignment);
+    void release(Scope& scope, void* memory);
+    void* takeSlot(uint32_t sizeClass);
+    void returnSlot(uint32_t sizeClass, void* slot);
+
+    static constexpr uint32_t gClassCount = 8;              ///< Size classes of 64 up to 8192 bytes
+
+    Scope                       mScopes[static_cast<size_t>(EHostScope::Count)];
+    Arena                       mArenas[gClassCount];
+    std::atomic<uint64_t>       mArenaBytes { 0 };
+};
+
+
+/**
+ * @return the callbacks of the process wide host allocator for the given scope
+ */
+const VkAllocationCallbacks* getHostCallbacks(EHostScope scope);
+
+/**
+ * @return counters of the process wide host allocator
+ */
+HostAllocatorStats getHostAllocatorStats();
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+template<typename Signature, size_t Capacity>
+class InplaceFunction;
+
+
+/**
+ * Callable wrapper like std::function that stores the callable inside the wrapper instead of on the heap.
+ *
+ * Used for callbacks that are created every frame: a lambda whose captures exceed the capacity fails to compile
+ * instead of falling back to a heap allocation. Wrappers can be moved but not copied.
+ */
+template<typename Result, typename... Args, size_t Capacity>
+class InplaceFunction<Result(Args...), Capacity>
+{
+public:
+    InplaceFunction() = default;
+    InplaceFunction(std::nullptr_t)                                     { }
+    ~InplaceFunction()                                                  { reset(); }
+
+    template<typename Callable, typename = std::enable_if_t<!std::is_same<std::decay_t<Callable>, InplaceFunction>::value>>
+    InplaceFunction(Callable&& callable)
+    {
+        using Stored = std::decay_t<Callable>;
+        static_assert(sizeof(Stored) <= Capacity, "captures don't fit, increase the capacity of the function");
+        static_assert(alignof(Stored) <= alignof(std::max_align_t), "captures are over aligned");
+
+        new (mStorage) Stored(std::forward<Callable>(callable));
+        mInvoke = [](void* storage, Args... args) -> Result
+        {
+            return (*static_cast<Stored*>(storage))(std::forward<Args>(args)...);
+        };
+        mMove = [](void* target, void* source)
+        {
+            Stored* stored = static_cast<Stored*>(source);
+            if (target != nullptr)
+                new (target) Stored(std::move(*stored));
+            stored->~Stored();
+        };
+    }
+
+    InplaceFunction(InplaceFunction&& other) noexcept                  { moveFrom(other); }
+
+    InplaceFunction& operator=(InplaceFunction&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    InplaceFunction(const InplaceFunction&) = delete;
+    InplaceFunction& operator=(const InplaceFunction&) = delete;
+
+    /**
+     * Calls the stored callable, the function must not be empty
+     */
+    Result operator()(Args... args) const                               { return mInvoke(mStorage, std::forward<Args>(args)...); }
+
+    /**
+     * @return if a callable is stored
+     */
+    explicit operator bool() const                                      { return mInvoke != nullptr; }
+
+    /**
+     * Destroys the stored callable
+     */
+    void reset()
+    {
+        if (mMove != nullptr)
+            mMove(nullptr, mStorage);
+        mInvoke = nullptr;
+        mMove = nullptr;
+    }
+
+private:
+    using InvokeFunction = Result(*)(void* storage, Args... args);
+    using MoveFunction = void(*)(void* target, void* source);       ///< Move constructs into target and destroys source, only destroys when target is null
+
+    void moveFrom(InplaceFunction& other)
+    {
+        if (other.mMove != nullptr)
+            other.mMove(mStorage, other.mStorage);
+        mInvoke = other.mInvoke;
+        mMove = other.mMove;
+        other.mInvoke = nullptr;
+        other.mMove = nullptr;
+    }
+
+    alignas(std::max_align_t) mutable unsigned char mStorage[Capacity];
+    InvokeFunction                                  mInvoke = nullptr;
+    MoveFunction                                    mMove = nullptr;
+};
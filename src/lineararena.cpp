@@ -0,0 +1,77 @@
+#include "lineararena.h"
+
+#include <algorithm>
+#include <assert.h>
+
+LinearArena::~LinearArena()
+{
+    destroy();
+}
+
+
+void LinearArena::init(size_t capacity, std::pmr::memory_resource* upstream)
+{
+    assert(mBuffer == nullptr);
+    mUpstream = upstream;
+    mBuffer = static_cast<unsigned char*>(mUpstream->allocate(capacity, alignof(std::max_align_t)));
+    mTop = 0;
+    mStats.mCapacity = capacity;
+}
+
+
+void LinearArena::destroy()
+{
+    if (mBuffer == nullptr)
+        return;
+    mUpstream->deallocate(mBuffer, mStats.mCapacity, alignof(std::max_align_t));
+    mBuffer = nullptr;
+    mTop = 0;
+}
+
+
+void LinearArena::rewind(Marker marker)
+{
+    assert(marker <= mTop);
+    mTop = marker;
+}
+
+
+void LinearArena::reset()
+{
+    mTop = 0;
+    mStats.mResets++;
+}
+
+
+void* LinearArena::do_allocate(size_t bytes, size_t alignment)
+{
+    // Align the address, the buffer itself is only aligned to max_align_t
+    assert(mUpstream != nullptr);
+    uintptr_t base = reinterpret_cast<uintptr_t>(mBuffer);
+    uintptr_t start = (base + mTop + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+    size_t end = static_cast<size_t>(start - base) + bytes;
+    if (end > mStats.mCapacity)
+    {
+        mStats.mOverflows++;
+        return mUpstream->allocate(bytes, alignment);
+    }
+
+    mTop = end;
+    mStats.mPeak = std::max(mStats.mPeak, mTop);
+    return reinterpret_cast<void*>(start);
+}
+
+
+void LinearArena::do_deallocate(void* memory, size_t bytes, size_t alignment)
+{
+    unsigned char* address = static_cast<unsigned char*>(memory);
+    if (address < mBuffer || address >= mBuffer + mStats.mCapacity)
+    {
+        mUpstream->deallocate(memory, bytes, alignment);
+        return;
+    }
+
+    // Only the most recent allocation is given back
+    if (address + bytes == mBuffer + mTop)
+        mTop = static_cast<size_t>(address - mBuffer);
+}
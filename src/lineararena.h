@@ -0,0 +1,104 @@
+#pragma once
+
+#include <memory_resource>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Linear arena counters, sizes in bytes including alignment padding
+ */
+struct LinearArenaStats
+{
+    size_t      mCapacity = 0;
+    size_t      mPeak = 0;                  ///< Highest number of bytes in use at once
+    uint64_t    mOverflows = 0;             ///< Number of allocations that didn't fit and were taken from the upstream resource
+    uint64_t    mResets = 0;
+};
+
+
+/**
+ * Bump allocator over a single buffer, used through std::pmr containers.
+ *
+ * An allocation moves the top of the arena forward, memory is reclaimed all at once: by reset() at the start
+ * of a frame, or by ArenaScope when a block of setup code ends. Deallocating the most recent allocation moves
+ * the top back, which keeps a growing vector from leaving copies of itself behind. All other deallocations are free.
+ * Allocations that don't fit are taken from the upstream resource and counted, an arena with enough capacity
+ * never touches the heap after init().
+ * Not thread safe, containers allocated from the arena must not be used after it is reset or rewound.
+ */
+class LinearArena : public std::pmr::memory_resource
+{
+public:
+    using Marker = size_t;
+
+    LinearArena() = default;
+    ~LinearArena() override;
+
+    LinearArena(const LinearArena&) = delete;
+    LinearArena& operator=(const LinearArena&) = delete;
+
+    /**
+     * @param capacity size of the buffer in bytes, allocated once
+     * @param upstream serves allocations that don't fit
+     */
+    void init(size_t capacity, std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+
+    /**
+     * Frees the buffer, nothing may be allocated from the arena any more
+     */
+    void destroy();
+
+    /**
+     * @return the current top, to rewind to later
+     */
+    Marker getMarker() const                                            { return mTop; }
+
+    /**
+     * Releases everything allocated after the marker was taken
+     */
+    void rewind(Marker marker);
+
+    /**
+     * Releases everything, called once per frame when the arena holds frame data
+     */
+    void reset();
+
+    /**
+     * @return arena counters
+     */
+    const LinearArenaStats& getStats() const                            { return mStats; }
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* memory, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override      { return this == &other; }
+
+    std::pmr::memory_resource*  mUpstream = nullptr;
+    unsigned char*              mBuffer = nullptr;
+    size_t                      mTop = 0;                   ///< Offset of the first free byte
+    LinearArenaStats            mStats;
+};
+
+
+/**
+ * Rewinds an arena to where it was on construction once it goes out of scope.
+ * Setup code allocates its temporary lists from a shared arena within a scope, nested scopes unwind like a stack.
+ */
+class ArenaScope
+{
+public:
+    explicit ArenaScope(LinearArena& arena) : mArena(arena), mMarker(arena.getMarker())  { }
+    ~ArenaScope()                                                       { mArena.rewind(mMarker); }
+
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+    /**
+     * @return the arena, to construct containers with
+     */
+    LinearArena* get() const                                            { return &mArena; }
+
+private:
+    LinearArena&                mArena;
+    LinearArena::Marker         mMarker;
+};
@@ -0,0 +1,303 @@
+#include "logger.h"
+
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <assert.h>
+
+/**
+ * Number of slots in the ring, a power of two
+ */
+static const uint64_t gSlotCount = 512;
+
+/**
+ * Time the drain thread sleeps when there's nothing to print, bounds the delay of a missed wake up
+ */
+static const std::chrono::milliseconds gDrainInterval(10);
+
+/**
+ * Printed names of the levels and categories
+ */
+static const char* gLevelNames[] = { "debug", "info", "warning", "error", "off" };
+static const char* gCategoryNames[] = { "general", "instance", "device", "surface", "swapchain", "memory", "pipeline",
+    "render", "capture", "validation" };
+static_assert(sizeof(gCategoryNames) / sizeof(gCategoryNames[0]) == static_cast<size_t>(ELogCategory::Count), "missing log category name");
+
+
+Logger::Logger() :
+    mSlots(new Slot[gSlotCount]),
+    mStart(std::chrono::steady_clock::now())
+{
+    for (uint64_t i = 0; i < gSlotCount; i++)
+        mSlots[i].mSequence.store(i, std::memory_order_relaxed);
+}
+
+
+Logger::~Logger()
+{
+    destroy();
+}
+
+
+void Logger::init(ELogLevel level, uint32_t categories)
+{
+    assert(!mRunning);
+    mLevel.store(level, std::memory_order_relaxed);
+    mCategories.store(categories, std::memory_order_relaxed);
+    mRunning = true;
+    mThread = std::thread(&Logger::run, this);
+}
+
+
+void Logger::destroy()
+{
+    if (!mRunning)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mRunning = false;
+    }
+    mWake.notify_one();
+    mThread.join();
+}
+
+
+void Logger::write(ELogLevel level, ELogCategory category, const char* text, size_t length, bool truncated)
+{
+    uint64_t time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - mStart).count();
+    mRecords.fetch_add(1, std::memory_order_relaxed);
+    if (truncated)
+        mTruncated.fetch_add(1, std::memory_order_relaxed);
+
+    // Not running, print on the calling thread
+    if (!mRunning.load(std::memory_order_acquire))
+    {
+        print(level, category, time, text, length);
+        return;
+    }
+
+    // Claim a slot, a slot is free when its sequence equals the write position
+    uint64_t position = mWritePosition.load(std::memory_order_relaxed);
+    Slot* slot = nullptr;
+    while (true)
+    {
+        slot = &mSlots[position & (gSlotCount - 1)];
+        uint64_t sequence = slot->mSequence.load(std::memory_order_acquire);
+        if (sequence == position)
+        {
+            if (mWritePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (sequence < position)
+        {
+            // Full, the slot still holds a record of the previous lap
+            if (!mRunning.load(std::memory_order_acquire))
+            {
+                print(level, category, time, text, length);
+                return;
+            }
+            mStalls.fetch_add(1, std::memory_order_relaxed);
+            mWake.notify_one();
+            std::this_thread::yield();
+            position = mWritePosition.load(std::memory_order_relaxed);
+        }
+        else
+        {
+            // Claimed by another thread
+            position = mWritePosition.load(std::memory_order_relaxed);
+        }
+    }
+
+    // Copy and publish, the drain thread prints slots in order
+    slot->mLevel = level;
+    slot->mCategory = category;
+    slot->mTime = time;
+    slot->mLength = static_cast<uint32_t>(length);
+    std::memcpy(slot->mText, text, length);
+    slot->mSequence.store(position + 1, std::memory_order_release);
+    if (mSleeping.load(std::memory_order_relaxed))
+        mWake.notify_one();
+}
+
+
+void Logger::flush()
+{
+    if (!mRunning)
+        return;
+    uint64_t target = mWritePosition.load(std::memory_order_acquire);
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (mReadPosition.load(std::memory_order_acquire) < target && mRunning)
+    {
+        mWake.notify_one();
+        mDrained.wait_for(lock, gDrainInterval);
+    }
+}
+
+
+LoggerStats Logger::getStats() const
+{
+    LoggerStats stats;
+    stats.mRecords = mRecords.load(std::memory_order_relaxed);
+    stats.mStalls = mStalls.load(std::memory_order_relaxed);
+    stats.mTruncated = mTruncated.load(std::memory_order_relaxed);
+    return stats;
+}
+
+
+void Logger::run()
+{
+    std::string output;
+    output.reserve(gSlotCount * 128);
+    while (true)
+    {
+        // Print everything published since the last drain in one write
+        if (drain(output))
+        {
+            std::fwrite(output.data(), 1, output.size(), stdout);
+            std::fflush(stdout);
+            output.clear();
+            mDrained.notify_all();
+            continue;
+        }
+
+        // Nothing left, stop or wait for the next record
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (!mRunning)
+            break;
+        mSleeping = true;
+        mWake.wait_for(lock, gDrainInterval);
+        mSleeping = false;
+    }
+
+    // Records written while stopping
+    if (drain(output))
+    {
+        std::fwrite(output.data(), 1, output.size(), stdout);
+        std::fflush(stdout);
+    }
+    mDrained.notify_all();
+}
+
+
+bool Logger::drain(std::string& ioOutput)
+{
+    uint64_t position = mReadPosition.load(std::memory_order_relaxed);
+    uint64_t first = position;
+    while (true)
+    {
+        // Stop at the first slot that is claimed but not published yet
+        Slot& slot = mSlots[position & (gSlotCount - 1)];
+        if (slot.mSequence.load(std::memory_order_acquire) != position + 1)
+            break;
+        format(slot.mLevel, slot.mCategory, slot.mTime, slot.mText, slot.mLength, ioOutput);
+        slot.mSequence.store(position + gSlotCount, std::memory_order_release);
+        position++;
+    }
+    mReadPosition.store(position, std::memory_order_release);
+    return position != first;
+}
+
+
+void Logger::format(ELogLevel level, ELogCategory category, uint64_t time, const char* text, size_t length, std::string& ioOutput) const
+{
+    // [  1.234] device: warning: message
+    char prefix[64];
+    int prefix_length = std::snprintf(prefix, sizeof(prefix), "[%4u.%03u] %s: ", static_cast<unsigned int>(time / 1000000),
+        static_cast<unsigned int>(time / 1000 % 1000), gCategoryNames[static_cast<size_t>(category)]);
+    ioOutput.append(prefix, static_cast<size_t>(prefix_length));
+    if (level != ELogLevel::Info)
+        ioOutput.append(gLevelNames[static_cast<size_t>(level)]).append(": ");
+    ioOutput.append(text, length);
+    ioOutput.push_back('\n');
+}
+
+
+void Logger::print(ELogLevel level, ELogCategory category, uint64_t time, const char* text, size_t length) const
+{
+    std::string output;
+    format(level, category, time, text, length, output);
+    std::fwrite(output.data(), 1, output.size(), stdout);
+    std::fflush(stdout);
+}
+
+
+Logger& getLogger()
+{
+    static Logger logger;
+    return logger;
+}
+
+
+bool findLogCategory(const std::string& name, ELogCategory& outCategory)
+{
+    for (size_t i = 0; i < static_cast<size_t>(ELogCategory::Count); i++)
+    {
+        if (name == gCategoryNames[i])
+        {
+            outCategory = static_cast<ELogCategory>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+
+LogRecord& LogRecord::operator<<(const char* text)
+{
+    if (text == nullptr)
+        text = "(null)";
+    append(text, std::strlen(text));
+    return *this;
+}
+
+
+/**
+ * Formats an integer without going through a locale
+ */
+template<typename T>
+static void appendInteger(char (&buffer)[32], size_t& outLength, T value)
+{
+    std::to_chars_result result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    outLength = static_cast<size_t>(result.ptr - buffer);
+}
+
+
+#define LOG_RECORD_INTEGER(type) \
+    LogRecord& LogRecord::operator<<(type value) \
+    { \
+        char buffer[32]; \
+        size_t length(0); \
+        appendInteger(buffer, length, value); \
+        append(buffer, length); \
+        return *this; \
+    }
+
+LOG_RECORD_INTEGER(int)
+LOG_RECORD_INTEGER(unsigned int)
+LOG_RECORD_INTEGER(long)
+LOG_RECORD_INTEGER(unsigned long)
+LOG_RECORD_INTEGER(long long)
+LOG_RECORD_INTEGER(unsigned long long)
+
+
+LogRecord& LogRecord::operator<<(double value)
+{
+    // Matches the default precision of std::ostream
+    char buffer[32];
+    int length = std::snprintf(buffer, sizeof(buffer), "%g", value);
+    append(buffer, static_cast<size_t>(length));
+    return *this;
+}
+
+
+void LogRecord::append(const char* text, size_t length)
+{
+    size_t available = gLogRecordSize - mLength;
+    if (length > available)
+    {
+        length = available;
+        mTruncated = true;
+    }
+    std::memcpy(mText + mLength, text, length);
+    mLength += static_cast<uint32_t>(length);
+}
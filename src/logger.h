@@ -0,0 +1,240 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <stdint.h>
+
+/**
+ * Severity of a log record, records below the level of the logger are not printed
+ */
+enum class ELogLevel : uint8_t
+{
+    Debug,          ///< Full enumerations and per object details, compiled out of release builds
+    Info,           ///< Decisions made during setup and statistics
+    Warning,        ///< Fallbacks, the demo keeps running with reduced functionality
+    Error,          ///< Failures, usually followed by an early exit
+    Off
+};
+
+
+/**
+ * Part of the engine a log record belongs to, every category can be enabled separately
+ */
+enum class ELogCategory : uint8_t
+{
+    General,        ///< Application setup, arguments and statistics
+    Instance,       ///< Layers, instance extensions and the instance
+    Device,         ///< Physical device selection, queues, device extensions and features
+    Surface,        ///< Surfaces, formats and present modes
+    Swapchain,      ///< Swap chains and the images, views and attachments created per swap image
+    Memory,         ///< Memory pools, residency, uploads and descriptors
+    Pipeline,       ///< Pipelines, the pipeline cache and render passes
+    Render,         ///< Frame recording, submission, presentation and async compute
+    Capture,        ///< Frame capture
+    Validation,     ///< Messages of the validation layers
+    Count
+};
+
+
+/**
+ * Log levels compiled in, records below it are removed by the compiler together with their arguments.
+ * Debug records are compiled out of release builds unless the level is defined explicitly.
+ */
+#ifndef VULKANDEMO_LOG_LEVEL
+#ifdef NDEBUG
+#define VULKANDEMO_LOG_LEVEL 1
+#else
+#define VULKANDEMO_LOG_LEVEL 0
+#endif
+#endif
+
+
+/**
+ * Maximum length of a single record in bytes, longer records are truncated
+ */
+constexpr size_t gLogRecordSize = 480;
+
+
+/**
+ * Logger counters
+ */
+struct LoggerStats
+{
+    uint64_t    mRecords = 0;               ///< Number of records written
+    uint64_t    mStalls = 0;                ///< Number of times a record waited for the buffer to drain
+    uint64_t    mTruncated = 0;             ///< Number of records that didn't fit gLogRecordSize
+};
+
+
+/**
+ * Writes log records to stdout from a background thread.
+ *
+ * Records are formatted on the calling thread and copied into a fixed ring of slots, claiming a slot is a single
+ * compare and swap and never takes a lock. The drain thread prints everything that was published in one write.
+ * When the ring is full the caller yields until the drain thread freed a slot, records are never dropped.
+ * Before init() and after destroy() records are printed directly on the calling thread.
+ *
+ * Records are filtered by level and category at runtime, debug records are also removed at compile time through
+ * VULKANDEMO_LOG_LEVEL. Use the LOG_ macros to write records, they skip formatting when a record is filtered.
+ */
+class Logger
+{
+public:
+    Logger();
+    ~Logger();
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    /**
+     * Starts the drain thread
+     * @param level lowest level that is printed
+     * @param categories bit mask of the categories that are printed, bit n enables category n
+     */
+    void init(ELogLevel level, uint32_t categories = ~0u);
+
+    /**
+     * Prints all pending records and stops the drain thread, other threads must have stopped writing
+     */
+    void destroy();
+
+    /**
+     * @return if records of the given level and category are printed
+     */
+    bool isEnabled(ELogLevel level, ELogCategory category) const
+    {
+        return level >= mLevel.load(std::memory_order_relaxed) &&
+            (mCategories.load(std::memory_order_relaxed) & (1u << static_cast<uint32_t>(category))) != 0;
+    }
+
+    /**
+     * Publishes a formatted record, blocks only when the ring is full
+     * @param text the message without line ending
+     */
+    void write(ELogLevel level, ELogCategory category, const char* text, size_t length, bool truncated);
+
+    /**
+     * Blocks until all records written before the call are printed, before reading from stdin
+     */
+    void flush();
+
+    /**
+     * @return logger counters, gathered on request
+     */
+    LoggerStats getStats() const;
+
+private:
+    struct Slot
+    {
+        std::atomic<uint64_t>   mSequence { 0 };                ///< Position of the slot when free, position + 1 when published
+        ELogLevel               mLevel = ELogLevel::Info;
+        ELogCategory            mCategory = ELogCategory::General;
+        uint32_t                mLength = 0;
+        uint64_t                mTime = 0;                      ///< Microseconds since the logger was created
+        char                    mText[gLogRecordSize];
+    };
+
+    void run();
+    bool drain(std::string& ioOutput);
+    void format(ELogLevel level, ELogCategory category, uint64_t time, const char* text, size_t length, std::string& ioOutput) const;
+    void print(ELogLevel level, ELogCategory category, uint64_t time, const char* text, size_t length) const;
+
+    std::unique_ptr<Slot[]>                 mSlots;
+    std::atomic<uint64_t>                   mWritePosition { 0 };       ///< Next slot to claim
+    std::atomic<uint64_t>                   mReadPosition { 0 };        ///< Next slot to print, only advanced by the drain thread
+    std::atomic<ELogLevel>                  mLevel { ELogLevel::Info };
+    std::atomic<uint32_t>                   mCategories { ~0u };
+    std::atomic<bool>                       mRunning { false };
+    std::atomic<bool>                       mSleeping { false };        ///< If the drain thread waits for records
+    std::chrono::steady_clock::time_point   mStart;
+    std::thread                             mThread;
+    std::mutex                              mMutex;
+    std::condition_variable                 mWake;                      ///< Wakes the drain thread
+    std::condition_variable                 mDrained;                   ///< Signalled after every drain, for flush()
+    std::atomic<uint64_t>                   mRecords { 0 };
+    std::atomic<uint64_t>                   mStalls { 0 };
+    std::atomic<uint64_t>                   mTruncated { 0 };
+};
+
+
+/**
+ * @return the process wide logger
+ */
+Logger& getLogger();
+
+/**
+ * Finds a category by its printed name
+ * @return if the name matches a category
+ */
+bool findLogCategory(const std::string& name, ELogCategory& outCategory);
+
+
+/**
+ * Formats a single record on the stack, published to the logger when the statement ends
+ */
+class LogRecord
+{
+public:
+    LogRecord(ELogLevel level, ELogCategory category) : mLevel(level), mCategory(category)      { }
+    ~LogRecord()                                                                                { getLogger().write(mLevel, mCategory, mText, mLength, mTruncated); }
+
+    LogRecord(const LogRecord&) = delete;
+    LogRecord& operator=(const LogRecord&) = delete;
+
+    LogRecord& operator<<(const char* text);
+    LogRecord& operator<<(const std::string& text)                                              { append(text.data(), text.size()); return *this; }
+    LogRecord& operator<<(char value)                                                           { append(&value, 1); return *this; }
+    LogRecord& operator<<(int value);
+    LogRecord& operator<<(unsigned int value);
+    LogRecord& operator<<(long value);
+    LogRecord& operator<<(unsigned long value);
+    LogRecord& operator<<(long long value);
+    LogRecord& operator<<(unsigned long long value);
+    LogRecord& operator<<(double value);
+
+private:
+    void append(const char* text, size_t length);
+
+    ELogLevel       mLevel;
+    ELogCategory    mCategory;
+    uint32_t        mLength = 0;
+    bool            mTruncated = false;
+    char            mText[gLogRecordSize];
+};
+
+
+/**
+ * @return if records of the given level are compiled in
+ */
+constexpr bool isLogCompiled(ELogLevel level)
+{
+    return level >= static_cast<ELogLevel>(VULKANDEMO_LOG_LEVEL);
+}
+
+
+/**
+ * Turns a formatted record into a void expression, binds weaker than operator<< and stronger than ?:
+ */
+struct LogStatement
+{
+    void operator&(LogRecord&)                                                                  { }
+};
+
+
+/**
+ * Writes a record when its level and category are enabled: LOG_INFO(Device) << "selected: " << name;
+ * Arguments are not evaluated when the record is filtered. A single expression, safe in an unbraced if else.
+ */
+#define VULKANDEMO_LOG(level, category) \
+    !(isLogCompiled(ELogLevel::level) && getLogger().isEnabled(ELogLevel::level, ELogCategory::category)) ? (void)0 : \
+    LogStatement() & LogRecord(ELogLevel::level, ELogCategory::category)
+
+#define LOG_DEBUG(category)     VULKANDEMO_LOG(Debug, category)
+#define LOG_INFO(category)      VULKANDEMO_LOG(Info, category)
+#define LOG_WARNING(category)   VULKANDEMO_LOG(Warning, category)
+#define LOG_ERROR(category)     VULKANDEMO_LOG(Error, category)
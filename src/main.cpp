@@ -4,9 +4,34 @@
 #include <iostream>
 #include <vulkan/vulkan_core.h>
 #include <vector>
+#include <string>
 #include <set>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <atomic>
 #include <glm/glm.hpp>
 #include <assert.h>
+#include "pipelineregistry.h"
+#include "descriptorallocator.h"
+#include "highlightcompute.h"
+#include "resourcestatetracker.h"
+#include "rendergraph.h"
+#include "asynccompute.h"
+#include "swapimagepolicy.h"
+#include "dynamicresolution.h"
+#include "swapchain.h"
+#include "surfaceinfocache.h"
+#include "presentqueue.h"
+#include "framecapture.h"
+#include "eventqueue.h"
+#include "residencymanager.h"
+#include "uploadservice.h"
+#include "hostallocator.h"
+#include "lineararena.h"
+#include "capabilitycache.h"
+#include "logger.h"
+#include "devicefeatures.h"
 
 // Global Settings
 const char                      gAppName[] = "VulkanDemo";
@@ -15,9 +40,44 @@ int                             gWindowWidth = 1280;
 int                             gWindowHeight = 720;
 VkPresentModeKHR                gPresentationMode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
 VkSurfaceTransformFlagBitsKHR   gTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
-VkFormat                        gFormat = VK_FORMAT_B8G8R8A8_SRGB;
-VkColorSpaceKHR                 gColorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
 VkImageUsageFlags               gImageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+const char                      gPipelineCacheFile[] = "pipelinecache.bin";
+const char                      gCapabilityCacheFile[] = "capabilities.bin";
+const unsigned int              gMaxFramesInFlight = 2;
+const uint32_t                  gDescriptorSetsPerPool = 256;
+const bool                      gAsyncCompute = true;
+const uint32_t                  gHighlightSize = 256;
+const ELatencyMode              gLatencyMode = ELatencyMode::Balanced;
+const unsigned int              gSwapPolicyWindow = 120;
+const unsigned int              gWindowCount = 2;
+const bool                      gDynamicResolution = true;
+const double                    gTargetGpuTime = 14.0;
+const float                     gMinRenderScale = 0.5f;
+const EPresentSharing           gPresentSharing = EPresentSharing::Auto;
+const unsigned int              gPresentCalibrationFrames = 240;
+const bool                      gSwapchainMaintenance = true;
+const double                    gResizeSettleTime = 100.0;
+const bool                      gComputeSwapImages = false;
+const uint32_t                  gMinChannelBits = 8;
+const unsigned int              gCaptureWindow = 0;
+const unsigned int              gCaptureFrameRate = 60;
+const unsigned int              gCaptureBuffers = gMaxFramesInFlight + 4;
+const uint32_t                  gEventQueueSize = 64;
+const int                       gEventWaitTime = 10;
+const bool                      gMemoryBudget = true;
+const float                     gEvictThreshold = 0.9f;
+const float                     gEvictTarget = 0.8f;
+const VkDeviceSize              gDefragBytesPerFrame = 8 * 1024 * 1024;
+const bool                      gDirectUploads = true;
+const bool                      gBufferDeviceAddress = true;
+const VkSampleCountFlagBits     gSampleCount = VK_SAMPLE_COUNT_4_BIT;
+const bool                      gDepthAttachment = true;
+const VkDeviceSize              gUploadBenchmarkSize = 64 * 1024 * 1024;
+const unsigned int              gUploadBenchmarkIterations = 8;
+const size_t                    gFrameArenaSize = 64 * 1024;
+const size_t                    gSetupArenaSize = 256 * 1024;
+const ELogLevel                 gLogLevel = ELogLevel::Info;
+const uint32_t                  gMaxApiVersion = VK_API_VERSION_1_3;
 
 /**
  * This demo attempts to create a window and vulkan compatible surface using SDL
@@ -60,6 +120,61 @@ const std::set<std::string>& getRequestedDeviceExtensionNames()
 }
 
 
+/**
+ * Sets the device features the renderer can't do without and the ones it uses when available,
+ * the extensions they depend on are enabled by the builder
+ */
+void requestDeviceFeatures(DeviceFeatureBuilder& ioBuilder)
+{
+    ioBuilder.require(EDeviceFeature::Synchronization2);
+    ioBuilder.request(EDeviceFeature::TimelineSemaphore);
+    ioBuilder.request(EDeviceFeature::DescriptorIndexing);
+    ioBuilder.request(EDeviceFeature::DynamicRendering);
+    ioBuilder.request(EDeviceFeature::Storage16Bit);
+    if (gBufferDeviceAddress)
+        ioBuilder.request(EDeviceFeature::BufferDeviceAddress);
+    if (gSwapchainMaintenance)
+        ioBuilder.request(EDeviceFeature::SwapchainMaintenance);
+}
+
+
+/**
+ * @return the set of instance extension names that are enabled when available
+ */
+const std::set<std::string>& getOptionalInstanceExtensionNames()
+{
+    static std::set<std::string> extensions;
+    static bool initialized = false;
+    if (initialized)
+        return extensions;
+
+    if (gSwapchainMaintenance)
+    {
+        extensions.emplace(VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME);
+        extensions.emplace(VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME);
+    }
+    // Device features are queried through it when the instance is 1.0
+    extensions.emplace(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+    if (gBufferDeviceAddress)
+        extensions.emplace(VK_KHR_DEVICE_GROUP_CREATION_EXTENSION_NAME);
+    initialized = true;
+    return extensions;
+}
+
+
+/**
+ * @return the set of device extension names that are enabled when available,
+ * extensions of device features are enabled through requestDeviceFeatures()
+ */
+const std::set<std::string>& getOptionalDeviceExtensionNames()
+{
+    static std::set<std::string> extensions;
+    if (extensions.empty() && gMemoryBudget)
+        extensions.emplace(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    return extensions;
+}
+
+
 /**
  * @return the set of required image usage scenarios
  * that need to be supported by the surface and swap chain
@@ -75,6 +190,42 @@ const std::vector<VkImageUsageFlags> getRequestedImageUsages()
 }
 
 
+/**
+ * A format the swap chain can be created with
+ */
+struct SurfaceFormatCandidate
+{
+    VkSurfaceFormatKHR  mFormat;
+    uint32_t            mBytesPerPixel;     ///< Size of a pixel in memory, determines the bandwidth of every pass that touches it, 0 when unknown
+    uint32_t            mChannelBits;       ///< Bits of the smallest color channel, formats below gMinChannelBits are skipped, 0 when unknown
+    const char*         mName;
+};
+
+
+/**
+ * @return the swap chain formats in order of preference, used when the estimated bandwidth of formats is equal.
+ * Only formats the highlight color can be packed into are listed, see packColor()
+ */
+const std::vector<SurfaceFormatCandidate>& getSurfaceFormatCandidates()
+{
+    static std::vector<SurfaceFormatCandidate> candidates;
+    if (candidates.empty())
+    {
+        candidates.push_back({ { VK_FORMAT_B8G8R8A8_SRGB, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR }, 4, 8, "B8G8R8A8_SRGB" });
+        candidates.push_back({ { VK_FORMAT_R8G8B8A8_SRGB, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR }, 4, 8, "R8G8B8A8_SRGB" });
+        candidates.push_back({ { VK_FORMAT_A8B8G8R8_SRGB_PACK32, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR }, 4, 8, "A8B8G8R8_SRGB_PACK32" });
+        candidates.push_back({ { VK_FORMAT_B8G8R8A8_UNORM, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR }, 4, 8, "B8G8R8A8_UNORM" });
+        candidates.push_back({ { VK_FORMAT_R8G8B8A8_UNORM, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR }, 4, 8, "R8G8B8A8_UNORM" });
+        candidates.push_back({ { VK_FORMAT_A8B8G8R8_UNORM_PACK32, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR }, 4, 8, "A8B8G8R8_UNORM_PACK32" });
+        candidates.push_back({ { VK_FORMAT_A2B10G10R10_UNORM_PACK32, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR }, 4, 10, "A2B10G10R10_UNORM_PACK32" });
+        candidates.push_back({ { VK_FORMAT_A2R10G10B10_UNORM_PACK32, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR }, 4, 10, "A2R10G10B10_UNORM_PACK32" });
+        candidates.push_back({ { VK_FORMAT_R5G6B5_UNORM_PACK16, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR }, 2, 5, "R5G6B5_UNORM_PACK16" });
+        candidates.push_back({ { VK_FORMAT_B5G6R5_UNORM_PACK16, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR }, 2, 5, "B5G6R5_UNORM_PACK16" });
+    }
+    return candidates;
+}
+
+
 //////////////////////////////////////////////////////////////////////////
 // Utilities
 //////////////////////////////////////////////////////////////////////////
@@ -102,7 +253,7 @@ bool initSDL()
     // Initialize SDL
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS) == 0)
         return true;
-    std::cout << "Unable to initialize SDL\n";
+    LOG_ERROR(General) << "Unable to initialize SDL";
     return false;
 }
 
@@ -118,7 +269,12 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugReportFlagsEXT flags,
     const char* msg,
     void* userData)
 {
-    std::cout << "validation layer: " << layerPrefix << ": " << msg << std::endl;
+    if (flags & VK_DEBUG_REPORT_ERROR_BIT_EXT)
+        LOG_ERROR(Validation) << layerPrefix << ": " << msg;
+    else if (flags & (VK_DEBUG_REPORT_WARNING_BIT_EXT | VK_DEBUG_REPORT_PERFORMANCE_WARNING_BIT_EXT))
+        LOG_WARNING(Validation) << layerPrefix << ": " << msg;
+    else
+        LOG_DEBUG(Validation) << layerPrefix << ": " << msg;
     return VK_FALSE;
 }
 
@@ -147,9 +303,9 @@ bool setupDebugCallback(VkInstance instance, VkDebugReportCallbackEXT& callback)
     createInfo.flags = VK_DEBUG_REPORT_ERROR_BIT_EXT | VK_DEBUG_REPORT_WARNING_BIT_EXT;
     createInfo.pfnCallback = debugCallback;
 
-    if (createDebugReportCallbackEXT(instance, &createInfo, nullptr, &callback) != VK_SUCCESS)
+    if (createDebugReportCallbackEXT(instance, &createInfo, getHostCallbacks(EHostScope::Instance), &callback) != VK_SUCCESS)
     {
-        std::cout << "unable to create debug report callback extension\n";
+        LOG_ERROR(Instance) << "unable to create debug report callback extension";
         return false;
     }
     return true;
@@ -169,35 +325,26 @@ void destroyDebugReportCallbackEXT(VkInstance instance, VkDebugReportCallbackEXT
 }
 
 
-bool getAvailableVulkanLayers(std::vector<std::string>& outLayers)
+/**
+ * Finds the requested layers among the available ones
+ * Layers are listed as debug records when they were queried, not when they come from the capability snapshot
+ */
+bool getAvailableVulkanLayers(CapabilityCache& capabilities, std::vector<std::string>& outLayers)
 {
-    // Figure out the amount of available layers
+    // Figure out the available layers
     // Layers are used for debugging / validation etc / profiling..
-    unsigned int instance_layer_count = 0;
-    VkResult res = vkEnumerateInstanceLayerProperties(&instance_layer_count, NULL);
-    if (res != VK_SUCCESS)
-    {
-        std::cout << "unable to query vulkan instance layer property count\n";
-        return false;
-    }
-
-    std::vector<VkLayerProperties> instance_layer_names(instance_layer_count);
-    res = vkEnumerateInstanceLayerProperties(&instance_layer_count, instance_layer_names.data());
-    if (res != VK_SUCCESS)
-    {
-        std::cout << "unable to retrieve vulkan instance layer names\n";
-        return false;
-    }
+    bool cached = capabilities.getStats().mInstanceCached;
+    const std::vector<VkLayerProperties>& instance_layer_names = capabilities.getLayers();
 
-    // Display layer names and find the ones we specified above
-    std::cout << "found " << instance_layer_count << " instance layers:\n";
-    std::vector<const char*> valid_instance_layer_names;
+    // List layer names and find the ones we specified above
+    LOG_INFO(Instance) << "found " << instance_layer_names.size() << " instance layers" << (cached ? " (cached)" : "");
     const std::set<std::string>& lookup_layers = getRequestedLayerNames();
     int count(0);
     outLayers.clear();
     for (const auto& name : instance_layer_names)
     {
-        std::cout << count << ": " << name.layerName << ": " << name.description << "\n";
+        if (!cached)
+            LOG_DEBUG(Instance) << count << ": " << name.layerName << ": " << name.description;
         auto it = lookup_layers.find(std::string(name.layerName));
         if (it != lookup_layers.end())
             outLayers.emplace_back(name.layerName);
@@ -205,21 +352,24 @@ bool getAvailableVulkanLayers(std::vector<std::string>& outLayers)
     }
 
     // Print the ones we're enabling
-    std::cout << "\n";
     for (const auto& layer : outLayers)
-        std::cout << "applying layer: " << layer.c_str() << "\n";
+        LOG_INFO(Instance) << "applying layer: " << layer;
     return true;
 }
 
 
-bool getAvailableVulkanExtensions(SDL_Window* window, std::vector<std::string>& outExtensions)
+/**
+ * Collects the instance extensions SDL needs for the window and the optional extensions that are available
+ * The available extensions come from the capability snapshot when it's valid
+ */
+bool getAvailableVulkanExtensions(SDL_Window* window, CapabilityCache& capabilities, std::vector<std::string>& outExtensions)
 {
     // Figure out the amount of extensions vulkan needs to interface with the os windowing system
     // This is necessary because vulkan is a platform agnostic API and needs to know how to interface with the windowing system
     unsigned int ext_count = 0;
     if (!SDL_Vulkan_GetInstanceExtensions(window, &ext_count, nullptr))
     {
-        std::cout << "Unable to query the number of Vulkan instance extensions\n";
+        LOG_ERROR(Instance) << "Unable to query the number of Vulkan instance extensions";
         return false;
     }
 
@@ -227,44 +377,57 @@ bool getAvailableVulkanExtensions(SDL_Window* window, std::vector<std::string>&
     std::vector<const char*> ext_names(ext_count);
     if (!SDL_Vulkan_GetInstanceExtensions(window, &ext_count, ext_names.data()))
     {
-        std::cout << "Unable to query the number of Vulkan instance extension names\n";
+        LOG_ERROR(Instance) << "Unable to query the number of Vulkan instance extension names";
         return false;
     }
 
-    // Display names
-    std::cout << "found " << ext_count << " Vulkan instance extensions:\n";
+    // Store names
     for (unsigned int i = 0; i < ext_count; i++)
     {
-        std::cout << i << ": " << ext_names[i] << "\n";
+        LOG_INFO(Instance) << "applying instance extension: " << ext_names[i];
         outExtensions.emplace_back(ext_names[i]);
     }
 
     // Add debug display extension, we need this to relay debug messages
     outExtensions.emplace_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
-    std::cout << "\n";
+
+    // Add optional extensions that are supported by the instance
+    const std::vector<VkExtensionProperties>& instance_exts = capabilities.getInstanceExtensions();
+    const std::set<std::string>& optional_names = getOptionalInstanceExtensionNames();
+    for (const auto& ext : instance_exts)
+    {
+        if (optional_names.find(ext.extensionName) == optional_names.end())
+            continue;
+        LOG_INFO(Instance) << "applying optional instance extension: " << ext.extensionName;
+        outExtensions.emplace_back(ext.extensionName);
+    }
     return true;
 }
 
 
 /**
  * Creates a vulkan instance using all the available instance extensions and layers
+ * The instance is created with the version of the loader, up to gMaxApiVersion
+ * @param setupArena holds the name lists, rewound on return
+ * @param outApiVersion the version the instance was created with
  * @return if the instance was created successfully
  */
-bool createVulkanInstance(const std::vector<std::string>& layerNames, const std::vector<std::string>& extensionNames, VkInstance& outInstance)
+bool createVulkanInstance(const std::vector<std::string>& layerNames, const std::vector<std::string>& extensionNames, LinearArena& setupArena,
+    VkInstance& outInstance, uint32_t& outApiVersion)
 {
     // Copy layers
-    std::vector<const char*> layer_names;
+    ArenaScope scope(setupArena);
+    std::pmr::vector<const char*> layer_names(scope.get());
     for (const auto& layer : layerNames)
         layer_names.emplace_back(layer.c_str());
 
     // Copy extensions
-    std::vector<const char*> ext_names;
+    std::pmr::vector<const char*> ext_names(scope.get());
     for (const auto& ext : extensionNames)
         ext_names.emplace_back(ext.c_str());
 
-    // Get the suppoerted vulkan instance version
-    unsigned int api_version;
-    vkEnumerateInstanceVersion(&api_version);
+    // Get the suppoerted vulkan instance version, features promoted to core up to that version are used without extension
+    outApiVersion = std::min<uint32_t>(getInstanceApiVersion(), gMaxApiVersion);
 
     // initialize the VkApplicationInfo structure
     VkApplicationInfo app_info = {};
@@ -274,7 +437,7 @@ bool createVulkanInstance(const std::vector<std::string>& layerNames, const std:
     app_info.applicationVersion = 1;
     app_info.pEngineName = gEngineName;
     app_info.engineVersion = 1;
-    app_info.apiVersion = VK_API_VERSION_1_0;
+    app_info.apiVersion = outApiVersion;
 
     // initialize the VkInstanceCreateInfo structure
     VkInstanceCreateInfo inst_info = {};
@@ -288,17 +451,17 @@ bool createVulkanInstance(const std::vector<std::string>& layerNames, const std:
     inst_info.ppEnabledLayerNames = layer_names.data();
 
     // Create vulkan runtime instance
-    std::cout << "initializing Vulkan instance\n\n";
-    VkResult res = vkCreateInstance(&inst_info, NULL, &outInstance);
+    LOG_INFO(Instance) << "initializing Vulkan " << VK_API_VERSION_MAJOR(outApiVersion) << "." << VK_API_VERSION_MINOR(outApiVersion) << " instance";
+    VkResult res = vkCreateInstance(&inst_info, getHostCallbacks(EHostScope::Instance), &outInstance);
     switch (res)
     {
     case VK_SUCCESS:
         break;
     case VK_ERROR_INCOMPATIBLE_DRIVER:
-        std::cout << "unable to create vulkan instance, cannot find a compatible Vulkan ICD\n";
+        LOG_ERROR(Instance) << "unable to create vulkan instance, cannot find a compatible Vulkan ICD";
         return false;
     default:
-        std::cout << "unable to create Vulkan instance: unknown error\n";
+        LOG_ERROR(Instance) << "unable to create Vulkan instance: unknown error";
         return false;
     }
     return true;
@@ -310,15 +473,16 @@ bool createVulkanInstance(const std::vector<std::string>& layerNames, const std:
  * @return if query, selection and assignment was successful
  * @param outDevice the selected physical device (gpu)
  * @param outQueueFamilyIndex queue command family that can handle graphics commands
+ * @param capabilities holds the queue families of the selected device
  */
-bool selectGPU(VkInstance instance, VkPhysicalDevice& outDevice, unsigned int& outQueueFamilyIndex)
+bool selectGPU(VkInstance instance, CapabilityCache& capabilities, VkPhysicalDevice& outDevice, unsigned int& outQueueFamilyIndex)
 {
     // Get number of available physical devices, needs to be at least 1
     unsigned int physical_device_count(0);
     vkEnumeratePhysicalDevices(instance, &physical_device_count, nullptr);
     if (physical_device_count == 0)
     {
-        std::cout << "No physical devices found\n";
+        LOG_ERROR(Device) << "No physical devices found";
         return false;
     }
 
@@ -326,21 +490,23 @@ bool selectGPU(VkInstance instance, VkPhysicalDevice& outDevice, unsigned int& o
     std::vector<VkPhysicalDevice> physical_devices(physical_device_count);
     vkEnumeratePhysicalDevices(instance, &physical_device_count, physical_devices.data());
 
-    // Show device information
-    std::cout << "found " << physical_device_count << " GPU(s):\n";
+    // Get device information
+    LOG_INFO(Device) << "found " << physical_device_count << " GPU(s)";
     int count(0);
     std::vector<VkPhysicalDeviceProperties> physical_device_properties(physical_devices.size());
     for (auto& physical_device : physical_devices)
     {
         vkGetPhysicalDeviceProperties(physical_device, &(physical_device_properties[count]));
-        std::cout << count << ": " << physical_device_properties[count].deviceName << "\n";
         count++;
     }
 
-    // Select one if more than 1 is available
+    // Select one if more than 1 is available, the prompt is written to the console after all pending records
     unsigned int selection_id = 0;
     if (physical_device_count > 1)
     {
+        getLogger().flush();
+        for (unsigned int i = 0; i < physical_device_count; i++)
+            std::cout << i << ": " << physical_device_properties[i].deviceName << "\n";
         while (true)
         {
             std::cout << "select device: ";
@@ -353,22 +519,18 @@ bool selectGPU(VkInstance instance, VkPhysicalDevice& outDevice, unsigned int& o
             break;
         }
     }
-    std::cout << "selected: " << physical_device_properties[selection_id].deviceName << "\n";
+    LOG_INFO(Device) << "selected: " << physical_device_properties[selection_id].deviceName;
     VkPhysicalDevice selected_device = physical_devices[selection_id];
 
     // Find the number queues this device supports, we want to make sure that we have a queue that supports graphics commands
-    unsigned int family_queue_count(0);
-    vkGetPhysicalDeviceQueueFamilyProperties(selected_device, &family_queue_count, nullptr);
+    const std::vector<VkQueueFamilyProperties>& queue_properties = capabilities.getDevice(selected_device).mQueueFamilies;
+    unsigned int family_queue_count = static_cast<unsigned int>(queue_properties.size());
     if (family_queue_count == 0)
     {
-        std::cout << "device has no family of queues associated with it\n";
+        LOG_ERROR(Device) << "device has no family of queues associated with it";
         return false;
     }
 
-    // Extract the properties of all the queue families
-    std::vector<VkQueueFamilyProperties> queue_properties(family_queue_count);
-    vkGetPhysicalDeviceQueueFamilyProperties(selected_device, &family_queue_count, queue_properties.data());
-
     // Make sure the family of commands contains an option to issue graphical commands.
     unsigned int queue_node_index = -1;
     for (unsigned int i = 0; i < family_queue_count; i++)
@@ -382,7 +544,7 @@ bool selectGPU(VkInstance instance, VkPhysicalDevice& outDevice, unsigned int& o
 
     if (queue_node_index < 0)
     {
-        std::cout << "Unable to find a queue command family that accepts graphics commands\n";
+        LOG_ERROR(Device) << "Unable to find a queue command family that accepts graphics commands";
         return false;
     }
 
@@ -393,44 +555,156 @@ bool selectGPU(VkInstance instance, VkPhysicalDevice& outDevice, unsigned int& o
 }
 
 
+/**
+ * Finds the queue family compute work is submitted to.
+ * Prefers a family without graphics support, work submitted to such a queue can overlap with graphics work.
+ * Falls back to the graphics family when there is none or async compute is disabled.
+ * @param physicalDevice the selected gpu
+ * @param capabilities holds the queue families of the device
+ * @param graphicsFamilyIndex the queue family used for graphics
+ * @param outQueueFamilyIndex the selected compute queue family
+ */
+void selectComputeQueueFamily(VkPhysicalDevice physicalDevice, CapabilityCache& capabilities, unsigned int graphicsFamilyIndex,
+    unsigned int& outQueueFamilyIndex)
+{
+    outQueueFamilyIndex = graphicsFamilyIndex;
+    if (!gAsyncCompute)
+        return;
+
+    const std::vector<VkQueueFamilyProperties>& queue_properties = capabilities.getDevice(physicalDevice).mQueueFamilies;
+    for (unsigned int i = 0; i < queue_properties.size(); i++)
+    {
+        if (queue_properties[i].queueCount > 0 &&
+            (queue_properties[i].queueFlags & VK_QUEUE_COMPUTE_BIT) != 0 &&
+            (queue_properties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) == 0)
+        {
+            outQueueFamilyIndex = i;
+            LOG_INFO(Device) << "using dedicated compute queue family: " << i;
+            return;
+        }
+    }
+    LOG_INFO(Device) << "no dedicated compute queue family found, compute work is submitted to the graphics queue";
+}
+
+
+/**
+ * A window with its presentation surface and swap chain, every window is rendered by the same device and queue
+ * and presented from the same present queue
+ */
+struct Output
+{
+    SDL_Window*             mWindow = nullptr;
+    uint32_t                mWindowID = 0;              ///< SDL id of the window, events refer to windows by id
+    VkExtent2D              mDrawableSize = { 0, 0 };   ///< Size of the window in pixels, reported by the event thread
+    VkOffset2D              mHighlightOffset = { 0, 0 }; ///< Offset of the highlight from the center, moved by dragging the mouse
+    VkSurfaceKHR            mSurface = VK_NULL_HANDLE;
+    SwapChain               mSwapChain;                 ///< Owns the swap chain images, views and present semaphores
+    uint32_t                mRequestedImageCount = 3;   ///< Number of images to ask for, clamped to the surface limits
+    bool                    mTransferDst = false;       ///< If the images can be copied and blitted to, without it only the render pass draws into them
+    bool                    mScalable = false;          ///< If the format supports blitting, required to render at a lower resolution
+    VkFilter                mUpscaleFilter = VK_FILTER_NEAREST;
+    bool                    mCaptured = false;          ///< If frames of the window are captured, requests transfer source usage
+    bool                    mCapturable = false;        ///< If the images can be copied from, required for capturing
+    bool                    mPresentScaling = false;    ///< If presents are scaled to the window, recreation can wait until resizing stops
+    VkSampleCountFlagBits   mSamples = VK_SAMPLE_COUNT_1_BIT; ///< Samples of the color and depth attachment, resolved into the swap chain image
+    VkFormat                mDepthFormat = VK_FORMAT_UNDEFINED;
+    VkRenderPass            mRenderPass = VK_NULL_HANDLE; ///< Clears the attachments and resolves into the swap chain image, follows the format
+    bool                    mResizePending = false;     ///< If the swap chain is recreated once the window stopped resizing
+    std::chrono::steady_clock::time_point mResizeTime;  ///< Last time the window was resized
+};
+
+
+/**
+ * Finds the queue family all windows are presented from.
+ * Prefers the graphics family, no ownership transfers or sharing are required when it can present.
+ * Otherwise the first family that can present to every surface is selected.
+ * @param physicalDevice the selected gpu
+ * @param capabilities holds the queue families of the device
+ * @param outputs the windows and their surfaces
+ * @param graphicsFamilyIndex the queue family used for graphics
+ * @param outQueueFamilyIndex the selected present queue family
+ * @return if a family was found that can present to all surfaces
+ */
+bool selectPresentQueueFamily(VkPhysicalDevice physicalDevice, CapabilityCache& capabilities, const std::vector<Output>& outputs,
+    unsigned int graphicsFamilyIndex, unsigned int& outQueueFamilyIndex)
+{
+    unsigned int family_queue_count = static_cast<unsigned int>(capabilities.getDevice(physicalDevice).mQueueFamilies.size());
+
+    // Try the graphics family first
+    std::vector<unsigned int> candidates = { graphicsFamilyIndex };
+    for (unsigned int i = 0; i < family_queue_count; i++)
+    {
+        if (i != graphicsFamilyIndex)
+            candidates.emplace_back(i);
+    }
+
+    for (unsigned int family : candidates)
+    {
+        bool supported = true;
+        for (const auto& output : outputs)
+        {
+            VkBool32 surface_supported = VK_FALSE;
+            vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, family, output.mSurface, &surface_supported);
+            supported = supported && surface_supported == VK_TRUE;
+        }
+        if (!supported)
+            continue;
+
+        outQueueFamilyIndex = family;
+        if (family != graphicsFamilyIndex)
+            LOG_INFO(Device) << "graphics queue family can't present, using present queue family: " << family;
+        return true;
+    }
+
+    LOG_ERROR(Device) << "Surface is not supported by physical device!";
+    return false;
+}
+
+
 /**
  *  Creates a logical device
+ *  Optional extensions are only enabled when the instance extensions they depend on are enabled
+ *  Features are negotiated by the feature builder, which enables them through its feature chain
+ *  Name lists are allocated from the setup arena, which is rewound on return
+ *  Device extensions come from the capability snapshot, they are only listed when they were queried
+ *  @param apiVersion the version the instance was created with
+ *  @param instanceExtensions extensions enabled on the instance
+ *  @param ioFeatures holds the required and requested features, negotiated against the device
  */
-bool createLogicalDevice(VkPhysicalDevice& physicalDevice,
+bool createLogicalDevice(VkInstance instance,
+    uint32_t apiVersion,
+    const std::vector<std::string>& instanceExtensions,
+    VkPhysicalDevice& physicalDevice,
     unsigned int queueFamilyIndex,
+    unsigned int computeQueueFamilyIndex,
+    unsigned int presentQueueFamilyIndex,
     const std::vector<std::string>& layerNames,
-    VkDevice& outDevice)
+    CapabilityCache& capabilities,
+    LinearArena& setupArena,
+    DeviceFeatureBuilder& ioFeatures,
+    VkDevice& outDevice,
+    bool& outMemoryBudget)
 {
     // Copy layer names
-    std::vector<const char*> layer_names;
+    ArenaScope scope(setupArena);
+    std::pmr::vector<const char*> layer_names(scope.get());
     for (const auto& layer : layerNames)
         layer_names.emplace_back(layer.c_str());
 
 
-    // Get the number of available extensions for our graphics card
-    uint32_t device_property_count(0);
-    if (vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &device_property_count, NULL) != VK_SUCCESS)
-    {
-        std::cout << "Unable to acquire device extension property count\n";
-        return false;
-    }
-    std::cout << "\nfound " << device_property_count << " device extensions\n";
-
-    // Acquire their actual names
-    std::vector<VkExtensionProperties> device_properties(device_property_count);
-    if (vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &device_property_count, device_properties.data()) != VK_SUCCESS)
-    {
-        std::cout << "Unable to acquire device extension property names\n";
-        return false;
-    }
+    // Get the available extensions for our graphics card
+    const DeviceCapabilities& device_capabilities = capabilities.getDevice(physicalDevice);
+    const std::vector<VkExtensionProperties>& device_properties = device_capabilities.mExtensions;
+    LOG_INFO(Device) << "found " << device_properties.size() << " device extensions" << (device_capabilities.mCached ? " (cached)" : "");
 
     // Match names against requested extension
-    std::vector<const char*> device_property_names;
+    std::pmr::vector<const char*> device_property_names(scope.get());
     const std::set<std::string>& required_extension_names = getRequestedDeviceExtensionNames();
     int count = 0;
     for (const auto& ext_property : device_properties)
     {
-        std::cout << count << ": " << ext_property.extensionName << "\n";
+        if (!device_capabilities.mCached)
+            LOG_DEBUG(Device) << count << ": " << ext_property.extensionName;
         auto it = required_extension_names.find(std::string(ext_property.extensionName));
         if (it != required_extension_names.end())
         {
@@ -442,13 +716,36 @@ bool createLogicalDevice(VkPhysicalDevice& physicalDevice,
     // Warn if not all required extensions were found
     if (required_extension_names.size() != device_property_names.size())
     {
-        std::cout << "not all required device extensions are supported!\n";
+        LOG_ERROR(Device) << "not all required device extensions are supported!";
+        return false;
+    }
+
+    // Negotiate features, the builder adds the extensions of the enabled features that aren't core at the device version
+    if (!ioFeatures.negotiate(instance, apiVersion, instanceExtensions, physicalDevice, device_properties))
         return false;
+    for (const char* name : ioFeatures.getExtensions())
+        device_property_names.emplace_back(name);
+
+    // Add optional extensions, the memory budget is queried through vkGetPhysicalDeviceMemoryProperties2KHR
+    bool properties2 = std::find(instanceExtensions.begin(), instanceExtensions.end(), VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) != instanceExtensions.end();
+    const std::set<std::string>& optional_extension_names = getOptionalDeviceExtensionNames();
+    outMemoryBudget = false;
+    for (const auto& ext_property : device_properties)
+    {
+        std::string name(ext_property.extensionName);
+        if (optional_extension_names.find(name) == optional_extension_names.end())
+            continue;
+        if (name == VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)
+        {
+            if (!properties2)
+                continue;
+            outMemoryBudget = true;
+        }
+        device_property_names.emplace_back(ext_property.extensionName);
     }
 
-    std::cout << "\n";
     for (const auto& name : device_property_names)
-        std::cout << "applying device extension: " << name << "\n";
+        LOG_INFO(Device) << "applying device extension: " << name;
 
     // Create queue information structure used by device based on the previously fetched queue information from the physical device
     // We create one command processing queue for graphics
@@ -461,24 +758,39 @@ bool createLogicalDevice(VkPhysicalDevice& physicalDevice,
     queue_create_info.pNext = NULL;
     queue_create_info.flags = 0;
 
+    // And one for compute, when the compute family differs from the graphics family
+    std::pmr::vector<VkDeviceQueueCreateInfo> queue_create_infos(1, queue_create_info, scope.get());
+    if (computeQueueFamilyIndex != queueFamilyIndex)
+    {
+        queue_create_infos.emplace_back(queue_create_info);
+        queue_create_infos.back().queueFamilyIndex = computeQueueFamilyIndex;
+    }
+
+    // And one for presentation, when no other family can present
+    if (presentQueueFamilyIndex != queueFamilyIndex && presentQueueFamilyIndex != computeQueueFamilyIndex)
+    {
+        queue_create_infos.emplace_back(queue_create_info);
+        queue_create_infos.back().queueFamilyIndex = presentQueueFamilyIndex;
+    }
+
     // Device creation information
     VkDeviceCreateInfo create_info;
     create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    create_info.queueCreateInfoCount = 1;
-    create_info.pQueueCreateInfos = &queue_create_info;
+    create_info.queueCreateInfoCount = static_cast<uint32_t>(queue_create_infos.size());
+    create_info.pQueueCreateInfos = queue_create_infos.data();
     create_info.ppEnabledLayerNames = layer_names.data();
     create_info.enabledLayerCount = static_cast<uint32_t>(layer_names.size());
     create_info.ppEnabledExtensionNames = device_property_names.data();
     create_info.enabledExtensionCount = static_cast<uint32_t>(device_property_names.size());
-    create_info.pNext = NULL;
+    create_info.pNext = ioFeatures.getChain();
     create_info.pEnabledFeatures = NULL;
     create_info.flags = 0;
 
     // Finally we're ready to create a new device
-    VkResult res = vkCreateDevice(physicalDevice, &create_info, nullptr, &outDevice);
+    VkResult res = vkCreateDevice(physicalDevice, &create_info, getHostCallbacks(EHostScope::Device), &outDevice);
     if (res != VK_SUCCESS)
     {
-        std::cout << "failed to create logical device!\n";
+        LOG_ERROR(Device) << "failed to create logical device!";
         return false;
     }
     return true;
@@ -496,95 +808,58 @@ void getDeviceQueue(VkDevice device, int familyQueueIndex, VkQueue& outGraphicsQ
 
 /**
  *  Creates the vulkan surface that is rendered to by the device using SDL
+ *  Support is checked when selecting the present queue family, which doesn't have to be the graphics family
  */
-bool createSurface(SDL_Window* window, VkInstance instance, VkPhysicalDevice gpu, uint32_t graphicsFamilyQueueIndex, VkSurfaceKHR& outSurface)
+bool createSurface(SDL_Window* window, VkInstance instance, VkSurfaceKHR& outSurface)
 {
     if (!SDL_Vulkan_CreateSurface(window, instance, &outSurface))
     {
-        std::cout << "Unable to create Vulkan compatible surface using SDL\n";
-        return false;
-    }
-
-    // Make sure the surface is compatible with the queue family and gpu
-    VkBool32 supported = false;
-    vkGetPhysicalDeviceSurfaceSupportKHR(gpu, graphicsFamilyQueueIndex, outSurface, &supported);
-    if (!supported)
-    {
-        std::cout << "Surface is not supported by physical device!\n";
+        LOG_ERROR(Surface) << "Unable to create Vulkan compatible surface using SDL";
         return false;
     }
-
     return true;
 }
 
 
 /**
- * @return if the present modes could be queried and ioMode is set
- * @param outMode the mode that is requested, will contain FIFO when requested mode is not available
+ * Selects the presentation mode from the modes supported by the surface
+ * @param ioMode the mode that is requested, will contain FIFO when requested mode is not available
  */
-bool getPresentationMode(VkSurfaceKHR surface, VkPhysicalDevice device, VkPresentModeKHR& ioMode)
+void getPresentationMode(const std::vector<VkPresentModeKHR>& availableModes, VkPresentModeKHR& ioMode)
 {
-    uint32_t mode_count(0);
-    if(vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &mode_count, NULL) != VK_SUCCESS)
-    {
-        std::cout << "unable to query present mode count for physical device\n";
-        return false;
-    }
-
-    std::vector<VkPresentModeKHR> available_modes(mode_count);
-    if (vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &mode_count, available_modes.data()) != VK_SUCCESS)
-    {
-        std::cout << "unable to query the various present modes for physical device\n";
-        return false;
-    }
-
-    for (auto& mode : available_modes)
+    for (auto& mode : availableModes)
     {
         if (mode == ioMode)
-            return true;
+            return;
     }
-    std::cout << "unable to obtain preferred display mode, fallback to FIFO\n";
+    LOG_WARNING(Surface) << "unable to obtain preferred display mode, fallback to FIFO";
     ioMode = VK_PRESENT_MODE_FIFO_KHR;
-    return true;
-}
-
-
-/**
- * Obtain the surface properties that are required for the creation of the swap chain
- */
-bool getSurfaceProperties(VkPhysicalDevice device, VkSurfaceKHR surface, VkSurfaceCapabilitiesKHR& capabilities)
-{
-    if(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &capabilities) != VK_SUCCESS)
-    {
-        std::cout << "unable to acquire surface capabilities\n";
-        return false;
-    }
-    return true;
 }
 
 
 /**
  * Figure out the number of images that are used by the swapchain and
- * available to us in the application, based on the minimum amount of necessary images
- * provided by the capabilities struct.
+ * available to us in the application, based on the requested amount of images
+ * clamped to the limits provided by the capabilities struct.
  */
-unsigned int getNumberOfSwapImages(const VkSurfaceCapabilitiesKHR& capabilities)
+unsigned int getNumberOfSwapImages(const VkSurfaceCapabilitiesKHR& capabilities, uint32_t requested)
 {
-    unsigned int number = capabilities.minImageCount + 1;
-    return number > capabilities.maxImageCount ? capabilities.minImageCount : number;
+    return clampSwapImageCount(requested, capabilities);
 }
 
 
 /**
  *  Returns the size of a swapchain image based on the current surface
+ *  The window size is in screen coordinates, on high DPI displays the drawable size in pixels is larger
+ *  The drawable size is queried by the event thread, the render thread doesn't touch the window
  */
-VkExtent2D getSwapImageSize(const VkSurfaceCapabilitiesKHR& capabilities)
+VkExtent2D getSwapImageSize(const VkSurfaceCapabilitiesKHR& capabilities, VkExtent2D drawableSize)
 {
-    // Default size = window size
-    VkExtent2D size = { (unsigned int)gWindowWidth, (unsigned int)gWindowHeight };
+    // Default size = drawable size of the window
+    VkExtent2D size = drawableSize;
 
     // This happens when the window scales based on the size of an image
-    if (capabilities.currentExtent.width == 0xFFFFFFF)
+    if (capabilities.currentExtent.width == 0xFFFFFFFF)
     {
         size.width  = glm::clamp<unsigned int>(size.width,  capabilities.minImageExtent.width,  capabilities.maxImageExtent.width);
         size.height = glm::clamp<unsigned int>(size.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
@@ -615,7 +890,7 @@ bool getImageUsage(const VkSurfaceCapabilitiesKHR& capabilities, VkImageUsageFla
         VkImageUsageFlags image_usage = desired_usage & capabilities.supportedUsageFlags;
         if (image_usage != desired_usage)
         {
-            std::cout << "unsupported image usage flag: " << desired_usage << "\n";
+            LOG_ERROR(Surface) << "unsupported image usage flag: " << desired_usage;
             return false;
         }
 
@@ -634,66 +909,199 @@ VkSurfaceTransformFlagBitsKHR getTransform(const VkSurfaceCapabilitiesKHR& capab
 {
     if (capabilities.supportedTransforms & gTransform)
         return gTransform;
-    std::cout << "unsupported surface transform: " << gTransform;
+    LOG_WARNING(Surface) << "unsupported surface transform: " << gTransform;
     return capabilities.currentTransform;
 }
 
 
 /**
- * @return the most appropriate color space based on the globals provided above
+ * The selected swap chain format and why it was selected
+ */
+struct SurfaceFormatChoice
+{
+    SurfaceFormatCandidate  mCandidate;
+    bool                    mStorage = false;   ///< If compute writes to the swap chain images directly, requires gComputeSwapImages
+    uint32_t                mCost = 0;          ///< Estimated bytes written per pixel by a full screen pass, 0 when unknown
+};
+
+
+/**
+ * Selects the swap chain format with the lowest estimated bandwidth from the candidates supported by the surface.
+ * When a compute pass writes the swap chain images (gComputeSwapImages) it can only do so when the format supports
+ * storage, otherwise it writes to an intermediate image that is copied afterwards: one write plus a read and a write
+ * per pixel for the copy. Without such a pass storage is never requested, it can disable framebuffer compression.
+ * Equal costs are resolved by the order of the candidates. Format and color space must both be supported.
+ * @param physicalDevice the gpu, queried for storage support of every format
+ * @param formats formats supported by the surface
+ * @param supportedUsage image usage supported by the surface
+ * @param outChoice the selected format
+ * @return if a format was selected
  */
-bool getFormat(VkPhysicalDevice device, VkSurfaceKHR surface, VkSurfaceFormatKHR& outFormat)
+bool getFormat(VkPhysicalDevice physicalDevice, const std::vector<VkSurfaceFormatKHR>& formats, VkImageUsageFlags supportedUsage,
+    SurfaceFormatChoice& outChoice)
 {
-    unsigned int count(0);
-    if (vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &count, nullptr) != VK_SUCCESS)
+    if (formats.empty())
     {
-        std::cout << "unable to query number of supported surface formats";
+        LOG_ERROR(Surface) << "surface doesn't support any format";
         return false;
     }
 
-    std::vector<VkSurfaceFormatKHR> found_formats(count);
-    if (vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &count, found_formats.data()) != VK_SUCCESS)
+    // This means there are no restrictions on the supported format
+    bool unrestricted = formats.size() == 1 && formats[0].format == VK_FORMAT_UNDEFINED;
+    bool surface_storage = gComputeSwapImages && (supportedUsage & VK_IMAGE_USAGE_STORAGE_BIT) != 0;
+
+    bool found = false;
+    for (const auto& candidate : getSurfaceFormatCandidates())
     {
-        std::cout << "unable to query all supported surface formats\n";
-        return false;
+        if (candidate.mChannelBits < gMinChannelBits)
+            continue;
+
+        bool supported = unrestricted;
+        for (const auto& format : formats)
+            supported = supported || (format.format == candidate.mFormat.format && format.colorSpace == candidate.mFormat.colorSpace);
+        if (!supported)
+            continue;
+
+        VkFormatProperties format_properties;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, candidate.mFormat.format, &format_properties);
+        bool storage = surface_storage && (format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) != 0;
+        uint32_t cost = storage || !gComputeSwapImages ? candidate.mBytesPerPixel : candidate.mBytesPerPixel * 3;
+        if (found && cost >= outChoice.mCost)
+            continue;
+
+        outChoice.mCandidate = candidate;
+        outChoice.mStorage = storage;
+        outChoice.mCost = cost;
+        found = true;
     }
 
-    // This means there are no restrictions on the supported format.
-    // Preference would work
-    if (found_formats.size() == 1 && found_formats[0].format == VK_FORMAT_UNDEFINED)
-    {
-        outFormat.format = gFormat;
-        outFormat.colorSpace = gColorSpace;
+    if (found)
         return true;
-    }
 
-    // Otherwise check if both are supported
-    for (const auto& found_format_outer : found_formats)
+    // No preferred format available, the highlight color might be packed incorrectly.
+    // Nothing is known about its layout, it isn't ranked
+    LOG_WARNING(Surface) << "no preferred surface format found, picking first available one";
+    outChoice.mCandidate = { formats[0], 0, 0, "first available" };
+    outChoice.mStorage = false;
+    outChoice.mCost = 0;
+    return true;
+}
+
+
+/**
+ * @return the highest sample count up to the requested one that color and depth attachments support
+ */
+VkSampleCountFlagBits getSampleCount(VkPhysicalDevice physicalDevice, VkSampleCountFlagBits requested)
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    VkSampleCountFlags supported = properties.limits.framebufferColorSampleCounts & properties.limits.framebufferDepthSampleCounts;
+    uint32_t samples = requested;
+    while (samples > VK_SAMPLE_COUNT_1_BIT && (supported & samples) == 0)
+        samples >>= 1;
+    return static_cast<VkSampleCountFlagBits>(samples);
+}
+
+
+/**
+ * Finds a depth format that can be used as attachment, formats without stencil are preferred
+ * @return if a depth format was found
+ */
+bool getDepthFormat(VkPhysicalDevice physicalDevice, VkFormat& outFormat)
+{
+    for (VkFormat format : { VK_FORMAT_D32_SFLOAT, VK_FORMAT_X8_D24_UNORM_PACK32, VK_FORMAT_D16_UNORM })
     {
-        // Format found
-        if (found_format_outer.format == gFormat)
+        VkFormatProperties format_properties;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &format_properties);
+        if ((format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) != 0)
         {
-            outFormat.format = found_format_outer.format;
-            for (const auto& found_format_inner : found_formats)
-            {
-                // Color space found
-                if (found_format_inner.colorSpace == gColorSpace)
-                {
-                    outFormat.colorSpace = found_format_inner.colorSpace;
-                    return true;
-                }
-            }
-
-            // No matching color space, pick first one
-            std::cout << "warning: no matching color space found, picking first available one\n!";
-            outFormat.colorSpace = found_formats[0].colorSpace;
+            outFormat = format;
             return true;
         }
     }
+    LOG_ERROR(Swapchain) << "no depth attachment format available";
+    return false;
+}
+
+
+/**
+ * Creates the render pass the background is rendered in, matches the framebuffers of the swap chain.
+ * Multisample color and depth are cleared and never stored, only the resolved color reaches the swap chain image.
+ * The swap chain image is in the color attachment layout before and after the pass, the render graph transitions it.
+ * @param format format of the swap chain images
+ * @param samples samples of the color and depth attachment, the swap chain image is written directly when 1
+ * @param depthFormat format of the depth attachment, VK_FORMAT_UNDEFINED for none
+ */
+bool createRenderPass(VkDevice device, VkFormat format, VkSampleCountFlagBits samples, VkFormat depthFormat, VkRenderPass& outRenderPass)
+{
+    bool multisampled = samples != VK_SAMPLE_COUNT_1_BIT;
+    std::vector<VkAttachmentDescription> attachments;
+
+    VkAttachmentDescription color = {};
+    color.format = format;
+    color.samples = samples;
+    color.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    color.storeOp = multisampled ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
+    color.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    color.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    color.initialLayout = multisampled ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    color.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    attachments.emplace_back(color);
+    VkAttachmentReference color_ref = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+
+    VkAttachmentReference depth_ref = { VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+    if (depthFormat != VK_FORMAT_UNDEFINED)
+    {
+        VkAttachmentDescription depth = color;
+        depth.format = depthFormat;
+        depth.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        depth.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        depth.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        depth_ref.attachment = static_cast<uint32_t>(attachments.size());
+        attachments.emplace_back(depth);
+    }
+
+    VkAttachmentReference resolve_ref = { VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+    if (multisampled)
+    {
+        VkAttachmentDescription resolve = color;
+        resolve.samples = VK_SAMPLE_COUNT_1_BIT;
+        resolve.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        resolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        resolve.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        resolve_ref.attachment = static_cast<uint32_t>(attachments.size());
+        attachments.emplace_back(resolve);
+    }
 
-    // No matching formats found
-    std::cout << "warning: no matching color format found, picking first available one\n";
-    outFormat = found_formats[0];
+    VkSubpassDescription subpass = {};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &color_ref;
+    subpass.pResolveAttachments = multisampled ? &resolve_ref : nullptr;
+    subpass.pDepthStencilAttachment = depthFormat != VK_FORMAT_UNDEFINED ? &depth_ref : nullptr;
+
+    // The attachments are shared by all frames in flight, the previous frame must be done writing them
+    VkSubpassDependency dependency = {};
+    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependency.dstSubpass = 0;
+    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+    VkRenderPassCreateInfo render_pass_info = {};
+    render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    render_pass_info.attachmentCount = static_cast<uint32_t>(attachments.size());
+    render_pass_info.pAttachments = attachments.data();
+    render_pass_info.subpassCount = 1;
+    render_pass_info.pSubpasses = &subpass;
+    render_pass_info.dependencyCount = 1;
+    render_pass_info.pDependencies = &dependency;
+    if (vkCreateRenderPass(device, &render_pass_info, getHostCallbacks(EHostScope::Pipeline), &outRenderPass) != VK_SUCCESS)
+    {
+        LOG_ERROR(Pipeline) << "unable to create render pass";
+        return false;
+    }
     return true;
 }
 
@@ -701,24 +1109,31 @@ bool getFormat(VkPhysicalDevice device, VkSurfaceKHR surface, VkSurfaceFormatKHR
 /**
  * creates the swap chain using utility functions above to retrieve swap chain properties
  * Swap chain is associated with a single window (surface) and allows us to display images to screen
+ * The previous swap chain, if any, is destroyed. The per image objects are updated by the swap chain.
+ * Supported formats and present modes come from the surface cache, only the capabilities are queried every time.
+ * The present queue decides how the images are shared between the graphics and present family.
+ * With swap chain maintenance presents are scaled when the window size no longer matches the images.
  */
-bool createSwapChain(VkSurfaceKHR surface, VkPhysicalDevice physicalDevice, VkDevice device, VkSwapchainKHR& outSwapChain)
+bool createSwapChain(VkPhysicalDevice physicalDevice, VkDevice device, SurfaceInfoCache& surfaceCache, const PresentQueue& presentQueue,
+    Output& ioOutput)
 {
+    VkSurfaceKHR surface = ioOutput.mSurface;
+
     // Get properties of surface, necessary for creation of swap-chain
-    VkSurfaceCapabilitiesKHR surface_properties;
-    if (!getSurfaceProperties(physicalDevice, surface, surface_properties))
+    const SurfaceInfo* surface_info = surfaceCache.query(surface);
+    if (surface_info == nullptr)
         return false;
+    const VkSurfaceCapabilitiesKHR& surface_properties = surface_info->mCapabilities;
 
     // Get the image presentation mode (synced, immediate etc.)
     VkPresentModeKHR presentation_mode = gPresentationMode;
-    if (!getPresentationMode(surface, physicalDevice, presentation_mode))
-        return false;
+    getPresentationMode(surface_info->mPresentModes, presentation_mode);
 
     // Get other swap chain related features
-    unsigned int swap_image_count = getNumberOfSwapImages(surface_properties);
+    unsigned int swap_image_count = getNumberOfSwapImages(surface_properties, ioOutput.mRequestedImageCount);
 
     // Size of the images
-    VkExtent2D swap_image_extent = getSwapImageSize(surface_properties);
+    VkExtent2D swap_image_extent = getSwapImageSize(surface_properties, ioOutput.mDrawableSize);
 
     // Get image usage (color etc.)
     VkImageUsageFlags usage_flags;
@@ -728,13 +1143,42 @@ bool createSwapChain(VkSurfaceKHR surface, VkPhysicalDevice physicalDevice, VkDe
     // Get the transform, falls back on current transform when transform is not supported
     VkSurfaceTransformFlagBitsKHR transform = getTransform(surface_properties);
 
-    // Get swapchain image format
-    VkSurfaceFormatKHR image_format;
-    if (!getFormat(physicalDevice, surface, image_format))
+    // Get swapchain image format, the one that requires the least bandwidth
+    SurfaceFormatChoice format_choice;
+    if (!getFormat(physicalDevice, surface_info->mFormats, surface_properties.supportedUsageFlags, format_choice))
         return false;
-
-    // Old swap chain
-    VkSwapchainKHR old_swap_chain = outSwapChain;
+    VkSurfaceFormatKHR image_format = format_choice.mCandidate.mFormat;
+    if (format_choice.mStorage)
+        usage_flags |= VK_IMAGE_USAGE_STORAGE_BIT;
+
+    // The highlight is copied and lower resolution frames are blitted onto the swap chain image, both are skipped when the surface can't
+    ioOutput.mTransferDst = (surface_properties.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT) != 0;
+    if (ioOutput.mTransferDst)
+        usage_flags |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+
+    // Captured frames are copied out of the swap chain image
+    ioOutput.mCapturable = ioOutput.mCaptured && (surface_properties.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) != 0;
+    if (ioOutput.mCapturable)
+        usage_flags |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
+    // Report the choice when the format changes, not on every resize
+    if (image_format.format != ioOutput.mSwapChain.getFormat() && format_choice.mCost == 0)
+    {
+        LOG_INFO(Surface) << "window " << ioOutput.mWindowID << " surface format: " << format_choice.mCandidate.mName << " (" <<
+            image_format.format << "), pixel size unknown";
+    }
+    else if (image_format.format != ioOutput.mSwapChain.getFormat() && !gComputeSwapImages)
+    {
+        LOG_INFO(Surface) << "window " << ioOutput.mWindowID << " surface format: " << format_choice.mCandidate.mName << ", " <<
+            format_choice.mCandidate.mBytesPerPixel << " bytes per pixel";
+    }
+    else if (image_format.format != ioOutput.mSwapChain.getFormat())
+    {
+        LOG_INFO(Surface) << "window " << ioOutput.mWindowID << " surface format: " << format_choice.mCandidate.mName << ", " <<
+            format_choice.mCandidate.mBytesPerPixel << " bytes per pixel, " << (format_choice.mStorage ? "storage supported" : "no storage") <<
+            ", estimated " << format_choice.mCost << " bytes written per pixel by a full screen compute pass" <<
+            (format_choice.mStorage ? "" : " (includes copy)");
+    }
 
     // Populate swapchain creation info
     VkSwapchainCreateInfoKHR swap_info;
@@ -747,118 +1191,961 @@ bool createSwapChain(VkSurfaceKHR surface, VkPhysicalDevice physicalDevice, VkDe
     swap_info.imageExtent = swap_image_extent;
     swap_info.imageArrayLayers = 1;
     swap_info.imageUsage = usage_flags;
-    swap_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    swap_info.queueFamilyIndexCount = 0;
-    swap_info.pQueueFamilyIndices = nullptr;
     swap_info.preTransform = transform;
     swap_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     swap_info.presentMode = presentation_mode;
     swap_info.clipped = true;
     swap_info.oldSwapchain = NULL;
     swap_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+    presentQueue.applySharing(swap_info);
+
+    // Let the presentation engine scale images while the window is resized, recreation can wait until resizing stops
+    VkSwapchainPresentScalingCreateInfoEXT scaling_info = {};
+    scaling_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_PRESENT_SCALING_CREATE_INFO_EXT;
+    if (ioOutput.mSwapChain.canRetire())
+    {
+        VkPresentScalingFlagsEXT scaling = surfaceCache.getPresentScaling(surface, presentation_mode);
+        if ((scaling & VK_PRESENT_SCALING_STRETCH_BIT_EXT) != 0)
+            scaling_info.scalingBehavior = VK_PRESENT_SCALING_STRETCH_BIT_EXT;
+        else if ((scaling & VK_PRESENT_SCALING_ASPECT_RATIO_STRETCH_BIT_EXT) != 0)
+            scaling_info.scalingBehavior = VK_PRESENT_SCALING_ASPECT_RATIO_STRETCH_BIT_EXT;
+    }
+    ioOutput.mPresentScaling = scaling_info.scalingBehavior != 0;
+    if (ioOutput.mPresentScaling)
+        swap_info.pNext = &scaling_info;
+
+    // The render pass follows the format, a format change is rare enough to wait for the frames that use the old one
+    if (image_format.format != ioOutput.mSwapChain.getFormat())
+    {
+        if (ioOutput.mRenderPass != VK_NULL_HANDLE)
+        {
+            vkDeviceWaitIdle(device);
+            ioOutput.mSwapChain.setRenderPass(VK_NULL_HANDLE);
+            vkDestroyRenderPass(device, ioOutput.mRenderPass, getHostCallbacks(EHostScope::Pipeline));
+            ioOutput.mRenderPass = VK_NULL_HANDLE;
+        }
+        if (!createRenderPass(device, image_format.format, ioOutput.mSamples, ioOutput.mDepthFormat, ioOutput.mRenderPass))
+            return false;
+    }
+
+    // Replace the old swap chain, views, attachments and framebuffers are rebuilt for the new images
+    if (!ioOutput.mSwapChain.create(swap_info) || !ioOutput.mSwapChain.setRenderPass(ioOutput.mRenderPass))
+        return false;
+
+    // Lower resolution frames are blitted onto the swap chain image, which requires blit support for the format
+    VkFormatProperties format_properties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, image_format.format, &format_properties);
+    VkFormatFeatureFlags blit_features = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT;
+    ioOutput.mScalable = ioOutput.mTransferDst && (format_properties.optimalTilingFeatures & blit_features) == blit_features;
+    ioOutput.mUpscaleFilter = (format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) != 0 ?
+        VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+    return true;
+}
+
+
+/**
+ * Creates the swap chain of an output, the surface is created before the device
+ * because it determines the queue family the output is presented from.
+ * The multisample color and depth attachments are transient, sized to the swap chain images by the swap chain.
+ * @param swapchainMaintenance if VK_EXT_swapchain_maintenance1 is enabled
+ */
+bool createOutput(VkPhysicalDevice physicalDevice, VkDevice device, bool swapchainMaintenance, SurfaceInfoCache& surfaceCache,
+    const PresentQueue& presentQueue, Output& ioOutput)
+{
+    ioOutput.mSamples = getSampleCount(physicalDevice, gSampleCount);
+    if (gDepthAttachment && !getDepthFormat(physicalDevice, ioOutput.mDepthFormat))
+        return false;
+
+    VkPhysicalDeviceMemoryProperties memory_properties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memory_properties);
+    ioOutput.mSwapChain.init(device, swapchainMaintenance);
+    ioOutput.mSwapChain.setAttachments(memory_properties, ioOutput.mSamples, ioOutput.mDepthFormat);
+    return createSwapChain(physicalDevice, device, surfaceCache, presentQueue, ioOutput);
+}
+
+
+/**
+ * Destroys the swap chain, render pass, surface and window of an output, the device must be idle
+ */
+void destroyOutput(VkInstance instance, VkDevice device, Output& output)
+{
+    output.mSwapChain.destroy();
+    vkDestroyRenderPass(device, output.mRenderPass, getHostCallbacks(EHostScope::Pipeline));
+    output.mRenderPass = VK_NULL_HANDLE;
+    // SDL creates the surface without allocation callbacks, it's destroyed without them
+    vkDestroySurfaceKHR(instance, output.mSurface, nullptr);
+    SDL_DestroyWindow(output.mWindow);
+    output.mSurface = VK_NULL_HANDLE;
+    output.mWindow = nullptr;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// Rendering
+//////////////////////////////////////////////////////////////////////////
+
+/**
+ * Vulkan objects used to record and submit a single frame in flight
+ */
+struct FrameResources
+{
+    VkCommandPool       mCommandPool = VK_NULL_HANDLE;
+    VkCommandBuffer     mCommandBuffer = VK_NULL_HANDLE;
+    VkFence             mFence = VK_NULL_HANDLE;                ///< Signaled when the GPU finished executing the frame
+    std::vector<VkSemaphore> mImageAvailable;                   ///< Per window, signaled when its acquired swap chain image can be written to
+    ResidentBuffer      mHighlightBuffer = gInvalidResidentBuffer; ///< Highlight pixels, written by compute and copied by graphics
+    LinearArena         mArena;                                 ///< Lists built while recording the frame, reset once its fence signaled
+};
+
+
+/**
+ * CPU side timings of a single frame, in ms
+ */
+struct FrameTimings
+{
+    double              mFenceTime = 0.0;                       ///< Time spent waiting for the GPU to release the frame resources
+    double              mAcquireTime = 0.0;                     ///< Time spent waiting for a swap chain image
+};
+
+
+/**
+ * @return milliseconds elapsed since the given point in time
+ */
+double getElapsedMs(std::chrono::steady_clock::time_point since)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+}
+
+
+/**
+ * Creates the command pool, command buffer and synchronization primitives of a single frame in flight
+ * @param queueFamilyIndex graphics queue family
+ * @param windowCount number of windows, every window acquires its own swap chain image
+ */
+bool createFrameResources(VkDevice device, unsigned int queueFamilyIndex, unsigned int windowCount, FrameResources& outFrame)
+{
+    VkCommandPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    pool_info.queueFamilyIndex = queueFamilyIndex;
+    if (vkCreateCommandPool(device, &pool_info, getHostCallbacks(EHostScope::Device), &outFrame.mCommandPool) != VK_SUCCESS)
+    {
+        LOG_ERROR(Render) << "unable to create command pool";
+        return false;
+    }
 
-    // Destroy old swap chain
-    if (old_swap_chain != VK_NULL_HANDLE)
+    VkCommandBufferAllocateInfo buffer_info = {};
+    buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    buffer_info.commandPool = outFrame.mCommandPool;
+    buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    buffer_info.commandBufferCount = 1;
+    if (vkAllocateCommandBuffers(device, &buffer_info, &outFrame.mCommandBuffer) != VK_SUCCESS)
     {
-        vkDestroySwapchainKHR(device, old_swap_chain, nullptr);
-        old_swap_chain = VK_NULL_HANDLE;
+        LOG_ERROR(Render) << "unable to allocate command buffer";
+        return false;
     }
 
-    // Create new one
-    if (vkCreateSwapchainKHR(device, &swap_info, nullptr, &old_swap_chain) != VK_SUCCESS)
+    // Created signaled, the first wait on a frame must not block
+    VkFenceCreateInfo fence_info = {};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+    if (vkCreateFence(device, &fence_info, getHostCallbacks(EHostScope::Device), &outFrame.mFence) != VK_SUCCESS)
     {
-        std::cout << "unable to create swap chain\n";
+        LOG_ERROR(Render) << "unable to create frame fence";
         return false;
     }
 
-    // Store handle
-    outSwapChain = old_swap_chain;
+    VkSemaphoreCreateInfo semaphore_info = {};
+    semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    outFrame.mImageAvailable.resize(windowCount, VK_NULL_HANDLE);
+    for (auto& semaphore : outFrame.mImageAvailable)
+    {
+        if (vkCreateSemaphore(device, &semaphore_info, getHostCallbacks(EHostScope::Device), &semaphore) != VK_SUCCESS)
+        {
+            LOG_ERROR(Render) << "unable to create frame semaphores";
+            return false;
+        }
+    }
+
+    outFrame.mArena.init(gFrameArenaSize);
     return true;
 }
 
 
 /**
- *  Returns the handles of all the images in a swap chain, result is stored in outImageHandles
+ * Destroys all objects of a single frame in flight, the device must be idle.
+ * The highlight buffer is owned by the residency manager.
  */
-bool getSwapChainImageHandles(VkDevice device, VkSwapchainKHR chain, std::vector<VkImage>& outImageHandles)
+void destroyFrameResources(VkDevice device, FrameResources& frame)
 {
-    unsigned int image_count(0);
-    VkResult res = vkGetSwapchainImagesKHR(device, chain, &image_count, nullptr);
-    if (res != VK_SUCCESS)
+    for (auto semaphore : frame.mImageAvailable)
+        vkDestroySemaphore(device, semaphore, getHostCallbacks(EHostScope::Device));
+    vkDestroyFence(device, frame.mFence, getHostCallbacks(EHostScope::Device));
+    vkDestroyCommandPool(device, frame.mCommandPool, getHostCallbacks(EHostScope::Device));
+    frame.mArena.destroy();
+    frame.mImageAvailable.clear();
+    frame.mCommandPool = VK_NULL_HANDLE;
+    frame.mCommandBuffer = VK_NULL_HANDLE;
+    frame.mFence = VK_NULL_HANDLE;
+    frame.mHighlightBuffer = gInvalidResidentBuffer;
+}
+
+
+/**
+ * Clears the given image to a color, the image must be in the transfer destination layout
+ */
+void clearImage(VkCommandBuffer commandBuffer, VkImage image, const VkClearColorValue& color)
+{
+    VkImageSubresourceRange range = {};
+    range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    range.levelCount = 1;
+    range.layerCount = 1;
+    vkCmdClearColorImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &color, 1, &range);
+}
+
+
+/**
+ * Copies a region of the source image into the destination image, both must be in their transfer layout
+ */
+void copyImage(VkCommandBuffer commandBuffer, VkImage src, VkImage dst, VkExtent2D extent, VkOffset2D dstOffset)
+{
+    VkImageCopy region = {};
+    region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.srcSubresource.layerCount = 1;
+    region.dstSubresource = region.srcSubresource;
+    region.dstOffset = { dstOffset.x, dstOffset.y, 0 };
+    region.extent = { extent.width, extent.height, 1 };
+    vkCmdCopyImage(commandBuffer, src, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+}
+
+
+/**
+ * Scales the source image onto the destination image, both must be in their transfer layout
+ */
+void blitImage(VkCommandBuffer commandBuffer, VkImage src, VkExtent2D srcExtent, VkImage dst, VkExtent2D dstExtent, VkFilter filter)
+{
+    VkImageBlit region = {};
+    region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.srcSubresource.layerCount = 1;
+    region.dstSubresource = region.srcSubresource;
+    region.srcOffsets[1] = { static_cast<int32_t>(srcExtent.width), static_cast<int32_t>(srcExtent.height), 1 };
+    region.dstOffsets[1] = { static_cast<int32_t>(dstExtent.width), static_cast<int32_t>(dstExtent.height), 1 };
+    vkCmdBlitImage(commandBuffer, src, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region, filter);
+}
+
+
+/**
+ * Packs a color into the 32 bit fill value of the given format, 16 bit formats hold two pixels
+ */
+uint32_t packColor(VkFormat format, float r, float g, float b)
+{
+    // 10 bits per color channel, opaque alpha
+    if (format == VK_FORMAT_A2R10G10B10_UNORM_PACK32 || format == VK_FORMAT_A2B10G10R10_UNORM_PACK32)
+    {
+        uint32_t r10 = static_cast<uint32_t>(clamp(r, 0.0f, 1.0f) * 1023.0f);
+        uint32_t g10 = static_cast<uint32_t>(clamp(g, 0.0f, 1.0f) * 1023.0f);
+        uint32_t b10 = static_cast<uint32_t>(clamp(b, 0.0f, 1.0f) * 1023.0f);
+        return format == VK_FORMAT_A2R10G10B10_UNORM_PACK32 ? (b10 | g10 << 10 | r10 << 20 | 0xC0000000u) : (r10 | g10 << 10 | b10 << 20 | 0xC0000000u);
+    }
+
+    // Two 16 bit pixels per fill value
+    if (format == VK_FORMAT_R5G6B5_UNORM_PACK16 || format == VK_FORMAT_B5G6R5_UNORM_PACK16)
+    {
+        uint32_t r5 = static_cast<uint32_t>(clamp(r, 0.0f, 1.0f) * 31.0f);
+        uint32_t g6 = static_cast<uint32_t>(clamp(g, 0.0f, 1.0f) * 63.0f);
+        uint32_t b5 = static_cast<uint32_t>(clamp(b, 0.0f, 1.0f) * 31.0f);
+        uint32_t pixel = format == VK_FORMAT_R5G6B5_UNORM_PACK16 ? (b5 | g6 << 5 | r5 << 11) : (r5 | g6 << 5 | b5 << 11);
+        return pixel | pixel << 16;
+    }
+
+    bool bgra = format == VK_FORMAT_B8G8R8A8_SRGB || format == VK_FORMAT_B8G8R8A8_UNORM;
+    uint32_t cr = static_cast<uint32_t>(clamp(r, 0.0f, 1.0f) * 255.0f);
+    uint32_t cg = static_cast<uint32_t>(clamp(g, 0.0f, 1.0f) * 255.0f);
+    uint32_t cb = static_cast<uint32_t>(clamp(b, 0.0f, 1.0f) * 255.0f);
+    return bgra ? (cb | cg << 8 | cr << 16 | 0xFF000000u) : (cr | cg << 8 | cb << 16 | 0xFF000000u);
+}
+
+
+/**
+ * Records the compute work of a frame: fills the highlight buffer with the highlight color
+ */
+void recordCompute(VkCommandBuffer commandBuffer, HighlightCompute& highlight, VkBuffer highlightBuffer, VkDeviceAddress highlightAddress, VkFormat format)
+{
+    float t = static_cast<float>(SDL_GetTicks() % 4000) / 4000.0f;
+    highlight.record(commandBuffer, highlightBuffer, highlightAddress, gHighlightSize * gHighlightSize * 4, packColor(format, 1.0f, 1.0f - t, 0.2f));
+}
+
+
+/**
+ * Declares the passes that render a single window into the render graph of a frame.
+ * The background and highlight are rendered into intermediate images that are composited into the swap chain image,
+ * their lifetimes don't overlap so the graph places them in the same memory.
+ * The highlight pixels are produced by the compute queue, the submission must wait on that work at the transfer stage.
+ * The background is rendered at the scene extent and upscaled to the swap chain image, the highlight is composited
+ * at native resolution. At native resolution the background is rendered in the render pass of the window instead,
+ * directly into the swap chain image: its multisample color and depth only exist within the pass.
+ * The highlight is centered, moved by the given offset and kept inside the image.
+ * Without transfer destination usage the swap chain image is only drawn by the render pass, at native resolution and
+ * without highlight.
+ * The image is released to the present family when that family owns the image while presenting,
+ * VK_QUEUE_FAMILY_IGNORED when it doesn't need to be transferred.
+ * @return the imported swap chain image
+ */
+RenderGraphResource declareWindow(RenderGraph& graph, VkImage image, VkFormat format, VkExtent2D extent, VkExtent2D sceneExtent, VkFilter filter,
+    VkRenderPass renderPass, VkFramebuffer framebuffer, bool transferDst, VkBuffer highlightBuffer, VkOffset2D highlightOffset, uint32_t presentFamily)
+{
+    assert(transferDst || (framebuffer != VK_NULL_HANDLE && sceneExtent.width == extent.width && sceneExtent.height == extent.height));
+    RenderGraphImageDescription color_desc;
+    color_desc.mFormat = format;
+    color_desc.mExtent = extent;
+    RenderGraphResource swap_image = graph.importImage("swapchain", image, color_desc);
+
+    // Slowly cycle the clear color
+    float t = static_cast<float>(SDL_GetTicks() % 4000) / 4000.0f;
+    VkClearColorValue background_color = { { t, 0.2f, 1.0f - t, 1.0f } };
+
+    unsigned int pass = 0;
+    bool scaled = sceneExtent.width != extent.width || sceneExtent.height != extent.height;
+    if (!scaled && framebuffer != VK_NULL_HANDLE)
+    {
+        // Clear values are indexed by attachment: color, depth or resolve, resolve, see SwapChain::setAttachments()
+        pass = graph.addPass("background", [renderPass, framebuffer, extent, background_color](VkCommandBuffer cmd, const RenderGraph&)
+        {
+            VkClearValue clear_values[3] = {};
+            clear_values[0].color = background_color;
+            clear_values[1].depthStencil = { 1.0f, 0 };
+            clear_values[2].color = background_color;
+
+            VkRenderPassBeginInfo begin_info = {};
+            begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            begin_info.renderPass = renderPass;
+            begin_info.framebuffer = framebuffer;
+            begin_info.renderArea.extent = extent;
+            begin_info.clearValueCount = 3;
+            begin_info.pClearValues = clear_values;
+            vkCmdBeginRenderPass(cmd, &begin_info, VK_SUBPASS_CONTENTS_INLINE);
+            vkCmdEndRenderPass(cmd);
+        });
+        graph.write(pass, swap_image, ERenderGraphAccess::ColorAttachment);
+    }
+    else
+    {
+        RenderGraphImageDescription scene_desc = color_desc;
+        scene_desc.mExtent = sceneExtent;
+        RenderGraphResource background = graph.createImage("background", scene_desc);
+
+        pass = graph.addPass("background", [background, background_color](VkCommandBuffer cmd, const RenderGraph& g)
+        {
+            clearImage(cmd, g.getImage(background), background_color);
+        });
+        graph.write(pass, background, ERenderGraphAccess::TransferDst);
+
+        // Only scale when the resolution differs, a blit is more expensive than a copy
+        pass = graph.addPass(scaled ? "upscale background" : "compose background", [background, swap_image, extent, sceneExtent, filter, scaled](VkCommandBuffer cmd, const RenderGraph& g)
+        {
+            if (scaled)
+                blitImage(cmd, g.getImage(background), sceneExtent, g.getImage(swap_image), extent, filter);
+            else
+                copyImage(cmd, g.getImage(background), g.getImage(swap_image), extent, { 0, 0 });
+        });
+        graph.read(pass, background, ERenderGraphAccess::TransferSrc);
+        graph.write(pass, swap_image, ERenderGraphAccess::TransferDst);
+    }
+
+    if (!transferDst)
+    {
+        graph.addOutput(swap_image, ERenderGraphAccess::Present, presentFamily);
+        return swap_image;
+    }
+
+    RenderGraphImageDescription highlight_desc = color_desc;
+    highlight_desc.mExtent = { std::min(extent.width, gHighlightSize), std::min(extent.height, gHighlightSize) };
+    RenderGraphResource highlight = graph.createImage("highlight", highlight_desc);
+    pass = graph.addPass("highlight", [highlight, highlight_desc, highlightBuffer](VkCommandBuffer cmd, const RenderGraph& g)
+    {
+        VkBufferImageCopy region = {};
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent = { highlight_desc.mExtent.width, highlight_desc.mExtent.height, 1 };
+        vkCmdCopyBufferToImage(cmd, highlightBuffer, g.getImage(highlight), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+    });
+    graph.write(pass, highlight, ERenderGraphAccess::TransferDst);
+
+    int32_t max_x = static_cast<int32_t>(extent.width - highlight_desc.mExtent.width);
+    int32_t max_y = static_cast<int32_t>(extent.height - highlight_desc.mExtent.height);
+    VkOffset2D position = { clamp<int32_t>(max_x / 2 + highlightOffset.x, 0, max_x), clamp<int32_t>(max_y / 2 + highlightOffset.y, 0, max_y) };
+    pass = graph.addPass("compose highlight", [highlight, swap_image, position, highlight_desc](VkCommandBuffer cmd, const RenderGraph& g)
+    {
+        copyImage(cmd, g.getImage(highlight), g.getImage(swap_image), highlight_desc.mExtent, position);
+    });
+    graph.read(pass, highlight, ERenderGraphAccess::TransferSrc);
+    graph.write(pass, swap_image, ERenderGraphAccess::TransferDst);
+
+    graph.addOutput(swap_image, ERenderGraphAccess::Present, presentFamily);
+    return swap_image;
+}
+
+
+/**
+ * Declares the copy of a finished swap chain image into a capture buffer.
+ * The pass doesn't contribute to any output of the graph and is kept explicitly.
+ */
+void declareCapture(RenderGraph& graph, RenderGraphResource swapImage, const FrameCapture& capture, int slot)
+{
+    unsigned int pass = graph.addPass("capture", [swapImage, &capture, slot](VkCommandBuffer cmd, const RenderGraph& g)
+    {
+        capture.recordCopy(cmd, g.getImage(swapImage), slot);
+    });
+    graph.read(pass, swapImage, ERenderGraphAccess::TransferSrc);
+    graph.keepPass(pass);
+}
+
+
+/**
+ * Recreates the swap chain and fetches the new image handles, called when the current chain is out of date.
+ * The state tracker stops tracking the old images and starts tracking the new ones.
+ * Only waits for the device when the old swap chain can't be retired, see SwapChain::create()
+ */
+bool recreateSwapChain(VkPhysicalDevice physicalDevice, VkDevice device, SurfaceInfoCache& surfaceCache, const PresentQueue& presentQueue,
+    Output& ioOutput, ResourceStateTracker& stateTracker)
+{
+    if (!ioOutput.mSwapChain.canRetire())
+        vkDeviceWaitIdle(device);
+    ioOutput.mResizePending = false;
+    for (const auto& image : ioOutput.mSwapChain.getImages())
+        stateTracker.forgetImage(image.mImage);
+
+    if (!createSwapChain(physicalDevice, device, surfaceCache, presentQueue, ioOutput))
+        return false;
+
+    for (const auto& image : ioOutput.mSwapChain.getImages())
+        stateTracker.registerImage(image.mImage, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+    return true;
+}
+
+
+/**
+ * Hands back images that were acquired for a frame that won't be presented
+ */
+void releaseImages(std::vector<Output>& outputs)
+{
+    for (auto& output : outputs)
+        output.mSwapChain.releaseImages();
+}
+
+
+/**
+ * Abandons a frame after images were acquired for it, the frame isn't submitted or presented.
+ * Signaled semaphores can't be signaled again before they're waited on: an empty submission waits on the acquire
+ * and compute semaphores and signals the frame fence, after which the acquired images are released.
+ * When that submission fails as well the fence is recreated signaled, the next wait on the frame must not block.
+ */
+void abandonFrame(VkDevice device, VkQueue queue, const std::pmr::vector<VkSemaphore>& waitSemaphores, FrameResources& ioFrame,
+    std::vector<Output>& ioOutputs)
+{
+    std::pmr::vector<VkPipelineStageFlags> wait_stages(waitSemaphores.size(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, &ioFrame.mArena);
+    VkSubmitInfo submit_info = {};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+    submit_info.pWaitSemaphores = waitSemaphores.data();
+    submit_info.pWaitDstStageMask = wait_stages.data();
+    vkResetFences(device, 1, &ioFrame.mFence);
+    if (vkQueueSubmit(queue, 1, &submit_info, ioFrame.mFence) != VK_SUCCESS)
+    {
+        vkDestroyFence(device, ioFrame.mFence, getHostCallbacks(EHostScope::Device));
+        ioFrame.mFence = VK_NULL_HANDLE;
+        VkFenceCreateInfo fence_info = {};
+        fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+        if (vkCreateFence(device, &fence_info, getHostCallbacks(EHostScope::Device), &ioFrame.mFence) != VK_SUCCESS)
+            LOG_ERROR(Render) << "unable to restore frame fence";
+    }
+    releaseImages(ioOutputs);
+}
+
+
+/**
+ * Renders and presents a single frame to all windows using the resources of the given frame in flight.
+ * Waits for the previous use of those resources to complete first, after which
+ * all descriptor sets allocated for that frame are released in bulk.
+ * All windows are recorded into one command buffer and presented with a single present call.
+ * When the present family owns the images while presenting, the images are released after rendering and acquired
+ * by the present queue.
+ * Windows that scale their presents are only marked for recreation when their swap chain is suboptimal.
+ * Frames of the captured window are copied to a capture buffer, copies of this frame in flight completed and are written.
+ * Memory budgets are checked once the frame in flight is released, streamable buffers are evicted under pressure.
+ * @return if the frame was rendered or windows were skipped because their swap chain had to be recreated
+ */
+bool renderFrame(VkPhysicalDevice physicalDevice, VkDevice device, VkQueue queue, SurfaceInfoCache& surfaceCache, PresentQueue& presentQueue,
+    FrameResources& frame, unsigned int frameIndex, DescriptorAllocator& descriptorAllocator, HighlightCompute& highlight,
+    ResourceStateTracker& stateTracker, RenderGraph& renderGraph, AsyncCompute& asyncCompute, const DynamicResolution& resolution, FrameCapture& capture,
+    ResidencyManager& residency, std::vector<Output>& ioOutputs, FrameTimings& outTimings)
+{
+    // Wait until the GPU is done with this frame, after which its resources can be reused
+    // The frame waited on the compute work of the same frame, which is therefore also complete
+    auto wait_start = std::chrono::steady_clock::now();
+    vkWaitForFences(device, 1, &frame.mFence, VK_TRUE, UINT64_MAX);
+    outTimings.mFenceTime = getElapsedMs(wait_start);
+    frame.mArena.reset();
+    descriptorAllocator.beginFrame(frameIndex);
+    asyncCompute.collect(frameIndex);
+    presentQueue.collect(frameIndex);
+    capture.collect(frameIndex);
+    residency.update();
+    for (auto& output : ioOutputs)
+        output.mSwapChain.collect();
+
+    // Acquire an image of every window, a window with an out of date swap chain skips this frame
+    // Time spent in acquire tells if the presentation engine holds on to the images
+    // Lists of this frame live in its arena, reserved up front so they never grow
+    std::pmr::memory_resource* arena = &frame.mArena;
+    std::pmr::vector<unsigned int> presented(arena);
+    std::pmr::vector<VkSwapchainKHR> swap_chains(arena);
+    std::pmr::vector<uint32_t> image_indices(arena);
+    std::pmr::vector<VkSemaphore> wait_semaphores(arena);
+    std::pmr::vector<VkSemaphore> signal_semaphores(arena);
+    std::pmr::vector<VkSemaphore> transfer_semaphores(arena);
+    presented.reserve(ioOutputs.size());
+    swap_chains.reserve(ioOutputs.size());
+    image_indices.reserve(ioOutputs.size());
+    wait_semaphores.reserve(ioOutputs.size() + 1);
+    signal_semaphores.reserve(ioOutputs.size());
+    transfer_semaphores.reserve(ioOutputs.size());
+    outTimings.mAcquireTime = 0.0;
+    for (unsigned int i = 0; i < ioOutputs.size(); i++)
+    {
+        uint32_t image_index(0);
+        auto acquire_start = std::chrono::steady_clock::now();
+        VkResult res = ioOutputs[i].mSwapChain.acquire(frame.mImageAvailable[i], image_index);
+        outTimings.mAcquireTime += getElapsedMs(acquire_start);
+        if (res == VK_ERROR_OUT_OF_DATE_KHR)
+        {
+            if (!recreateSwapChain(physicalDevice, device, surfaceCache, presentQueue, ioOutputs[i], stateTracker))
+            {
+                abandonFrame(device, queue, wait_semaphores, frame, ioOutputs);
+                return false;
+            }
+            continue;
+        }
+        if (res != VK_SUCCESS && res != VK_SUBOPTIMAL_KHR)
+        {
+            LOG_ERROR(Render) << "unable to acquire swap chain image";
+            abandonFrame(device, queue, wait_semaphores, frame, ioOutputs);
+            return false;
+        }
+        presented.emplace_back(i);
+        swap_chains.emplace_back(ioOutputs[i].mSwapChain.getHandle());
+        image_indices.emplace_back(image_index);
+        wait_semaphores.emplace_back(frame.mImageAvailable[i]);
+        signal_semaphores.emplace_back(ioOutputs[i].mSwapChain.getImage(image_index).mRenderFinished);
+        transfer_semaphores.emplace_back(ioOutputs[i].mSwapChain.getImage(image_index).mTransferred);
+    }
+
+    if (presented.empty())
+        return true;
+
+    // Compute work only depends on resources of this frame, it can start while graphics is still busy with the previous frame
+    // The highlight is shared by all windows and packed in the format of the first one
+    VkFormat format = ioOutputs[presented[0]].mSwapChain.getFormat();
+    // The highlight buffer is streamable, use() restores it when it was evicted and returns its current range
+    VkBuffer highlight_buffer = residency.use(frame.mHighlightBuffer);
+    if (highlight_buffer == VK_NULL_HANDLE)
+    {
+        LOG_ERROR(Render) << "unable to restore highlight buffer";
+        abandonFrame(device, queue, wait_semaphores, frame, ioOutputs);
+        return false;
+    }
+    // The address can change whenever the buffer moved, it's only valid for this frame
+    VkDeviceAddress highlight_address = highlight.isAddressed() ? residency.getAddress(frame.mHighlightBuffer) : 0;
+    if (highlight.isAddressed() && highlight_address == 0)
+    {
+        LOG_ERROR(Render) << "unable to query highlight buffer address";
+        abandonFrame(device, queue, wait_semaphores, frame, ioOutputs);
+        return false;
+    }
+    if (!asyncCompute.submit(frameIndex, [&highlight, highlight_buffer, highlight_address, format](VkCommandBuffer cmd) { recordCompute(cmd, highlight, highlight_buffer, highlight_address, format); }))
+    {
+        abandonFrame(device, queue, wait_semaphores, frame, ioOutputs);
+        return false;
+    }
+
+    // The images are handed over by the acquire semaphores, the compute results by the compute semaphore
+    // All of them block the transfer stage of the submission below
+    wait_semaphores.emplace_back(asyncCompute.getSemaphore(frameIndex));
+    std::pmr::vector<VkPipelineStageFlags> wait_stages(wait_semaphores.size(), VK_PIPELINE_STAGE_TRANSFER_BIT, arena);
+
+    vkResetCommandPool(device, frame.mCommandPool, 0);
+
+    VkCommandBufferBeginInfo begin_info = {};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(frame.mCommandBuffer, &begin_info);
+    asyncCompute.beginGraphics(frame.mCommandBuffer, frameIndex);
+
+    // Every window is an output of the same graph, their intermediate images can share memory
+    renderGraph.reset();
+    uint32_t present_family = presentQueue.needsTransfer() ? presentQueue.getFamily() : VK_QUEUE_FAMILY_IGNORED;
+    for (unsigned int i = 0; i < presented.size(); i++)
+    {
+        const Output& output = ioOutputs[presented[i]];
+        const SwapChainImage& swap_chain_image = output.mSwapChain.getImage(image_indices[i]);
+        VkImage image = swap_chain_image.mImage;
+        stateTracker.resetImage(image, VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_NONE_KHR);
+
+        VkExtent2D extent = output.mSwapChain.getExtent();
+        VkExtent2D scene_extent = output.mScalable ? resolution.getExtent(extent) : extent;
+        RenderGraphResource swap_image = declareWindow(renderGraph, image, output.mSwapChain.getFormat(), extent, scene_extent,
+            output.mUpscaleFilter, output.mRenderPass, swap_chain_image.mFramebuffer, output.mTransferDst, highlight_buffer, output.mHighlightOffset, present_family);
+
+        // Frames are skipped when the writer falls behind, rendering never waits for it
+        int capture_slot = output.mCapturable ? capture.beginCapture(frameIndex, extent) : -1;
+        if (capture_slot >= 0)
+            declareCapture(renderGraph, swap_image, capture, capture_slot);
+    }
+    if (!renderGraph.compile())
+    {
+        abandonFrame(device, queue, wait_semaphores, frame, ioOutputs);
+        return false;
+    }
+    renderGraph.execute(frame.mCommandBuffer);
+
+    asyncCompute.endGraphics(frame.mCommandBuffer, frameIndex);
+    presentQueue.endGraphics(frame.mCommandBuffer, frameIndex);
+    vkEndCommandBuffer(frame.mCommandBuffer);
+
+    // The semaphores of an image can only be signaled again after its previous present completed
+    std::pmr::vector<VkFence> present_fences(arena);
+    present_fences.reserve(presented.size());
+    for (unsigned int i = 0; i < presented.size(); i++)
+        present_fences.emplace_back(ioOutputs[presented[i]].mSwapChain.preparePresent(image_indices[i]));
+
+    VkSubmitInfo submit_info = {};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.waitSemaphoreCount = static_cast<uint32_t>(wait_semaphores.size());
+    submit_info.pWaitSemaphores = wait_semaphores.data();
+    submit_info.pWaitDstStageMask = wait_stages.data();
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &frame.mCommandBuffer;
+    submit_info.signalSemaphoreCount = static_cast<uint32_t>(signal_semaphores.size());
+    submit_info.pSignalSemaphores = signal_semaphores.data();
+
+    // Only reset the fence right before the work that signals it is submitted
+    vkResetFences(device, 1, &frame.mFence);
+    if (vkQueueSubmit(queue, 1, &submit_info, frame.mFence) != VK_SUCCESS)
     {
-        std::cout << "unable to get number of images in swap chain\n";
+        LOG_ERROR(Render) << "unable to submit frame";
+        abandonFrame(device, queue, wait_semaphores, frame, ioOutputs);
         return false;
     }
 
-    outImageHandles.clear();
-    outImageHandles.resize(image_count);
-    if (vkGetSwapchainImagesKHR(device, chain, &image_count, outImageHandles.data()) != VK_SUCCESS)
+    // Present all windows at once, the returned value is the most severe result of all swap chains
+    // The individual results tell which swap chains have to be recreated
+    // Every image has its own render finished semaphore, it's only reused after the image is acquired again
+    // The present queue acquires ownership of the images first when they were released by the graph
+    std::pmr::vector<VkResult> results(swap_chains.size(), VK_SUCCESS, arena);
+    VkPresentInfoKHR present_info = {};
+    present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+    present_info.waitSemaphoreCount = static_cast<uint32_t>(signal_semaphores.size());
+    present_info.pWaitSemaphores = signal_semaphores.data();
+    present_info.swapchainCount = static_cast<uint32_t>(swap_chains.size());
+    present_info.pSwapchains = swap_chains.data();
+    present_info.pImageIndices = image_indices.data();
+    present_info.pResults = results.data();
+
+    // Present fences tell when the semaphores and retired swap chains are no longer in use
+    VkSwapchainPresentFenceInfoEXT fence_info = {};
+    fence_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_PRESENT_FENCE_INFO_EXT;
+    fence_info.swapchainCount = static_cast<uint32_t>(present_fences.size());
+    fence_info.pFences = present_fences.data();
+    if (present_fences[0] != VK_NULL_HANDLE)
+        present_info.pNext = &fence_info;
+    for (unsigned int i = 0; i < presented.size(); i++)
+        ioOutputs[presented[i]].mSwapChain.beginPresent(image_indices[i]);
+    VkResult present_result = presentQueue.present(frameIndex, stateTracker, transfer_semaphores, present_info);
+    if (present_result != VK_SUCCESS && present_result != VK_SUBOPTIMAL_KHR && present_result != VK_ERROR_OUT_OF_DATE_KHR)
     {
-        std::cout << "unable to get image handles from swap chain\n";
+        LOG_ERROR(Render) << "unable to present frame: " << present_result;
         return false;
     }
+    for (unsigned int i = 0; i < presented.size(); i++)
+    {
+        // A scaled present still looks right, recreate once the window stopped resizing
+        Output& output = ioOutputs[presented[i]];
+        if (results[i] == VK_SUBOPTIMAL_KHR && output.mPresentScaling)
+        {
+            if (!output.mResizePending)
+            {
+                output.mResizePending = true;
+                output.mResizeTime = std::chrono::steady_clock::now();
+            }
+            continue;
+        }
+
+        if (results[i] == VK_ERROR_OUT_OF_DATE_KHR || results[i] == VK_SUBOPTIMAL_KHR)
+        {
+            if (!recreateSwapChain(physicalDevice, device, surfaceCache, presentQueue, output, stateTracker))
+                return false;
+            continue;
+        }
+        if (results[i] != VK_SUCCESS)
+        {
+            LOG_ERROR(Render) << "unable to present swap chain image";
+            return false;
+        }
+    }
     return true;
 }
 
 
 /**
- * Create a vulkan window
+ * Waits briefly for OS events and posts them to the render thread, bursts are coalesced into a few render events.
+ * Runs on the main thread, SDL requires events to be pumped on the thread that created the windows.
+ * Events that didn't fit in the queue are posted again on the next call.
+ */
+void pumpEvents(EventQueue& queue)
+{
+    SDL_Event event;
+    if (!SDL_WaitEventTimeout(&event, gEventWaitTime))
+    {
+        queue.flush();
+        return;
+    }
+
+    do
+    {
+        RenderEvent render_event;
+        if (event.type == SDL_QUIT || (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_CLOSE))
+        {
+            // Closing any window stops the application, SDL_QUIT is only sent when the last window is closed
+            render_event.mType = ERenderEventType::Quit;
+            queue.post(render_event);
+        }
+        else if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_DISPLAY_CHANGED)
+        {
+            render_event.mType = ERenderEventType::DisplayChanged;
+            render_event.mWindowID = event.window.windowID;
+            queue.post(render_event);
+        }
+        else if (event.type == SDL_DISPLAYEVENT)
+        {
+            render_event.mType = ERenderEventType::DisplaysChanged;
+            queue.post(render_event);
+        }
+        else if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+        {
+            // The event holds the size in screen coordinates, swap chains need pixels
+            SDL_Window* window = SDL_GetWindowFromID(event.window.windowID);
+            if (window == nullptr)
+                continue;
+            render_event.mType = ERenderEventType::Resize;
+            render_event.mWindowID = event.window.windowID;
+            SDL_Vulkan_GetDrawableSize(window, &render_event.mX, &render_event.mY);
+            queue.post(render_event);
+        }
+        else if (event.type == SDL_MOUSEMOTION && (event.motion.state & SDL_BUTTON_LMASK) != 0)
+        {
+            render_event.mType = ERenderEventType::MouseDrag;
+            render_event.mWindowID = event.motion.windowID;
+            render_event.mX = event.motion.xrel;
+            render_event.mY = event.motion.yrel;
+            queue.post(render_event);
+        }
+    } while (SDL_PollEvent(&event));
+    queue.flush();
+}
+
+
+/**
+ * Applies the events posted by the event thread since the last frame, runs on the render thread.
+ * Supported formats and present modes can change when a window moves to another display or displays change.
+ * Scaled swap chains are recreated when the window stopped resizing, others when their swap chain is out of date.
+ * @param ioRun set to false when the application should stop
+ */
+void applyEvents(EventQueue& queue, SurfaceInfoCache& surfaceCache, std::vector<Output>& ioOutputs, bool& ioRun)
+{
+    RenderEvent event;
+    while (queue.pop(event))
+    {
+        if (event.mType == ERenderEventType::Quit)
+            ioRun = false;
+        else if (event.mType == ERenderEventType::DisplaysChanged)
+            surfaceCache.invalidateAll();
+
+        for (auto& output : ioOutputs)
+        {
+            if (output.mWindowID != event.mWindowID)
+                continue;
+
+            switch (event.mType)
+            {
+            case ERenderEventType::DisplayChanged:
+                surfaceCache.invalidate(output.mSurface);
+                break;
+            case ERenderEventType::Resize:
+                output.mDrawableSize = { static_cast<uint32_t>(event.mX), static_cast<uint32_t>(event.mY) };
+                if (output.mPresentScaling)
+                {
+                    output.mResizePending = true;
+                    output.mResizeTime = std::chrono::steady_clock::now();
+                }
+                break;
+            case ERenderEventType::MouseDrag:
+            {
+                int32_t range_x = static_cast<int32_t>(output.mDrawableSize.width / 2);
+                int32_t range_y = static_cast<int32_t>(output.mDrawableSize.height / 2);
+                output.mHighlightOffset.x = clamp<int32_t>(output.mHighlightOffset.x + event.mX, -range_x, range_x);
+                output.mHighlightOffset.y = clamp<int32_t>(output.mHighlightOffset.y + event.mY, -range_y, range_y);
+                break;
+            }
+            default:
+                break;
+            }
+        }
+    }
+}
+
+
+/**
+ * Create a vulkan window, every window is centered on its own display when there are enough displays
+ * @param index index of the window
  */
-SDL_Window* createWindow()
+SDL_Window* createWindow(unsigned int index)
 {
-    return SDL_CreateWindow(gAppName, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, gWindowWidth, gWindowHeight, SDL_WINDOW_VULKAN | SDL_WINDOW_SHOWN);
+    int display_count = SDL_GetNumVideoDisplays();
+    int display = display_count > 0 ? static_cast<int>(index) % display_count : 0;
+    int position = static_cast<int>(index) < display_count ? SDL_WINDOWPOS_CENTERED_DISPLAY(display) : SDL_WINDOWPOS_UNDEFINED_DISPLAY(display);
+    return SDL_CreateWindow(gAppName, position, position, gWindowWidth, gWindowHeight,
+        SDL_WINDOW_VULKAN | SDL_WINDOW_SHOWN | SDL_WINDOW_ALLOW_HIGHDPI);
 }
 
 
 /**
  *  Destroys the vulkan instance
  */
-void quit(VkInstance instance, VkDevice device, VkDebugReportCallbackEXT callback, VkSwapchainKHR chain, VkSurfaceKHR presentation_surface)
+void quit(VkInstance instance, VkDevice device, VkDebugReportCallbackEXT callback, std::vector<Output>& outputs,
+    PipelineRegistry& pipelineRegistry, DescriptorAllocator& descriptorAllocator, HighlightCompute& highlight, RenderGraph& renderGraph, AsyncCompute& asyncCompute,
+    PresentQueue& presentQueue, ResidencyManager& residency, UploadService& uploads, std::vector<FrameResources>& frames)
 {
-    vkDestroySwapchainKHR(device, chain, nullptr);
-    vkDestroyDevice(device, nullptr);
-    destroyDebugReportCallbackEXT(instance, callback, nullptr);
-    vkDestroySurfaceKHR(instance, presentation_surface, nullptr);
-    vkDestroyInstance(instance, nullptr);
+    renderGraph.destroy();
+    residency.destroy();
+    uploads.destroy();
+    asyncCompute.destroy();
+    presentQueue.destroy();
+    for (auto& frame : frames)
+        destroyFrameResources(device, frame);
+    descriptorAllocator.destroy();
+    pipelineRegistry.destroy();
+    highlight.destroy();
+    for (auto& output : outputs)
+        destroyOutput(instance, device, output);
+    vkDestroyDevice(device, getHostCallbacks(EHostScope::Device));
+    destroyDebugReportCallbackEXT(instance, callback, getHostCallbacks(EHostScope::Instance));
+    vkDestroyInstance(instance, getHostCallbacks(EHostScope::Instance));
     SDL_Quit();
 }
 
 
 int main(int argc, char *argv[])
 {
+    // Frames of the first window are captured with --capture <path>, a .y4m extension writes video, raw frames otherwise
+    // --benchmark-uploads measures the throughput of both upload paths before rendering starts
+    // --refresh-capabilities ignores the capability snapshot of a previous run
+    // --verbose prints debug records such as every available layer and extension, --quiet only warnings and errors
+    // --log <category> only prints records of the given categories, can be repeated
+    std::string capture_path;
+    bool benchmark_uploads = false;
+    bool refresh_capabilities = false;
+    ELogLevel log_level = gLogLevel;
+    uint32_t log_categories = 0;
+    std::vector<std::string> unknown_categories;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::string(argv[i]) == "--capture" && i + 1 < argc)
+            capture_path = argv[++i];
+        else if (std::string(argv[i]) == "--benchmark-uploads")
+            benchmark_uploads = true;
+        else if (std::string(argv[i]) == "--refresh-capabilities")
+            refresh_capabilities = true;
+        else if (std::string(argv[i]) == "--verbose")
+            log_level = ELogLevel::Debug;
+        else if (std::string(argv[i]) == "--quiet")
+            log_level = ELogLevel::Warning;
+        else if (std::string(argv[i]) == "--log" && i + 1 < argc)
+        {
+            ELogCategory category;
+            if (findLogCategory(argv[++i], category))
+                log_categories |= 1u << static_cast<uint32_t>(category);
+            else
+                unknown_categories.emplace_back(argv[i]);
+        }
+    }
+
+    // Records are printed by a background thread from here on
+    getLogger().init(log_level, log_categories != 0 ? log_categories : ~0u);
+    for (const auto& category : unknown_categories)
+        LOG_WARNING(General) << "unknown log category: " << category;
+    if (log_level == ELogLevel::Debug && !isLogCompiled(ELogLevel::Debug))
+        LOG_WARNING(General) << "debug records are compiled out of this build";
+    bool y4m = capture_path.size() > 4 && capture_path.compare(capture_path.size() - 4, 4, ".y4m") == 0;
+
+    // Temporary lists of the setup code are allocated from a single buffer, every step rewinds it when done
+    LinearArena setup_arena;
+    setup_arena.init(gSetupArenaSize);
+
     // Initialize SDL
     if (!initSDL())
         return -1;
 
-    // Create vulkan compatible window
-        SDL_Window* window {createWindow()};
-        if (!window){
-        SDL_Quit();
-        return -1;
+    // Create vulkan compatible windows, all of them are rendered by the same device
+    std::vector<Output> outputs(gWindowCount);
+    for (unsigned int i = 0; i < gWindowCount; i++)
+    {
+        outputs[i].mCaptured = !capture_path.empty() && i == gCaptureWindow;
+        outputs[i].mWindow = createWindow(i);
+        if (outputs[i].mWindow == nullptr)
+        {
+            SDL_Quit();
+            return -1;
         }
 
+        // Later sizes are reported through resize events
+        int drawable_width(0), drawable_height(0);
+        SDL_Vulkan_GetDrawableSize(outputs[i].mWindow, &drawable_width, &drawable_height);
+        outputs[i].mWindowID = SDL_GetWindowID(outputs[i].mWindow);
+        outputs[i].mDrawableSize = { static_cast<uint32_t>(drawable_width), static_cast<uint32_t>(drawable_height) };
+    }
+
+    // Layers, extensions and queue families of a previous run are reused while the loader and driver are unchanged
+    CapabilityCache capabilities;
+    capabilities.init(gCapabilityCacheFile, refresh_capabilities);
+
     // Get available vulkan extensions, necessary for interfacing with native window
     // SDL takes care of this call and returns, next to the default VK_KHR_surface a platform specific extension
     // When initializing the vulkan instance these extensions have to be enabled in order to create a valid
     // surface later on.
     std::vector<std::string> found_extensions;
-    if (!getAvailableVulkanExtensions(window, found_extensions))
+    if (!getAvailableVulkanExtensions(outputs[0].mWindow, capabilities, found_extensions))
         return -1;
 
     // Get available vulkan layer extensions, notify when not all could be found
     std::vector<std::string> found_layers;
-    if (!getAvailableVulkanLayers(found_layers))
+    if (!getAvailableVulkanLayers(capabilities, found_layers))
         return -1;
 
     // Warn when not all requested layers could be found
     if (found_layers.size() != getRequestedLayerNames().size())
-        std::cout << "warning! not all requested layers could be found!\n";
+        LOG_WARNING(Instance) << "not all requested layers could be found!";
 
     // Create Vulkan Instance
     VkInstance instance;
-    if (!createVulkanInstance(found_layers, found_extensions, instance))
+    uint32_t api_version(VK_API_VERSION_1_0);
+    if (!createVulkanInstance(found_layers, found_extensions, setup_arena, instance, api_version))
         return -1;
 
+    // Devices in the capability snapshot are identified by their UUID, queried through properties2 when enabled
+    bool properties2 = std::find(found_extensions.begin(), found_extensions.end(), VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) != found_extensions.end();
+    capabilities.setInstance(instance, properties2);
+
     // Vulkan messaging callback
     VkDebugReportCallbackEXT callback;
     setupDebugCallback(instance, callback);
@@ -866,55 +2153,376 @@ int main(int argc, char *argv[])
     // Select GPU after succsessful creation of a vulkan instance (jeeeej no global states anymore)
     VkPhysicalDevice gpu;
     unsigned int graphics_queue_index(-1);
-    if (!selectGPU(instance, gpu, graphics_queue_index))
+    if (!selectGPU(instance, capabilities, gpu, graphics_queue_index))
+        return -1;
+
+    // Select the queue family compute work is submitted to, ideally one that runs next to graphics
+    unsigned int compute_queue_index(0);
+    selectComputeQueueFamily(gpu, capabilities, graphics_queue_index, compute_queue_index);
+
+    // Create the surfaces we want to render to, associated with the windows we created before
+    for (auto& output : outputs)
+    {
+        if (!createSurface(output.mWindow, instance, output.mSurface))
+            return -1;
+    }
+
+    // Select the queue family all surfaces are presented from, ideally the graphics family
+    unsigned int present_queue_index(0);
+    if (!selectPresentQueueFamily(gpu, capabilities, outputs, graphics_queue_index, present_queue_index))
         return -1;
 
     // Create a logical device that interfaces with the physical device
+    // Features are negotiated once, setup code branches on the outcome instead of checking support where a feature is used
+    DeviceFeatureBuilder feature_builder;
+    requestDeviceFeatures(feature_builder);
+    bool memory_budget = false;
     VkDevice device;
-    if (!createLogicalDevice(gpu, graphics_queue_index, found_layers, device))
+    if (!createLogicalDevice(instance, api_version, found_extensions, gpu, graphics_queue_index, compute_queue_index, present_queue_index, found_layers,
+        capabilities, setup_arena, feature_builder, device, memory_budget))
+        return -1;
+    const DeviceFeatures& device_features = feature_builder.getFeatures();
+
+    // Store what was queried, the next launch skips those queries
+    const CapabilityCacheStats& capability_stats = capabilities.getStats();
+    LOG_INFO(Device) << "capabilities: " << (capability_stats.mInstanceCached ? "instance cached" : "instance queried") << ", " <<
+        capability_stats.mDeviceHits << " device lookups from snapshot, " << capability_stats.mDeviceMisses << " queried";
+    capabilities.save();
+    LOG_INFO(Device) << "swap chain maintenance: " << (device_features.mSwapchainMaintenance ? "present fences and scaling" : "unavailable, recreation waits for the device");
+    LOG_INFO(Device) << "buffer device address: " << (device_features.mBufferDeviceAddress ? "enabled, the highlight buffer is passed as push constant pointer" : "unavailable, the highlight buffer is bound through a descriptor");
+
+    // Pipelines are shared and compiled in the background, the cache is persisted between runs
+    PipelineRegistry pipeline_registry;
+    if (!pipeline_registry.init(device, gPipelineCacheFile, 0))
+        return -1;
+
+    // Fetch the queue we want to submit the actual commands to
+    VkQueue graphics_queue;
+    getDeviceQueue(device, graphics_queue_index, graphics_queue);
+
+    VkQueue compute_queue;
+    getDeviceQueue(device, compute_queue_index, compute_queue);
+
+    // Images are presented from the present queue, when it differs from the graphics queue the sharing mode
+    // that performs best is selected at runtime
+    VkQueue present_queue_handle;
+    getDeviceQueue(device, present_queue_index, present_queue_handle);
+    PresentQueue present_queue;
+    if (!present_queue.init(gpu, capabilities.getDevice(gpu).mQueueFamilies, device, graphics_queue_index, present_queue_index,
+        present_queue_handle, gMaxFramesInFlight, gPresentSharing, gPresentCalibrationFrames))
         return -1;
 
-    // Create the surface we want to render to, associated with the window we created before
-    // This call also checks if the created surface is compatible with the previously selected physical device and associated render queue
-    VkSurfaceKHR presentation_surface;
-    if (!createSurface(window, instance, gpu, graphics_queue_index, presentation_surface))
+    // Create the swap chains of the windows
+    // The number of swap chain images is selected based on measured frame times
+    // Supported formats and present modes are cached, swap chain recreation only queries the current surface extent
+    SwapImagePolicy swap_policy(gLatencyMode, gSwapPolicyWindow);
+    SurfaceInfoCache surface_cache;
+    surface_cache.init(gpu, device_features.mSwapchainMaintenance ? instance : VK_NULL_HANDLE);
+    for (auto& output : outputs)
+    {
+        output.mRequestedImageCount = swap_policy.getImageCount();
+        if (!createOutput(gpu, device, device_features.mSwapchainMaintenance, surface_cache, present_queue, output))
+            return -1;
+    }
+
+    // Layout transitions and barriers are derived from the tracked state of every image
+    ResourceStateTracker state_tracker;
+    if (!state_tracker.init(device))
         return -1;
+    for (const auto& output : outputs)
+    {
+        for (const auto& image : output.mSwapChain.getImages())
+            state_tracker.registerImage(image.mImage, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+    }
+
+    LOG_INFO(General) << "successfully initialized vulkan and physical device (gpu).";
+    LOG_INFO(General) << "successfully created " << outputs.size() << " window(s) and compatible surface(s)";
+    LOG_INFO(General) << "successfully created swapchain(s)";
+    LOG_INFO(General) << "ready to render!";
 
-    // Create swap chain
-    VkSwapchainKHR swap_chain = NULL;
-    if (!createSwapChain(presentation_surface, gpu, device, swap_chain))
+    // Create the resources of every frame in flight, the CPU records frame N+1 while the GPU renders frame N
+    std::vector<FrameResources> frames(gMaxFramesInFlight);
+    for (auto& frame : frames)
+    {
+        if (!createFrameResources(device, graphics_queue_index, gWindowCount, frame))
+            return -1;
+    }
+
+    // Descriptor sets are allocated per frame and released in bulk when that frame's fence signals
+    DescriptorAllocator descriptor_allocator;
+    if (!descriptor_allocator.init(device, gMaxFramesInFlight, gDescriptorSetsPerPool))
         return -1;
 
-    // Get image handles from swap chain
-    std::vector<VkImage> chain_images;
-    if (!getSwapChainImageHandles(device, swap_chain, chain_images))
+    // The highlight pixels are written by a compute shader, its buffer is bound through a descriptor set of the frame
+    // The pipeline is compiled by the registry in the background, frames are filled by a transfer until then
+    HighlightCompute highlight;
+    if (!highlight.init(device, pipeline_registry, descriptor_allocator, device_features.mBufferDeviceAddress))
         return -1;
 
-    // Fetch the queue we want to submit the actual commands to
-    VkQueue graphics_queue;
-    getDeviceQueue(device, graphics_queue_index, graphics_queue);
+    // Every frame is described by a render graph, it owns the intermediate images
+    RenderGraph render_graph;
+    if (!render_graph.init(gpu, device, graphics_queue_index, gMaxFramesInFlight, state_tracker))
+        return -1;
+
+    // Compute work of the next frame runs on the compute queue while graphics is still busy
+    AsyncCompute async_compute;
+    if (!async_compute.init(gpu, capabilities.getDevice(gpu).mQueueFamilies, device, compute_queue_index, compute_queue, graphics_queue_index,
+        gMaxFramesInFlight))
+        return -1;
 
-    std::cout << "\nsuccessfully initialized vulkan and physical device (gpu).\n";
-    std::cout << "successfully created a window and compatible surface\n";
-    std::cout << "successfully created swapchain\n";
-    std::cout << "ready to render!\n";
+    // The scene is rendered at a lower resolution when the GPU can't hold the target frame time
+    DynamicResolution dynamic_resolution(gTargetGpuTime, gDynamicResolution ? gMinRenderScale : 1.0f, 1.0f);
+    for (const auto& output : outputs)
+    {
+        if (!output.mScalable)
+            LOG_WARNING(Render) << "swap chain images can't be blitted to, dynamic resolution disabled for window " << output.mWindowID;
+    }
 
-    // WOOP, finally ready to render some stuff!
-    bool run = true;
-    while (run)
+    // Captured frames are read back a few frames later and written to disk on a separate thread
+    // The capture keeps the size of the window at startup, frames rendered after a resize are skipped
+    FrameCapture frame_capture;
+    if (!capture_path.empty())
     {
-        SDL_Event event;
-        while (SDL_PollEvent(&event))
+        const Output& captured = outputs[gCaptureWindow];
+        if (!captured.mCapturable)
         {
-            if (event.type == SDL_QUIT)
-            {
+            LOG_ERROR(Capture) << "surface doesn't support copying from swap chain images, unable to capture";
+            return -1;
+        }
+        if (!frame_capture.init(gpu, device, captured.mSwapChain.getFormat(), captured.mSwapChain.getExtent(), gCaptureBuffers, capture_path,
+            y4m ? ECaptureFormat::Y4M : ECaptureFormat::Raw, gCaptureFrameRate))
+            return -1;
+    }
+
+    // Writes directly into device local memory when the CPU can reach all of it, through staging buffers otherwise
+    UploadService uploads;
+    if (!uploads.init(gpu, device, graphics_queue_index, graphics_queue, gDirectUploads))
+        return -1;
+
+    if (benchmark_uploads)
+    {
+        UploadBenchmark benchmark;
+        if (!uploads.benchmark(gUploadBenchmarkSize, gUploadBenchmarkIterations, benchmark))
+            return -1;
+        if (uploads.isDirect())
+            LOG_INFO(Memory) << "upload benchmark: staged " << benchmark.mStaged << "MB/s, direct " << benchmark.mDirect << "MB/s";
+        else
+            LOG_INFO(Memory) << "upload benchmark: staged " << benchmark.mStaged << "MB/s, direct unavailable";
+    }
+
+    // Tracks device memory usage against the budget of every heap, streamable buffers are moved to host memory under pressure
+    // The compute queue writes the highlight buffers, they're shared with the compute family
+    ResidencyManager residency;
+    if (!residency.init(instance, gpu, device, graphics_queue_index, graphics_queue, compute_queue_index, uploads, gMaxFramesInFlight, memory_budget,
+        device_features.mBufferDeviceAddress, gEvictThreshold, gEvictTarget, gDefragBytesPerFrame))
+        return -1;
+
+    // Every frame in flight writes its own highlight buffer, they're streamable like any other resident buffer
+    // The compute queue writes them, which keeps the defragmenter from moving them
+    std::vector<uint8_t> highlight_data(gHighlightSize * gHighlightSize * 4, 0);
+    for (auto& frame : frames)
+    {
+        frame.mHighlightBuffer = residency.createBuffer(highlight_data.size(),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, highlight_data.data(), true);
+        if (frame.mHighlightBuffer == gInvalidResidentBuffer)
+            return -1;
+    }
+
+    // Events are pumped on this thread, simulation and recording happen on the render thread
+    // Both talk through a lock free queue of coalesced events, the render thread never waits on the OS event queue
+    EventQueue event_queue(gEventQueueSize);
+    std::atomic<bool> rendering(true);
+    std::thread render_thread([&]()
+    {
+        auto last_frame_start = std::chrono::steady_clock::now();
+
+        // WOOP, finally ready to render some stuff!
+        bool run = true;
+        unsigned int frame_index = 0;
+        while (run)
+        {
+            applyEvents(event_queue, surface_cache, outputs, run);
+            if (!run)
+                break;
+
+            auto frame_start = std::chrono::steady_clock::now();
+            double frame_interval = std::chrono::duration<double, std::milli>(frame_start - last_frame_start).count();
+            last_frame_start = frame_start;
+
+            FrameTimings timings;
+            if (!renderFrame(gpu, device, graphics_queue, surface_cache, present_queue, frames[frame_index], frame_index, descriptor_allocator, highlight,
+                state_tracker, render_graph, async_compute, dynamic_resolution, frame_capture, residency, outputs, timings))
                 run = false;
+            frame_index = (frame_index + 1) % gMaxFramesInFlight;
+
+            // Recreate the swap chain when the policy prefers a different number of images
+            double cpu_time = getElapsedMs(frame_start) - timings.mFenceTime - timings.mAcquireTime;
+            double gpu_time = async_compute.getStats().mGraphicsTime / 1000000.0;
+            swap_policy.recordFrame(frame_interval, cpu_time, gpu_time, timings.mAcquireTime);
+            dynamic_resolution.update(gpu_time);
+            for (auto& output : outputs)
+            {
+                if (!run || !output.mResizePending || getElapsedMs(output.mResizeTime) < gResizeSettleTime)
+                    continue;
+                output.mResizePending = false;
+                if (!recreateSwapChain(gpu, device, surface_cache, present_queue, output, state_tracker))
+                    run = false;
+            }
+
+            bool sharing_changed = present_queue.recordFrame(cpu_time + gpu_time);
+            bool image_count_changed = swap_policy.update();
+            if (run && (sharing_changed || image_count_changed))
+            {
+                for (auto& output : outputs)
+                {
+                    output.mRequestedImageCount = swap_policy.getImageCount();
+                    if (!recreateSwapChain(gpu, device, surface_cache, present_queue, output, state_tracker))
+                        run = false;
+                }
             }
         }
+        rendering = false;
+    });
+
+    // Keep pumping until the render thread stopped, windows must stay responsive while it finishes the last frame
+    while (rendering)
+        pumpEvents(event_queue);
+    render_thread.join();
+
+    // Make sure the GPU is done with all frames in flight before destroying anything
+    vkDeviceWaitIdle(device);
+
+    // Write the frames that are still in the capture buffers
+    bool capturing = frame_capture.isActive();
+    frame_capture.destroy();
+
+    // Report how much compute work ran next to graphics work
+    const AsyncComputeStats& compute_stats = async_compute.getStats();
+    double average_overlap = compute_stats.mOverlappedFrames == 0 ? 0.0 :
+        compute_stats.mTotalOverlapTime / static_cast<double>(compute_stats.mOverlappedFrames) / 1000.0;
+    LOG_INFO(Render) << "async compute: " << (async_compute.isAsync() ? "dedicated queue" : "graphics queue") << ", overlapped " <<
+        compute_stats.mOverlappedFrames << " of " << compute_stats.mFrames << " frames, average overlap: " << average_overlap << "us";
+
+    // Report how long the highlight waited for its pipeline, the cache makes later launches faster
+    const HighlightComputeStats& highlight_stats = highlight.getStats();
+    PipelineRegistryStats registry_stats = pipeline_registry.getStats();
+    LOG_INFO(Pipeline) << "pipelines: " << registry_stats.mMisses << " compiled, " << registry_stats.mFailures << " failed, " <<
+        registry_stats.mHits << " hits, " << registry_stats.mFallbacks << " fallbacks, highlight filled by compute in " <<
+        highlight_stats.mDispatches << " frames, by transfer in " << highlight_stats.mFallbackFills;
+
+    const DescriptorAllocatorStats& descriptor_stats = descriptor_allocator.getStats();
+    LOG_INFO(Memory) << "descriptors: " << descriptor_stats.mPoolsCreated << " pools, " << descriptor_stats.mTotalAllocations << " sets allocated, " <<
+        descriptor_stats.mPoolResets << " pool resets, " << descriptor_stats.mLayoutsCreated << " layouts, " << descriptor_stats.mLayoutHits << " layout hits";
+
+    // Barriers the tracker merged or skipped were never recorded
+    const ResourceStateTrackerStats& tracker_stats = state_tracker.getStats();
+    LOG_INFO(Render) << "state tracker: " << tracker_stats.mTransitions << " transitions, " << tracker_stats.mSkipped << " skipped, " <<
+        tracker_stats.mMerged << " merged, " << tracker_stats.mBarriers << " barriers in " << tracker_stats.mBatches << " batches";
+
+    // Aliasing saves the difference between requested and allocated transient memory
+    const RenderGraphStats& graph_stats = render_graph.getStats();
+    LOG_INFO(Render) << "render graph: " << graph_stats.mPasses << " passes, " << graph_stats.mCulledPasses << " culled, " <<
+        graph_stats.mTransientImages << " transient images in " << graph_stats.mAllocations << " allocations, " <<
+        graph_stats.mAllocatedBytes / (1024 * 1024) << "/" << graph_stats.mRequestedBytes / (1024 * 1024) << "MB allocated, rebuilt " <<
+        graph_stats.mRebuilds << " times";
+
+    const SwapImagePolicyStats& swap_stats = swap_policy.getStats();
+    LOG_INFO(Swapchain) << "swap images: " << swap_policy.getImageCount() << ", acquire blocked in " << swap_stats.mBlockedFrames << " of " <<
+        swap_stats.mFrames << " frames, image count changed " << swap_stats.mChanges << " times";
+
+    for (const auto& output : outputs)
+    {
+        const SwapChainStats& chain_stats = output.mSwapChain.getStats();
+        LOG_INFO(Swapchain) << "window " << output.mWindowID << ": " << chain_stats.mGeneration << " swap chain(s), created " <<
+            chain_stats.mViewsCreated << " views and " << chain_stats.mSemaphoresCreated << " semaphores, reused " << chain_stats.mSemaphoresReused << " semaphores, " <<
+            chain_stats.mRetired << " retired, " << chain_stats.mReleased << " images released, " << chain_stats.mAttachmentsCreated << " attachments created (" <<
+            chain_stats.mLazyAttachments << " lazily allocated, " << chain_stats.mAttachmentBytes / (1024 * 1024) << "MB at " << output.mSamples << "x)";
+    }
+
+    const SurfaceInfoCacheStats& surface_stats = surface_cache.getStats();
+    LOG_INFO(Surface) << "surface queries: " << surface_stats.mQueries << ", enumerated " << surface_stats.mFullQueries << " times, " <<
+        surface_stats.mInvalidations << " invalidations";
+
+    const PresentQueueStats& present_stats = present_queue.getStats();
+    const char* present_sharing = present_queue.getSharing() == EPresentSharing::Concurrent ? "concurrent" : "exclusive";
+    if (present_stats.mConcurrentCost > 0.0 && present_stats.mExclusiveCost > 0.0)
+        LOG_INFO(Render) << "present queue family: " << present_queue.getFamily() << ", " << present_sharing << " sharing, " <<
+            present_stats.mTransfers << " ownership transfers, concurrent: " << present_stats.mConcurrentCost << "ms, exclusive: " <<
+            present_stats.mExclusiveCost << "ms";
+    else
+        LOG_INFO(Render) << "present queue family: " << present_queue.getFamily() << ", " << present_sharing << " sharing, " <<
+            present_stats.mTransfers << " ownership transfers";
+
+    if (capturing)
+    {
+        FrameCaptureStats capture_stats = frame_capture.getStats();
+        double average_write = capture_stats.mWritten == 0 ? 0.0 : capture_stats.mWriteTime / static_cast<double>(capture_stats.mWritten);
+        LOG_INFO(Capture) << "capture: " << capture_stats.mWritten << " of " << capture_stats.mCaptured << " frames written, " << capture_stats.mDropped <<
+            " dropped, " << capture_stats.mSkipped << " skipped, " << capture_stats.mBytesWritten / (1024 * 1024) << "MB, average write time: " <<
+            average_write << "ms";
+    }
+
+    const ResidencyStats& residency_stats = residency.getStats();
+    for (unsigned int i = 0; i < residency_stats.mHeaps.size(); i++)
+    {
+        const ResidencyHeap& heap = residency_stats.mHeaps[i];
+        LOG_INFO(Memory) << "heap " << i << (heap.mDeviceLocal ? " (device local)" : "") << ": " << heap.mUsage / (1024 * 1024) << "MB used of " <<
+            heap.mBudget / (1024 * 1024) << "MB budget" << (residency_stats.mMeasured ? "" : " (estimated)") << ", " <<
+            heap.mStreamable / (1024 * 1024) << "MB streamable";
+    }
+    LOG_INFO(Memory) << "residency: " << residency_stats.mResident << " resident, " << residency_stats.mEvicted << " evicted, " <<
+        residency_stats.mEvictions << " evictions (" << residency_stats.mEvictedBytes / (1024 * 1024) << "MB), " << residency_stats.mRestores <<
+        " restores (" << residency_stats.mRestoredBytes / (1024 * 1024) << "MB), over threshold in " << residency_stats.mPressuredFrames << " frames";
+    LOG_INFO(Memory) << "memory pools: " << residency_stats.mPools.mBlocks << " blocks, " << residency_stats.mPools.mUsedBytes / (1024 * 1024) << "/" <<
+        residency_stats.mPools.mBlockBytes / (1024 * 1024) << "MB used, fragmentation " << residency_stats.mPools.mFragmentation << ", " <<
+        residency_stats.mMoves << " moves (" << residency_stats.mMovedBytes / (1024 * 1024) << "MB) in " << residency_stats.mDefragFrames << " frames";
+
+    const UploadStats& upload_stats = uploads.getStats();
+    LOG_INFO(Memory) << "uploads: " << upload_stats.mDirectUploads << " direct (" << upload_stats.mDirectBytes / (1024 * 1024) << "MB), " <<
+        upload_stats.mStagedUploads << " staged (" << upload_stats.mStagedBytes / (1024 * 1024) << "MB)";
+
+    const EventQueueStats& event_stats = event_queue.getStats();
+    LOG_INFO(General) << "events: " << event_stats.mPosted << " posted, " << event_stats.mCoalesced << " coalesced, " << event_stats.mPushed <<
+        " handed to the render thread, queue full " << event_stats.mDeferred << " times";
+
+    // Frame lists that didn't fit in their arena were allocated on the heap
+    LinearArenaStats frame_arena_stats;
+    for (const auto& frame : frames)
+    {
+        const LinearArenaStats& stats = frame.mArena.getStats();
+        frame_arena_stats.mCapacity = stats.mCapacity;
+        frame_arena_stats.mPeak = std::max(frame_arena_stats.mPeak, stats.mPeak);
+        frame_arena_stats.mOverflows += stats.mOverflows;
     }
+    const LinearArenaStats& setup_arena_stats = setup_arena.getStats();
+    LOG_INFO(Memory) << "frame arenas: " << frame_arena_stats.mPeak / 1024 << "/" << frame_arena_stats.mCapacity / 1024 << "KB peak, " <<
+        frame_arena_stats.mOverflows << " heap allocations, setup arena: " << setup_arena_stats.mPeak / 1024 << "/" <<
+        setup_arena_stats.mCapacity / 1024 << "KB peak, " << setup_arena_stats.mOverflows << " heap allocations";
+
+    // Driver host allocations per scope, live bytes still include the objects destroyed on quit
+    const char* host_scope_names[] = { "instance", "device", "swapchain", "pipeline" };
+    HostAllocatorStats host_stats = getHostAllocatorStats();
+    for (size_t i = 0; i < static_cast<size_t>(EHostScope::Count); i++)
+    {
+        const HostScopeStats& scope = host_stats.mScopes[i];
+        LOG_INFO(Memory) << "host allocations (" << host_scope_names[i] << "): " << scope.mAllocations << " allocations, " << scope.mPooled <<
+            " pooled, " << scope.mReallocations << " reallocations, " << scope.mLiveBytes / 1024 << "KB live, " << scope.mPeakBytes / 1024 <<
+            "KB peak, " << scope.mInternalBytes / 1024 << "KB internal";
+    }
+    LOG_INFO(Memory) << "host arenas: " << host_stats.mArenaBytes / 1024 << "KB reserved";
+
+    const DynamicResolutionStats& resolution_stats = dynamic_resolution.getStats();
+    LOG_INFO(Render) << "render scale: " << resolution_stats.mScale << ", gpu time: " << resolution_stats.mGpuTime << "ms, scale changed " <<
+        resolution_stats.mChanges << " times";
 
     // Destroy Vulkan Instance
-    quit(instance, device, callback, swap_chain, presentation_surface);
+    quit(instance, device, callback, outputs, pipeline_registry, descriptor_allocator, highlight, render_graph, async_compute, present_queue, residency, uploads, frames);
+
+    // Print what's left, the validation layers report leaks on quit
+    LoggerStats log_stats = getLogger().getStats();
+    LOG_DEBUG(General) << "log: " << log_stats.mRecords << " records, waited for the drain thread " << log_stats.mStalls << " times, " <<
+        log_stats.mTruncated << " truncated";
+    getLogger().destroy();
 
     return 1;
 }
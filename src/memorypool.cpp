@@ -0,0 +1,170 @@
+#include "memorypool.h"
+#include "hostallocator.h"
+
+#include <algorithm>
+#include <iterator>
+#include <assert.h>
+
+MemoryPool::~MemoryPool()
+{
+    destroy();
+}
+
+
+void MemoryPool::init(VkDevice device, uint32_t memoryTypeIndex, VkDeviceSize blockSize, VkMemoryAllocateFlags allocateFlags)
+{
+    mDevice = device;
+    mMemoryType = memoryTypeIndex;
+    mBlockSize = blockSize;
+    mAllocateFlags = allocateFlags;
+}
+
+
+void MemoryPool::destroy()
+{
+    if (mDevice == VK_NULL_HANDLE)
+        return;
+
+    for (auto& block : mBlocks)
+        vkFreeMemory(mDevice, block.mMemory, getHostCallbacks(EHostScope::Device));
+    mBlocks.clear();
+    mDevice = VK_NULL_HANDLE;
+}
+
+
+bool MemoryPool::allocate(VkDeviceSize size, VkDeviceSize alignment, MemoryAllocation& outAllocation)
+{
+    for (uint32_t i = 0; i < mBlocks.size(); i++)
+    {
+        if (findRange(i, size, alignment, mBlocks[i].mSize, outAllocation))
+            return true;
+    }
+
+    // Allocate a new block, unused slots are taken first
+    VkMemoryAllocateFlagsInfoKHR flags_info = {};
+    flags_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO_KHR;
+    flags_info.flags = mAllocateFlags;
+    VkMemoryAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.pNext = mAllocateFlags != 0 ? &flags_info : nullptr;
+    alloc_info.allocationSize = std::max(size, mBlockSize);
+    alloc_info.memoryTypeIndex = mMemoryType;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    if (vkAllocateMemory(mDevice, &alloc_info, getHostCallbacks(EHostScope::Device), &memory) != VK_SUCCESS)
+        return false;
+
+    auto it = std::find_if(mBlocks.begin(), mBlocks.end(), [](const Block& block) { return block.mMemory == VK_NULL_HANDLE; });
+    if (it == mBlocks.end())
+        it = mBlocks.emplace(mBlocks.end());
+    it->mMemory = memory;
+    it->mSize = alloc_info.allocationSize;
+    it->mFree[0] = it->mSize;
+    return findRange(static_cast<uint32_t>(it - mBlocks.begin()), size, alignment, it->mSize, outAllocation);
+}
+
+
+bool MemoryPool::allocateBelow(VkDeviceSize size, VkDeviceSize alignment, const MemoryAllocation& limit, MemoryAllocation& outAllocation)
+{
+    assert(limit.mBlock < mBlocks.size());
+    for (uint32_t i = 0; i <= limit.mBlock; i++)
+    {
+        VkDeviceSize block_limit = i == limit.mBlock ? limit.mOffset : mBlocks[i].mSize;
+        if (findRange(i, size, alignment, block_limit, outAllocation))
+            return true;
+    }
+    return false;
+}
+
+
+void MemoryPool::free(const MemoryAllocation& allocation)
+{
+    assert(allocation.mBlock < mBlocks.size());
+    Block& block = mBlocks[allocation.mBlock];
+    block.mUsed -= allocation.mSize;
+    block.mAllocations--;
+
+    // The last range of a block releases its memory
+    if (block.mAllocations == 0)
+    {
+        vkFreeMemory(mDevice, block.mMemory, getHostCallbacks(EHostScope::Device));
+        block = Block();
+        return;
+    }
+
+    // Merge with the free ranges before and after
+    VkDeviceSize offset = allocation.mOffset;
+    VkDeviceSize size = allocation.mSize;
+    auto next = block.mFree.lower_bound(offset);
+    if (next != block.mFree.begin())
+    {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset)
+        {
+            offset = prev->first;
+            size += prev->second;
+            block.mFree.erase(prev);
+        }
+    }
+    if (next != block.mFree.end() && offset + size == next->first)
+    {
+        size += next->second;
+        block.mFree.erase(next);
+    }
+    block.mFree[offset] = size;
+}
+
+
+MemoryPoolStats MemoryPool::getStats() const
+{
+    MemoryPoolStats stats;
+    VkDeviceSize free_bytes = 0;
+    for (const auto& block : mBlocks)
+    {
+        if (block.mMemory == VK_NULL_HANDLE)
+            continue;
+        stats.mBlocks++;
+        stats.mAllocations += block.mAllocations;
+        stats.mBlockBytes += block.mSize;
+        stats.mUsedBytes += block.mUsed;
+        for (const auto& range : block.mFree)
+        {
+            free_bytes += range.second;
+            stats.mLargestFree = std::max(stats.mLargestFree, range.second);
+        }
+    }
+    if (free_bytes > 0)
+        stats.mFragmentation = 1.0f - static_cast<float>(static_cast<double>(stats.mLargestFree) / static_cast<double>(free_bytes));
+    return stats;
+}
+
+
+bool MemoryPool::findRange(uint32_t block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize limit, MemoryAllocation& outAllocation)
+{
+    Block& state = mBlocks[block];
+    if (state.mMemory == VK_NULL_HANDLE)
+        return false;
+
+    for (auto it = state.mFree.begin(); it != state.mFree.end() && it->first < limit; ++it)
+    {
+        VkDeviceSize start = it->first;
+        VkDeviceSize end = start + it->second;
+        VkDeviceSize aligned = (start + alignment - 1) / alignment * alignment;
+        if (aligned >= limit || aligned + size > end)
+            continue;
+
+        // Split the range, padding before the allocation and the remainder after it stay free
+        state.mFree.erase(it);
+        if (aligned > start)
+            state.mFree[start] = aligned - start;
+        if (end > aligned + size)
+            state.mFree[aligned + size] = end - (aligned + size);
+        state.mUsed += size;
+        state.mAllocations++;
+
+        outAllocation.mBlock = block;
+        outAllocation.mOffset = aligned;
+        outAllocation.mSize = size;
+        return true;
+    }
+    return false;
+}
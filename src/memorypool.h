@@ -0,0 +1,107 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <map>
+
+/**
+ * A range of memory in a pool block
+ */
+struct MemoryAllocation
+{
+    uint32_t        mBlock = 0;                 ///< Index of the block the range belongs to
+    VkDeviceSize    mOffset = 0;                ///< Aligned start of the range in the block
+    VkDeviceSize    mSize = 0;
+};
+
+
+/**
+ * Memory pool state, in bytes
+ */
+struct MemoryPoolStats
+{
+    uint64_t        mBlocks = 0;                ///< Number of device memory allocations
+    uint64_t        mAllocations = 0;           ///< Number of ranges handed out
+    VkDeviceSize    mBlockBytes = 0;            ///< Total size of all blocks
+    VkDeviceSize    mUsedBytes = 0;             ///< Bytes handed out, excludes alignment padding
+    VkDeviceSize    mLargestFree = 0;           ///< Largest free range in any block
+    float           mFragmentation = 0.0f;      ///< 1 - largest free range / free bytes, 0 when all free memory is contiguous
+};
+
+
+/**
+ * Sub-allocates ranges of a single memory type from large device memory blocks.
+ *
+ * Ranges are placed at the first fit, searching blocks in order: lower blocks fill up first, which is the
+ * direction the defragmenter compacts in, see allocateBelow(). Free ranges are merged with their neighbours and
+ * a block is freed as soon as its last range is freed. Requests larger than the block size get a block of their own.
+ */
+class MemoryPool
+{
+public:
+    MemoryPool() = default;
+    ~MemoryPool();
+
+    MemoryPool(const MemoryPool&) = delete;
+    MemoryPool& operator=(const MemoryPool&) = delete;
+
+    /**
+     * @param device the device memory is allocated on
+     * @param memoryTypeIndex memory type of every block
+     * @param blockSize size of a block
+     * @param allocateFlags flags every block is allocated with, VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR for buffers
+     * whose address is queried
+     */
+    void init(VkDevice device, uint32_t memoryTypeIndex, VkDeviceSize blockSize, VkMemoryAllocateFlags allocateFlags);
+
+    /**
+     * Frees all blocks, the device must be idle
+     */
+    void destroy();
+
+    /**
+     * Reserves a range, a new block is allocated when no block has room
+     * @return if a range was reserved
+     */
+    bool allocate(VkDeviceSize size, VkDeviceSize alignment, MemoryAllocation& outAllocation);
+
+    /**
+     * Reserves a range that lies before the given allocation: in an earlier block, or earlier in the same block.
+     * Never allocates a new block.
+     * @return if such a range was available
+     */
+    bool allocateBelow(VkDeviceSize size, VkDeviceSize alignment, const MemoryAllocation& limit, MemoryAllocation& outAllocation);
+
+    /**
+     * Returns a range to the pool, the block is freed when it no longer holds any range
+     */
+    void free(const MemoryAllocation& allocation);
+
+    /**
+     * @return the device memory the allocation lives in
+     */
+    VkDeviceMemory getMemory(const MemoryAllocation& allocation) const  { return mBlocks[allocation.mBlock].mMemory; }
+
+    /**
+     * @return pool state, computed on request
+     */
+    MemoryPoolStats getStats() const;
+
+private:
+    struct Block
+    {
+        VkDeviceMemory                          mMemory = VK_NULL_HANDLE;   ///< VK_NULL_HANDLE when the slot is unused
+        VkDeviceSize                            mSize = 0;
+        VkDeviceSize                            mUsed = 0;
+        uint64_t                                mAllocations = 0;
+        std::map<VkDeviceSize, VkDeviceSize>    mFree;                      ///< Free ranges, offset to size
+    };
+
+    bool findRange(uint32_t block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize limit, MemoryAllocation& outAllocation);
+
+    VkDevice                    mDevice = VK_NULL_HANDLE;
+    uint32_t                    mMemoryType = 0;
+    VkDeviceSize                mBlockSize = 0;
+    VkMemoryAllocateFlags       mAllocateFlags = 0;
+    std::vector<Block>          mBlocks;
+};
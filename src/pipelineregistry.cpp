@@ -0,0 +1,439 @@
+#include "pipelineregistry.h"
+#include "hostallocator.h"
+#include "hash.h"
+#include "logger.h"
+
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+
+//////////////////////////////////////////////////////////////////////////
+// Hashing
+//////////////////////////////////////////////////////////////////////////
+
+template<typename T>
+static bool equalArray(const std::vector<T>& lhs, const std::vector<T>& rhs)
+{
+    return lhs.size() == rhs.size() &&
+        (lhs.empty() || std::memcmp(lhs.data(), rhs.data(), sizeof(T) * lhs.size()) == 0);
+}
+
+
+uint64_t hashPipelineDescription(const PipelineDescription& description)
+{
+    uint64_t hash = gHashSeed;
+    hashValue(hash, description.mStages.size());
+    for (const auto& stage : description.mStages)
+    {
+        hashValue(hash, stage.mStage);
+        hashValue(hash, stage.mModule);
+        hashBytes(hash, stage.mEntryPoint.data(), stage.mEntryPoint.size());
+    }
+    hashArray(hash, description.mVertexBindings);
+    hashArray(hash, description.mVertexAttributes);
+    hashValue(hash, description.mTopology);
+    hashValue(hash, description.mPolygonMode);
+    hashValue(hash, description.mCullMode);
+    hashValue(hash, description.mFrontFace);
+    hashValue(hash, description.mSamples);
+    hashValue(hash, description.mDepthTest);
+    hashValue(hash, description.mDepthWrite);
+    hashValue(hash, description.mDepthCompareOp);
+    hashArray(hash, description.mBlendAttachments);
+    hashArray(hash, description.mColorFormats);
+    hashValue(hash, description.mDepthFormat);
+    hashValue(hash, description.mLayout);
+    hashValue(hash, description.mRenderPass);
+    hashValue(hash, description.mSubpass);
+    return hash;
+}
+
+
+bool operator==(const PipelineDescription& lhs, const PipelineDescription& rhs)
+{
+    if (lhs.mStages.size() != rhs.mStages.size())
+        return false;
+
+    for (size_t i = 0; i < lhs.mStages.size(); i++)
+    {
+        const auto& l = lhs.mStages[i];
+        const auto& r = rhs.mStages[i];
+        if (l.mStage != r.mStage || l.mModule != r.mModule || l.mEntryPoint != r.mEntryPoint)
+            return false;
+    }
+
+    return equalArray(lhs.mVertexBindings, rhs.mVertexBindings) &&
+        equalArray(lhs.mVertexAttributes, rhs.mVertexAttributes) &&
+        lhs.mTopology == rhs.mTopology &&
+        lhs.mPolygonMode == rhs.mPolygonMode &&
+        lhs.mCullMode == rhs.mCullMode &&
+        lhs.mFrontFace == rhs.mFrontFace &&
+        lhs.mSamples == rhs.mSamples &&
+        lhs.mDepthTest == rhs.mDepthTest &&
+        lhs.mDepthWrite == rhs.mDepthWrite &&
+        lhs.mDepthCompareOp == rhs.mDepthCompareOp &&
+        equalArray(lhs.mBlendAttachments, rhs.mBlendAttachments) &&
+        equalArray(lhs.mColorFormats, rhs.mColorFormats) &&
+        lhs.mDepthFormat == rhs.mDepthFormat &&
+        lhs.mLayout == rhs.mLayout &&
+        lhs.mRenderPass == rhs.mRenderPass &&
+        lhs.mSubpass == rhs.mSubpass;
+}
+
+
+bool operator!=(const PipelineDescription& lhs, const PipelineDescription& rhs)
+{
+    return !(lhs == rhs);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// Pipeline creation
+//////////////////////////////////////////////////////////////////////////
+
+bool isComputePipeline(const PipelineDescription& description)
+{
+    return description.mStages.size() == 1 && description.mStages[0].mStage == VK_SHADER_STAGE_COMPUTE_BIT;
+}
+
+
+bool createGraphicsPipeline(VkDevice device, VkPipelineCache cache, const PipelineDescription& description, VkPipeline& outPipeline)
+{
+    // Shader stages
+    std::vector<VkPipelineShaderStageCreateInfo> stages(description.mStages.size());
+    for (size_t i = 0; i < stages.size(); i++)
+    {
+        stages[i] = {};
+        stages[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        stages[i].stage = description.mStages[i].mStage;
+        stages[i].module = description.mStages[i].mModule;
+        stages[i].pName = description.mStages[i].mEntryPoint.c_str();
+    }
+
+    // Vertex layout
+    VkPipelineVertexInputStateCreateInfo vertex_input = {};
+    vertex_input.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertex_input.vertexBindingDescriptionCount = static_cast<uint32_t>(description.mVertexBindings.size());
+    vertex_input.pVertexBindingDescriptions = description.mVertexBindings.data();
+    vertex_input.vertexAttributeDescriptionCount = static_cast<uint32_t>(description.mVertexAttributes.size());
+    vertex_input.pVertexAttributeDescriptions = description.mVertexAttributes.data();
+
+    VkPipelineInputAssemblyStateCreateInfo input_assembly = {};
+    input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    input_assembly.topology = description.mTopology;
+    input_assembly.primitiveRestartEnable = VK_FALSE;
+
+    // Viewport and scissor are set when recording
+    VkPipelineViewportStateCreateInfo viewport_state = {};
+    viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewport_state.viewportCount = 1;
+    viewport_state.scissorCount = 1;
+
+    VkPipelineRasterizationStateCreateInfo rasterizer = {};
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.polygonMode = description.mPolygonMode;
+    rasterizer.cullMode = description.mCullMode;
+    rasterizer.frontFace = description.mFrontFace;
+    rasterizer.lineWidth = 1.0f;
+
+    VkPipelineMultisampleStateCreateInfo multisample = {};
+    multisample.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisample.rasterizationSamples = description.mSamples;
+
+    VkPipelineDepthStencilStateCreateInfo depth_stencil = {};
+    depth_stencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depth_stencil.depthTestEnable = description.mDepthTest ? VK_TRUE : VK_FALSE;
+    depth_stencil.depthWriteEnable = description.mDepthWrite ? VK_TRUE : VK_FALSE;
+    depth_stencil.depthCompareOp = description.mDepthCompareOp;
+
+    VkPipelineColorBlendStateCreateInfo color_blend = {};
+    color_blend.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    color_blend.attachmentCount = static_cast<uint32_t>(description.mBlendAttachments.size());
+    color_blend.pAttachments = description.mBlendAttachments.data();
+
+    VkDynamicState dynamic_states[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+    VkPipelineDynamicStateCreateInfo dynamic_state = {};
+    dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamic_state.dynamicStateCount = 2;
+    dynamic_state.pDynamicStates = dynamic_states;
+
+    VkGraphicsPipelineCreateInfo pipeline_info = {};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipeline_info.stageCount = static_cast<uint32_t>(stages.size());
+    pipeline_info.pStages = stages.data();
+    pipeline_info.pVertexInputState = &vertex_input;
+    pipeline_info.pInputAssemblyState = &input_assembly;
+    pipeline_info.pViewportState = &viewport_state;
+    pipeline_info.pRasterizationState = &rasterizer;
+    pipeline_info.pMultisampleState = &multisample;
+    pipeline_info.pDepthStencilState = description.mDepthFormat != VK_FORMAT_UNDEFINED ? &depth_stencil : nullptr;
+    pipeline_info.pColorBlendState = &color_blend;
+    pipeline_info.pDynamicState = &dynamic_state;
+    pipeline_info.layout = description.mLayout;
+    pipeline_info.renderPass = description.mRenderPass;
+    pipeline_info.subpass = description.mSubpass;
+    pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+    pipeline_info.basePipelineIndex = -1;
+
+    if (vkCreateGraphicsPipelines(device, cache, 1, &pipeline_info, getHostCallbacks(EHostScope::Pipeline), &outPipeline) != VK_SUCCESS)
+    {
+        LOG_ERROR(Pipeline) << "unable to create graphics pipeline";
+        outPipeline = VK_NULL_HANDLE;
+        return false;
+    }
+    return true;
+}
+
+
+bool createComputePipeline(VkDevice device, VkPipelineCache cache, const PipelineDescription& description, VkPipeline& outPipeline)
+{
+    VkComputePipelineCreateInfo pipeline_info = {};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_info.stage.module = description.mStages[0].mModule;
+    pipeline_info.stage.pName = description.mStages[0].mEntryPoint.c_str();
+    pipeline_info.layout = description.mLayout;
+    pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+    pipeline_info.basePipelineIndex = -1;
+
+    if (vkCreateComputePipelines(device, cache, 1, &pipeline_info, getHostCallbacks(EHostScope::Pipeline), &outPipeline) != VK_SUCCESS)
+    {
+        LOG_ERROR(Pipeline) << "unable to create compute pipeline";
+        outPipeline = VK_NULL_HANDLE;
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * Reads the contents of a binary file, returns false when the file doesn't exist
+ */
+static bool readCacheFile(const std::string& path, std::vector<char>& outData)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open())
+        return false;
+
+    std::streamsize size = file.tellg();
+    if (size <= 0)
+        return false;
+
+    outData.resize(static_cast<size_t>(size));
+    file.seekg(0, std::ios::beg);
+    return static_cast<bool>(file.read(outData.data(), size));
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// PipelineRegistry
+//////////////////////////////////////////////////////////////////////////
+
+PipelineRegistry::~PipelineRegistry()
+{
+    destroy();
+}
+
+
+bool PipelineRegistry::init(VkDevice device, const std::string& cachePath, unsigned int workerCount)
+{
+    mDevice = device;
+    mCachePath = cachePath;
+
+    // Seed the cache with data from a previous run, the driver ignores data that doesn't match the device or driver version
+    std::vector<char> cache_data;
+    if (!mCachePath.empty() && readCacheFile(mCachePath, cache_data))
+        LOG_INFO(Pipeline) << "loaded pipeline cache: " << mCachePath << " (" << cache_data.size() << " bytes)";
+
+    VkPipelineCacheCreateInfo cache_info = {};
+    cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cache_info.initialDataSize = cache_data.size();
+    cache_info.pInitialData = cache_data.empty() ? nullptr : cache_data.data();
+    if (vkCreatePipelineCache(mDevice, &cache_info, getHostCallbacks(EHostScope::Pipeline), &mCache) != VK_SUCCESS)
+    {
+        LOG_ERROR(Pipeline) << "unable to create pipeline cache";
+        return false;
+    }
+
+    // Leave a core for the render thread
+    if (workerCount == 0)
+    {
+        unsigned int cores = std::thread::hardware_concurrency();
+        workerCount = cores > 2 ? cores - 1 : 1;
+    }
+
+    mStop = false;
+    for (unsigned int i = 0; i < workerCount; i++)
+        mWorkers.emplace_back(&PipelineRegistry::workerLoop, this);
+    LOG_INFO(Pipeline) << "pipeline registry: " << workerCount << " compile thread(s)";
+    return true;
+}
+
+
+void PipelineRegistry::destroy()
+{
+    if (mDevice == VK_NULL_HANDLE)
+        return;
+
+    // Stop workers, queued descriptions are dropped
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStop = true;
+        mQueue.clear();
+    }
+    mWorkCondition.notify_all();
+    for (auto& worker : mWorkers)
+        worker.join();
+    mWorkers.clear();
+
+    for (auto& it : mEntries)
+    {
+        if (it.second.mPipeline != VK_NULL_HANDLE)
+            vkDestroyPipeline(mDevice, it.second.mPipeline, getHostCallbacks(EHostScope::Pipeline));
+    }
+    mEntries.clear();
+
+    saveCache();
+    vkDestroyPipelineCache(mDevice, mCache, getHostCallbacks(EHostScope::Pipeline));
+    mCache = VK_NULL_HANDLE;
+    mDevice = VK_NULL_HANDLE;
+}
+
+
+VkPipeline PipelineRegistry::acquire(const PipelineDescription& description, VkPipeline fallback)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    auto it = mEntries.find(description);
+    if (it != mEntries.end())
+    {
+        if (it->second.mState == EState::Ready)
+        {
+            mStats.mHits++;
+            return it->second.mPipeline;
+        }
+        mStats.mFallbacks++;
+        return fallback;
+    }
+
+    // First time we see this description, hand it to a worker
+    auto inserted = mEntries.emplace(description, Entry());
+    mQueue.emplace_back(&(*inserted.first));
+    mStats.mMisses++;
+    mStats.mFallbacks++;
+    lock.unlock();
+    mWorkCondition.notify_one();
+    return fallback;
+}
+
+
+VkPipeline PipelineRegistry::acquireBlocking(const PipelineDescription& description)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    auto it = mEntries.find(description);
+    if (it == mEntries.end())
+    {
+        it = mEntries.emplace(description, Entry()).first;
+        mStats.mMisses++;
+    }
+    Entry& entry = it->second;
+
+    // Take it out of the queue and compile it here instead of waiting for a worker
+    if (entry.mState == EState::Queued)
+    {
+        auto queued = std::find(mQueue.begin(), mQueue.end(), &(*it));
+        if (queued != mQueue.end())
+            mQueue.erase(queued);
+        entry.mState = EState::Compiling;
+        lock.unlock();
+        compile(it->first, entry);
+        lock.lock();
+    }
+
+    // A worker is on it
+    mDoneCondition.wait(lock, [&entry]() { return entry.mState != EState::Compiling; });
+    if (entry.mState == EState::Ready)
+        mStats.mHits++;
+    return entry.mPipeline;
+}
+
+
+PipelineRegistryStats PipelineRegistry::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    PipelineRegistryStats stats = mStats;
+    stats.mPending = 0;
+    for (const auto& it : mEntries)
+    {
+        if (it.second.mState == EState::Queued || it.second.mState == EState::Compiling)
+            stats.mPending++;
+    }
+    return stats;
+}
+
+
+void PipelineRegistry::workerLoop()
+{
+    while (true)
+    {
+        EntryMap::value_type* job = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mWorkCondition.wait(lock, [this]() { return mStop || !mQueue.empty(); });
+            if (mStop)
+                return;
+            job = mQueue.front();
+            mQueue.pop_front();
+            job->second.mState = EState::Compiling;
+        }
+
+        // Map nodes are stable, the description can be read without holding the lock
+        compile(job->first, job->second);
+    }
+}
+
+
+void PipelineRegistry::compile(const PipelineDescription& description, Entry& entry)
+{
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    bool success = isComputePipeline(description) ? createComputePipeline(mDevice, mCache, description, pipeline) :
+        createGraphicsPipeline(mDevice, mCache, description, pipeline);
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        entry.mPipeline = pipeline;
+        entry.mState = success ? EState::Ready : EState::Failed;
+        if (!success)
+            mStats.mFailures++;
+    }
+    mDoneCondition.notify_all();
+}
+
+
+bool PipelineRegistry::saveCache() const
+{
+    if (mCachePath.empty())
+        return true;
+
+    size_t size(0);
+    if (vkGetPipelineCacheData(mDevice, mCache, &size, nullptr) != VK_SUCCESS || size == 0)
+    {
+        LOG_ERROR(Pipeline) << "unable to query pipeline cache size";
+        return false;
+    }
+
+    std::vector<char> data(size);
+    if (vkGetPipelineCacheData(mDevice, mCache, &size, data.data()) != VK_SUCCESS)
+    {
+        LOG_ERROR(Pipeline) << "unable to retrieve pipeline cache data";
+        return false;
+    }
+
+    std::ofstream file(mCachePath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open() || !file.write(data.data(), size))
+    {
+        LOG_ERROR(Pipeline) << "unable to write pipeline cache: " << mCachePath;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+
+/**
+ * A single programmable stage of a pipeline
+ */
+struct PipelineShaderStage
+{
+    VkShaderStageFlagBits   mStage = VK_SHADER_STAGE_VERTEX_BIT;
+    VkShaderModule          mModule = VK_NULL_HANDLE;
+    std::string             mEntryPoint = "main";
+};
+
+
+/**
+ * Everything that makes up a graphics or compute pipeline.
+ * Two descriptions that compare equal always resolve to the same pipeline.
+ * Viewport and scissor are always dynamic and therefore not part of the description,
+ * this allows pipelines to survive a swap chain resize.
+ * A description with a single compute stage describes a compute pipeline, only its stage and layout are used.
+ */
+struct PipelineDescription
+{
+    std::vector<PipelineShaderStage>                    mStages;
+    std::vector<VkVertexInputBindingDescription>        mVertexBindings;
+    std::vector<VkVertexInputAttributeDescription>      mVertexAttributes;
+    VkPrimitiveTopology                                 mTopology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    VkPolygonMode                                       mPolygonMode = VK_POLYGON_MODE_FILL;
+    VkCullModeFlags                                     mCullMode = VK_CULL_MODE_NONE;
+    VkFrontFace                                         mFrontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    VkSampleCountFlagBits                               mSamples = VK_SAMPLE_COUNT_1_BIT;
+    bool                                                mDepthTest = false;
+    bool                                                mDepthWrite = false;
+    VkCompareOp                                         mDepthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+    std::vector<VkPipelineColorBlendAttachmentState>    mBlendAttachments;  ///< One entry for every color attachment
+    std::vector<VkFormat>                               mColorFormats;      ///< Attachment formats, ie: the swap chain image format
+    VkFormat                                            mDepthFormat = VK_FORMAT_UNDEFINED;
+    VkPipelineLayout                                    mLayout = VK_NULL_HANDLE;
+    VkRenderPass                                        mRenderPass = VK_NULL_HANDLE;
+    uint32_t                                            mSubpass = 0;
+};
+
+bool operator==(const PipelineDescription& lhs, const PipelineDescription& rhs);
+bool operator!=(const PipelineDescription& lhs, const PipelineDescription& rhs);
+
+
+/**
+ * @return 64 bit hash of the full pipeline description
+ */
+uint64_t hashPipelineDescription(const PipelineDescription& description);
+
+
+/**
+ * Allows a pipeline description to be used as key in an unordered container
+ */
+struct PipelineDescriptionHasher
+{
+    size_t operator()(const PipelineDescription& description) const    { return static_cast<size_t>(hashPipelineDescription(description)); }
+};
+
+
+/**
+ * @return if the description holds a single compute stage
+ */
+bool isComputePipeline(const PipelineDescription& description);
+
+
+/**
+ * Creates a graphics pipeline from a description using the given cache.
+ * The cache is internally synchronized and can be shared between threads.
+ */
+bool createGraphicsPipeline(VkDevice device, VkPipelineCache cache, const PipelineDescription& description, VkPipeline& outPipeline);
+
+
+/**
+ * Creates a compute pipeline from a description with a single compute stage using the given cache.
+ */
+bool createComputePipeline(VkDevice device, VkPipelineCache cache, const PipelineDescription& description, VkPipeline& outPipeline);
+
+
+/**
+ * Pipeline registry statistics
+ */
+struct PipelineRegistryStats
+{
+    uint64_t    mHits = 0;          ///< Number of times a compiled pipeline was returned
+    uint64_t    mMisses = 0;        ///< Number of unique descriptions that had to be compiled
+    uint64_t    mFallbacks = 0;     ///< Number of times the fallback pipeline was returned
+    uint64_t    mFailures = 0;      ///< Number of descriptions that failed to compile
+    size_t      mPending = 0;       ///< Number of pipelines waiting for or being compiled
+};
+
+
+/**
+ * Owns every graphics and compute pipeline in the application, keyed by a hash of the full pipeline description.
+ * Identical descriptions share a single pipeline. Missing pipelines are compiled on worker threads
+ * against a shared pipeline cache, until then the fallback handed to acquire() is returned.
+ * The pipeline cache is loaded from and written back to disk, which makes subsequent launches cheaper.
+ * Shader modules, layouts and render passes referenced by a description must outlive the registry.
+ */
+class PipelineRegistry
+{
+public:
+    PipelineRegistry() = default;
+    ~PipelineRegistry();
+
+    PipelineRegistry(const PipelineRegistry&) = delete;
+    PipelineRegistry& operator=(const PipelineRegistry&) = delete;
+
+    /**
+     * Creates the shared pipeline cache and starts the compilation threads.
+     * @param device the device to create the pipelines on
+     * @param cachePath file the pipeline cache is seeded from and written back to, can be empty
+     * @param workerCount number of compilation threads, 0 selects a count based on the available cores
+     * @return if the registry initialized successfully
+     */
+    bool init(VkDevice device, const std::string& cachePath, unsigned int workerCount);
+
+    /**
+     * Stops the compilation threads, writes the pipeline cache to disk and destroys all pipelines.
+     * The device must be idle.
+     */
+    void destroy();
+
+    /**
+     * Returns the pipeline for the given description if it has been compiled.
+     * Schedules compilation when the description hasn't been seen before and returns fallback until it's ready.
+     * @param description the full pipeline description
+     * @param fallback pipeline to use while the requested one is compiling, can be VK_NULL_HANDLE to skip the draw
+     */
+    VkPipeline acquire(const PipelineDescription& description, VkPipeline fallback);
+
+    /**
+     * Returns the pipeline for the given description, compiles it on the calling thread when missing.
+     * Use this to create fallback pipelines up front.
+     * @return the pipeline, VK_NULL_HANDLE if compilation failed
+     */
+    VkPipeline acquireBlocking(const PipelineDescription& description);
+
+    /**
+     * @return registry statistics
+     */
+    PipelineRegistryStats getStats() const;
+
+    /**
+     * @return the shared pipeline cache
+     */
+    VkPipelineCache getPipelineCache() const                            { return mCache; }
+
+private:
+    enum class EState : uint8_t
+    {
+        Queued,         ///< Waiting for a worker
+        Compiling,      ///< Worker or blocking call is compiling the pipeline
+        Ready,          ///< Pipeline available
+        Failed          ///< Compilation failed, never retried
+    };
+
+    struct Entry
+    {
+        VkPipeline  mPipeline = VK_NULL_HANDLE;
+        EState      mState = EState::Queued;
+    };
+
+    using EntryMap = std::unordered_map<PipelineDescription, Entry, PipelineDescriptionHasher>;
+
+    void workerLoop();
+    void compile(const PipelineDescription& description, Entry& entry);
+    bool saveCache() const;
+
+    VkDevice                                    mDevice = VK_NULL_HANDLE;
+    VkPipelineCache                             mCache = VK_NULL_HANDLE;
+    std::string                                 mCachePath;
+    EntryMap                                    mEntries;
+    std::deque<EntryMap::value_type*>           mQueue;
+    std::vector<std::thread>                    mWorkers;
+    mutable std::mutex                          mMutex;
+    std::condition_variable                     mWorkCondition;
+    std::condition_variable                     mDoneCondition;
+    bool                                        mStop = false;
+    PipelineRegistryStats                       mStats;
+};
@@ -0,0 +1,243 @@
+#include "presentqueue.h"
+#include "hostallocator.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <assert.h>
+
+/**
+ * Frames skipped after switching modes, the swap chain was just recreated
+ */
+static const unsigned int gWarmupFrames = 10;
+
+
+PresentQueue::~PresentQueue()
+{
+    destroy();
+}
+
+
+bool PresentQueue::init(VkPhysicalDevice physicalDevice, const std::vector<VkQueueFamilyProperties>& queueFamilies, VkDevice device,
+    uint32_t graphicsFamily, uint32_t presentFamily, VkQueue presentQueue, unsigned int frameCount, EPresentSharing sharing,
+    unsigned int calibrationFrames)
+{
+    assert(frameCount > 0);
+    mDevice = device;
+    mQueue = presentQueue;
+    mFamilies[0] = graphicsFamily;
+    mFamilies[1] = presentFamily;
+    mPresentFamily = presentFamily;
+    mSeparate = graphicsFamily != presentFamily;
+    mCalibrationFrames = calibrationFrames;
+
+    // Nothing to share when graphics presents itself, start measuring with concurrent sharing otherwise
+    mSharing = !mSeparate ? EPresentSharing::Exclusive : sharing;
+    mCalibrating = mSharing == EPresentSharing::Auto;
+    if (mCalibrating)
+        mSharing = EPresentSharing::Concurrent;
+    if (!mSeparate)
+        return true;
+
+    LOG_INFO(Render) << "presenting from queue family " << presentFamily << ", rendering on queue family " << graphicsFamily;
+    mFrames.resize(frameCount);
+    for (auto& frame : mFrames)
+    {
+        VkCommandPoolCreateInfo pool_info = {};
+        pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        pool_info.queueFamilyIndex = presentFamily;
+        if (vkCreateCommandPool(device, &pool_info, getHostCallbacks(EHostScope::Device), &frame.mCommandPool) != VK_SUCCESS)
+        {
+            LOG_ERROR(Render) << "unable to create present command pool";
+            return false;
+        }
+
+        VkCommandBufferAllocateInfo buffer_info = {};
+        buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        buffer_info.commandPool = frame.mCommandPool;
+        buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        buffer_info.commandBufferCount = 1;
+        if (vkAllocateCommandBuffers(device, &buffer_info, &frame.mCommandBuffer) != VK_SUCCESS)
+        {
+            LOG_ERROR(Render) << "unable to allocate present command buffer";
+            return false;
+        }
+
+        VkFenceCreateInfo fence_info = {};
+        fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+        if (vkCreateFence(device, &fence_info, getHostCallbacks(EHostScope::Device), &frame.mFence) != VK_SUCCESS)
+        {
+            LOG_ERROR(Render) << "unable to create present fence";
+            return false;
+        }
+    }
+
+    // Rendering ends on the graphics queue, the transfer on the present queue, both must write timestamps
+    uint32_t valid_bits = std::min(queueFamilies[graphicsFamily].timestampValidBits, queueFamilies[presentFamily].timestampValidBits);
+    if (valid_bits == 0)
+    {
+        LOG_WARNING(Render) << "timestamps not supported, ownership transfers are not measured";
+        return true;
+    }
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    mTimestampMask = valid_bits >= 64 ? ~0ULL : (1ULL << valid_bits) - 1;
+    mTimestampPeriod = static_cast<double>(properties.limits.timestampPeriod);
+
+    VkQueryPoolCreateInfo query_info = {};
+    query_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    query_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    query_info.queryCount = frameCount * EQuery::Count;
+    if (vkCreateQueryPool(device, &query_info, getHostCallbacks(EHostScope::Device), &mQueryPool) != VK_SUCCESS)
+    {
+        LOG_ERROR(Render) << "unable to create present timestamp query pool";
+        return false;
+    }
+    return true;
+}
+
+
+void PresentQueue::destroy()
+{
+    if (mDevice == VK_NULL_HANDLE)
+        return;
+
+    for (auto& frame : mFrames)
+    {
+        vkDestroyFence(mDevice, frame.mFence, getHostCallbacks(EHostScope::Device));
+        vkDestroyCommandPool(mDevice, frame.mCommandPool, getHostCallbacks(EHostScope::Device));
+    }
+    mFrames.clear();
+    vkDestroyQueryPool(mDevice, mQueryPool, getHostCallbacks(EHostScope::Device));
+    mQueryPool = VK_NULL_HANDLE;
+    mDevice = VK_NULL_HANDLE;
+}
+
+
+void PresentQueue::applySharing(VkSwapchainCreateInfoKHR& ioCreateInfo) const
+{
+    bool concurrent = mSeparate && mSharing == EPresentSharing::Concurrent;
+    ioCreateInfo.imageSharingMode = concurrent ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+    ioCreateInfo.queueFamilyIndexCount = concurrent ? 2 : 0;
+    ioCreateInfo.pQueueFamilyIndices = concurrent ? mFamilies : nullptr;
+}
+
+
+void PresentQueue::collect(unsigned int frameIndex)
+{
+    if (mQueryPool == VK_NULL_HANDLE || !mFrames[frameIndex].mTimed)
+        return;
+
+    // The queries are reset by the next graphics submission of the frame, the transfer must have written them by then
+    Frame& frame = mFrames[frameIndex];
+    frame.mTimed = false;
+    vkWaitForFences(mDevice, 1, &frame.mFence, VK_TRUE, UINT64_MAX);
+
+    uint64_t stamps[EQuery::Count];
+    if (vkGetQueryPoolResults(mDevice, mQueryPool, frameIndex * EQuery::Count, EQuery::Count, sizeof(stamps), stamps,
+        sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+        return;
+
+    uint64_t elapsed = ((stamps[TransferEnd] & mTimestampMask) - (stamps[GraphicsEnd] & mTimestampMask)) & mTimestampMask;
+    mStats.mTransferTime = static_cast<double>(elapsed) * mTimestampPeriod / 1000000.0;
+}
+
+
+void PresentQueue::endGraphics(VkCommandBuffer commandBuffer, unsigned int frameIndex)
+{
+    if (mQueryPool == VK_NULL_HANDLE || !needsTransfer())
+        return;
+
+    uint32_t query = frameIndex * EQuery::Count;
+    vkCmdResetQueryPool(commandBuffer, mQueryPool, query, EQuery::Count);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, mQueryPool, query + GraphicsEnd);
+}
+
+
+VkResult PresentQueue::present(unsigned int frameIndex, ResourceStateTracker& stateTracker, const std::pmr::vector<VkSemaphore>& transferSemaphores,
+    VkPresentInfoKHR& presentInfo)
+{
+    if (!needsTransfer())
+        return vkQueuePresentKHR(mQueue, &presentInfo);
+
+    // Acquire ownership of the released images, waits for rendering to finish
+    assert(transferSemaphores.size() == presentInfo.swapchainCount);
+    Frame& frame = mFrames[frameIndex];
+    vkWaitForFences(mDevice, 1, &frame.mFence, VK_TRUE, UINT64_MAX);
+    vkResetFences(mDevice, 1, &frame.mFence);
+    vkResetCommandPool(mDevice, frame.mCommandPool, 0);
+
+    VkCommandBufferBeginInfo begin_info = {};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(frame.mCommandBuffer, &begin_info);
+    stateTracker.flushAcquire(frame.mCommandBuffer);
+    if (mQueryPool != VK_NULL_HANDLE)
+        vkCmdWriteTimestamp(frame.mCommandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, mQueryPool, frameIndex * EQuery::Count + TransferEnd);
+    vkEndCommandBuffer(frame.mCommandBuffer);
+
+    mWaitStages.assign(presentInfo.waitSemaphoreCount, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+    VkSubmitInfo submit_info = {};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.waitSemaphoreCount = presentInfo.waitSemaphoreCount;
+    submit_info.pWaitSemaphores = presentInfo.pWaitSemaphores;
+    submit_info.pWaitDstStageMask = mWaitStages.data();
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &frame.mCommandBuffer;
+    submit_info.signalSemaphoreCount = static_cast<uint32_t>(transferSemaphores.size());
+    submit_info.pSignalSemaphores = transferSemaphores.data();
+    VkResult res = vkQueueSubmit(mQueue, 1, &submit_info, frame.mFence);
+    if (res != VK_SUCCESS)
+    {
+        LOG_ERROR(Render) << "unable to submit ownership transfer to present queue";
+        return res;
+    }
+    mStats.mTransfers++;
+    frame.mTimed = mQueryPool != VK_NULL_HANDLE;
+
+    presentInfo.waitSemaphoreCount = static_cast<uint32_t>(transferSemaphores.size());
+    presentInfo.pWaitSemaphores = transferSemaphores.data();
+    return vkQueuePresentKHR(mQueue, &presentInfo);
+}
+
+
+bool PresentQueue::recordFrame(double cost)
+{
+    if (!mCalibrating)
+        return false;
+
+    mMeasuredFrames++;
+    if (mMeasuredFrames <= gWarmupFrames)
+        return false;
+
+    // The acquire submission isn't part of the graphics work, without it exclusive sharing looks cheaper than it is
+    mMeasuredCost += needsTransfer() ? cost + mStats.mTransferTime : cost;
+    if (mMeasuredFrames < gWarmupFrames + mCalibrationFrames)
+        return false;
+
+    double average = mMeasuredCost / static_cast<double>(mCalibrationFrames);
+    mMeasuredFrames = 0;
+    mMeasuredCost = 0.0;
+
+    // Concurrent is measured first, continue with exclusive
+    if (mSharing == EPresentSharing::Concurrent)
+    {
+        mStats.mConcurrentCost = average;
+        mSharing = EPresentSharing::Exclusive;
+        return true;
+    }
+
+    // Keep the cheapest one
+    mStats.mExclusiveCost = average;
+    mCalibrating = false;
+    bool concurrent = mStats.mConcurrentCost < mStats.mExclusiveCost;
+    LOG_INFO(Render) << "present sharing: " << (concurrent ? "concurrent" : "exclusive") << " (concurrent: " << mStats.mConcurrentCost <<
+        "ms, exclusive: " << mStats.mExclusiveCost << "ms)";
+    if (!concurrent)
+        return false;
+
+    mSharing = EPresentSharing::Concurrent;
+    return true;
+}
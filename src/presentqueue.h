@@ -0,0 +1,164 @@
+#pragma once
+
+#include "resourcestatetracker.h"
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <memory_resource>
+
+/**
+ * How swap chain images are shared between the graphics and present queue family
+ */
+enum class EPresentSharing : uint8_t
+{
+    Auto,           ///< Measures both modes and keeps the cheapest one
+    Exclusive,      ///< Owned by one family at a time, ownership is transferred with release and acquire barriers
+    Concurrent      ///< Shared by both families, no ownership transfers but possibly slower access (ie: no compression)
+};
+
+
+/**
+ * Present queue counters, costs are in ms per frame
+ */
+struct PresentQueueStats
+{
+    double      mExclusiveCost = 0.0;       ///< Average cost of a frame with exclusive sharing, 0 when not measured
+    double      mConcurrentCost = 0.0;      ///< Average cost of a frame with concurrent sharing, 0 when not measured
+    double      mTransferTime = 0.0;        ///< Time from the end of rendering until the present queue acquired the images, last measured frame
+    uint64_t    mTransfers = 0;             ///< Number of ownership acquire submissions on the present queue
+};
+
+
+/**
+ * Presents swap chain images from the present queue family, which can differ from the graphics family.
+ *
+ * When both families are the same images are simply presented. When they differ the swap chain images are either
+ * shared concurrently, or owned exclusively by one family at a time. Exclusive ownership requires the graphics queue
+ * to release every image, ie: RenderGraph::addOutput() with the present family, and the present queue to acquire
+ * it before presenting, which costs an extra submission. Concurrent sharing avoids that submission but can disable
+ * compression of the images on some hardware. In Auto mode both are measured for a number of frames,
+ * after which the cheapest mode is kept.
+ *
+ * The acquire submission runs on the present queue, outside of the graphics work the frame cost is measured with.
+ * Timestamps written at the end of rendering and at the end of the acquire submission measure it, including the time
+ * the present queue takes to pick it up, and it is added to every exclusive sample.
+ */
+class PresentQueue
+{
+public:
+    PresentQueue() = default;
+    ~PresentQueue();
+
+    PresentQueue(const PresentQueue&) = delete;
+    PresentQueue& operator=(const PresentQueue&) = delete;
+
+    /**
+     * @param physicalDevice gpu, used to query the timestamp period
+     * @param queueFamilies queue families of the gpu, used for timestamp support
+     * @param device the device the queues belong to
+     * @param graphicsFamily queue family the images are rendered on
+     * @param presentFamily queue family the images are presented from
+     * @param presentQueue queue of the present family
+     * @param frameCount number of frames in flight
+     * @param sharing requested sharing mode, only used when the families differ
+     * @param calibrationFrames number of frames measured per mode in Auto mode
+     * @return if the objects required for ownership transfers could be created
+     */
+    bool init(VkPhysicalDevice physicalDevice, const std::vector<VkQueueFamilyProperties>& queueFamilies, VkDevice device,
+        uint32_t graphicsFamily, uint32_t presentFamily, VkQueue presentQueue, unsigned int frameCount, EPresentSharing sharing,
+        unsigned int calibrationFrames);
+
+    /**
+     * Destroys all objects, the device must be idle
+     */
+    void destroy();
+
+    /**
+     * Sets the sharing mode and queue families of a swap chain that is about to be created
+     */
+    void applySharing(VkSwapchainCreateInfoKHR& ioCreateInfo) const;
+
+    /**
+     * @return if images have to be released to the present family after rendering
+     */
+    bool needsTransfer() const                                          { return mSeparate && mSharing == EPresentSharing::Exclusive; }
+
+    /**
+     * @return the present queue family
+     */
+    uint32_t getFamily() const                                          { return mPresentFamily; }
+
+    /**
+     * @return the current sharing mode, Exclusive when both families are the same
+     */
+    EPresentSharing getSharing() const                                  { return mSharing; }
+
+    /**
+     * Reads the duration of the last ownership transfer of the frame, waits for its acquire submission to complete.
+     * Call after the fence of the frame signaled, before its command buffer is recorded.
+     */
+    void collect(unsigned int frameIndex);
+
+    /**
+     * Writes the end of rendering timestamp of a frame when ownership is transferred, call at the end of its command buffer
+     */
+    void endGraphics(VkCommandBuffer commandBuffer, unsigned int frameIndex);
+
+    /**
+     * Presents the images on the present queue.
+     * When ownership is transferred the images released by the graphics queue are acquired first, in a submission that
+     * waits on the semaphores of the present info and signals the transfer semaphores, which present waits on instead.
+     * @param frameIndex frame in flight
+     * @param stateTracker holds the acquire barriers of the released images
+     * @param transferSemaphores one per presented image, only used when ownership is transferred
+     * @param presentInfo swap chains, images and semaphores to present
+     * @return the result of vkQueuePresentKHR, or the error when the acquire submission failed
+     */
+    VkResult present(unsigned int frameIndex, ResourceStateTracker& stateTracker, const std::pmr::vector<VkSemaphore>& transferSemaphores,
+        VkPresentInfoKHR& presentInfo);
+
+    /**
+     * Records the cost of a frame, only used while calibrating in Auto mode
+     * @param cost time spent on the frame in ms, CPU and GPU, the ownership transfer is added in exclusive mode
+     * @return if the sharing mode changed and all swap chains have to be recreated
+     */
+    bool recordFrame(double cost);
+
+    /**
+     * @return present queue counters
+     */
+    const PresentQueueStats& getStats() const                           { return mStats; }
+
+private:
+    enum EQuery : uint32_t
+    {
+        GraphicsEnd = 0,
+        TransferEnd,
+        Count
+    };
+
+    struct Frame
+    {
+        VkCommandPool           mCommandPool = VK_NULL_HANDLE;
+        VkCommandBuffer         mCommandBuffer = VK_NULL_HANDLE;
+        VkFence                 mFence = VK_NULL_HANDLE;            ///< Signaled when the acquire submission completed
+        bool                    mTimed = false;                     ///< If timestamps were written since the last collect
+    };
+
+    VkDevice                    mDevice = VK_NULL_HANDLE;
+    VkQueue                     mQueue = VK_NULL_HANDLE;
+    VkQueryPool                 mQueryPool = VK_NULL_HANDLE;        ///< Only created when both families support timestamps
+    double                      mTimestampPeriod = 1.0;             ///< Nanoseconds per timestamp tick
+    uint64_t                    mTimestampMask = 0;
+    uint32_t                    mFamilies[2] = { 0, 0 };            ///< Graphics and present family
+    uint32_t                    mPresentFamily = 0;
+    bool                        mSeparate = false;
+    EPresentSharing             mSharing = EPresentSharing::Exclusive;
+    bool                        mCalibrating = false;
+    unsigned int                mCalibrationFrames = 0;
+    unsigned int                mMeasuredFrames = 0;
+    double                      mMeasuredCost = 0.0;
+    std::vector<Frame>          mFrames;
+    std::vector<VkPipelineStageFlags> mWaitStages;                  ///< Wait stages of the acquire submission, reused every frame
+    PresentQueueStats           mStats;
+};
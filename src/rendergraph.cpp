@@ -0,0 +1,575 @@
+#include "rendergraph.h"
+#include "hostallocator.h"
+#include "hash.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <assert.h>
+
+/**
+ * Pipeline stage, access mask, layout and usage implied by a render graph access
+ */
+struct AccessInfo
+{
+    VkPipelineStageFlags2   mStage;
+    VkAccessFlags2          mAccess;
+    VkImageLayout           mLayout;
+    VkImageUsageFlags       mUsage;
+};
+
+
+static AccessInfo getAccessInfo(ERenderGraphAccess access)
+{
+    switch (access)
+    {
+    case ERenderGraphAccess::ColorAttachment:
+        return { VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT };
+    case ERenderGraphAccess::DepthAttachment:
+        return { VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+            VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT };
+    case ERenderGraphAccess::Sampled:
+        return { VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT };
+    case ERenderGraphAccess::StorageRead:
+        return { VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT,
+            VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT };
+    case ERenderGraphAccess::StorageWrite:
+        return { VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+            VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT };
+    case ERenderGraphAccess::TransferSrc:
+        return { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT };
+    case ERenderGraphAccess::TransferDst:
+        return { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT };
+    case ERenderGraphAccess::Present:
+        return { VK_PIPELINE_STAGE_2_NONE_KHR, VK_ACCESS_2_NONE_KHR, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, 0 };
+    }
+    assert(false);
+    return { VK_PIPELINE_STAGE_2_NONE_KHR, VK_ACCESS_2_NONE_KHR, VK_IMAGE_LAYOUT_UNDEFINED, 0 };
+}
+
+
+/**
+ * Finds a device local memory type that is allowed by the given type bits
+ * @return if a memory type was found
+ */
+static bool findDeviceLocalMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeBits, uint32_t& outTypeIndex)
+{
+    VkPhysicalDeviceMemoryProperties properties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &properties);
+    for (uint32_t i = 0; i < properties.memoryTypeCount; i++)
+    {
+        if ((typeBits & (1u << i)) != 0 && (properties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != 0)
+        {
+            outTypeIndex = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+RenderGraph::~RenderGraph()
+{
+    destroy();
+}
+
+
+bool RenderGraph::init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamily, unsigned int frameCount, ResourceStateTracker& stateTracker)
+{
+    assert(frameCount > 0);
+    mPhysicalDevice = physicalDevice;
+    mDevice = device;
+    mQueueFamily = queueFamily;
+    mFrameCount = frameCount;
+    mStateTracker = &stateTracker;
+    return true;
+}
+
+
+void RenderGraph::destroy()
+{
+    if (mDevice == VK_NULL_HANDLE)
+        return;
+
+    retireTransients();
+    destroyRetired(true);
+    reset();
+    mPasses.clear();
+    mDevice = VK_NULL_HANDLE;
+}
+
+
+void RenderGraph::reset()
+{
+    // Passes are kept with their access lists, a graph of the same shape doesn't allocate again
+    for (unsigned int p = 0; p < mPassCount; p++)
+    {
+        mPasses[p].mExecute = nullptr;
+        mPasses[p].mAccesses.clear();
+    }
+    mPassCount = 0;
+    mResources.clear();
+    mOutputs.clear();
+}
+
+
+RenderGraphResource RenderGraph::importImage(const char* name, VkImage image, const RenderGraphImageDescription& description)
+{
+    Resource resource;
+    resource.mName = name;
+    resource.mDescription = description;
+    resource.mImage = image;
+    mResources.emplace_back(resource);
+    return static_cast<RenderGraphResource>(mResources.size() - 1);
+}
+
+
+RenderGraphResource RenderGraph::createImage(const char* name, const RenderGraphImageDescription& description)
+{
+    Resource resource;
+    resource.mName = name;
+    resource.mDescription = description;
+    resource.mTransient = true;
+    mResources.emplace_back(resource);
+    return static_cast<RenderGraphResource>(mResources.size() - 1);
+}
+
+
+unsigned int RenderGraph::addPass(const char* name, RenderGraphExecuteFunction execute)
+{
+    if (mPassCount == mPasses.size())
+        mPasses.emplace_back(Pass());
+
+    Pass& pass = mPasses[mPassCount];
+    pass.mName = name;
+    pass.mExecute = std::move(execute);
+    pass.mCulled = false;
+    pass.mSideEffects = false;
+    return mPassCount++;
+}
+
+
+void RenderGraph::read(unsigned int pass, RenderGraphResource resource, ERenderGraphAccess access)
+{
+    assert(pass < mPassCount && resource < mResources.size());
+    Access pass_access;
+    pass_access.mResource = resource;
+    pass_access.mAccess = access;
+    pass_access.mWrite = false;
+    mPasses[pass].mAccesses.emplace_back(pass_access);
+}
+
+
+void RenderGraph::write(unsigned int pass, RenderGraphResource resource, ERenderGraphAccess access)
+{
+    assert(pass < mPassCount && resource < mResources.size());
+    Access pass_access;
+    pass_access.mResource = resource;
+    pass_access.mAccess = access;
+    pass_access.mWrite = true;
+    mPasses[pass].mAccesses.emplace_back(pass_access);
+}
+
+
+void RenderGraph::keepPass(unsigned int pass)
+{
+    assert(pass < mPassCount);
+    mPasses[pass].mSideEffects = true;
+}
+
+
+void RenderGraph::addOutput(RenderGraphResource resource, ERenderGraphAccess access, uint32_t queueFamily)
+{
+    assert(resource < mResources.size());
+    Output output;
+    output.mResource = resource;
+    output.mAccess = access;
+    output.mQueueFamily = queueFamily;
+    mOutputs.emplace_back(output);
+}
+
+
+bool RenderGraph::compile()
+{
+    assert(!mOutputs.empty());
+    mCompileCount++;
+    destroyRetired(false);
+    cull();
+
+    // Lifetimes and usage of every image, only live passes count
+    for (unsigned int p = 0; p < mPassCount; p++)
+    {
+        if (mPasses[p].mCulled)
+            continue;
+
+        for (const auto& access : mPasses[p].mAccesses)
+        {
+            Resource& resource = mResources[access.mResource];
+            resource.mUsage |= getAccessInfo(access.mAccess).mUsage;
+            if (resource.mFirstPass < 0)
+                resource.mFirstPass = static_cast<int>(p);
+            resource.mLastPass = static_cast<int>(p);
+        }
+    }
+
+    // Transient images are only recreated when the declared images or their lifetimes changed
+    uint64_t hash = hashTransients();
+    if (hash != mTransientHash)
+    {
+        retireTransients();
+        if (!createTransients())
+            return false;
+        mTransientHash = hash;
+        mStats.mRebuilds++;
+    }
+
+    unsigned int physical = 0;
+    for (auto& resource : mResources)
+    {
+        if (!resource.mTransient)
+            continue;
+        resource.mPhysical = static_cast<int>(physical++);
+        resource.mImage = mPhysicalImages[resource.mPhysical].mImage;
+    }
+
+    mStats.mPasses = mPassCount;
+    mStats.mCulledPasses = std::count_if(mPasses.begin(), mPasses.begin() + mPassCount, [](const Pass& pass) { return pass.mCulled; });
+    return true;
+}
+
+
+void RenderGraph::execute(VkCommandBuffer commandBuffer)
+{
+    for (unsigned int p = 0; p < mPassCount; p++)
+    {
+        const Pass& pass = mPasses[p];
+        if (pass.mCulled)
+            continue;
+
+        // Images that share memory with another image start out undefined and wait for the previous occupant
+        for (const auto& access : pass.mAccesses)
+        {
+            const Resource& resource = mResources[access.mResource];
+            if (!resource.mTransient || resource.mFirstPass != static_cast<int>(p))
+                continue;
+
+            const PhysicalImage& physical = mPhysicalImages[resource.mPhysical];
+            if (physical.mAliased)
+                mStateTracker->resetImage(physical.mImage, VK_IMAGE_LAYOUT_UNDEFINED, physical.mAliasStage, physical.mAliasAccess);
+        }
+
+        // All barriers of the pass are issued as a single batch
+        for (const auto& access : pass.mAccesses)
+        {
+            AccessInfo info = getAccessInfo(access.mAccess);
+            mStateTracker->transitionImage(mResources[access.mResource].mImage, info.mStage, info.mAccess, info.mLayout);
+        }
+        mStateTracker->flush(commandBuffer);
+
+        if (pass.mExecute)
+            pass.mExecute(commandBuffer, *this);
+    }
+
+    // Outputs are transitioned as a single batch, outputs used on another queue family are released to it
+    for (const auto& output : mOutputs)
+    {
+        AccessInfo info = getAccessInfo(output.mAccess);
+        VkImage image = mResources[output.mResource].mImage;
+        if (output.mQueueFamily != VK_QUEUE_FAMILY_IGNORED && output.mQueueFamily != mQueueFamily)
+            mStateTracker->releaseImage(image, info.mLayout, mQueueFamily, output.mQueueFamily);
+        else
+            mStateTracker->transitionImage(image, info.mStage, info.mAccess, info.mLayout);
+    }
+    mStateTracker->flush(commandBuffer);
+}
+
+
+VkImage RenderGraph::getImage(RenderGraphResource resource) const
+{
+    assert(resource < mResources.size());
+    return mResources[resource].mImage;
+}
+
+
+const RenderGraphImageDescription& RenderGraph::getDescription(RenderGraphResource resource) const
+{
+    assert(resource < mResources.size());
+    return mResources[resource].mDescription;
+}
+
+
+void RenderGraph::cull()
+{
+    // Walk back from the outputs, a pass is live when it writes an image that is needed later on or is kept explicitly
+    mNeeded.assign(mResources.size(), false);
+    for (const auto& output : mOutputs)
+        mNeeded[output.mResource] = true;
+    for (unsigned int p = mPassCount; p-- > 0;)
+    {
+        Pass& pass = mPasses[p];
+        pass.mCulled = !pass.mSideEffects && std::none_of(pass.mAccesses.begin(), pass.mAccesses.end(), [this](const Access& access)
+        {
+            return access.mWrite && mNeeded[access.mResource];
+        });
+
+        if (pass.mCulled)
+            continue;
+
+        for (const auto& access : pass.mAccesses)
+        {
+            if (!access.mWrite)
+                mNeeded[access.mResource] = true;
+        }
+    }
+}
+
+
+uint64_t RenderGraph::hashTransients() const
+{
+    uint64_t hash = gHashSeed;
+    for (const auto& resource : mResources)
+    {
+        if (!resource.mTransient)
+            continue;
+
+        hashValue(hash, resource.mDescription.mFormat);
+        hashValue(hash, resource.mDescription.mExtent.width);
+        hashValue(hash, resource.mDescription.mExtent.height);
+        hashValue(hash, resource.mDescription.mAspect);
+        hashValue(hash, resource.mDescription.mSamples);
+        hashValue(hash, resource.mUsage);
+        hashValue(hash, resource.mFirstPass);
+        hashValue(hash, resource.mLastPass);
+    }
+    return hash;
+}
+
+
+bool RenderGraph::createTransients()
+{
+    struct Placement
+    {
+        unsigned int            mResource;
+        VkMemoryRequirements    mRequirements;
+    };
+
+    struct Allocation
+    {
+        VkDeviceSize                mSize = 0;
+        uint32_t                    mTypeBits = 0;
+        std::vector<unsigned int>   mResources;     ///< Images bound to the allocation
+    };
+
+    // Create an image for every transient that is used, culled transients keep an empty slot
+    std::vector<Placement> placements;
+    for (unsigned int i = 0; i < mResources.size(); i++)
+    {
+        const Resource& resource = mResources[i];
+        if (!resource.mTransient)
+            continue;
+
+        mPhysicalImages.emplace_back(PhysicalImage());
+        if (resource.mFirstPass < 0)
+            continue;
+
+        VkImageCreateInfo image_info = {};
+        image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        image_info.imageType = VK_IMAGE_TYPE_2D;
+        image_info.format = resource.mDescription.mFormat;
+        image_info.extent = { resource.mDescription.mExtent.width, resource.mDescription.mExtent.height, 1 };
+        image_info.mipLevels = 1;
+        image_info.arrayLayers = 1;
+        image_info.samples = resource.mDescription.mSamples;
+        image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        image_info.usage = resource.mUsage;
+        image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        VkImage& image = mPhysicalImages.back().mImage;
+        if (vkCreateImage(mDevice, &image_info, getHostCallbacks(EHostScope::Device), &image) != VK_SUCCESS)
+        {
+            LOG_ERROR(Render) << "unable to create render graph image: " << resource.mName;
+            return false;
+        }
+        mStateTracker->registerImage(image, resource.mDescription.mAspect, VK_IMAGE_LAYOUT_UNDEFINED);
+
+        Placement placement;
+        placement.mResource = i;
+        vkGetImageMemoryRequirements(mDevice, image, &placement.mRequirements);
+        placements.emplace_back(placement);
+    }
+
+    // Largest images first, every image is placed in the first allocation whose images don't overlap in lifetime
+    std::sort(placements.begin(), placements.end(), [](const Placement& a, const Placement& b)
+    {
+        return a.mRequirements.size > b.mRequirements.size;
+    });
+
+    std::vector<Allocation> allocations;
+    std::vector<unsigned int> physical_index(mResources.size(), 0);
+    unsigned int physical = 0;
+    for (unsigned int i = 0; i < mResources.size(); i++)
+    {
+        if (mResources[i].mTransient)
+            physical_index[i] = physical++;
+    }
+
+    mStats.mRequestedBytes = 0;
+    for (const auto& placement : placements)
+    {
+        const Resource& resource = mResources[placement.mResource];
+        mStats.mRequestedBytes += placement.mRequirements.size;
+
+        Allocation* target = nullptr;
+        for (auto& allocation : allocations)
+        {
+            if ((allocation.mTypeBits & placement.mRequirements.memoryTypeBits) == 0)
+                continue;
+
+            bool overlaps = std::any_of(allocation.mResources.begin(), allocation.mResources.end(), [&](unsigned int other)
+            {
+                return !(resource.mLastPass < mResources[other].mFirstPass || mResources[other].mLastPass < resource.mFirstPass);
+            });
+
+            if (!overlaps)
+            {
+                target = &allocation;
+                break;
+            }
+        }
+
+        if (target == nullptr)
+        {
+            allocations.emplace_back(Allocation());
+            target = &allocations.back();
+            target->mTypeBits = placement.mRequirements.memoryTypeBits;
+        }
+
+        // All images are bound at offset 0, the size of the largest image is always properly aligned
+        target->mSize = std::max(target->mSize, placement.mRequirements.size);
+        target->mTypeBits &= placement.mRequirements.memoryTypeBits;
+        target->mResources.emplace_back(placement.mResource);
+    }
+
+    mStats.mAllocatedBytes = 0;
+    for (unsigned int a = 0; a < allocations.size(); a++)
+    {
+        Allocation& allocation = allocations[a];
+
+        uint32_t type_index(0);
+        if (!findDeviceLocalMemoryType(mPhysicalDevice, allocation.mTypeBits, type_index))
+        {
+            LOG_ERROR(Render) << "unable to find device local memory for render graph images";
+            return false;
+        }
+
+        VkMemoryAllocateInfo alloc_info = {};
+        alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        alloc_info.allocationSize = allocation.mSize;
+        alloc_info.memoryTypeIndex = type_index;
+
+        VkDeviceMemory memory;
+        if (vkAllocateMemory(mDevice, &alloc_info, getHostCallbacks(EHostScope::Device), &memory) != VK_SUCCESS)
+        {
+            LOG_ERROR(Render) << "unable to allocate render graph memory";
+            return false;
+        }
+        mMemory.emplace_back(memory);
+        mStats.mAllocatedBytes += allocation.mSize;
+
+        // Every occupant waits for the one before it, the first waits for the last one of the previous frame
+        std::sort(allocation.mResources.begin(), allocation.mResources.end(), [this](unsigned int l, unsigned int r)
+        {
+            return mResources[l].mFirstPass < mResources[r].mFirstPass;
+        });
+
+        size_t count = allocation.mResources.size();
+        for (size_t i = 0; i < count; i++)
+        {
+            unsigned int resource = allocation.mResources[i];
+            unsigned int previous = allocation.mResources[(i + count - 1) % count];
+
+            PhysicalImage& image = mPhysicalImages[physical_index[resource]];
+            image.mAllocation = a;
+            image.mAliased = count > 1;
+            if (vkBindImageMemory(mDevice, image.mImage, memory, 0) != VK_SUCCESS)
+            {
+                LOG_ERROR(Render) << "unable to bind render graph image memory: " << mResources[resource].mName;
+                return false;
+            }
+
+            if (!image.mAliased)
+                continue;
+
+            for (unsigned int p = 0; p < mPassCount; p++)
+            {
+                const Pass& pass = mPasses[p];
+                if (pass.mCulled)
+                    continue;
+
+                for (const auto& access : pass.mAccesses)
+                {
+                    if (access.mResource != previous)
+                        continue;
+
+                    AccessInfo info = getAccessInfo(access.mAccess);
+                    image.mAliasStage |= info.mStage;
+                    if (access.mWrite)
+                        image.mAliasAccess |= info.mAccess;
+                }
+            }
+        }
+    }
+
+    mStats.mTransientImages = placements.size();
+    mStats.mAllocations = allocations.size();
+    return true;
+}
+
+
+void RenderGraph::retireTransients()
+{
+    if (mPhysicalImages.empty() && mMemory.empty())
+        return;
+
+    // Frames in flight might still use the images, destroy them once those frames completed
+    Retired retired;
+    for (const auto& physical : mPhysicalImages)
+    {
+        if (physical.mImage == VK_NULL_HANDLE)
+            continue;
+        mStateTracker->forgetImage(physical.mImage);
+        retired.mImages.emplace_back(physical.mImage);
+    }
+    retired.mMemory = std::move(mMemory);
+    retired.mDestroyAt = mCompileCount + mFrameCount;
+    mRetired.emplace_back(std::move(retired));
+
+    mPhysicalImages.clear();
+    mMemory.clear();
+    mTransientHash = 0;
+}
+
+
+void RenderGraph::destroyRetired(bool all)
+{
+    auto it = mRetired.begin();
+    while (it != mRetired.end())
+    {
+        if (!all && mCompileCount < it->mDestroyAt)
+        {
+            ++it;
+            continue;
+        }
+
+        for (auto image : it->mImages)
+            vkDestroyImage(mDevice, image, getHostCallbacks(EHostScope::Device));
+        for (auto memory : it->mMemory)
+            vkFreeMemory(mDevice, memory, getHostCallbacks(EHostScope::Device));
+        it = mRetired.erase(it);
+    }
+}
@@ -0,0 +1,257 @@
+#pragma once
+
+#include "inplacefunction.h"
+#include "resourcestatetracker.h"
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+class RenderGraph;
+
+/**
+ * Handle to an image declared in a render graph, only valid for the frame it was declared in
+ */
+using RenderGraphResource = uint32_t;
+constexpr RenderGraphResource gInvalidRenderGraphResource = 0xFFFFFFFF;
+
+
+/**
+ * The ways a pass can use an image, every access implies a pipeline stage, access mask and layout
+ */
+enum class ERenderGraphAccess : uint8_t
+{
+    ColorAttachment,        ///< Written (and blended) as color attachment
+    DepthAttachment,        ///< Depth tested and written
+    Sampled,                ///< Read using a sampler in a fragment or compute shader
+    StorageRead,            ///< Read as storage image in a fragment or compute shader
+    StorageWrite,           ///< Written as storage image in a fragment or compute shader
+    TransferSrc,            ///< Source of a copy or blit
+    TransferDst,            ///< Destination of a copy, blit or clear
+    Present                 ///< Handed to the presentation engine, only valid as output access
+};
+
+
+/**
+ * Properties of an image owned by the render graph
+ */
+struct RenderGraphImageDescription
+{
+    VkFormat                mFormat = VK_FORMAT_UNDEFINED;
+    VkExtent2D              mExtent = { 0, 0 };
+    VkImageAspectFlags      mAspect = VK_IMAGE_ASPECT_COLOR_BIT;
+    VkSampleCountFlagBits   mSamples = VK_SAMPLE_COUNT_1_BIT;
+};
+
+
+/**
+ * Records the commands of a single pass, barriers for all declared reads and writes are already in place.
+ * Declared every frame: captures are stored inline and must fit the capacity.
+ */
+using RenderGraphExecuteFunction = InplaceFunction<void(VkCommandBuffer commandBuffer, const RenderGraph& graph), 64>;
+
+
+/**
+ * Render graph counters, updated on compile
+ */
+struct RenderGraphStats
+{
+    uint64_t    mPasses = 0;            ///< Number of declared passes
+    uint64_t    mCulledPasses = 0;      ///< Number of passes that don't contribute to the output
+    uint64_t    mTransientImages = 0;   ///< Number of images owned by the graph
+    uint64_t    mAllocations = 0;       ///< Number of memory allocations backing the transient images
+    uint64_t    mRequestedBytes = 0;    ///< Memory required without aliasing
+    uint64_t    mAllocatedBytes = 0;    ///< Memory allocated with aliasing
+    uint64_t    mRebuilds = 0;          ///< Number of times the transient images had to be recreated
+};
+
+
+/**
+ * Declarative description of the work required to render a single frame.
+ *
+ * Every frame passes and resources are declared from scratch: passes state which images they read and write,
+ * images are either imported (ie: the acquired swap chain image) or transient and owned by the graph.
+ * compile() culls every pass that doesn't contribute to the output, computes the lifetime of every transient image
+ * and places images whose lifetimes don't overlap in the same memory allocation. execute() records the passes in
+ * declaration order, barriers are derived from the declared accesses by the resource state tracker and issued
+ * as a single batch before every pass.
+ *
+ * Transient images and their memory are kept alive between frames and only recreated when the declared images
+ * or their lifetimes change, which makes compiling an unchanged graph cheap. Declaring a graph doesn't touch the heap
+ * once it reached its largest size: passes keep their access lists between frames, names aren't copied and
+ * execute functions store their captures inline.
+ * All frames in flight share the transient images, they're submitted to the same queue and ordered by barriers.
+ */
+class RenderGraph
+{
+public:
+    RenderGraph() = default;
+    ~RenderGraph();
+
+    RenderGraph(const RenderGraph&) = delete;
+    RenderGraph& operator=(const RenderGraph&) = delete;
+
+    /**
+     * @param physicalDevice the gpu to select the memory type of transient images for
+     * @param device the device to create transient images on
+     * @param queueFamily queue family the graph is executed on
+     * @param frameCount number of frames in flight, determines when replaced images can be destroyed
+     * @param stateTracker tracks the state of every image used by the graph, must outlive the graph
+     */
+    bool init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamily, unsigned int frameCount, ResourceStateTracker& stateTracker);
+
+    /**
+     * Destroys all transient images and their memory, the device must be idle
+     */
+    void destroy();
+
+    /**
+     * Clears all declared passes and resources, call at the start of every frame.
+     * The storage of passes and their access lists is kept for the next frame.
+     */
+    void reset();
+
+    /**
+     * Declares an image that isn't owned by the graph, it must be registered with the state tracker
+     * @param name used in error messages, not copied: must outlive the frame, usually a literal
+     */
+    RenderGraphResource importImage(const char* name, VkImage image, const RenderGraphImageDescription& description);
+
+    /**
+     * Declares an image owned by the graph, its contents are undefined at the start of the first pass that uses it
+     * @param name used in error messages, not copied: must outlive the frame, usually a literal
+     */
+    RenderGraphResource createImage(const char* name, const RenderGraphImageDescription& description);
+
+    /**
+     * Declares a pass, executed in declaration order
+     * @param name not copied: must outlive the frame, usually a literal
+     * @return index of the pass, used to declare what it reads and writes
+     */
+    unsigned int addPass(const char* name, RenderGraphExecuteFunction execute);
+
+    /**
+     * Declares that the pass reads the given image
+     */
+    void read(unsigned int pass, RenderGraphResource resource, ERenderGraphAccess access);
+
+    /**
+     * Declares that the pass writes the given image
+     */
+    void write(unsigned int pass, RenderGraphResource resource, ERenderGraphAccess access);
+
+    /**
+     * Prevents the pass from being culled, for passes whose results leave the graph another way (ie: a readback copy)
+     */
+    void keepPass(unsigned int pass);
+
+    /**
+     * Marks a final result of the graph, passes that don't contribute to any output are culled.
+     * A graph can have multiple outputs, ie: one swap chain image per window.
+     * @param resource the final image, usually an imported swap chain image
+     * @param access how the image is used after the graph executed, ie: ERenderGraphAccess::Present
+     * @param queueFamily queue family the image is used on afterwards, ownership is released to it when it differs
+     * from the family the graph executes on
+     */
+    void addOutput(RenderGraphResource resource, ERenderGraphAccess access, uint32_t queueFamily = VK_QUEUE_FAMILY_IGNORED);
+
+    /**
+     * Culls passes, computes image lifetimes and (re)creates transient images when necessary
+     * @return if all transient images could be created
+     */
+    bool compile();
+
+    /**
+     * Records all passes that weren't culled, including barriers, and transitions the outputs into their final state
+     */
+    void execute(VkCommandBuffer commandBuffer);
+
+    /**
+     * @return the Vulkan image of a declared resource, available after compile()
+     */
+    VkImage getImage(RenderGraphResource resource) const;
+
+    /**
+     * @return the description of a declared resource
+     */
+    const RenderGraphImageDescription& getDescription(RenderGraphResource resource) const;
+
+    /**
+     * @return graph counters
+     */
+    const RenderGraphStats& getStats() const                            { return mStats; }
+
+private:
+    struct Access
+    {
+        RenderGraphResource     mResource = gInvalidRenderGraphResource;
+        ERenderGraphAccess      mAccess = ERenderGraphAccess::Sampled;
+        bool                    mWrite = false;
+    };
+
+    struct Pass
+    {
+        const char*                 mName = nullptr;
+        RenderGraphExecuteFunction  mExecute;
+        std::vector<Access>         mAccesses;
+        bool                        mCulled = false;
+        bool                        mSideEffects = false;       ///< Never culled, see keepPass()
+    };
+
+    struct Output
+    {
+        RenderGraphResource     mResource = gInvalidRenderGraphResource;
+        ERenderGraphAccess      mAccess = ERenderGraphAccess::Present;
+        uint32_t                mQueueFamily = VK_QUEUE_FAMILY_IGNORED;
+    };
+
+    struct Resource
+    {
+        const char*                 mName = nullptr;
+        RenderGraphImageDescription mDescription;
+        VkImage                     mImage = VK_NULL_HANDLE;
+        bool                        mTransient = false;
+        VkImageUsageFlags           mUsage = 0;                 ///< Union of all declared accesses
+        int                         mFirstPass = -1;            ///< First pass that uses the image, -1 when unused
+        int                         mLastPass = -1;             ///< Last pass that uses the image
+        int                         mPhysical = -1;             ///< Index of the backing transient image
+    };
+
+    struct PhysicalImage
+    {
+        VkImage                     mImage = VK_NULL_HANDLE;
+        unsigned int                mAllocation = 0;            ///< Index of the memory allocation the image is bound to
+        bool                        mAliased = false;           ///< If other images share its memory
+        VkPipelineStageFlags2       mAliasStage = 0;            ///< Stages the previous occupant of the memory is used in
+        VkAccessFlags2              mAliasAccess = 0;           ///< Writes of the previous occupant of the memory
+    };
+
+    struct Retired
+    {
+        std::vector<VkImage>        mImages;
+        std::vector<VkDeviceMemory> mMemory;
+        uint64_t                    mDestroyAt = 0;             ///< Compile count after which the objects are no longer in use
+    };
+
+    void cull();
+    uint64_t hashTransients() const;
+    bool createTransients();
+    void retireTransients();
+    void destroyRetired(bool all);
+
+    VkPhysicalDevice                mPhysicalDevice = VK_NULL_HANDLE;
+    VkDevice                        mDevice = VK_NULL_HANDLE;
+    uint32_t                        mQueueFamily = VK_QUEUE_FAMILY_IGNORED;
+    unsigned int                    mFrameCount = 0;
+    ResourceStateTracker*           mStateTracker = nullptr;
+    std::vector<Pass>               mPasses;                    ///< Only the first mPassCount are declared, the rest is kept for reuse
+    unsigned int                    mPassCount = 0;
+    std::vector<bool>               mNeeded;                    ///< Per resource, if a live pass reads it, see cull()
+    std::vector<Resource>           mResources;
+    std::vector<Output>             mOutputs;
+    std::vector<PhysicalImage>      mPhysicalImages;
+    std::vector<VkDeviceMemory>     mMemory;
+    uint64_t                        mTransientHash = 0;
+    uint64_t                        mCompileCount = 0;
+    std::vector<Retired>            mRetired;
+    RenderGraphStats                mStats;
+};
@@ -0,0 +1,719 @@
+#include "residencymanager.h"
+#include "hostallocator.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <assert.h>
+
+/**
+ * Fraction of a heap that is assumed to be available when the budget can't be queried
+ */
+static const double gEstimatedBudget = 0.8;
+
+/**
+ * Size of a device memory block resident buffers are sub-allocated from
+ */
+static const VkDeviceSize gPoolBlockSize = 64 * 1024 * 1024;
+
+
+/**
+ * Finds a memory type with all required properties whose heap has none of the excluded flags
+ * @return if a matching memory type was found
+ */
+static bool findMemoryType(const VkPhysicalDeviceMemoryProperties& properties, uint32_t typeBits, VkMemoryPropertyFlags required,
+    VkMemoryHeapFlags excludedHeap, uint32_t& outTypeIndex)
+{
+    for (uint32_t i = 0; i < properties.memoryTypeCount; i++)
+    {
+        const VkMemoryType& type = properties.memoryTypes[i];
+        if ((typeBits & (1u << i)) == 0 || (type.propertyFlags & required) != required)
+            continue;
+        if ((properties.memoryHeaps[type.heapIndex].flags & excludedHeap) != 0)
+            continue;
+        outTypeIndex = i;
+        return true;
+    }
+    return false;
+}
+
+
+/**
+ * Creates the command pool, command buffer and fence used to submit copies
+ */
+static bool createCopyObjects(VkDevice device, uint32_t queueFamily, VkCommandPool& outPool, VkCommandBuffer& outBuffer, VkFence& outFence)
+{
+    VkCommandPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    pool_info.queueFamilyIndex = queueFamily;
+    if (vkCreateCommandPool(device, &pool_info, getHostCallbacks(EHostScope::Device), &outPool) != VK_SUCCESS)
+    {
+        LOG_ERROR(Memory) << "unable to create residency command pool";
+        return false;
+    }
+
+    VkCommandBufferAllocateInfo buffer_info = {};
+    buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    buffer_info.commandPool = outPool;
+    buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    buffer_info.commandBufferCount = 1;
+    if (vkAllocateCommandBuffers(device, &buffer_info, &outBuffer) != VK_SUCCESS)
+    {
+        LOG_ERROR(Memory) << "unable to allocate residency command buffer";
+        return false;
+    }
+
+    VkFenceCreateInfo fence_info = {};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    if (vkCreateFence(device, &fence_info, getHostCallbacks(EHostScope::Device), &outFence) != VK_SUCCESS)
+    {
+        LOG_ERROR(Memory) << "unable to create residency fence";
+        return false;
+    }
+    return true;
+}
+
+
+ResidencyManager::~ResidencyManager()
+{
+    destroy();
+}
+
+
+bool ResidencyManager::init(VkInstance instance, VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamily, VkQueue queue,
+    uint32_t sharedFamily, UploadService& uploads, unsigned int frameCount, bool memoryBudget, bool bufferDeviceAddress, float evictThreshold, float evictTarget,
+    VkDeviceSize defragBudget)
+{
+    assert(evictTarget <= evictThreshold);
+    mPhysicalDevice = physicalDevice;
+    mDevice = device;
+    mQueue = queue;
+    mQueueFamilies = { queueFamily };
+    if (sharedFamily != queueFamily)
+        mQueueFamilies.emplace_back(sharedFamily);
+    mUploads = &uploads;
+    mFrameCount = frameCount;
+    mEvictThreshold = evictThreshold;
+    mEvictTarget = evictTarget;
+    mDefragBudget = defragBudget;
+    mGetMemoryProperties2 = !memoryBudget ? nullptr :
+        reinterpret_cast<PFN_vkGetPhysicalDeviceMemoryProperties2KHR>(vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceMemoryProperties2KHR"));
+    mGetBufferAddress = !bufferDeviceAddress ? nullptr :
+        reinterpret_cast<PFN_vkGetBufferDeviceAddressKHR>(vkGetDeviceProcAddr(device, "vkGetBufferDeviceAddressKHR"));
+
+    // Core since 1.2, the KHR entry point is only there when the extension is enabled
+    if (bufferDeviceAddress && mGetBufferAddress == nullptr)
+        mGetBufferAddress = reinterpret_cast<PFN_vkGetBufferDeviceAddressKHR>(vkGetDeviceProcAddr(device, "vkGetBufferDeviceAddress"));
+
+    // Evicted buffers are moved to a heap outside device local memory, on UMA devices there is none
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &mMemoryProperties);
+    mStats.mHeaps.resize(mMemoryProperties.memoryHeapCount);
+    for (uint32_t i = 0; i < mMemoryProperties.memoryHeapCount; i++)
+    {
+        mStats.mHeaps[i].mSize = mMemoryProperties.memoryHeaps[i].size;
+        mStats.mHeaps[i].mDeviceLocal = (mMemoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+        mEvictable |= !mStats.mHeaps[i].mDeviceLocal;
+    }
+    if (!mEvictable)
+        LOG_INFO(Memory) << "all memory heaps are device local, streamable buffers are never evicted";
+
+    // Eviction and restoration wait for their copies, moves are polled
+    if (!createCopyObjects(device, queueFamily, mCommandPool, mCommandBuffer, mFence) ||
+        !createCopyObjects(device, queueFamily, mMoveCommandPool, mMoveCommandBuffer, mMoveFence))
+        return false;
+
+    queryHeaps();
+    LOG_INFO(Memory) << "memory budget: " << (mStats.mMeasured ? "reported by driver" : "estimated from heap sizes");
+    return true;
+}
+
+
+void ResidencyManager::destroy()
+{
+    if (mDevice == VK_NULL_HANDLE)
+        return;
+
+    // Moves were submitted before the device went idle, their targets are released like any other buffer
+    completeMoves(true);
+    releaseRetired(true);
+    for (auto& buffer : mBuffers)
+    {
+        if (!buffer.mAlive)
+            continue;
+        vkDestroyBuffer(mDevice, buffer.mBuffer, getHostCallbacks(EHostScope::Device));
+        vkFreeMemory(mDevice, buffer.mMemory, getHostCallbacks(EHostScope::Device));
+    }
+    mBuffers.clear();
+    mFreeBuffers.clear();
+    mPools.clear();
+    vkDestroyFence(mDevice, mFence, getHostCallbacks(EHostScope::Device));
+    vkDestroyCommandPool(mDevice, mCommandPool, getHostCallbacks(EHostScope::Device));
+    vkDestroyFence(mDevice, mMoveFence, getHostCallbacks(EHostScope::Device));
+    vkDestroyCommandPool(mDevice, mMoveCommandPool, getHostCallbacks(EHostScope::Device));
+    mFence = VK_NULL_HANDLE;
+    mCommandPool = VK_NULL_HANDLE;
+    mMoveFence = VK_NULL_HANDLE;
+    mMoveCommandPool = VK_NULL_HANDLE;
+    mDevice = VK_NULL_HANDLE;
+}
+
+
+ResidentBuffer ResidencyManager::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, const void* data, bool gpuWritten)
+{
+    // Eviction, restoration and moves copy the contents in all directions
+    Buffer buffer;
+    buffer.mSize = size;
+    buffer.mUsage = usage | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    if (mGetBufferAddress != nullptr)
+        buffer.mUsage |= VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT_KHR;
+    Resident resident;
+    if (!createResident(size, buffer.mUsage, nullptr, resident))
+        return gInvalidResidentBuffer;
+
+    VkDeviceMemory memory = mPools[resident.mMemoryType].getMemory(resident.mAllocation);
+    if (!mUploads->upload(data, size, resident.mBuffer, memory, resident.mAllocation.mOffset, resident.mMemoryType))
+    {
+        LOG_ERROR(Memory) << "unable to upload streamable buffer";
+        destroyResident(resident);
+        return gInvalidResidentBuffer;
+    }
+
+    buffer.mBuffer = resident.mBuffer;
+    buffer.mAllocation = resident.mAllocation;
+    buffer.mMemoryType = resident.mMemoryType;
+    buffer.mHeap = resident.mHeap;
+    buffer.mLastUse = mFrame;
+    buffer.mResident = true;
+    buffer.mGpuWritten = gpuWritten;
+    buffer.mAlive = true;
+    mStats.mHeaps[buffer.mHeap].mStreamable += size;
+    mStats.mResident++;
+
+    if (!mFreeBuffers.empty())
+    {
+        ResidentBuffer handle = mFreeBuffers.back();
+        mFreeBuffers.pop_back();
+        mBuffers[handle] = buffer;
+        return handle;
+    }
+    mBuffers.emplace_back(buffer);
+    return static_cast<ResidentBuffer>(mBuffers.size() - 1);
+}
+
+
+void ResidencyManager::destroyBuffer(ResidentBuffer handle)
+{
+    assert(handle < mBuffers.size() && mBuffers[handle].mAlive);
+
+    // The move still reads the buffer
+    if (mBuffers[handle].mMoving)
+        completeMoves(true);
+
+    Buffer& buffer = mBuffers[handle];
+    if (buffer.mResident)
+    {
+        Resident resident;
+        resident.mBuffer = buffer.mBuffer;
+        resident.mAllocation = buffer.mAllocation;
+        resident.mMemoryType = buffer.mMemoryType;
+        destroyResident(resident);
+        mStats.mHeaps[buffer.mHeap].mStreamable -= buffer.mSize;
+        mStats.mResident--;
+    }
+    else
+    {
+        vkDestroyBuffer(mDevice, buffer.mBuffer, getHostCallbacks(EHostScope::Device));
+        vkFreeMemory(mDevice, buffer.mMemory, getHostCallbacks(EHostScope::Device));
+        mStats.mEvicted--;
+    }
+    buffer = Buffer();
+    mFreeBuffers.emplace_back(handle);
+}
+
+
+VkBuffer ResidencyManager::use(ResidentBuffer handle)
+{
+    assert(handle < mBuffers.size() && mBuffers[handle].mAlive);
+    Buffer& buffer = mBuffers[handle];
+    buffer.mLastUse = mFrame;
+    if (buffer.mResident)
+        return buffer.mBuffer;
+
+    // Copy the host copy back into device local memory, the copy completes before the buffer is used
+    Resident resident;
+    if (!createResident(buffer.mSize, buffer.mUsage, nullptr, resident))
+        return VK_NULL_HANDLE;
+
+    Copy copy;
+    copy.mSrc = buffer.mBuffer;
+    copy.mDst = resident.mBuffer;
+    copy.mSize = buffer.mSize;
+    if (!submitCopies({ copy }))
+    {
+        destroyResident(resident);
+        return VK_NULL_HANDLE;
+    }
+
+    vkDestroyBuffer(mDevice, buffer.mBuffer, getHostCallbacks(EHostScope::Device));
+    vkFreeMemory(mDevice, buffer.mMemory, getHostCallbacks(EHostScope::Device));
+    buffer.mBuffer = resident.mBuffer;
+    buffer.mMemory = VK_NULL_HANDLE;
+    buffer.mAllocation = resident.mAllocation;
+    buffer.mMemoryType = resident.mMemoryType;
+    buffer.mHeap = resident.mHeap;
+    buffer.mResident = true;
+    mStats.mHeaps[buffer.mHeap].mStreamable += buffer.mSize;
+    mStats.mHeaps[buffer.mHeap].mUsage += buffer.mSize;
+    mStats.mResident++;
+    mStats.mEvicted--;
+    mStats.mRestores++;
+    mStats.mRestoredBytes += buffer.mSize;
+    return buffer.mBuffer;
+}
+
+
+VkDeviceAddress ResidencyManager::getAddress(ResidentBuffer handle)
+{
+    assert(mGetBufferAddress != nullptr);
+    VkBuffer buffer = use(handle);
+    if (buffer == VK_NULL_HANDLE)
+        return 0;
+
+    VkBufferDeviceAddressInfoKHR address_info = {};
+    address_info.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO_KHR;
+    address_info.buffer = buffer;
+    return mGetBufferAddress(mDevice, &address_info);
+}
+
+
+void ResidencyManager::update()
+{
+    mFrame++;
+    completeMoves(false);
+    releaseRetired(false);
+
+    queryHeaps();
+    bool pressured = false;
+    bool compact = false;
+    for (uint32_t i = 0; i < mStats.mHeaps.size(); i++)
+    {
+        const ResidencyHeap& heap = mStats.mHeaps[i];
+        if (!heap.mDeviceLocal || static_cast<double>(heap.mUsage) <= static_cast<double>(heap.mBudget) * mEvictTarget)
+            continue;
+        compact = true;
+        if (static_cast<double>(heap.mUsage) <= static_cast<double>(heap.mBudget) * mEvictThreshold)
+            continue;
+        pressured = true;
+        evict(i);
+    }
+    if (pressured)
+        mStats.mPressuredFrames++;
+
+    // Holes only cost memory that is needed when a heap runs out of budget, compacting them earlier is wasted work
+    if (compact)
+        defragment();
+
+    // Report the combined pools, with the fragmentation of the worst one
+    mStats.mPools = MemoryPoolStats();
+    for (const auto& pool : mPools)
+    {
+        MemoryPoolStats pool_stats = pool.second.getStats();
+        mStats.mPools.mBlocks += pool_stats.mBlocks;
+        mStats.mPools.mAllocations += pool_stats.mAllocations;
+        mStats.mPools.mBlockBytes += pool_stats.mBlockBytes;
+        mStats.mPools.mUsedBytes += pool_stats.mUsedBytes;
+        mStats.mPools.mLargestFree = std::max(mStats.mPools.mLargestFree, pool_stats.mLargestFree);
+        mStats.mPools.mFragmentation = std::max(mStats.mPools.mFragmentation, pool_stats.mFragmentation);
+    }
+}
+
+
+bool ResidencyManager::createMemory(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags required, VkMemoryHeapFlags excludedHeap,
+    VkBuffer& outBuffer, VkDeviceMemory& outMemory, uint32_t& outHeap)
+{
+    VkBufferCreateInfo buffer_info = {};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = size;
+    buffer_info.usage = usage;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (vkCreateBuffer(mDevice, &buffer_info, getHostCallbacks(EHostScope::Device), &outBuffer) != VK_SUCCESS)
+        return false;
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(mDevice, outBuffer, &requirements);
+    VkMemoryAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.allocationSize = requirements.size;
+    if (!findMemoryType(mMemoryProperties, requirements.memoryTypeBits, required, excludedHeap, alloc_info.memoryTypeIndex) ||
+        vkAllocateMemory(mDevice, &alloc_info, getHostCallbacks(EHostScope::Device), &outMemory) != VK_SUCCESS)
+    {
+        vkDestroyBuffer(mDevice, outBuffer, getHostCallbacks(EHostScope::Device));
+        outBuffer = VK_NULL_HANDLE;
+        return false;
+    }
+
+    outHeap = mMemoryProperties.memoryTypes[alloc_info.memoryTypeIndex].heapIndex;
+    if (vkBindBufferMemory(mDevice, outBuffer, outMemory, 0) != VK_SUCCESS)
+    {
+        vkDestroyBuffer(mDevice, outBuffer, getHostCallbacks(EHostScope::Device));
+        vkFreeMemory(mDevice, outMemory, getHostCallbacks(EHostScope::Device));
+        outBuffer = VK_NULL_HANDLE;
+        outMemory = VK_NULL_HANDLE;
+        return false;
+    }
+    return true;
+}
+
+
+bool ResidencyManager::createResident(VkDeviceSize size, VkBufferUsageFlags usage, const Buffer* moved, Resident& outResident)
+{
+    VkBufferCreateInfo buffer_info = {};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = size;
+    buffer_info.usage = usage;
+    buffer_info.sharingMode = mQueueFamilies.size() > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+    buffer_info.queueFamilyIndexCount = mQueueFamilies.size() > 1 ? static_cast<uint32_t>(mQueueFamilies.size()) : 0;
+    buffer_info.pQueueFamilyIndices = mQueueFamilies.size() > 1 ? mQueueFamilies.data() : nullptr;
+    if (vkCreateBuffer(mDevice, &buffer_info, getHostCallbacks(EHostScope::Device), &outResident.mBuffer) != VK_SUCCESS)
+        return false;
+
+    // A moved buffer stays in its pool, closer to the start, new buffers prefer memory uploads can write into
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(mDevice, outResident.mBuffer, &requirements);
+    bool allocated = false;
+    if (moved != nullptr)
+    {
+        outResident.mMemoryType = moved->mMemoryType;
+        allocated = (requirements.memoryTypeBits & (1u << moved->mMemoryType)) != 0 &&
+            mPools[moved->mMemoryType].allocateBelow(requirements.size, requirements.alignment, moved->mAllocation, outResident.mAllocation);
+    }
+    else if (findMemoryType(mMemoryProperties, requirements.memoryTypeBits, mUploads->getMemoryProperties(), 0, outResident.mMemoryType) ||
+        findMemoryType(mMemoryProperties, requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, outResident.mMemoryType))
+    {
+        auto it = mPools.find(outResident.mMemoryType);
+        if (it == mPools.end())
+        {
+            it = mPools.emplace(std::piecewise_construct, std::forward_as_tuple(outResident.mMemoryType), std::forward_as_tuple()).first;
+            VkMemoryAllocateFlags flags = mGetBufferAddress != nullptr ? VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR : 0;
+            it->second.init(mDevice, outResident.mMemoryType, gPoolBlockSize, flags);
+        }
+        allocated = it->second.allocate(requirements.size, requirements.alignment, outResident.mAllocation);
+    }
+
+    if (!allocated)
+    {
+        vkDestroyBuffer(mDevice, outResident.mBuffer, getHostCallbacks(EHostScope::Device));
+        outResident.mBuffer = VK_NULL_HANDLE;
+        return false;
+    }
+
+    mLayoutChanges++;
+    MemoryPool& pool = mPools[outResident.mMemoryType];
+    outResident.mHeap = mMemoryProperties.memoryTypes[outResident.mMemoryType].heapIndex;
+    if (vkBindBufferMemory(mDevice, outResident.mBuffer, pool.getMemory(outResident.mAllocation), outResident.mAllocation.mOffset) != VK_SUCCESS)
+    {
+        destroyResident(outResident);
+        outResident.mBuffer = VK_NULL_HANDLE;
+        return false;
+    }
+    return true;
+}
+
+
+void ResidencyManager::destroyResident(const Resident& resident)
+{
+    vkDestroyBuffer(mDevice, resident.mBuffer, getHostCallbacks(EHostScope::Device));
+    mPools[resident.mMemoryType].free(resident.mAllocation);
+    mLayoutChanges++;
+}
+
+
+void ResidencyManager::recordCopies(VkCommandBuffer commandBuffer, const std::vector<Copy>& copies)
+{
+    VkCommandBufferBeginInfo begin_info = {};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(commandBuffer, &begin_info);
+    for (const auto& copy : copies)
+    {
+        VkBufferCopy region = {};
+        region.size = copy.mSize;
+        vkCmdCopyBuffer(commandBuffer, copy.mSrc, copy.mDst, 1, &region);
+    }
+
+    // Work submitted later on the same queue sees the copied contents
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    vkEndCommandBuffer(commandBuffer);
+}
+
+
+bool ResidencyManager::submitCopies(const std::vector<Copy>& copies)
+{
+    vkResetCommandPool(mDevice, mCommandPool, 0);
+    recordCopies(mCommandBuffer, copies);
+
+    VkSubmitInfo submit_info = {};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &mCommandBuffer;
+    if (vkQueueSubmit(mQueue, 1, &submit_info, mFence) != VK_SUCCESS)
+    {
+        LOG_ERROR(Memory) << "unable to submit residency copies";
+        return false;
+    }
+    vkWaitForFences(mDevice, 1, &mFence, VK_TRUE, UINT64_MAX);
+    vkResetFences(mDevice, 1, &mFence);
+    return true;
+}
+
+
+void ResidencyManager::queryHeaps()
+{
+    mStats.mMeasured = mGetMemoryProperties2 != nullptr;
+    if (!mStats.mMeasured)
+    {
+        for (auto& heap : mStats.mHeaps)
+        {
+            heap.mBudget = static_cast<VkDeviceSize>(static_cast<double>(heap.mSize) * gEstimatedBudget);
+            heap.mUsage = heap.mStreamable;
+        }
+        return;
+    }
+
+    // Budget and usage account for other processes and allocations made by the driver
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = {};
+    budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+    VkPhysicalDeviceMemoryProperties2 properties = {};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    properties.pNext = &budget;
+    mGetMemoryProperties2(mPhysicalDevice, &properties);
+    for (uint32_t i = 0; i < mStats.mHeaps.size(); i++)
+    {
+        mStats.mHeaps[i].mBudget = budget.heapBudget[i];
+        mStats.mHeaps[i].mUsage = budget.heapUsage[i];
+    }
+}
+
+
+void ResidencyManager::evict(uint32_t heap)
+{
+    if (!mEvictable)
+        return;
+
+    // Least recently used first, buffers used by a frame in flight or being moved are skipped
+    std::vector<ResidentBuffer> candidates;
+    for (ResidentBuffer i = 0; i < mBuffers.size(); i++)
+    {
+        const Buffer& buffer = mBuffers[i];
+        if (buffer.mAlive && buffer.mResident && !buffer.mMoving && buffer.mHeap == heap && buffer.mLastUse + mFrameCount <= mFrame)
+            candidates.emplace_back(i);
+    }
+    std::sort(candidates.begin(), candidates.end(), [this](ResidentBuffer a, ResidentBuffer b) { return mBuffers[a].mLastUse < mBuffers[b].mLastUse; });
+
+    // Copy every victim into memory outside the device local heaps
+    ResidencyHeap& state = mStats.mHeaps[heap];
+    VkDeviceSize target = static_cast<VkDeviceSize>(static_cast<double>(state.mBudget) * mEvictTarget);
+    VkDeviceSize excess = state.mUsage - std::min(state.mUsage, target);
+    VkDeviceSize selected = 0;
+    std::vector<ResidentBuffer> victims;
+    std::vector<VkBuffer> host_buffers;
+    std::vector<VkDeviceMemory> host_memory;
+    std::vector<Copy> copies;
+    for (ResidentBuffer handle : candidates)
+    {
+        if (selected >= excess)
+            break;
+
+        const Buffer& buffer = mBuffers[handle];
+        VkBuffer host_buffer = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        uint32_t host_heap(0);
+        // Host copies are only copied from and into, they are never read by shaders
+        VkBufferUsageFlags host_usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        if (!createMemory(buffer.mSize, host_usage, 0, VK_MEMORY_HEAP_DEVICE_LOCAL_BIT, host_buffer, memory, host_heap))
+        {
+            LOG_ERROR(Memory) << "unable to allocate host memory for eviction";
+            break;
+        }
+
+        Copy copy;
+        copy.mSrc = buffer.mBuffer;
+        copy.mDst = host_buffer;
+        copy.mSize = buffer.mSize;
+        copies.emplace_back(copy);
+        victims.emplace_back(handle);
+        host_buffers.emplace_back(host_buffer);
+        host_memory.emplace_back(memory);
+        selected += buffer.mSize;
+    }
+
+    if (copies.empty())
+        return;
+
+    if (!submitCopies(copies))
+    {
+        for (unsigned int i = 0; i < victims.size(); i++)
+        {
+            vkDestroyBuffer(mDevice, host_buffers[i], getHostCallbacks(EHostScope::Device));
+            vkFreeMemory(mDevice, host_memory[i], getHostCallbacks(EHostScope::Device));
+        }
+        return;
+    }
+
+    // Release the pool ranges, the host copies take their place
+    for (unsigned int i = 0; i < victims.size(); i++)
+    {
+        Buffer& buffer = mBuffers[victims[i]];
+        Resident resident;
+        resident.mBuffer = buffer.mBuffer;
+        resident.mAllocation = buffer.mAllocation;
+        resident.mMemoryType = buffer.mMemoryType;
+        destroyResident(resident);
+        buffer.mBuffer = host_buffers[i];
+        buffer.mMemory = host_memory[i];
+        buffer.mResident = false;
+        state.mStreamable -= buffer.mSize;
+        state.mUsage -= std::min(state.mUsage, buffer.mSize);
+        mStats.mResident--;
+        mStats.mEvicted++;
+        mStats.mEvictions++;
+        mStats.mEvictedBytes += buffer.mSize;
+    }
+}
+
+
+void ResidencyManager::completeMoves(bool wait)
+{
+    if (mMoves.empty())
+        return;
+    if (wait)
+        vkWaitForFences(mDevice, 1, &mMoveFence, VK_TRUE, UINT64_MAX);
+    else if (vkGetFenceStatus(mDevice, mMoveFence) != VK_SUCCESS)
+        return;
+    vkResetFences(mDevice, 1, &mMoveFence);
+
+    // Switch every handle to its new range, frames in flight might still read the old one
+    for (const auto& move : mMoves)
+    {
+        Buffer& buffer = mBuffers[move.mHandle];
+        Retired retired;
+        retired.mResident.mBuffer = buffer.mBuffer;
+        retired.mResident.mAllocation = buffer.mAllocation;
+        retired.mResident.mMemoryType = buffer.mMemoryType;
+        retired.mReleaseAt = mFrame + mFrameCount;
+        mRetired.emplace_back(retired);
+
+        buffer.mBuffer = move.mTarget.mBuffer;
+        buffer.mAllocation = move.mTarget.mAllocation;
+        buffer.mMoving = false;
+    }
+    mMoves.clear();
+}
+
+
+void ResidencyManager::releaseRetired(bool all)
+{
+    auto it = std::remove_if(mRetired.begin(), mRetired.end(), [this, all](const Retired& retired)
+    {
+        if (!all && retired.mReleaseAt > mFrame)
+            return false;
+        destroyResident(retired.mResident);
+        return true;
+    });
+    mRetired.erase(it, mRetired.end());
+}
+
+
+void ResidencyManager::defragment()
+{
+    // Nothing changed since the last attempt, the same buffers would fail to move again
+    if (mDefragBudget == 0 || !mMoves.empty() || mLayoutChanges == mSettledLayout)
+        return;
+
+    // Pools with all free memory in one range have nothing to compact
+    std::vector<uint32_t> fragmented;
+    for (const auto& pool : mPools)
+    {
+        if (pool.second.getStats().mFragmentation > 0.0f)
+            fragmented.emplace_back(pool.first);
+    }
+    if (fragmented.empty())
+    {
+        mSettledLayout = mLayoutChanges;
+        return;
+    }
+
+    // Buffers furthest from the start of their pool move first
+    // Buffers a frame in flight uses or the GPU writes are skipped, the copy isn't synchronized with their writes
+    std::vector<ResidentBuffer> candidates;
+    for (ResidentBuffer i = 0; i < mBuffers.size(); i++)
+    {
+        const Buffer& buffer = mBuffers[i];
+        if (buffer.mAlive && buffer.mResident && !buffer.mGpuWritten && buffer.mLastUse + mFrameCount <= mFrame &&
+            std::find(fragmented.begin(), fragmented.end(), buffer.mMemoryType) != fragmented.end())
+            candidates.emplace_back(i);
+    }
+    std::sort(candidates.begin(), candidates.end(), [this](ResidentBuffer a, ResidentBuffer b)
+    {
+        const MemoryAllocation& lhs = mBuffers[a].mAllocation;
+        const MemoryAllocation& rhs = mBuffers[b].mAllocation;
+        return lhs.mBlock != rhs.mBlock ? lhs.mBlock > rhs.mBlock : lhs.mOffset > rhs.mOffset;
+    });
+
+    // Reserve a range closer to the start for as many buffers as the budget allows
+    VkDeviceSize moved = 0;
+    std::vector<Copy> copies;
+    for (ResidentBuffer handle : candidates)
+    {
+        Buffer& buffer = mBuffers[handle];
+        if (moved + buffer.mSize > mDefragBudget)
+            continue;
+
+        Move move;
+        move.mHandle = handle;
+        if (!createResident(buffer.mSize, buffer.mUsage, &buffer, move.mTarget))
+            continue;
+
+        Copy copy;
+        copy.mSrc = buffer.mBuffer;
+        copy.mDst = move.mTarget.mBuffer;
+        copy.mSize = buffer.mSize;
+        copies.emplace_back(copy);
+        mMoves.emplace_back(move);
+        buffer.mMoving = true;
+        moved += buffer.mSize;
+    }
+
+    // Buffers that become idle later are picked up with the next layout change
+    if (copies.empty())
+    {
+        mSettledLayout = mLayoutChanges;
+        return;
+    }
+
+    // Submitted without waiting, the handles switch in a later frame once the fence signaled
+    vkResetCommandPool(mDevice, mMoveCommandPool, 0);
+    recordCopies(mMoveCommandBuffer, copies);
+    VkSubmitInfo submit_info = {};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &mMoveCommandBuffer;
+    if (vkQueueSubmit(mQueue, 1, &submit_info, mMoveFence) != VK_SUCCESS)
+    {
+        LOG_ERROR(Memory) << "unable to submit defragmentation copies";
+        for (const auto& move : mMoves)
+        {
+            destroyResident(move.mTarget);
+            mBuffers[move.mHandle].mMoving = false;
+        }
+        mMoves.clear();
+        return;
+    }
+    mStats.mMoves += mMoves.size();
+    mStats.mMovedBytes += moved;
+    mStats.mDefragFrames++;
+}
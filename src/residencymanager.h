@@ -0,0 +1,241 @@
+#pragma once
+
+#include "memorypool.h"
+#include "uploadservice.h"
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <map>
+
+/**
+ * Handle to a streamable buffer owned by the residency manager, stays valid while the buffer is evicted and restored
+ */
+using ResidentBuffer = uint32_t;
+constexpr ResidentBuffer gInvalidResidentBuffer = 0xFFFFFFFF;
+
+
+/**
+ * Memory state of a single heap, in bytes
+ */
+struct ResidencyHeap
+{
+    VkDeviceSize    mSize = 0;                  ///< Size of the heap
+    VkDeviceSize    mBudget = 0;                ///< Memory the process can use before the driver starts paging
+    VkDeviceSize    mUsage = 0;                 ///< Memory used by the process, all allocations, not only streamable buffers
+    VkDeviceSize    mStreamable = 0;            ///< Memory used by resident streamable buffers
+    bool            mDeviceLocal = false;
+};
+
+
+/**
+ * Residency counters, heaps are updated every frame
+ */
+struct ResidencyStats
+{
+    std::vector<ResidencyHeap>  mHeaps;
+    bool                        mMeasured = false;          ///< If budget and usage are reported by VK_EXT_memory_budget, estimated otherwise
+    uint64_t                    mResident = 0;              ///< Number of streamable buffers in device local memory
+    uint64_t                    mEvicted = 0;               ///< Number of streamable buffers in host memory
+    uint64_t                    mEvictions = 0;             ///< Number of times a buffer was moved to host memory
+    uint64_t                    mRestores = 0;              ///< Number of times a buffer was moved back to device local memory
+    uint64_t                    mEvictedBytes = 0;          ///< Total bytes moved to host memory
+    uint64_t                    mRestoredBytes = 0;         ///< Total bytes moved back to device local memory
+    uint64_t                    mPressuredFrames = 0;       ///< Number of frames a heap exceeded the eviction threshold
+    MemoryPoolStats             mPools;                     ///< Combined state of the device local pools, fragmentation of the worst pool
+    uint64_t                    mMoves = 0;                 ///< Number of buffers moved by the defragmenter
+    uint64_t                    mMovedBytes = 0;            ///< Total bytes moved by the defragmenter
+    uint64_t                    mDefragFrames = 0;          ///< Number of frames the defragmenter moved buffers in
+};
+
+
+/**
+ * Keeps device local memory usage below the budget of every heap by moving streamable buffers to host memory.
+ *
+ * Budget and usage of every heap are queried once per frame using VK_EXT_memory_budget. Without the extension the
+ * budget is estimated as a fraction of the heap size and usage is the memory of the streamable buffers.
+ * When usage exceeds the eviction threshold, the least recently used buffers that are no longer in flight are copied
+ * to host memory and their device memory is freed, until usage drops below the eviction target.
+ * That happens before the driver starts paging, which would move memory at a moment of its choosing.
+ * An evicted buffer is copied back to device local memory the next time it is used.
+ *
+ * Copies are submitted to the given queue and waited on, eviction and restoration are rare and the
+ * thresholds keep them from happening every frame. Resident buffers can also be used by a second queue family,
+ * ie: compute, they're shared concurrently with it and never change owner.
+ *
+ * Resident buffers are sub-allocated from memory pools, one per memory type. Long sessions leave holes in those
+ * pools, which are compacted incrementally under memory pressure: while a device local heap is above the eviction
+ * target, every frame buffers at the end of the pool are copied into holes closer to the start, bounded by a byte
+ * budget. Compaction frees the blocks it empties, which can keep usage from reaching the eviction threshold. Moves are submitted without waiting, the handle switches to the
+ * new buffer once the copy completed. The old range is released after the frames in flight that might still
+ * read it completed. Descriptors are written every frame from the buffer returned by use(), no descriptor
+ * refers to a buffer that moved. Only buffers no frame in flight uses are moved, and never buffers the GPU writes:
+ * the copy isn't synchronized with their writes, which would be lost when the handle switches. A layout the
+ * defragmenter couldn't improve isn't retried until a buffer is created, destroyed or moved.
+ *
+ * With VK_KHR_buffer_device_address, buffers are created with shader device address usage and their pools are
+ * allocated with the device address flag. Moves, eviction and restoration change the address of a buffer, which is
+ * why getAddress() is called every frame, the same way use() is.
+ */
+class ResidencyManager
+{
+public:
+    ResidencyManager() = default;
+    ~ResidencyManager();
+
+    ResidencyManager(const ResidencyManager&) = delete;
+    ResidencyManager& operator=(const ResidencyManager&) = delete;
+
+    /**
+     * @param instance instance used to load vkGetPhysicalDeviceMemoryProperties2KHR, only used with memoryBudget
+     * @param physicalDevice gpu the heaps belong to
+     * @param device the device buffers are created on
+     * @param queueFamily queue family of the queue copies are submitted to
+     * @param queue queue copies are submitted to, buffers are used on the same queue
+     * @param sharedFamily queue family that uses the buffers next to queueFamily, resident buffers are shared concurrently when it differs
+     * @param uploads uploads the initial contents of buffers, decides which memory type buffers are created in
+     * @param frameCount number of frames in flight, a buffer used within that many frames is never evicted
+     * @param memoryBudget if VK_EXT_memory_budget is enabled on the device
+     * @param bufferDeviceAddress if the bufferDeviceAddress feature is enabled on the device
+     * @param evictThreshold fraction of the budget at which eviction starts
+     * @param evictTarget fraction of the budget eviction brings usage back to, the defragmenter runs while usage is above it
+     * @param defragBudget maximum number of bytes moved by the defragmenter per frame, 0 disables defragmentation
+     */
+    bool init(VkInstance instance, VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamily, VkQueue queue,
+        uint32_t sharedFamily, UploadService& uploads, unsigned int frameCount, bool memoryBudget, bool bufferDeviceAddress, float evictThreshold, float evictTarget,
+        VkDeviceSize defragBudget);
+
+    /**
+     * Destroys all buffers and the copy objects, the device must be idle
+     */
+    void destroy();
+
+    /**
+     * Creates a streamable buffer in device local memory, its contents are written directly when the memory is host visible,
+     * uploaded through a staging buffer otherwise
+     * @param size size of the buffer in bytes
+     * @param usage how the buffer is used, transfer usage required for eviction and shader device address usage are added
+     * @param data initial contents, size bytes
+     * @param gpuWritten if the GPU writes the buffer, ie: from a compute shader, such buffers are never moved by the defragmenter
+     * @return the buffer, gInvalidResidentBuffer when it couldn't be created
+     */
+    ResidentBuffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, const void* data, bool gpuWritten);
+
+    /**
+     * Destroys a streamable buffer, the GPU must no longer use it
+     */
+    void destroyBuffer(ResidentBuffer buffer);
+
+    /**
+     * Marks the buffer as used by the current frame, restores it to device local memory when it was evicted
+     * @return the buffer to bind, VK_NULL_HANDLE when it couldn't be restored
+     */
+    VkBuffer use(ResidentBuffer buffer);
+
+    /**
+     * Marks the buffer as used by the current frame like use(), requires buffer device addresses
+     * @return GPU address of the buffer, only valid for the current frame, 0 when it couldn't be restored
+     */
+    VkDeviceAddress getAddress(ResidentBuffer buffer);
+
+    /**
+     * @return if buffer addresses can be queried using getAddress()
+     */
+    bool hasAddresses() const                                           { return mGetBufferAddress != nullptr; }
+
+    /**
+     * Starts a new frame: completes finished moves, queries budget and usage of every heap, evicts buffers from heaps
+     * that exceed the threshold and starts moving buffers into holes of the pools when a heap exceeds the target.
+     * Call after waiting for the fence of the frame in flight.
+     */
+    void update();
+
+    /**
+     * @return residency counters and the state of every heap
+     */
+    const ResidencyStats& getStats() const                              { return mStats; }
+
+private:
+    struct Buffer
+    {
+        VkBuffer            mBuffer = VK_NULL_HANDLE;       ///< Device local buffer when resident, host copy when evicted
+        VkDeviceMemory      mMemory = VK_NULL_HANDLE;       ///< Memory of the host copy, resident buffers live in a pool
+        MemoryAllocation    mAllocation;                    ///< Range in the pool of the memory type, when resident
+        uint32_t            mMemoryType = 0;
+        VkDeviceSize        mSize = 0;
+        VkBufferUsageFlags  mUsage = 0;
+        uint32_t            mHeap = 0;                      ///< Heap of the device local memory
+        uint64_t            mLastUse = 0;                   ///< Frame the buffer was last used in
+        bool                mResident = false;
+        bool                mMoving = false;                ///< If a copy to a new range is in flight
+        bool                mGpuWritten = false;            ///< If the GPU writes the buffer, it stays in its range until evicted
+        bool                mAlive = false;
+    };
+
+    struct Resident
+    {
+        VkBuffer            mBuffer = VK_NULL_HANDLE;
+        MemoryAllocation    mAllocation;
+        uint32_t            mMemoryType = 0;
+        uint32_t            mHeap = 0;
+    };
+
+    struct Move
+    {
+        ResidentBuffer      mHandle = gInvalidResidentBuffer;
+        Resident            mTarget;
+    };
+
+    struct Retired
+    {
+        Resident            mResident;
+        uint64_t            mReleaseAt = 0;                 ///< Frame after which no frame in flight uses the range
+    };
+
+    struct Copy
+    {
+        VkBuffer            mSrc = VK_NULL_HANDLE;
+        VkBuffer            mDst = VK_NULL_HANDLE;
+        VkDeviceSize        mSize = 0;
+    };
+
+    bool createMemory(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags required, VkMemoryHeapFlags excludedHeap,
+        VkBuffer& outBuffer, VkDeviceMemory& outMemory, uint32_t& outHeap);
+    bool createResident(VkDeviceSize size, VkBufferUsageFlags usage, const Buffer* moved, Resident& outResident);
+    void destroyResident(const Resident& resident);
+    void recordCopies(VkCommandBuffer commandBuffer, const std::vector<Copy>& copies);
+    bool submitCopies(const std::vector<Copy>& copies);
+    void queryHeaps();
+    void evict(uint32_t heap);
+    void completeMoves(bool wait);
+    void releaseRetired(bool all);
+    void defragment();
+
+    VkPhysicalDevice                mPhysicalDevice = VK_NULL_HANDLE;
+    VkDevice                        mDevice = VK_NULL_HANDLE;
+    VkQueue                         mQueue = VK_NULL_HANDLE;
+    std::vector<uint32_t>           mQueueFamilies;                     ///< Families resident buffers are used on, concurrent when more than one
+    UploadService*                  mUploads = nullptr;
+    VkCommandPool                   mCommandPool = VK_NULL_HANDLE;
+    VkCommandBuffer                 mCommandBuffer = VK_NULL_HANDLE;
+    VkFence                         mFence = VK_NULL_HANDLE;            ///< Signaled when a copy submission completed
+    VkCommandPool                   mMoveCommandPool = VK_NULL_HANDLE;
+    VkCommandBuffer                 mMoveCommandBuffer = VK_NULL_HANDLE;
+    VkFence                         mMoveFence = VK_NULL_HANDLE;        ///< Signaled when the defragmenter copies completed
+    PFN_vkGetPhysicalDeviceMemoryProperties2KHR mGetMemoryProperties2 = nullptr;
+    PFN_vkGetBufferDeviceAddressKHR mGetBufferAddress = nullptr;        ///< Loaded when buffer device addresses are enabled
+    VkPhysicalDeviceMemoryProperties mMemoryProperties = {};
+    bool                            mEvictable = false;                 ///< If a heap outside device local memory exists
+    unsigned int                    mFrameCount = 0;
+    float                           mEvictThreshold = 1.0f;
+    float                           mEvictTarget = 1.0f;
+    VkDeviceSize                    mDefragBudget = 0;
+    uint64_t                        mFrame = 0;
+    uint64_t                        mLayoutChanges = 0;                 ///< Incremented whenever a range of a pool is reserved or released
+    uint64_t                        mSettledLayout = UINT64_MAX;        ///< Value of mLayoutChanges when the defragmenter last found nothing to move
+    std::vector<Buffer>             mBuffers;
+    std::vector<ResidentBuffer>     mFreeBuffers;                       ///< Handles of destroyed buffers, reused first
+    std::map<uint32_t, MemoryPool>  mPools;                             ///< Device local pools by memory type
+    std::vector<Move>               mMoves;                             ///< Moves waiting for mMoveFence
+    std::vector<Retired>            mRetired;                           ///< Ranges that were moved away from
+    ResidencyStats                  mStats;
+};
@@ -0,0 +1,303 @@
+#include "resourcestatetracker.h"
+#include "logger.h"
+
+#include <assert.h>
+
+/**
+ * Every access flag that writes memory, all others only read
+ */
+static const VkAccessFlags2 gWriteAccess =
+    VK_ACCESS_2_SHADER_WRITE_BIT |
+    VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT |
+    VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT |
+    VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+    VK_ACCESS_2_TRANSFER_WRITE_BIT |
+    VK_ACCESS_2_HOST_WRITE_BIT |
+    VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+
+bool ResourceStateTracker::init(VkDevice device)
+{
+    // Core since 1.3, the KHR entry point is only there when the extension is enabled
+    mCmdPipelineBarrier2 = reinterpret_cast<PFN_vkCmdPipelineBarrier2KHR>(vkGetDeviceProcAddr(device, "vkCmdPipelineBarrier2KHR"));
+    if (mCmdPipelineBarrier2 == nullptr)
+        mCmdPipelineBarrier2 = reinterpret_cast<PFN_vkCmdPipelineBarrier2KHR>(vkGetDeviceProcAddr(device, "vkCmdPipelineBarrier2"));
+    if (mCmdPipelineBarrier2 == nullptr)
+    {
+        LOG_ERROR(Render) << "unable to load vkCmdPipelineBarrier2, is synchronization2 enabled?";
+        return false;
+    }
+    return true;
+}
+
+
+void ResourceStateTracker::registerImage(VkImage image, VkImageAspectFlags aspect, VkImageLayout layout)
+{
+    TrackedImage& tracked = mImages[image];
+    tracked.mState = State();
+    tracked.mState.mLayout = layout;
+    tracked.mAspect = aspect;
+}
+
+
+void ResourceStateTracker::registerBuffer(VkBuffer buffer)
+{
+    mBuffers[buffer] = State();
+}
+
+
+void ResourceStateTracker::forgetImage(VkImage image)
+{
+    assert(mPendingStates.empty());
+    mImages.erase(image);
+}
+
+
+void ResourceStateTracker::forgetBuffer(VkBuffer buffer)
+{
+    assert(mPendingStates.empty());
+    mBuffers.erase(buffer);
+}
+
+
+void ResourceStateTracker::resetImage(VkImage image, VkImageLayout layout, VkPipelineStageFlags2 waitStage, VkAccessFlags2 waitAccess)
+{
+    auto it = mImages.find(image);
+    assert(it != mImages.end());
+    assert(it->second.mState.mPending < 0);
+
+    // Treat the previous use as a write: the next barrier chains to its stage and makes its access available
+    State& state = it->second.mState;
+    state = State();
+    state.mLayout = layout;
+    state.mWriteStage = waitStage;
+    state.mWriteAccess = waitAccess;
+}
+
+
+void ResourceStateTracker::transitionImage(VkImage image, VkPipelineStageFlags2 stage, VkAccessFlags2 access, VkImageLayout layout)
+{
+    auto it = mImages.find(image);
+    assert(it != mImages.end());
+    TrackedImage& tracked = it->second;
+    State& state = tracked.mState;
+
+    VkImageLayout old_layout = state.mLayout;
+    Barrier barrier;
+    if (!transition(state, stage, access, layout, barrier))
+        return;
+
+    // Extend the pending barrier, the resource isn't accessed in between
+    if (state.mPending >= 0)
+    {
+        VkImageMemoryBarrier2KHR& pending = mImageBarriers[state.mPending];
+        pending.dstStageMask |= barrier.mDstStage;
+        pending.dstAccessMask |= barrier.mDstAccess;
+        pending.newLayout = layout;
+        mStats.mMerged++;
+        return;
+    }
+
+    VkImageMemoryBarrier2KHR image_barrier = {};
+    image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2_KHR;
+    image_barrier.srcStageMask = barrier.mSrcStage;
+    image_barrier.srcAccessMask = barrier.mSrcAccess;
+    image_barrier.dstStageMask = barrier.mDstStage;
+    image_barrier.dstAccessMask = barrier.mDstAccess;
+    image_barrier.oldLayout = old_layout;
+    image_barrier.newLayout = layout;
+    image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    image_barrier.image = image;
+    image_barrier.subresourceRange.aspectMask = tracked.mAspect;
+    image_barrier.subresourceRange.baseMipLevel = 0;
+    image_barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+    image_barrier.subresourceRange.baseArrayLayer = 0;
+    image_barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+
+    state.mPending = static_cast<int>(mImageBarriers.size());
+    mImageBarriers.emplace_back(image_barrier);
+    mPendingStates.emplace_back(&state);
+}
+
+
+void ResourceStateTracker::transitionBuffer(VkBuffer buffer, VkPipelineStageFlags2 stage, VkAccessFlags2 access)
+{
+    auto it = mBuffers.find(buffer);
+    assert(it != mBuffers.end());
+    State& state = it->second;
+
+    Barrier barrier;
+    if (!transition(state, stage, access, VK_IMAGE_LAYOUT_UNDEFINED, barrier))
+        return;
+
+    if (state.mPending >= 0)
+    {
+        VkBufferMemoryBarrier2KHR& pending = mBufferBarriers[state.mPending];
+        pending.dstStageMask |= barrier.mDstStage;
+        pending.dstAccessMask |= barrier.mDstAccess;
+        mStats.mMerged++;
+        return;
+    }
+
+    VkBufferMemoryBarrier2KHR buffer_barrier = {};
+    buffer_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2_KHR;
+    buffer_barrier.srcStageMask = barrier.mSrcStage;
+    buffer_barrier.srcAccessMask = barrier.mSrcAccess;
+    buffer_barrier.dstStageMask = barrier.mDstStage;
+    buffer_barrier.dstAccessMask = barrier.mDstAccess;
+    buffer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    buffer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    buffer_barrier.buffer = buffer;
+    buffer_barrier.offset = 0;
+    buffer_barrier.size = VK_WHOLE_SIZE;
+
+    state.mPending = static_cast<int>(mBufferBarriers.size());
+    mBufferBarriers.emplace_back(buffer_barrier);
+    mPendingStates.emplace_back(&state);
+}
+
+
+void ResourceStateTracker::releaseImage(VkImage image, VkImageLayout layout, uint32_t srcFamily, uint32_t dstFamily)
+{
+    auto it = mImages.find(image);
+    assert(it != mImages.end());
+    State& state = it->second.mState;
+
+    // Ownership transfers require a barrier, even when the layout doesn't change
+    transitionImage(image, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, layout);
+    if (state.mPending < 0)
+    {
+        VkImageMemoryBarrier2KHR image_barrier = {};
+        image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2_KHR;
+        image_barrier.srcStageMask = state.mWriteStage | state.mReadStages;
+        image_barrier.srcAccessMask = state.mWriteAccess;
+        image_barrier.oldLayout = layout;
+        image_barrier.newLayout = layout;
+        image_barrier.image = image;
+        image_barrier.subresourceRange.aspectMask = it->second.mAspect;
+        image_barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+        image_barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+
+        state.mPending = static_cast<int>(mImageBarriers.size());
+        mImageBarriers.emplace_back(image_barrier);
+        mPendingStates.emplace_back(&state);
+    }
+
+    // The destination stage of a release is ignored, the acquire repeats the layouts and waits on the destination queue
+    VkImageMemoryBarrier2KHR& release = mImageBarriers[state.mPending];
+    release.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+    release.dstAccessMask = VK_ACCESS_2_NONE;
+    release.srcQueueFamilyIndex = srcFamily;
+    release.dstQueueFamilyIndex = dstFamily;
+
+    VkImageMemoryBarrier2KHR acquire = release;
+    acquire.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+    acquire.srcAccessMask = VK_ACCESS_2_NONE;
+    acquire.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    mAcquireBarriers.emplace_back(acquire);
+}
+
+
+void ResourceStateTracker::flush(VkCommandBuffer commandBuffer)
+{
+    if (mImageBarriers.empty() && mBufferBarriers.empty())
+        return;
+
+    VkDependencyInfoKHR dependency_info = {};
+    dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
+    dependency_info.bufferMemoryBarrierCount = static_cast<uint32_t>(mBufferBarriers.size());
+    dependency_info.pBufferMemoryBarriers = mBufferBarriers.data();
+    dependency_info.imageMemoryBarrierCount = static_cast<uint32_t>(mImageBarriers.size());
+    dependency_info.pImageMemoryBarriers = mImageBarriers.data();
+    mCmdPipelineBarrier2(commandBuffer, &dependency_info);
+
+    mStats.mBarriers += mImageBarriers.size() + mBufferBarriers.size();
+    mStats.mBatches++;
+
+    for (auto* state : mPendingStates)
+        state->mPending = -1;
+    mPendingStates.clear();
+    mImageBarriers.clear();
+    mBufferBarriers.clear();
+}
+
+
+void ResourceStateTracker::flushAcquire(VkCommandBuffer commandBuffer)
+{
+    if (mAcquireBarriers.empty())
+        return;
+
+    VkDependencyInfoKHR dependency_info = {};
+    dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
+    dependency_info.imageMemoryBarrierCount = static_cast<uint32_t>(mAcquireBarriers.size());
+    dependency_info.pImageMemoryBarriers = mAcquireBarriers.data();
+    mCmdPipelineBarrier2(commandBuffer, &dependency_info);
+
+    mStats.mBarriers += mAcquireBarriers.size();
+    mStats.mBatches++;
+    mAcquireBarriers.clear();
+}
+
+
+VkImageLayout ResourceStateTracker::getLayout(VkImage image) const
+{
+    auto it = mImages.find(image);
+    return it != mImages.end() ? it->second.mState.mLayout : VK_IMAGE_LAYOUT_UNDEFINED;
+}
+
+
+bool ResourceStateTracker::transition(State& state, VkPipelineStageFlags2 stage, VkAccessFlags2 access, VkImageLayout layout, Barrier& outBarrier)
+{
+    mStats.mTransitions++;
+    bool layout_change = layout != state.mLayout;
+    bool write = (access & gWriteAccess) != 0;
+
+    // Writes and layout transitions wait for every earlier access, only earlier writes need to be made available
+    if (write || layout_change)
+    {
+        VkPipelineStageFlags2 src_stage = state.mWriteStage | state.mReadStages;
+        if (src_stage == VK_PIPELINE_STAGE_2_NONE && !layout_change)
+        {
+            // First use of an idle resource
+            state.mWriteStage = stage;
+            state.mWriteAccess = access & gWriteAccess;
+            state.mVisibleStages = VK_PIPELINE_STAGE_2_NONE;
+            state.mVisibleAccess = VK_ACCESS_2_NONE;
+            state.mReadStages = VK_PIPELINE_STAGE_2_NONE;
+            mStats.mSkipped++;
+            return false;
+        }
+
+        outBarrier.mSrcStage = src_stage;
+        outBarrier.mSrcAccess = state.mWriteAccess;
+        outBarrier.mDstStage = stage;
+        outBarrier.mDstAccess = access;
+
+        // A layout transition counts as a write that is visible to the destination access
+        state.mWriteStage = stage;
+        state.mWriteAccess = access & gWriteAccess;
+        state.mVisibleStages = write ? VK_PIPELINE_STAGE_2_NONE : stage;
+        state.mVisibleAccess = write ? VK_ACCESS_2_NONE : access;
+        state.mReadStages = write ? VK_PIPELINE_STAGE_2_NONE : stage;
+        state.mLayout = layout;
+        return true;
+    }
+
+    // Read after read, or the write is already visible to this stage and access
+    state.mReadStages |= stage;
+    if (state.mWriteStage == VK_PIPELINE_STAGE_2_NONE ||
+        ((stage & ~state.mVisibleStages) == 0 && (access & ~state.mVisibleAccess) == 0))
+    {
+        mStats.mSkipped++;
+        return false;
+    }
+
+    outBarrier.mSrcStage = state.mWriteStage;
+    outBarrier.mSrcAccess = state.mWriteAccess;
+    outBarrier.mDstStage = stage;
+    outBarrier.mDstAccess = access;
+    state.mVisibleStages |= stage;
+    state.mVisibleAccess |= access;
+    return true;
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <unordered_map>
+
+/**
+ * State tracker counters
+ */
+struct ResourceStateTrackerStats
+{
+    uint64_t    mTransitions = 0;       ///< Number of requested transitions
+    uint64_t    mSkipped = 0;           ///< Number of transitions that didn't require a barrier
+    uint64_t    mMerged = 0;            ///< Number of transitions folded into a barrier that was already pending
+    uint64_t    mBarriers = 0;          ///< Number of image and buffer barriers recorded
+    uint64_t    mBatches = 0;           ///< Number of vkCmdPipelineBarrier2 calls
+};
+
+
+/**
+ * Tracks the layout, last access and pipeline stage of every registered image and buffer
+ * and derives the barriers required to move a resource into a new state.
+ *
+ * Transitions are only recorded, nothing is written to a command buffer until flush() is called,
+ * which emits all pending barriers in a single vkCmdPipelineBarrier2 call.
+ * Barriers are only generated when required:
+ *   - layout changes and writes after any access get a full barrier
+ *   - reads after a write get a barrier unless that write was already made visible to the stage and access
+ *   - reads after reads in the same layout are free
+ * Transitioning a resource that already has a pending barrier extends that barrier.
+ * Record all transitions required by the next command(s), then flush() before recording them.
+ *
+ * State is tracked for entire resources (all mips and layers) on a single queue, in submission order.
+ * Images can be handed to another queue family with releaseImage(), the matching acquire barriers are recorded
+ * on the destination queue by flushAcquire().
+ * Requires the synchronization2 feature, through VK_KHR_synchronization2 or Vulkan 1.3. Not thread safe.
+ */
+class ResourceStateTracker
+{
+public:
+    ResourceStateTracker() = default;
+
+    ResourceStateTracker(const ResourceStateTracker&) = delete;
+    ResourceStateTracker& operator=(const ResourceStateTracker&) = delete;
+
+    /**
+     * Loads vkCmdPipelineBarrier2KHR from the device
+     * @return if the synchronization2 entry point is available
+     */
+    bool init(VkDevice device);
+
+    /**
+     * Starts tracking an image, assumed to be idle in the given layout
+     */
+    void registerImage(VkImage image, VkImageAspectFlags aspect, VkImageLayout layout);
+
+    /**
+     * Starts tracking a buffer, assumed to be idle
+     */
+    void registerBuffer(VkBuffer buffer);
+
+    /**
+     * Stops tracking an image, call before the image is destroyed: handles can be reused
+     */
+    void forgetImage(VkImage image);
+
+    /**
+     * Stops tracking a buffer, call before the buffer is destroyed: handles can be reused
+     */
+    void forgetBuffer(VkBuffer buffer);
+
+    /**
+     * Re-bases the state of an image whose previous use isn't known to the tracker,
+     * ie: an acquired swap chain image or an image that aliases the memory of another one.
+     * The next barrier on the image is chained to the given stage and makes the given access available.
+     * @param image the tracked image
+     * @param layout the layout of the image, VK_IMAGE_LAYOUT_UNDEFINED to discard the contents
+     * @param waitStage pipeline stage to wait for, ie: the stage a semaphore wait blocks
+     * @param waitAccess memory writes to make available before the next access, ie: by an aliased image
+     */
+    void resetImage(VkImage image, VkImageLayout layout, VkPipelineStageFlags2 waitStage, VkAccessFlags2 waitAccess);
+
+    /**
+     * Records that the image is accessed next in the given stage, with the given access and layout
+     */
+    void transitionImage(VkImage image, VkPipelineStageFlags2 stage, VkAccessFlags2 access, VkImageLayout layout);
+
+    /**
+     * Records that the buffer is accessed next in the given stage with the given access
+     */
+    void transitionBuffer(VkBuffer buffer, VkPipelineStageFlags2 stage, VkAccessFlags2 access);
+
+    /**
+     * Records the release half of a queue family ownership transfer, combined with the transition into the given layout.
+     * The image can't be accessed on this queue afterwards until it is reset.
+     * @param image the tracked image
+     * @param layout the layout of the image on the destination queue
+     * @param srcFamily the queue family the image is currently owned by
+     * @param dstFamily the queue family that acquires the image
+     */
+    void releaseImage(VkImage image, VkImageLayout layout, uint32_t srcFamily, uint32_t dstFamily);
+
+    /**
+     * Writes all pending barriers into the command buffer using a single call, does nothing when none are pending
+     */
+    void flush(VkCommandBuffer commandBuffer);
+
+    /**
+     * Writes the acquire half of all released images into a command buffer of the destination queue,
+     * call after flush() and after the releasing submission is ordered before it, ie: with a semaphore
+     */
+    void flushAcquire(VkCommandBuffer commandBuffer);
+
+    /**
+     * @return the layout the image is in after all recorded transitions
+     */
+    VkImageLayout getLayout(VkImage image) const;
+
+    /**
+     * @return tracker counters
+     */
+    const ResourceStateTrackerStats& getStats() const                    { return mStats; }
+
+private:
+    struct State
+    {
+        VkPipelineStageFlags2   mWriteStage = VK_PIPELINE_STAGE_2_NONE;     ///< Stage of the last write or layout transition
+        VkAccessFlags2          mWriteAccess = VK_ACCESS_2_NONE;            ///< Access of the last write, to make available
+        VkPipelineStageFlags2   mVisibleStages = VK_PIPELINE_STAGE_2_NONE;  ///< Stages the last write is visible to
+        VkAccessFlags2          mVisibleAccess = VK_ACCESS_2_NONE;          ///< Access the last write is visible to
+        VkPipelineStageFlags2   mReadStages = VK_PIPELINE_STAGE_2_NONE;     ///< Stages that read since the last write
+        VkImageLayout           mLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        int                     mPending = -1;                              ///< Index of the pending barrier, -1 when none
+    };
+
+    struct TrackedImage
+    {
+        State                   mState;
+        VkImageAspectFlags      mAspect = 0;
+    };
+
+    struct Barrier
+    {
+        VkPipelineStageFlags2   mSrcStage = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2          mSrcAccess = VK_ACCESS_2_NONE;
+        VkPipelineStageFlags2   mDstStage = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2          mDstAccess = VK_ACCESS_2_NONE;
+    };
+
+    bool transition(State& state, VkPipelineStageFlags2 stage, VkAccessFlags2 access, VkImageLayout layout, Barrier& outBarrier);
+
+    PFN_vkCmdPipelineBarrier2KHR                    mCmdPipelineBarrier2 = nullptr;
+    std::unordered_map<VkImage, TrackedImage>       mImages;
+    std::unordered_map<VkBuffer, State>             mBuffers;
+    std::vector<VkImageMemoryBarrier2KHR>           mImageBarriers;
+    std::vector<VkBufferMemoryBarrier2KHR>          mBufferBarriers;
+    std::vector<VkImageMemoryBarrier2KHR>           mAcquireBarriers;   ///< Acquire half of released images
+    std::vector<State*>                             mPendingStates;     ///< States referenced by a pending barrier
+    ResourceStateTrackerStats                       mStats;
+};
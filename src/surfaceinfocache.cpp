@@ -0,0 +1,126 @@
+#include "surfaceinfocache.h"
+#include "logger.h"
+
+
+void SurfaceInfoCache::init(VkPhysicalDevice physicalDevice, VkInstance instance)
+{
+    mPhysicalDevice = physicalDevice;
+    mEntries.clear();
+    mGetCapabilities2 = instance == VK_NULL_HANDLE ? nullptr :
+        reinterpret_cast<PFN_vkGetPhysicalDeviceSurfaceCapabilities2KHR>(vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceSurfaceCapabilities2KHR"));
+}
+
+
+const SurfaceInfo* SurfaceInfoCache::query(VkSurfaceKHR surface)
+{
+    mStats.mQueries++;
+    Entry& entry = mEntries[surface];
+    if (vkGetPhysicalDeviceSurfaceCapabilitiesKHR(mPhysicalDevice, surface, &entry.mInfo.mCapabilities) != VK_SUCCESS)
+    {
+        LOG_ERROR(Surface) << "unable to acquire surface capabilities";
+        return nullptr;
+    }
+
+    if (!entry.mValid)
+    {
+        if (!enumerate(surface, entry.mInfo))
+            return nullptr;
+        entry.mValid = true;
+        mStats.mFullQueries++;
+    }
+    return &entry.mInfo;
+}
+
+
+VkPresentScalingFlagsEXT SurfaceInfoCache::getPresentScaling(VkSurfaceKHR surface, VkPresentModeKHR mode)
+{
+    if (mGetCapabilities2 == nullptr)
+        return 0;
+
+    Entry& entry = mEntries[surface];
+    if (entry.mScalingValid && entry.mScalingMode == mode)
+        return entry.mScaling;
+
+    // Scaling capabilities are specific to a present mode
+    VkSurfacePresentModeEXT present_mode = {};
+    present_mode.sType = VK_STRUCTURE_TYPE_SURFACE_PRESENT_MODE_EXT;
+    present_mode.presentMode = mode;
+
+    VkPhysicalDeviceSurfaceInfo2KHR surface_info = {};
+    surface_info.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SURFACE_INFO_2_KHR;
+    surface_info.pNext = &present_mode;
+    surface_info.surface = surface;
+
+    VkSurfacePresentScalingCapabilitiesEXT scaling = {};
+    scaling.sType = VK_STRUCTURE_TYPE_SURFACE_PRESENT_SCALING_CAPABILITIES_EXT;
+    VkSurfaceCapabilities2KHR capabilities = {};
+    capabilities.sType = VK_STRUCTURE_TYPE_SURFACE_CAPABILITIES_2_KHR;
+    capabilities.pNext = &scaling;
+    if (mGetCapabilities2(mPhysicalDevice, &surface_info, &capabilities) != VK_SUCCESS)
+    {
+        LOG_ERROR(Surface) << "unable to acquire surface present scaling capabilities";
+        return 0;
+    }
+
+    entry.mScaling = scaling.supportedPresentScaling;
+    entry.mScalingMode = mode;
+    entry.mScalingValid = true;
+    return entry.mScaling;
+}
+
+
+void SurfaceInfoCache::invalidate(VkSurfaceKHR surface)
+{
+    auto it = mEntries.find(surface);
+    if (it == mEntries.end() || !it->second.mValid)
+        return;
+    it->second.mValid = false;
+    it->second.mScalingValid = false;
+    mStats.mInvalidations++;
+}
+
+
+void SurfaceInfoCache::invalidateAll()
+{
+    for (auto& entry : mEntries)
+        invalidate(entry.first);
+}
+
+
+void SurfaceInfoCache::forget(VkSurfaceKHR surface)
+{
+    mEntries.erase(surface);
+}
+
+
+bool SurfaceInfoCache::enumerate(VkSurfaceKHR surface, SurfaceInfo& outInfo)
+{
+    uint32_t format_count(0);
+    if (vkGetPhysicalDeviceSurfaceFormatsKHR(mPhysicalDevice, surface, &format_count, nullptr) != VK_SUCCESS)
+    {
+        LOG_ERROR(Surface) << "unable to query number of supported surface formats";
+        return false;
+    }
+
+    outInfo.mFormats.resize(format_count);
+    if (vkGetPhysicalDeviceSurfaceFormatsKHR(mPhysicalDevice, surface, &format_count, outInfo.mFormats.data()) != VK_SUCCESS)
+    {
+        LOG_ERROR(Surface) << "unable to query all supported surface formats";
+        return false;
+    }
+
+    uint32_t mode_count(0);
+    if (vkGetPhysicalDeviceSurfacePresentModesKHR(mPhysicalDevice, surface, &mode_count, nullptr) != VK_SUCCESS)
+    {
+        LOG_ERROR(Surface) << "unable to query present mode count for physical device";
+        return false;
+    }
+
+    outInfo.mPresentModes.resize(mode_count);
+    if (vkGetPhysicalDeviceSurfacePresentModesKHR(mPhysicalDevice, surface, &mode_count, outInfo.mPresentModes.data()) != VK_SUCCESS)
+    {
+        LOG_ERROR(Surface) << "unable to query the various present modes for physical device";
+        return false;
+    }
+    return true;
+}
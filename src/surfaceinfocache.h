@@ -0,0 +1,94 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <unordered_map>
+
+/**
+ * Properties of a surface that are required to create a swap chain
+ */
+struct SurfaceInfo
+{
+    VkSurfaceCapabilitiesKHR        mCapabilities = {};     ///< Refreshed on every query, the current extent follows the window
+    std::vector<VkSurfaceFormatKHR> mFormats;               ///< Supported formats, cached until invalidated
+    std::vector<VkPresentModeKHR>   mPresentModes;          ///< Supported present modes, cached until invalidated
+};
+
+
+/**
+ * Surface info cache counters
+ */
+struct SurfaceInfoCacheStats
+{
+    uint64_t    mQueries = 0;               ///< Number of requests for surface info
+    uint64_t    mFullQueries = 0;           ///< Number of requests that enumerated formats and present modes
+    uint64_t    mInvalidations = 0;         ///< Number of surfaces invalidated
+};
+
+
+/**
+ * Caches the supported formats and present modes of every surface.
+ * Swap chain recreation, ie: on every resize, only needs the current capabilities of the surface. Those are a single
+ * call and always refreshed, the formats and present modes take two enumeration calls each and only change when the
+ * window moves to another display or the display configuration changes. Call invalidate() or invalidateAll() on
+ * those events, the next query enumerates them again.
+ * With VK_EXT_surface_maintenance1 the scaling behaviors supported by a present mode are cached as well.
+ */
+class SurfaceInfoCache
+{
+public:
+    /**
+     * @param physicalDevice the device the surfaces are presented from
+     * @param instance used to query present scaling, VK_NULL_HANDLE when VK_EXT_surface_maintenance1 isn't enabled
+     */
+    void init(VkPhysicalDevice physicalDevice, VkInstance instance = VK_NULL_HANDLE);
+
+    /**
+     * Returns the info of a surface, formats and present modes are only enumerated the first time or after invalidation
+     * @return the surface info, nullptr when the surface could not be queried
+     */
+    const SurfaceInfo* query(VkSurfaceKHR surface);
+
+    /**
+     * Returns how the presentation engine can scale images of the given present mode that don't match the surface size
+     * @return the supported scaling behaviors, 0 when unknown or VK_EXT_surface_maintenance1 isn't enabled
+     */
+    VkPresentScalingFlagsEXT getPresentScaling(VkSurfaceKHR surface, VkPresentModeKHR mode);
+
+    /**
+     * Enumerates the formats and present modes of the surface again on the next query
+     */
+    void invalidate(VkSurfaceKHR surface);
+
+    /**
+     * Enumerates the formats and present modes of all surfaces again on their next query
+     */
+    void invalidateAll();
+
+    /**
+     * Removes the surface from the cache, call before destroying the surface
+     */
+    void forget(VkSurfaceKHR surface);
+
+    /**
+     * @return cache counters
+     */
+    const SurfaceInfoCacheStats& getStats() const                       { return mStats; }
+
+private:
+    struct Entry
+    {
+        SurfaceInfo                 mInfo;
+        bool                        mValid = false;             ///< If formats and present modes are up to date
+        bool                        mScalingValid = false;      ///< If the scaling of mScalingMode is up to date
+        VkPresentModeKHR            mScalingMode = VK_PRESENT_MODE_FIFO_KHR;
+        VkPresentScalingFlagsEXT    mScaling = 0;
+    };
+
+    bool enumerate(VkSurfaceKHR surface, SurfaceInfo& outInfo);
+
+    VkPhysicalDevice                                mPhysicalDevice = VK_NULL_HANDLE;
+    PFN_vkGetPhysicalDeviceSurfaceCapabilities2KHR  mGetCapabilities2 = nullptr;
+    std::unordered_map<VkSurfaceKHR, Entry>         mEntries;
+    SurfaceInfoCacheStats                           mStats;
+};
@@ -0,0 +1,463 @@
+#include "swapchain.h"
+#include "hostallocator.h"
+#include "logger.h"
+
+#include <algorithm>
+
+/**
+ * Finds a memory type with the given properties that is allowed by the type bits
+ * @return if a matching memory type was found
+ */
+static bool findMemoryType(const VkPhysicalDeviceMemoryProperties& properties, uint32_t typeBits, VkMemoryPropertyFlags required, uint32_t& outTypeIndex)
+{
+    for (uint32_t i = 0; i < properties.memoryTypeCount; i++)
+    {
+        if ((typeBits & (1u << i)) != 0 && (properties.memoryTypes[i].propertyFlags & required) == required)
+        {
+            outTypeIndex = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+SwapChain::~SwapChain()
+{
+    destroy();
+}
+
+
+void SwapChain::init(VkDevice device, bool maintenance)
+{
+    mDevice = device;
+    mMaintenance = false;
+    if (!maintenance)
+        return;
+
+    mReleaseImages = reinterpret_cast<PFN_vkReleaseSwapchainImagesEXT>(vkGetDeviceProcAddr(device, "vkReleaseSwapchainImagesEXT"));
+    if (mReleaseImages == nullptr)
+    {
+        LOG_WARNING(Swapchain) << "unable to load vkReleaseSwapchainImagesEXT, swap chains are recreated on an idle device";
+        return;
+    }
+    mMaintenance = true;
+}
+
+
+void SwapChain::destroy()
+{
+    if (mDevice == VK_NULL_HANDLE)
+        return;
+
+    for (auto& retired : mRetired)
+    {
+        for (auto& image : retired.mImages)
+        {
+            destroyImage(image);
+            destroySyncObjects(image);
+        }
+        destroyAttachment(retired.mColor);
+        destroyAttachment(retired.mDepth);
+        vkDestroySwapchainKHR(mDevice, retired.mHandle, getHostCallbacks(EHostScope::Swapchain));
+    }
+    mRetired.clear();
+    destroyAttachment(mColor);
+    destroyAttachment(mDepth);
+
+    for (auto& image : mImages)
+    {
+        destroyImage(image);
+        destroySyncObjects(image);
+    }
+    mImages.clear();
+
+    vkDestroySwapchainKHR(mDevice, mHandle, getHostCallbacks(EHostScope::Swapchain));
+    mHandle = VK_NULL_HANDLE;
+    mDevice = VK_NULL_HANDLE;
+}
+
+
+bool SwapChain::create(const VkSwapchainCreateInfoKHR& createInfo)
+{
+    // Attachments follow the size and format of the images
+    VkSwapchainCreateInfoKHR create_info = createInfo;
+    bool attachments_changed = createInfo.imageFormat != mFormat || createInfo.imageExtent.width != mExtent.width ||
+        createInfo.imageExtent.height != mExtent.height;
+    if (mHandle != VK_NULL_HANDLE && mMaintenance)
+    {
+        // Retire the old swap chain, presents in flight can still wait on its semaphores
+        // Its images are handed back, the new swap chain gets its own set of per image objects
+        release(mHandle, mImages);
+        create_info.oldSwapchain = mHandle;
+        Retired retired;
+        retired.mHandle = mHandle;
+        retired.mImages = std::move(mImages);
+        if (attachments_changed)
+        {
+            retired.mColor = mColor;
+            retired.mDepth = mDepth;
+            mColor = Attachment();
+            mDepth = Attachment();
+        }
+        mRetired.emplace_back(std::move(retired));
+        mImages.clear();
+        mHandle = VK_NULL_HANDLE;
+        mStats.mRetired++;
+    }
+    else if (mHandle != VK_NULL_HANDLE)
+    {
+        // Destroy old swap chain, the images it owns are no longer valid
+        // The new images can get the handles of the old ones, views and framebuffers are never carried over
+        for (auto& image : mImages)
+            destroyImage(image);
+        vkDestroySwapchainKHR(mDevice, mHandle, getHostCallbacks(EHostScope::Swapchain));
+        mHandle = VK_NULL_HANDLE;
+        if (attachments_changed)
+        {
+            destroyAttachment(mColor);
+            destroyAttachment(mDepth);
+        }
+    }
+
+    // Create new one
+    if (vkCreateSwapchainKHR(mDevice, &create_info, getHostCallbacks(EHostScope::Swapchain), &mHandle) != VK_SUCCESS)
+    {
+        LOG_ERROR(Swapchain) << "unable to create swap chain";
+        return false;
+    }
+    mStats.mGeneration++;
+
+    unsigned int image_count(0);
+    if (vkGetSwapchainImagesKHR(mDevice, mHandle, &image_count, nullptr) != VK_SUCCESS)
+    {
+        LOG_ERROR(Swapchain) << "unable to get number of images in swap chain";
+        return false;
+    }
+
+    std::vector<VkImage> images(image_count);
+    if (vkGetSwapchainImagesKHR(mDevice, mHandle, &image_count, images.data()) != VK_SUCCESS)
+    {
+        LOG_ERROR(Swapchain) << "unable to get image handles from swap chain";
+        return false;
+    }
+
+    mFormat = createInfo.imageFormat;
+    mExtent = createInfo.imageExtent;
+    return updateImages(images);
+}
+
+
+void SwapChain::collect()
+{
+    for (auto it = mRetired.begin(); it != mRetired.end();)
+    {
+        // Acquired images that were released never reset their fence
+        bool presented = true;
+        for (const auto& image : it->mImages)
+            presented = presented && vkGetFenceStatus(mDevice, image.mPresentFence) == VK_SUCCESS;
+        if (!presented)
+        {
+            ++it;
+            continue;
+        }
+
+        for (auto& image : it->mImages)
+        {
+            destroyImage(image);
+            destroySyncObjects(image);
+        }
+        destroyAttachment(it->mColor);
+        destroyAttachment(it->mDepth);
+        vkDestroySwapchainKHR(mDevice, it->mHandle, getHostCallbacks(EHostScope::Swapchain));
+        it = mRetired.erase(it);
+    }
+}
+
+
+VkResult SwapChain::acquire(VkSemaphore semaphore, uint32_t& outIndex)
+{
+    VkResult res = vkAcquireNextImageKHR(mDevice, mHandle, UINT64_MAX, semaphore, VK_NULL_HANDLE, &outIndex);
+    if (res == VK_SUCCESS || res == VK_SUBOPTIMAL_KHR)
+        mImages[outIndex].mAcquired = true;
+    return res;
+}
+
+
+VkFence SwapChain::preparePresent(uint32_t index)
+{
+    if (!mMaintenance)
+        return VK_NULL_HANDLE;
+
+    // The image was acquired again, its previous present is done or about to be
+    SwapChainImage& image = mImages[index];
+    vkWaitForFences(mDevice, 1, &image.mPresentFence, VK_TRUE, UINT64_MAX);
+    return image.mPresentFence;
+}
+
+
+void SwapChain::beginPresent(uint32_t index)
+{
+    SwapChainImage& image = mImages[index];
+    image.mAcquired = false;
+    if (mMaintenance)
+        vkResetFences(mDevice, 1, &image.mPresentFence);
+}
+
+
+void SwapChain::releaseImages()
+{
+    release(mHandle, mImages);
+}
+
+
+void SwapChain::setAttachments(const VkPhysicalDeviceMemoryProperties& memoryProperties, VkSampleCountFlagBits samples, VkFormat depthFormat)
+{
+    mMemoryProperties = memoryProperties;
+    mSamples = samples;
+    mDepthFormat = depthFormat;
+}
+
+
+bool SwapChain::setRenderPass(VkRenderPass renderPass)
+{
+    if (renderPass == mRenderPass)
+        return true;
+
+    mRenderPass = renderPass;
+    for (auto& image : mImages)
+    {
+        vkDestroyFramebuffer(mDevice, image.mFramebuffer, getHostCallbacks(EHostScope::Swapchain));
+        image.mFramebuffer = VK_NULL_HANDLE;
+        if (!createFramebuffer(image))
+            return false;
+    }
+    return true;
+}
+
+
+bool SwapChain::updateImages(const std::vector<VkImage>& images)
+{
+    // Images beyond the new count are dropped entirely
+    for (size_t i = images.size(); i < mImages.size(); i++)
+    {
+        destroyImage(mImages[i]);
+        destroySyncObjects(mImages[i]);
+    }
+    mStats.mSemaphoresReused += 2 * std::min(images.size(), mImages.size());
+    mImages.resize(images.size());
+
+    // Attachments are shared by all images, they're only missing when the size or format changed
+    if (mSamples != VK_SAMPLE_COUNT_1_BIT && mColor.mImage == VK_NULL_HANDLE &&
+        !createAttachment(mFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_IMAGE_ASPECT_COLOR_BIT, mColor))
+        return false;
+    if (mDepthFormat != VK_FORMAT_UNDEFINED && mDepth.mImage == VK_NULL_HANDLE &&
+        !createAttachment(mDepthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT, mDepth))
+        return false;
+
+    for (size_t i = 0; i < images.size(); i++)
+    {
+        SwapChainImage& image = mImages[i];
+        image.mAcquired = false;
+
+        // Views and framebuffers of the previous swap chain are gone, only the semaphores are carried over
+        image.mImage = images[i];
+        VkImageViewCreateInfo view_info = {};
+        view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        view_info.image = image.mImage;
+        view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        view_info.format = mFormat;
+        view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        view_info.subresourceRange.levelCount = 1;
+        view_info.subresourceRange.layerCount = 1;
+        if (vkCreateImageView(mDevice, &view_info, getHostCallbacks(EHostScope::Swapchain), &image.mView) != VK_SUCCESS)
+        {
+            LOG_ERROR(Swapchain) << "unable to create swap chain image view";
+            return false;
+        }
+        mStats.mViewsCreated++;
+
+        if (image.mRenderFinished == VK_NULL_HANDLE)
+        {
+            VkSemaphoreCreateInfo semaphore_info = {};
+            semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+            if (vkCreateSemaphore(mDevice, &semaphore_info, getHostCallbacks(EHostScope::Swapchain), &image.mRenderFinished) != VK_SUCCESS ||
+                vkCreateSemaphore(mDevice, &semaphore_info, getHostCallbacks(EHostScope::Swapchain), &image.mTransferred) != VK_SUCCESS)
+            {
+                LOG_ERROR(Swapchain) << "unable to create swap chain semaphore";
+                return false;
+            }
+            mStats.mSemaphoresCreated += 2;
+        }
+
+        if (mMaintenance && image.mPresentFence == VK_NULL_HANDLE)
+        {
+            VkFenceCreateInfo fence_info = {};
+            fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+            fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+            if (vkCreateFence(mDevice, &fence_info, getHostCallbacks(EHostScope::Swapchain), &image.mPresentFence) != VK_SUCCESS)
+            {
+                LOG_ERROR(Swapchain) << "unable to create swap chain present fence";
+                return false;
+            }
+        }
+
+        if (!createFramebuffer(image))
+            return false;
+    }
+    return true;
+}
+
+
+bool SwapChain::createFramebuffer(SwapChainImage& image)
+{
+    if (mRenderPass == VK_NULL_HANDLE || image.mFramebuffer != VK_NULL_HANDLE)
+        return true;
+
+    // The multisample color attachment comes first and is resolved into the swap chain image, see setAttachments()
+    std::vector<VkImageView> attachments;
+    if (mColor.mView != VK_NULL_HANDLE)
+        attachments.emplace_back(mColor.mView);
+    else
+        attachments.emplace_back(image.mView);
+    if (mDepth.mView != VK_NULL_HANDLE)
+        attachments.emplace_back(mDepth.mView);
+    if (mColor.mView != VK_NULL_HANDLE)
+        attachments.emplace_back(image.mView);
+
+    VkFramebufferCreateInfo framebuffer_info = {};
+    framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebuffer_info.renderPass = mRenderPass;
+    framebuffer_info.attachmentCount = static_cast<uint32_t>(attachments.size());
+    framebuffer_info.pAttachments = attachments.data();
+    framebuffer_info.width = mExtent.width;
+    framebuffer_info.height = mExtent.height;
+    framebuffer_info.layers = 1;
+    if (vkCreateFramebuffer(mDevice, &framebuffer_info, getHostCallbacks(EHostScope::Swapchain), &image.mFramebuffer) != VK_SUCCESS)
+    {
+        LOG_ERROR(Swapchain) << "unable to create swap chain framebuffer";
+        return false;
+    }
+    mStats.mFramebuffersCreated++;
+    return true;
+}
+
+
+bool SwapChain::createAttachment(VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect, Attachment& outAttachment)
+{
+    VkImageCreateInfo image_info = {};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.format = format;
+    image_info.extent = { mExtent.width, mExtent.height, 1 };
+    image_info.mipLevels = 1;
+    image_info.arrayLayers = 1;
+    image_info.samples = mSamples;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.usage = usage | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    if (vkCreateImage(mDevice, &image_info, getHostCallbacks(EHostScope::Swapchain), &outAttachment.mImage) != VK_SUCCESS)
+    {
+        LOG_ERROR(Swapchain) << "unable to create swap chain attachment";
+        return false;
+    }
+
+    // Lazily allocated memory is only committed when the attachment can't stay in tile memory
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(mDevice, outAttachment.mImage, &requirements);
+    VkMemoryAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.allocationSize = requirements.size;
+    bool lazy = findMemoryType(mMemoryProperties, requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT,
+        alloc_info.memoryTypeIndex);
+    if ((!lazy && !findMemoryType(mMemoryProperties, requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, alloc_info.memoryTypeIndex)) ||
+        vkAllocateMemory(mDevice, &alloc_info, getHostCallbacks(EHostScope::Swapchain), &outAttachment.mMemory) != VK_SUCCESS ||
+        vkBindImageMemory(mDevice, outAttachment.mImage, outAttachment.mMemory, 0) != VK_SUCCESS)
+    {
+        LOG_ERROR(Swapchain) << "unable to allocate swap chain attachment memory";
+        destroyAttachment(outAttachment);
+        return false;
+    }
+
+    VkImageViewCreateInfo view_info = {};
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.image = outAttachment.mImage;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.format = format;
+    view_info.subresourceRange.aspectMask = aspect;
+    view_info.subresourceRange.levelCount = 1;
+    view_info.subresourceRange.layerCount = 1;
+    if (vkCreateImageView(mDevice, &view_info, getHostCallbacks(EHostScope::Swapchain), &outAttachment.mView) != VK_SUCCESS)
+    {
+        LOG_ERROR(Swapchain) << "unable to create swap chain attachment view";
+        destroyAttachment(outAttachment);
+        return false;
+    }
+
+    outAttachment.mSize = requirements.size;
+    mStats.mAttachmentsCreated++;
+    mStats.mLazyAttachments += lazy ? 1 : 0;
+    mStats.mAttachmentBytes = mColor.mSize + mDepth.mSize;
+    return true;
+}
+
+
+void SwapChain::destroyAttachment(Attachment& attachment)
+{
+    vkDestroyImageView(mDevice, attachment.mView, getHostCallbacks(EHostScope::Swapchain));
+    vkDestroyImage(mDevice, attachment.mImage, getHostCallbacks(EHostScope::Swapchain));
+    vkFreeMemory(mDevice, attachment.mMemory, getHostCallbacks(EHostScope::Swapchain));
+    attachment = Attachment();
+}
+
+
+void SwapChain::destroyImage(SwapChainImage& image)
+{
+    vkDestroyFramebuffer(mDevice, image.mFramebuffer, getHostCallbacks(EHostScope::Swapchain));
+    vkDestroyImageView(mDevice, image.mView, getHostCallbacks(EHostScope::Swapchain));
+    image.mFramebuffer = VK_NULL_HANDLE;
+    image.mView = VK_NULL_HANDLE;
+    image.mImage = VK_NULL_HANDLE;
+}
+
+
+void SwapChain::destroySyncObjects(SwapChainImage& image)
+{
+    vkDestroySemaphore(mDevice, image.mRenderFinished, getHostCallbacks(EHostScope::Swapchain));
+    vkDestroySemaphore(mDevice, image.mTransferred, getHostCallbacks(EHostScope::Swapchain));
+    vkDestroyFence(mDevice, image.mPresentFence, getHostCallbacks(EHostScope::Swapchain));
+    image.mRenderFinished = VK_NULL_HANDLE;
+    image.mTransferred = VK_NULL_HANDLE;
+    image.mPresentFence = VK_NULL_HANDLE;
+}
+
+
+void SwapChain::release(VkSwapchainKHR handle, std::vector<SwapChainImage>& images)
+{
+    if (!mMaintenance)
+        return;
+
+    std::vector<uint32_t> indices;
+    for (uint32_t i = 0; i < images.size(); i++)
+    {
+        if (!images[i].mAcquired)
+            continue;
+        indices.emplace_back(i);
+        images[i].mAcquired = false;
+    }
+    if (indices.empty())
+        return;
+
+    VkReleaseSwapchainImagesInfoEXT release_info = {};
+    release_info.sType = VK_STRUCTURE_TYPE_RELEASE_SWAPCHAIN_IMAGES_INFO_EXT;
+    release_info.swapchain = handle;
+    release_info.imageIndexCount = static_cast<uint32_t>(indices.size());
+    release_info.pImageIndices = indices.data();
+    if (mReleaseImages(mDevice, &release_info) != VK_SUCCESS)
+    {
+        LOG_ERROR(Swapchain) << "unable to release swap chain images";
+        return;
+    }
+    mStats.mReleased += indices.size();
+}
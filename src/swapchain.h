@@ -0,0 +1,214 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+/**
+ * Objects owned by a single swap chain image
+ */
+struct SwapChainImage
+{
+    VkImage         mImage = VK_NULL_HANDLE;
+    VkImageView     mView = VK_NULL_HANDLE;
+    VkSemaphore     mRenderFinished = VK_NULL_HANDLE;   ///< Signaled when rendering to the image finished, waited on by present
+    VkSemaphore     mTransferred = VK_NULL_HANDLE;      ///< Signaled when the present queue acquired ownership of the image
+    VkFramebuffer   mFramebuffer = VK_NULL_HANDLE;      ///< Only available when a render pass is set
+    VkFence         mPresentFence = VK_NULL_HANDLE;     ///< Signaled when the last present of the image completed, requires maintenance
+    bool            mAcquired = false;                  ///< If the image is acquired and not yet presented
+};
+
+
+/**
+ * Swap chain counters
+ */
+struct SwapChainStats
+{
+    uint64_t    mGeneration = 0;            ///< Number of times the swap chain was (re)created
+    uint64_t    mViewsCreated = 0;          ///< Total number of image views created
+    uint64_t    mSemaphoresCreated = 0;     ///< Total number of semaphores created
+    uint64_t    mSemaphoresReused = 0;      ///< Number of semaphores carried over to a new generation
+    uint64_t    mFramebuffersCreated = 0;   ///< Total number of framebuffers created
+    uint64_t    mAttachmentsCreated = 0;    ///< Total number of multisample color and depth attachments created
+    uint64_t    mLazyAttachments = 0;       ///< Number of those backed by lazily allocated memory
+    uint64_t    mAttachmentBytes = 0;       ///< Memory requested by the current attachments, lazily allocated memory might not be committed
+    uint64_t    mRetired = 0;               ///< Number of swap chains replaced without waiting for the device
+    uint64_t    mReleased = 0;              ///< Number of acquired images released without presenting them
+};
+
+
+/**
+ * Owns a swap chain and every object that is created per swap chain image: image views, render finished
+ * and ownership transfer semaphores and, when a render pass is set, framebuffers.
+ * All objects are built when the swap chain is (re)created, never while rendering a frame.
+ * On recreation semaphores are carried over, they don't depend on the image. Views and framebuffers are always rebuilt:
+ * a new image can have the handle of a destroyed one, so an unchanged handle doesn't mean an unchanged image.
+ *
+ * Framebuffers can include a multisample color and a depth attachment, shared by all images and sized to the images.
+ * Their contents never leave the render pass: they're created as transient attachments and bound to lazily
+ * allocated memory when the device offers it, on tiled GPUs they then only live in tile memory.
+ *
+ * With VK_EXT_swapchain_maintenance1 every present signals a fence, which tells when the semaphores it waited on
+ * can be reused and when a replaced swap chain is no longer in use. The device doesn't have to be idle on recreation:
+ * the old swap chain is retired, its acquired images are released and it is destroyed by collect() once all of its
+ * presents completed. Without the extension the device must be idle and the old swap chain is destroyed immediately.
+ */
+class SwapChain
+{
+public:
+    SwapChain() = default;
+    ~SwapChain();
+
+    SwapChain(const SwapChain&) = delete;
+    SwapChain& operator=(const SwapChain&) = delete;
+
+    /**
+     * @param device the device the swap chain is created on
+     * @param maintenance if VK_EXT_swapchain_maintenance1 is enabled on the device
+     */
+    void init(VkDevice device, bool maintenance = false);
+
+    /**
+     * Destroys the swap chain, retired swap chains and all per image objects, the device must be idle
+     */
+    void destroy();
+
+    /**
+     * Replaces the current swap chain with a new one and updates the per image objects.
+     * Without maintenance the device must be idle, the old swap chain is destroyed.
+     * With maintenance the old swap chain is retired, it is destroyed by collect() after its last present.
+     * @param createInfo swap chain properties
+     * @return if the swap chain and all per image objects were created
+     */
+    bool create(const VkSwapchainCreateInfoKHR& createInfo);
+
+    /**
+     * Destroys retired swap chains whose presents completed, does nothing without maintenance
+     */
+    void collect();
+
+    /**
+     * Acquires the next image
+     * @param semaphore signaled when the image can be rendered to
+     * @param outIndex index of the acquired image
+     * @return the result of vkAcquireNextImageKHR
+     */
+    VkResult acquire(VkSemaphore semaphore, uint32_t& outIndex);
+
+    /**
+     * Called before rendering to an acquired image, the image is presented afterwards.
+     * With maintenance it waits for the previous present of the image, after which its semaphores can be signaled again.
+     * The fence stays signaled until beginPresent(), an image that is never presented doesn't hold back collect().
+     * @return the fence the present must signal, VK_NULL_HANDLE without maintenance
+     */
+    VkFence preparePresent(uint32_t index);
+
+    /**
+     * Called right before the image is presented, the image is no longer acquired.
+     * With maintenance its present fence is reset, the present signals it again.
+     */
+    void beginPresent(uint32_t index);
+
+    /**
+     * Hands all acquired images that won't be presented back to the presentation engine.
+     * Without maintenance images can't be released, they stay acquired until the swap chain is destroyed.
+     */
+    void releaseImages();
+
+    /**
+     * @return if the swap chain can be recreated without waiting for the device, requires maintenance
+     */
+    bool canRetire() const                                              { return mMaintenance; }
+
+    /**
+     * Sets the attachments framebuffers are created with next to the swap chain image, call before create().
+     * Framebuffer attachments are ordered: multisample color, depth, swap chain image when samples exceeds 1,
+     * swap chain image, depth otherwise. The render pass resolves the multisample color into the swap chain image.
+     * @param memoryProperties memory types of the gpu, lazily allocated memory is preferred
+     * @param samples sample count of the color and depth attachment
+     * @param depthFormat format of the depth attachment, VK_FORMAT_UNDEFINED for none
+     */
+    void setAttachments(const VkPhysicalDeviceMemoryProperties& memoryProperties, VkSampleCountFlagBits samples, VkFormat depthFormat);
+
+    /**
+     * Sets the render pass framebuffers are created for, VK_NULL_HANDLE destroys all framebuffers.
+     * The device must be idle when framebuffers are replaced.
+     * @return if all framebuffers were created
+     */
+    bool setRenderPass(VkRenderPass renderPass);
+
+    /**
+     * @return the swap chain handle, VK_NULL_HANDLE when not created
+     */
+    VkSwapchainKHR getHandle() const                                    { return mHandle; }
+
+    /**
+     * @return the number of swap chain images
+     */
+    uint32_t getImageCount() const                                      { return static_cast<uint32_t>(mImages.size()); }
+
+    /**
+     * @return the objects of the image at the given index, as returned by vkAcquireNextImageKHR
+     */
+    const SwapChainImage& getImage(uint32_t index) const                { return mImages[index]; }
+
+    /**
+     * @return all swap chain images
+     */
+    const std::vector<SwapChainImage>& getImages() const                { return mImages; }
+
+    /**
+     * @return format of the swap chain images
+     */
+    VkFormat getFormat() const                                          { return mFormat; }
+
+    /**
+     * @return size of the swap chain images
+     */
+    VkExtent2D getExtent() const                                        { return mExtent; }
+
+    /**
+     * @return swap chain counters
+     */
+    const SwapChainStats& getStats() const                              { return mStats; }
+
+private:
+    struct Attachment
+    {
+        VkImage                     mImage = VK_NULL_HANDLE;
+        VkImageView                 mView = VK_NULL_HANDLE;
+        VkDeviceMemory              mMemory = VK_NULL_HANDLE;
+        VkDeviceSize                mSize = 0;
+    };
+
+    struct Retired
+    {
+        VkSwapchainKHR              mHandle = VK_NULL_HANDLE;
+        std::vector<SwapChainImage> mImages;
+        Attachment                  mColor;             ///< Attachments replaced together with the swap chain
+        Attachment                  mDepth;
+    };
+
+    bool updateImages(const std::vector<VkImage>& images);
+    bool createAttachment(VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect, Attachment& outAttachment);
+    void destroyAttachment(Attachment& attachment);
+    bool createFramebuffer(SwapChainImage& image);
+    void destroyImage(SwapChainImage& image);
+    void destroySyncObjects(SwapChainImage& image);
+    void release(VkSwapchainKHR handle, std::vector<SwapChainImage>& images);
+
+    VkDevice                        mDevice = VK_NULL_HANDLE;
+    bool                            mMaintenance = false;
+    PFN_vkReleaseSwapchainImagesEXT mReleaseImages = nullptr;
+    VkSwapchainKHR                  mHandle = VK_NULL_HANDLE;
+    VkRenderPass                    mRenderPass = VK_NULL_HANDLE;
+    VkFormat                        mFormat = VK_FORMAT_UNDEFINED;
+    VkExtent2D                      mExtent = { 0, 0 };
+    VkPhysicalDeviceMemoryProperties mMemoryProperties = {};
+    VkSampleCountFlagBits           mSamples = VK_SAMPLE_COUNT_1_BIT;
+    VkFormat                        mDepthFormat = VK_FORMAT_UNDEFINED;
+    Attachment                      mColor;             ///< Multisample color, resolved into the swap chain image
+    Attachment                      mDepth;
+    std::vector<SwapChainImage>     mImages;
+    std::vector<Retired>            mRetired;           ///< Replaced swap chains that might still be presenting
+    SwapChainStats                  mStats;
+};
@@ -0,0 +1,114 @@
+#include "swapimagepolicy.h"
+#include "logger.h"
+
+#include <algorithm>
+
+/**
+ * Acquire is considered blocking when it takes longer than this many ms
+ */
+static const double gAcquireBlockThreshold = 0.5;
+
+/**
+ * Fraction of the frame interval CPU or GPU may use before double buffering is considered too tight
+ */
+static const double gHeadroomRatio = 0.6;
+
+/**
+ * Fraction of the frame interval CPU or GPU may use in low latency mode before a third image is added
+ */
+static const double gOverrunRatio = 0.9;
+
+/**
+ * Fraction of frames acquire has to block on before quad buffering is considered
+ */
+static const double gBlockedRatio = 0.25;
+
+
+SwapImagePolicy::SwapImagePolicy(ELatencyMode mode, unsigned int windowSize) :
+    mMode(mode),
+    mWindowSize(std::max(windowSize, 1u))
+{
+    mImageCount = mode == ELatencyMode::Low ? 2 : 3;
+    mCandidate = mImageCount;
+}
+
+
+void SwapImagePolicy::recordFrame(double frameInterval, double cpuTime, double gpuTime, double acquireTime)
+{
+    mWindowFrames++;
+    mWindowInterval += frameInterval;
+    mWindowCpu += cpuTime;
+    mWindowGpu += gpuTime;
+    mWindowAcquire += acquireTime;
+    mStats.mFrames++;
+    if (acquireTime > gAcquireBlockThreshold)
+    {
+        mWindowBlocked++;
+        mStats.mBlockedFrames++;
+    }
+}
+
+
+bool SwapImagePolicy::update()
+{
+    if (mWindowFrames < mWindowSize)
+        return false;
+
+    double frames = static_cast<double>(mWindowFrames);
+    mStats.mFrameInterval = mWindowInterval / frames;
+    mStats.mCpuTime = mWindowCpu / frames;
+    mStats.mGpuTime = mWindowGpu / frames;
+    mStats.mAcquireTime = mWindowAcquire / frames;
+    mStats.mBlockedRatio = static_cast<double>(mWindowBlocked) / frames;
+
+    mWindowFrames = 0;
+    mWindowBlocked = 0;
+    mWindowInterval = 0.0;
+    mWindowCpu = 0.0;
+    mWindowGpu = 0.0;
+    mWindowAcquire = 0.0;
+
+    // Only switch when two consecutive windows agree
+    uint32_t preferred = evaluate();
+    bool changed = preferred != mImageCount && preferred == mCandidate;
+    mCandidate = preferred;
+    if (!changed)
+        return false;
+
+    LOG_INFO(Swapchain) << "swap image count: " << mImageCount << " -> " << preferred << " (interval: " << mStats.mFrameInterval <<
+        "ms, cpu: " << mStats.mCpuTime << "ms, gpu: " << mStats.mGpuTime << "ms, acquire blocked: " << mStats.mBlockedRatio * 100.0 << "%)";
+    mImageCount = preferred;
+    mStats.mChanges++;
+    return true;
+}
+
+
+uint32_t SwapImagePolicy::evaluate() const
+{
+    // Time the frame is busy without waiting on the presentation engine, against the time available per frame
+    double busy = std::max(mStats.mCpuTime, mStats.mGpuTime);
+    double budget = mStats.mFrameInterval;
+    bool headroom = busy < budget * gHeadroomRatio;
+    bool blocked = mStats.mBlockedRatio > gBlockedRatio;
+
+    switch (mMode)
+    {
+    case ELatencyMode::Low:
+        // Only add an image when frames don't fit, acquire blocking is the expected state with two images
+        return busy > budget * gOverrunRatio ? 3 : 2;
+    case ELatencyMode::Balanced:
+        return headroom ? 2 : 3;
+    case ELatencyMode::Throughput:
+        return !headroom && blocked ? 4 : 3;
+    }
+    return 3;
+}
+
+
+uint32_t clampSwapImageCount(uint32_t requested, const VkSurfaceCapabilitiesKHR& capabilities)
+{
+    uint32_t count = std::max(requested, capabilities.minImageCount);
+    if (capabilities.maxImageCount > 0)
+        count = std::min(count, capabilities.maxImageCount);
+    return count;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+
+/**
+ * Trade off between input latency and smoothness
+ */
+enum class ELatencyMode : uint8_t
+{
+    Low,            ///< Double buffering whenever frames are rendered in time
+    Balanced,       ///< Double buffering when there is headroom, triple buffering otherwise
+    Throughput      ///< Triple buffering, quad buffering when acquire keeps blocking a busy frame
+};
+
+
+/**
+ * Measurements of the last completed evaluation window
+ */
+struct SwapImagePolicyStats
+{
+    double      mFrameInterval = 0.0;       ///< Average time between frames in ms
+    double      mCpuTime = 0.0;             ///< Average CPU time per frame in ms, excluding acquire
+    double      mGpuTime = 0.0;             ///< Average GPU time per frame in ms
+    double      mAcquireTime = 0.0;         ///< Average time spent in vkAcquireNextImageKHR in ms
+    double      mBlockedRatio = 0.0;        ///< Fraction of frames where acquire blocked
+    uint64_t    mBlockedFrames = 0;         ///< Total number of frames where acquire blocked
+    uint64_t    mFrames = 0;                ///< Total number of recorded frames
+    uint64_t    mChanges = 0;               ///< Number of times the preferred image count changed
+};
+
+
+/**
+ * Picks the number of swap chain images from the latency mode and the measured frame times.
+ *
+ * Frames are recorded every frame and evaluated in windows of a fixed number of frames. Double buffering
+ * is selected when CPU and GPU comfortably finish within the frame interval, extra images only add latency then.
+ * Triple buffering absorbs frames that come close to or exceed the interval. Quad buffering is only considered in
+ * throughput mode when acquire keeps blocking while the frame is busy, which means the presentation engine holds
+ * on to images that the application could have rendered to.
+ * A new count has to be preferred by two consecutive windows before it's applied, to avoid recreating the swap chain
+ * on every hitch.
+ */
+class SwapImagePolicy
+{
+public:
+    /**
+     * @param mode latency mode to select the image count for
+     * @param windowSize number of frames per evaluation window
+     */
+    SwapImagePolicy(ELatencyMode mode, unsigned int windowSize);
+
+    /**
+     * Records the timings of a single frame, all times in ms
+     * @param frameInterval time since the previous frame started
+     * @param cpuTime time spent recording and submitting the frame, excluding acquire
+     * @param gpuTime time the GPU spent executing the frame, 0 when unknown
+     * @param acquireTime time spent waiting in vkAcquireNextImageKHR
+     */
+    void recordFrame(double frameInterval, double cpuTime, double gpuTime, double acquireTime);
+
+    /**
+     * Evaluates the measurements when a window completed
+     * @return if the preferred image count changed and the swap chain should be recreated
+     */
+    bool update();
+
+    /**
+     * @return the preferred number of swap chain images, not yet clamped to the surface limits
+     */
+    uint32_t getImageCount() const                                      { return mImageCount; }
+
+    /**
+     * @return latency mode
+     */
+    ELatencyMode getMode() const                                        { return mMode; }
+
+    /**
+     * @return measurements
+     */
+    const SwapImagePolicyStats& getStats() const                        { return mStats; }
+
+private:
+    uint32_t evaluate() const;
+
+    ELatencyMode            mMode;
+    unsigned int            mWindowSize;
+    uint32_t                mImageCount;
+    uint32_t                mCandidate;             ///< Count preferred by the previous window
+    unsigned int            mWindowFrames = 0;
+    unsigned int            mWindowBlocked = 0;
+    double                  mWindowInterval = 0.0;
+    double                  mWindowCpu = 0.0;
+    double                  mWindowGpu = 0.0;
+    double                  mWindowAcquire = 0.0;
+    SwapImagePolicyStats    mStats;
+};
+
+
+/**
+ * Clamps a requested number of swap chain images to the limits of the surface.
+ * A maximum image count of 0 means the surface doesn't impose an upper limit.
+ */
+uint32_t clampSwapImageCount(uint32_t requested, const VkSurfaceCapabilitiesKHR& capabilities);
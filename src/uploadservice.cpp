@@ -0,0 +1,284 @@
+#include "uploadservice.h"
+#include "hostallocator.h"
+#include "logger.h"
+
+#include <vector>
+#include <chrono>
+#include <cstring>
+
+/**
+ * Properties of memory the CPU can write into directly without flushing
+ */
+static const VkMemoryPropertyFlags gDirectProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+/**
+ * Properties of staging memory
+ */
+static const VkMemoryPropertyFlags gStagingProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+
+/**
+ * @return throughput in MB/s of uploading the given number of bytes in the given time
+ */
+static double getThroughput(VkDeviceSize bytes, std::chrono::steady_clock::time_point start)
+{
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return seconds > 0.0 ? static_cast<double>(bytes) / (1024.0 * 1024.0) / seconds : 0.0;
+}
+
+
+UploadService::~UploadService()
+{
+    destroy();
+}
+
+
+bool UploadService::init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamily, VkQueue queue, bool allowDirect)
+{
+    mDevice = device;
+    mQueue = queue;
+
+    // Direct writes are only worth it when the host visible window covers the largest device local heap
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &mMemoryProperties);
+    uint32_t largest_heap = 0;
+    VkDeviceSize largest_size = 0;
+    for (uint32_t i = 0; i < mMemoryProperties.memoryHeapCount; i++)
+    {
+        const VkMemoryHeap& heap = mMemoryProperties.memoryHeaps[i];
+        if ((heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0 && heap.size > largest_size)
+        {
+            largest_heap = i;
+            largest_size = heap.size;
+        }
+    }
+    for (uint32_t i = 0; allowDirect && i < mMemoryProperties.memoryTypeCount; i++)
+    {
+        const VkMemoryType& type = mMemoryProperties.memoryTypes[i];
+        if ((type.propertyFlags & gDirectProperties) == gDirectProperties && type.heapIndex == largest_heap)
+        {
+            mDirectType = i;
+            break;
+        }
+    }
+    LOG_INFO(Memory) << "uploads: " << (isDirect() ? "written directly into device local memory" : "copied through staging buffers");
+
+    VkCommandPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    pool_info.queueFamilyIndex = queueFamily;
+    if (vkCreateCommandPool(device, &pool_info, getHostCallbacks(EHostScope::Device), &mCommandPool) != VK_SUCCESS)
+    {
+        LOG_ERROR(Memory) << "unable to create upload command pool";
+        return false;
+    }
+
+    VkCommandBufferAllocateInfo buffer_info = {};
+    buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    buffer_info.commandPool = mCommandPool;
+    buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    buffer_info.commandBufferCount = 1;
+    if (vkAllocateCommandBuffers(device, &buffer_info, &mCommandBuffer) != VK_SUCCESS)
+    {
+        LOG_ERROR(Memory) << "unable to allocate upload command buffer";
+        return false;
+    }
+
+    VkFenceCreateInfo fence_info = {};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    if (vkCreateFence(device, &fence_info, getHostCallbacks(EHostScope::Device), &mFence) != VK_SUCCESS)
+    {
+        LOG_ERROR(Memory) << "unable to create upload fence";
+        return false;
+    }
+    return true;
+}
+
+
+void UploadService::destroy()
+{
+    if (mDevice == VK_NULL_HANDLE)
+        return;
+
+    vkDestroyFence(mDevice, mFence, getHostCallbacks(EHostScope::Device));
+    vkDestroyCommandPool(mDevice, mCommandPool, getHostCallbacks(EHostScope::Device));
+    mFence = VK_NULL_HANDLE;
+    mCommandPool = VK_NULL_HANDLE;
+    mDirectType = gNoDirectType;
+    mDevice = VK_NULL_HANDLE;
+}
+
+
+VkMemoryPropertyFlags UploadService::getMemoryProperties() const
+{
+    return isDirect() ? gDirectProperties : static_cast<VkMemoryPropertyFlags>(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+}
+
+
+bool UploadService::upload(const void* data, VkDeviceSize size, VkBuffer buffer, VkDeviceMemory memory, VkDeviceSize offset, uint32_t memoryType)
+{
+    // Memory written by the CPU is visible to work submitted afterwards, coherent memory needs no flush
+    if (isDirect() && (mMemoryProperties.memoryTypes[memoryType].propertyFlags & gStagingProperties) == gStagingProperties)
+    {
+        if (!uploadDirect(data, size, memory, offset))
+            return false;
+        mStats.mDirectUploads++;
+        mStats.mDirectBytes += size;
+        return true;
+    }
+
+    if (!uploadStaged(data, size, buffer))
+        return false;
+    mStats.mStagedUploads++;
+    mStats.mStagedBytes += size;
+    return true;
+}
+
+
+bool UploadService::benchmark(VkDeviceSize size, unsigned int iterations, UploadBenchmark& outResult)
+{
+    outResult = UploadBenchmark();
+    std::vector<uint8_t> data(static_cast<size_t>(size), 0xA5);
+
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    if (!createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, memory))
+        return false;
+
+    // Includes creating the staging buffer and waiting for the copy, like every staged upload
+    bool staged = true;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; staged && i < iterations; i++)
+        staged = uploadStaged(data.data(), size, buffer);
+    outResult.mStaged = getThroughput(size * iterations, start);
+    vkDestroyBuffer(mDevice, buffer, getHostCallbacks(EHostScope::Device));
+    vkFreeMemory(mDevice, memory, getHostCallbacks(EHostScope::Device));
+    if (!staged || !isDirect())
+        return staged;
+
+    if (!createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, mMemoryProperties.memoryTypes[mDirectType].propertyFlags, buffer, memory))
+        return false;
+
+    bool direct = true;
+    start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; direct && i < iterations; i++)
+        direct = uploadDirect(data.data(), size, memory, 0);
+    outResult.mDirect = getThroughput(size * iterations, start);
+    vkDestroyBuffer(mDevice, buffer, getHostCallbacks(EHostScope::Device));
+    vkFreeMemory(mDevice, memory, getHostCallbacks(EHostScope::Device));
+    return direct;
+}
+
+
+bool UploadService::uploadDirect(const void* data, VkDeviceSize size, VkDeviceMemory memory, VkDeviceSize offset)
+{
+    void* mapped = nullptr;
+    if (vkMapMemory(mDevice, memory, offset, size, 0, &mapped) != VK_SUCCESS)
+    {
+        LOG_ERROR(Memory) << "unable to map device local memory";
+        return false;
+    }
+    std::memcpy(mapped, data, static_cast<size_t>(size));
+    vkUnmapMemory(mDevice, memory);
+    return true;
+}
+
+
+bool UploadService::uploadStaged(const void* data, VkDeviceSize size, VkBuffer buffer)
+{
+    VkBuffer staging = VK_NULL_HANDLE;
+    VkDeviceMemory staging_memory = VK_NULL_HANDLE;
+    if (!createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, gStagingProperties, staging, staging_memory))
+        return false;
+
+    void* mapped = nullptr;
+    bool uploaded = vkMapMemory(mDevice, staging_memory, 0, size, 0, &mapped) == VK_SUCCESS;
+    if (uploaded)
+    {
+        std::memcpy(mapped, data, static_cast<size_t>(size));
+        vkUnmapMemory(mDevice, staging_memory);
+
+        vkResetCommandPool(mDevice, mCommandPool, 0);
+        VkCommandBufferBeginInfo begin_info = {};
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(mCommandBuffer, &begin_info);
+        VkBufferCopy region = {};
+        region.size = size;
+        vkCmdCopyBuffer(mCommandBuffer, staging, buffer, 1, &region);
+
+        // Work submitted later on the same queue sees the copied contents
+        VkMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+        vkCmdPipelineBarrier(mCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+        vkEndCommandBuffer(mCommandBuffer);
+
+        VkSubmitInfo submit_info = {};
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers = &mCommandBuffer;
+        uploaded = vkQueueSubmit(mQueue, 1, &submit_info, mFence) == VK_SUCCESS;
+        if (uploaded)
+        {
+            vkWaitForFences(mDevice, 1, &mFence, VK_TRUE, UINT64_MAX);
+            vkResetFences(mDevice, 1, &mFence);
+        }
+    }
+    if (!uploaded)
+        LOG_ERROR(Memory) << "unable to upload through staging buffer";
+
+    vkDestroyBuffer(mDevice, staging, getHostCallbacks(EHostScope::Device));
+    vkFreeMemory(mDevice, staging_memory, getHostCallbacks(EHostScope::Device));
+    return uploaded;
+}
+
+
+bool UploadService::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags required, VkBuffer& outBuffer, VkDeviceMemory& outMemory)
+{
+    VkBufferCreateInfo buffer_info = {};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = size;
+    buffer_info.usage = usage;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (vkCreateBuffer(mDevice, &buffer_info, getHostCallbacks(EHostScope::Device), &outBuffer) != VK_SUCCESS)
+        return false;
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(mDevice, outBuffer, &requirements);
+    VkMemoryAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.allocationSize = requirements.size;
+    if (!findMemoryType(requirements.memoryTypeBits, required, alloc_info.memoryTypeIndex) ||
+        vkAllocateMemory(mDevice, &alloc_info, getHostCallbacks(EHostScope::Device), &outMemory) != VK_SUCCESS)
+    {
+        vkDestroyBuffer(mDevice, outBuffer, getHostCallbacks(EHostScope::Device));
+        outBuffer = VK_NULL_HANDLE;
+        return false;
+    }
+
+    if (vkBindBufferMemory(mDevice, outBuffer, outMemory, 0) != VK_SUCCESS)
+    {
+        vkDestroyBuffer(mDevice, outBuffer, getHostCallbacks(EHostScope::Device));
+        vkFreeMemory(mDevice, outMemory, getHostCallbacks(EHostScope::Device));
+        outBuffer = VK_NULL_HANDLE;
+        outMemory = VK_NULL_HANDLE;
+        return false;
+    }
+    return true;
+}
+
+
+bool UploadService::findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags required, uint32_t& outTypeIndex) const
+{
+    for (uint32_t i = 0; i < mMemoryProperties.memoryTypeCount; i++)
+    {
+        if ((typeBits & (1u << i)) != 0 && (mMemoryProperties.memoryTypes[i].propertyFlags & required) == required)
+        {
+            outTypeIndex = i;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+/**
+ * Upload counters
+ */
+struct UploadStats
+{
+    uint64_t    mDirectUploads = 0;         ///< Number of uploads written into device local memory by the CPU
+    uint64_t    mStagedUploads = 0;         ///< Number of uploads copied through a staging buffer
+    uint64_t    mDirectBytes = 0;
+    uint64_t    mStagedBytes = 0;
+};
+
+
+/**
+ * Upload throughput of both paths, in MB/s, measured by UploadService::benchmark()
+ */
+struct UploadBenchmark
+{
+    double      mDirect = 0.0;              ///< 0 when the device has no suitable host visible device local memory
+    double      mStaged = 0.0;
+};
+
+
+/**
+ * Uploads data into device local buffers.
+ *
+ * On resizable BAR and UMA devices, and on software rasterizers, device local memory is also host visible.
+ * Writing into that memory directly skips the staging buffer and the copy on the GPU. The direct path is used when
+ * a host visible and coherent device local memory type lives in the largest device local heap: the 256MB window
+ * discrete GPUs expose without resizable BAR is too small to hold regular resources.
+ * Allocators ask getMemoryProperties() for the properties to look for first, every upload picks the direct path
+ * when its destination memory supports it and falls back to a staging copy otherwise.
+ *
+ * Staging copies are submitted to the given queue and waited on.
+ */
+class UploadService
+{
+public:
+    UploadService() = default;
+    ~UploadService();
+
+    UploadService(const UploadService&) = delete;
+    UploadService& operator=(const UploadService&) = delete;
+
+    /**
+     * @param physicalDevice gpu returned by selectGPU(), its memory types decide if the direct path is available
+     * @param device the device destination buffers are created on
+     * @param queueFamily queue family of the queue staging copies are submitted to
+     * @param queue queue staging copies are submitted to, destination buffers are used on the same queue
+     * @param allowDirect if the direct path can be used, staging copies are used for all uploads otherwise
+     */
+    bool init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamily, VkQueue queue, bool allowDirect);
+
+    /**
+     * Destroys the copy objects, the device must be idle
+     */
+    void destroy();
+
+    /**
+     * @return if device local memory can be written directly
+     */
+    bool isDirect() const                                               { return mDirectType != gNoDirectType; }
+
+    /**
+     * @return memory properties destination buffers should be allocated with first, device local when staging is used
+     */
+    VkMemoryPropertyFlags getMemoryProperties() const;
+
+    /**
+     * Writes data into a buffer, directly when its memory is host visible and coherent, through a staging buffer otherwise
+     * @param data contents, size bytes
+     * @param size number of bytes to upload
+     * @param buffer the destination, requires VK_BUFFER_USAGE_TRANSFER_DST_BIT for the staging path
+     * @param memory memory the buffer is bound to
+     * @param offset offset of the buffer in its memory
+     * @param memoryType memory type of the memory
+     * @return if the data was uploaded, the GPU sees it in work submitted afterwards
+     */
+    bool upload(const void* data, VkDeviceSize size, VkBuffer buffer, VkDeviceMemory memory, VkDeviceSize offset, uint32_t memoryType);
+
+    /**
+     * Measures upload throughput of both paths, the GPU must be idle
+     * @param size size of the uploaded buffer in bytes
+     * @param iterations number of uploads per path
+     * @return if the benchmark ran
+     */
+    bool benchmark(VkDeviceSize size, unsigned int iterations, UploadBenchmark& outResult);
+
+    /**
+     * @return upload counters
+     */
+    const UploadStats& getStats() const                                 { return mStats; }
+
+private:
+    static constexpr uint32_t gNoDirectType = 0xFFFFFFFF;
+
+    bool uploadDirect(const void* data, VkDeviceSize size, VkDeviceMemory memory, VkDeviceSize offset);
+    bool uploadStaged(const void* data, VkDeviceSize size, VkBuffer buffer);
+    bool createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags required, VkBuffer& outBuffer, VkDeviceMemory& outMemory);
+    bool findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags required, uint32_t& outTypeIndex) const;
+
+    VkDevice                        mDevice = VK_NULL_HANDLE;
+    VkQueue                         mQueue = VK_NULL_HANDLE;
+    VkCommandPool                   mCommandPool = VK_NULL_HANDLE;
+    VkCommandBuffer                 mCommandBuffer = VK_NULL_HANDLE;
+    VkFence                         mFence = VK_NULL_HANDLE;            ///< Signaled when a staging copy completed
+    VkPhysicalDeviceMemoryProperties mMemoryProperties = {};
+    uint32_t                        mDirectType = gNoDirectType;        ///< Host visible device local memory type
+    UploadStats                     mStats;
+};
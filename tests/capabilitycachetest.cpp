@@ -0,0 +1,255 @@
+#include "test.h"
+#include "vulkanstubs.h"
+#include "capabilitycache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+/**
+ * Snapshot file written and read by the tests, in the working directory of the test
+ */
+static const char* gSnapshotPath = "capabilitycachetest.bin";
+
+/**
+ * Fake physical device, the stubs report the same capabilities for every handle
+ */
+static const VkPhysicalDevice gDevice = makeStubHandle<VkPhysicalDevice>(1);
+
+
+/**
+ * @return a layer with the given name
+ */
+static VkLayerProperties makeLayer(const char* name)
+{
+    VkLayerProperties properties = {};
+    std::strncpy(properties.layerName, name, sizeof(properties.layerName) - 1);
+    return properties;
+}
+
+
+/**
+ * @return an extension with the given name
+ */
+static VkExtensionProperties makeExtension(const char* name)
+{
+    VkExtensionProperties properties = {};
+    std::strncpy(properties.extensionName, name, sizeof(properties.extensionName) - 1);
+    return properties;
+}
+
+
+/**
+ * Resets the stubs to a device with two queue families, one layer and a few extensions, removes the snapshot
+ */
+static void setupDevice()
+{
+    resetStubs();
+    std::remove(gSnapshotPath);
+
+    StubState& state = getStubState();
+    state.mDeviceProperties.vendorID = 0x10de;
+    state.mDeviceProperties.deviceID = 0x2204;
+    state.mDeviceProperties.driverVersion = 100;
+    std::memset(state.mDeviceProperties.pipelineCacheUUID, 0xab, VK_UUID_SIZE);
+
+    VkQueueFamilyProperties graphics = {};
+    graphics.queueFlags = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT;
+    graphics.queueCount = 16;
+    graphics.timestampValidBits = 64;
+    VkQueueFamilyProperties transfer = {};
+    transfer.queueFlags = VK_QUEUE_TRANSFER_BIT;
+    transfer.queueCount = 2;
+    state.mQueueFamilies = { graphics, transfer };
+
+    state.mLayers = { makeLayer("VK_LAYER_KHRONOS_validation") };
+    state.mInstanceExtensions = { makeExtension("VK_KHR_surface"), makeExtension("VK_EXT_debug_utils") };
+    state.mDeviceExtensions = { makeExtension("VK_KHR_swapchain") };
+}
+
+
+/**
+ * Queries everything main asks the cache for and writes the snapshot
+ */
+static void writeSnapshot()
+{
+    CapabilityCache cache;
+    cache.init(gSnapshotPath, false);
+    cache.getLayers();
+    cache.getInstanceExtensions();
+    cache.getDevice(gDevice);
+    CHECK(cache.save());
+}
+
+
+/**
+ * @return the contents of the snapshot file
+ */
+static std::vector<char> readFile()
+{
+    std::ifstream file(gSnapshotPath, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+
+/**
+ * Replaces the snapshot file
+ */
+static void writeFile(const std::vector<char>& data)
+{
+    std::ofstream file(gSnapshotPath, std::ios::binary | std::ios::trunc);
+    file.write(data.data(), data.size());
+}
+
+
+/**
+ * Loads the snapshot and checks that everything was queried again and matches the stubs
+ */
+static void checkRejected()
+{
+    unsigned int enumerations = getStubState().mEnumerations;
+    CapabilityCache cache;
+    cache.init(gSnapshotPath, false);
+    CHECK(!cache.getStats().mLoaded);
+    CHECK(!cache.getStats().mInstanceCached);
+    CHECK(cache.getLayers().size() == 1);
+    CHECK(cache.getInstanceExtensions().size() == 2);
+    const DeviceCapabilities& device = cache.getDevice(gDevice);
+    CHECK(!device.mCached);
+    CHECK(device.mQueueFamilies.size() == 2);
+    CHECK(device.mExtensions.size() == 1);
+    CHECK(cache.getStats().mDeviceMisses == 1);
+    CHECK(getStubState().mEnumerations > enumerations);
+}
+
+
+static void testRoundTrip()
+{
+    // A second launch reads everything from the snapshot without enumerating any properties
+    setupDevice();
+    writeSnapshot();
+    unsigned int enumerations = getStubState().mEnumerations;
+    CHECK(enumerations == 4);
+
+    CapabilityCache cache;
+    cache.init(gSnapshotPath, false);
+    CHECK(cache.getStats().mLoaded);
+    CHECK(cache.getStats().mInstanceCached);
+    CHECK(cache.getLayers().size() == 1);
+    CHECK(std::strcmp(cache.getLayers()[0].layerName, "VK_LAYER_KHRONOS_validation") == 0);
+    CHECK(cache.getInstanceExtensions().size() == 2);
+    CHECK(std::strcmp(cache.getInstanceExtensions()[1].extensionName, "VK_EXT_debug_utils") == 0);
+
+    const DeviceCapabilities& device = cache.getDevice(gDevice);
+    CHECK(device.mCached);
+    CHECK(device.mVendorID == 0x10de && device.mDeviceID == 0x2204 && device.mDriverVersion == 100);
+    CHECK(device.mQueueFamilies.size() == 2);
+    CHECK(device.mQueueFamilies[0].queueCount == 16 && device.mQueueFamilies[0].timestampValidBits == 64);
+    CHECK(device.mQueueFamilies[1].queueFlags == VK_QUEUE_TRANSFER_BIT);
+    CHECK(device.mExtensions.size() == 1);
+    CHECK(std::strcmp(device.mExtensions[0].extensionName, "VK_KHR_swapchain") == 0);
+    CHECK(cache.getStats().mDeviceHits == 1 && cache.getStats().mDeviceMisses == 0);
+    CHECK(getStubState().mEnumerations == enumerations);
+
+    // Nothing was queried, the snapshot isn't written again
+    std::remove(gSnapshotPath);
+    CHECK(cache.save());
+    CHECK(readFile().empty());
+}
+
+
+static void testStale()
+{
+    // A driver update refreshes the device, a new layer the instance section
+    setupDevice();
+    writeSnapshot();
+    StubState& state = getStubState();
+    state.mDeviceProperties.driverVersion = 101;
+    state.mLayers.emplace_back(makeLayer("VK_LAYER_MESA_overlay"));
+    {
+        CapabilityCache cache;
+        cache.init(gSnapshotPath, false);
+        CHECK(cache.getStats().mLoaded);
+        CHECK(!cache.getStats().mInstanceCached);
+        CHECK(cache.getLayers().size() == 2);
+        const DeviceCapabilities& device = cache.getDevice(gDevice);
+        CHECK(!device.mCached && device.mDriverVersion == 101);
+        CHECK(cache.getStats().mDeviceMisses == 1);
+        CHECK(cache.save());
+    }
+
+    // The refreshed snapshot replaced the stale device instead of adding one
+    CapabilityCache cache;
+    cache.init(gSnapshotPath, false);
+    CHECK(cache.getStats().mInstanceCached);
+    CHECK(cache.getDevice(gDevice).mCached);
+    CHECK(cache.getStats().mDeviceHits == 1);
+
+    // Refreshing ignores a valid snapshot
+    CapabilityCache refreshed;
+    refreshed.init(gSnapshotPath, true);
+    CHECK(!refreshed.getStats().mLoaded);
+    CHECK(!refreshed.getDevice(gDevice).mCached);
+}
+
+
+static void testCorrupt()
+{
+    // Every damaged snapshot is rejected as a whole and all capabilities are queried
+    setupDevice();
+    writeSnapshot();
+    const std::vector<char> valid = readFile();
+
+    // Header, api version, layer and instance extension arrays precede the device count
+    size_t count_offset = 6 * sizeof(uint32_t) + sizeof(uint32_t) + sizeof(VkLayerProperties) + sizeof(uint32_t) + 2 * sizeof(VkExtensionProperties);
+    size_t families_offset = count_offset + 4 * sizeof(uint32_t) + VK_UUID_SIZE;
+    CHECK(valid.size() == families_offset + sizeof(uint32_t) + 2 * sizeof(VkQueueFamilyProperties) + sizeof(uint32_t) + sizeof(VkExtensionProperties));
+
+    writeFile(std::vector<char>());
+    checkRejected();
+
+    std::vector<char> data = valid;
+    data[0] ^= 0xff;
+    writeFile(data);
+    checkRejected();
+
+    // Struct sizes that don't match the headers
+    data = valid;
+    data[4 * sizeof(uint32_t)]++;
+    writeFile(data);
+    checkRejected();
+
+    writeFile(std::vector<char>(valid.begin(), valid.begin() + valid.size() / 2));
+    checkRejected();
+
+    writeFile(std::vector<char>(valid.begin(), valid.end() - 1));
+    checkRejected();
+
+    // Counts larger than the remaining data must fail without allocating them
+    uint32_t huge = 0xffffffff;
+    data = valid;
+    std::memcpy(&data[count_offset], &huge, sizeof(huge));
+    writeFile(data);
+    checkRejected();
+
+    data = valid;
+    std::memcpy(&data[families_offset], &huge, sizeof(huge));
+    writeFile(data);
+    checkRejected();
+
+    data = valid;
+    std::memcpy(&data[6 * sizeof(uint32_t)], &huge, sizeof(huge));
+    writeFile(data);
+    checkRejected();
+    std::remove(gSnapshotPath);
+}
+
+
+int main()
+{
+    RUN_TEST(testRoundTrip);
+    RUN_TEST(testStale);
+    RUN_TEST(testCorrupt);
+    return getTestResult();
+}
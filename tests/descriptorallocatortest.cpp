@@ -0,0 +1,149 @@
+#include "test.h"
+#include "vulkanstubs.h"
+#include "descriptorallocator.h"
+
+/**
+ * Number of sets the first pool of every frame holds in the tests
+ */
+static const uint32_t gSetsPerPool = 4;
+
+
+/**
+ * Allocator for two frames on a fake device, every test starts without any pools
+ */
+struct AllocatorFixture
+{
+    AllocatorFixture()
+    {
+        resetStubs();
+        CHECK(mAllocator.init(makeStubHandle<VkDevice>(1), 2, gSetsPerPool));
+    }
+
+    ~AllocatorFixture()
+    {
+        mAllocator.destroy();
+        CHECK(getStubState().mLivePools == 0);
+        CHECK(getStubState().mLiveLayouts == 0);
+    }
+
+    /**
+     * Allocates count sets for the current frame
+     */
+    void allocate(unsigned int count)
+    {
+        for (unsigned int i = 0; i < count; i++)
+        {
+            VkDescriptorSet set = VK_NULL_HANDLE;
+            CHECK(mAllocator.allocate(mLayout, set));
+            CHECK(set != VK_NULL_HANDLE);
+        }
+    }
+
+    DescriptorAllocator     mAllocator;
+    VkDescriptorSetLayout   mLayout = makeStubHandle<VkDescriptorSetLayout>(2);
+};
+
+
+/**
+ * @return a single binding of the given type
+ */
+static VkDescriptorSetLayoutBinding makeBinding(uint32_t binding, VkDescriptorType type)
+{
+    VkDescriptorSetLayoutBinding result = {};
+    result.binding = binding;
+    result.descriptorType = type;
+    result.descriptorCount = 1;
+    result.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    return result;
+}
+
+
+static void testGrowth()
+{
+    // Every frame starts with a single pool, exhausting it adds a pool twice the size of the previous one
+    AllocatorFixture fixture;
+    DescriptorAllocator& allocator = fixture.mAllocator;
+    CHECK(getStubState().mPoolSizes.size() == 2);
+    CHECK(allocator.getStats().mPoolsCreated == 2);
+
+    allocator.beginFrame(0);
+    fixture.allocate(gSetsPerPool);
+    CHECK(allocator.getStats().mPoolsCreated == 2);
+
+    fixture.allocate(1);
+    CHECK(allocator.getStats().mPoolsCreated == 3);
+    fixture.allocate(2 * gSetsPerPool);
+    CHECK(allocator.getStats().mPoolsCreated == 4);
+    CHECK(getStubState().mPoolSizes == std::vector<uint32_t>({ gSetsPerPool, gSetsPerPool, 2 * gSetsPerPool, 4 * gSetsPerPool }));
+
+    const DescriptorAllocatorStats& stats = allocator.getStats();
+    CHECK(stats.mAllocationsThisFrame == 3 * gSetsPerPool + 1);
+    CHECK(stats.mTotalAllocations == 3 * gSetsPerPool + 1);
+}
+
+
+static void testReset()
+{
+    // Starting a frame again resets every pool it used and reuses them, without creating new ones
+    AllocatorFixture fixture;
+    DescriptorAllocator& allocator = fixture.mAllocator;
+    allocator.beginFrame(0);
+    fixture.allocate(3 * gSetsPerPool + 1);
+    CHECK(allocator.getStats().mPoolsCreated == 4);
+
+    // The other frame only resets its own pool
+    allocator.beginFrame(1);
+    CHECK(getStubState().mPoolResets == 2);
+    CHECK(allocator.getStats().mPoolResets == 2);
+    CHECK(allocator.getStats().mAllocationsLastFrame == 3 * gSetsPerPool + 1);
+    CHECK(allocator.getStats().mPoolGrowthLastFrame == 2);
+    fixture.allocate(gSetsPerPool);
+
+    allocator.beginFrame(0);
+    CHECK(getStubState().mPoolResets == 5);
+    CHECK(allocator.getStats().mPoolGrowthLastFrame == 0);
+    fixture.allocate(3 * gSetsPerPool + 1);
+    CHECK(allocator.getStats().mPoolsCreated == 4);
+    CHECK(getStubState().mLivePools == 4);
+
+    // Pools the last recording didn't reach are already empty and not reset again
+    allocator.beginFrame(1);
+    allocator.beginFrame(0);
+    fixture.allocate(1);
+    allocator.beginFrame(1);
+    allocator.beginFrame(0);
+    CHECK(getStubState().mPoolResets == 11);
+    CHECK(allocator.getStats().mTotalAllocations == 7 * gSetsPerPool + 3);
+}
+
+
+static void testLayouts()
+{
+    // Layouts are shared by equal bindings, regardless of their order
+    AllocatorFixture fixture;
+    DescriptorAllocator& allocator = fixture.mAllocator;
+    VkDescriptorSetLayoutBinding image = makeBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+    VkDescriptorSetLayoutBinding buffer = makeBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+
+    VkDescriptorSetLayout layout = allocator.getLayout({ image, buffer });
+    CHECK(layout != VK_NULL_HANDLE);
+    CHECK(allocator.getLayout({ buffer, image }) == layout);
+    CHECK(allocator.getLayout({ image, buffer }) == layout);
+
+    VkDescriptorSetLayout single = allocator.getLayout({ image });
+    CHECK(single != VK_NULL_HANDLE && single != layout);
+
+    const DescriptorAllocatorStats& stats = allocator.getStats();
+    CHECK(stats.mLayoutsCreated == 2);
+    CHECK(stats.mLayoutHits == 2);
+    CHECK(getStubState().mLiveLayouts == 2);
+}
+
+
+int main()
+{
+    RUN_TEST(testGrowth);
+    RUN_TEST(testReset);
+    RUN_TEST(testLayouts);
+    return getTestResult();
+}
@@ -0,0 +1,220 @@
+#include "test.h"
+#include "vulkanstubs.h"
+#include "devicefeatures.h"
+
+#include <cstring>
+
+/**
+ * Fake instance and physical device, the stubs report the same features for every handle
+ */
+static const VkInstance gInstance = makeStubHandle<VkInstance>(1);
+static const VkPhysicalDevice gDevice = makeStubHandle<VkPhysicalDevice>(2);
+
+
+/**
+ * Resets the stubs to a device of the given version that supports the given feature structures
+ */
+static void setupDevice(uint32_t apiVersion, const std::vector<VkStructureType>& supported)
+{
+    resetStubs();
+    getStubState().mDeviceProperties.apiVersion = apiVersion;
+    getStubState().mSupportedFeatures = supported;
+}
+
+
+/**
+ * @return properties of every named device extension
+ */
+static std::vector<VkExtensionProperties> makeExtensions(const std::vector<const char*>& names)
+{
+    std::vector<VkExtensionProperties> extensions;
+    for (const char* name : names)
+    {
+        VkExtensionProperties extension = {};
+        std::strncpy(extension.extensionName, name, sizeof(extension.extensionName) - 1);
+        extensions.emplace_back(extension);
+    }
+    return extensions;
+}
+
+
+/**
+ * @return structure types of the chain in order
+ */
+static std::vector<VkStructureType> getChainTypes(const void* chain)
+{
+    std::vector<VkStructureType> types;
+    for (const VkBaseOutStructure* it = static_cast<const VkBaseOutStructure*>(chain); it != nullptr; it = it->pNext)
+        types.emplace_back(it->sType);
+    return types;
+}
+
+
+/**
+ * @return the structure of the given type in the chain, null when absent
+ */
+template<typename T>
+static const T* findStructure(const void* chain, VkStructureType type)
+{
+    for (const VkBaseOutStructure* it = static_cast<const VkBaseOutStructure*>(chain); it != nullptr; it = it->pNext)
+    {
+        if (it->sType == type)
+            return reinterpret_cast<const T*>(it);
+    }
+    return nullptr;
+}
+
+
+/**
+ * @return if the extension is one the builder asks the device to enable
+ */
+static bool hasExtension(const DeviceFeatureBuilder& builder, const char* name)
+{
+    for (const char* extension : builder.getExtensions())
+    {
+        if (std::strcmp(extension, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+
+static void testExtensionChain()
+{
+    // On a 1.1 device features are enabled through their extensions, unavailable requested features are left out
+    setupDevice(VK_API_VERSION_1_1, { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR,
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_EXT });
+    std::vector<VkExtensionProperties> device_extensions = makeExtensions({ VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME,
+        VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME, VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME });
+
+    DeviceFeatureBuilder builder;
+    builder.require(EDeviceFeature::Synchronization2);
+    builder.request(EDeviceFeature::TimelineSemaphore);
+    builder.request(EDeviceFeature::SwapchainMaintenance);
+    builder.request(EDeviceFeature::DynamicRendering);
+    CHECK(builder.negotiate(gInstance, VK_API_VERSION_1_1, { VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME }, gDevice, device_extensions));
+
+    // Dynamic rendering isn't available, it wasn't queried
+    CHECK(getStubState().mQueriedFeatures.size() == 3);
+
+    const DeviceFeatures& features = builder.getFeatures();
+    CHECK(features.mApiVersion == VK_API_VERSION_1_1);
+    CHECK(features.mSynchronization2 && features.mTimelineSemaphore && features.mSwapchainMaintenance);
+    CHECK(!features.mDynamicRendering && !features.mDescriptorIndexing && !features.mStorage16Bit && !features.mBufferDeviceAddress);
+
+    std::vector<VkStructureType> chain = getChainTypes(builder.getChain());
+    CHECK(chain.size() == 4);
+    CHECK(chain[0] == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR);
+    const auto* synchronization2 = findStructure<VkPhysicalDeviceSynchronization2FeaturesKHR>(builder.getChain(),
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR);
+    const auto* timeline = findStructure<VkPhysicalDeviceTimelineSemaphoreFeaturesKHR>(builder.getChain(),
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR);
+    const auto* maintenance = findStructure<VkPhysicalDeviceSwapchainMaintenance1FeaturesEXT>(builder.getChain(),
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_EXT);
+    CHECK(synchronization2 != nullptr && synchronization2->synchronization2 == VK_TRUE);
+    CHECK(timeline != nullptr && timeline->timelineSemaphore == VK_TRUE);
+    CHECK(maintenance != nullptr && maintenance->swapchainMaintenance1 == VK_TRUE);
+
+    // Instance extensions and extensions that are core at 1.1 aren't device extensions to enable
+    CHECK(builder.getExtensions().size() == 3);
+    CHECK(hasExtension(builder, VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME));
+    CHECK(hasExtension(builder, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME));
+    CHECK(hasExtension(builder, VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME));
+    CHECK(!hasExtension(builder, VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME));
+    CHECK(!hasExtension(builder, VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME));
+}
+
+
+static void testCore()
+{
+    // Features that are core at the device version need no extension, only the bits that are used are enabled
+    setupDevice(VK_API_VERSION_1_3, { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR,
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES_KHR });
+
+    DeviceFeatureBuilder builder;
+    builder.require(EDeviceFeature::Synchronization2);
+    builder.require(EDeviceFeature::DynamicRendering);
+    builder.request(EDeviceFeature::BufferDeviceAddress);
+    CHECK(builder.negotiate(gInstance, VK_API_VERSION_1_3, {}, gDevice, {}));
+    CHECK(builder.getExtensions().empty());
+    CHECK(builder.getFeatures().mApiVersion == VK_API_VERSION_1_3);
+    CHECK(builder.getFeatures().mDynamicRendering && builder.getFeatures().mBufferDeviceAddress);
+    CHECK(getChainTypes(builder.getChain()).size() == 4);
+
+    const auto* address = findStructure<VkPhysicalDeviceBufferDeviceAddressFeaturesKHR>(builder.getChain(),
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES_KHR);
+    CHECK(address != nullptr && address->bufferDeviceAddress == VK_TRUE);
+    CHECK(address != nullptr && address->bufferDeviceAddressCaptureReplay == VK_FALSE && address->bufferDeviceAddressMultiDevice == VK_FALSE);
+}
+
+
+static void testVersionLimit()
+{
+    // The instance version limits the device version, features then depend on their extensions again
+    setupDevice(VK_API_VERSION_1_3, { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR });
+    DeviceFeatureBuilder builder;
+    builder.require(EDeviceFeature::Synchronization2);
+    CHECK(!builder.negotiate(gInstance, VK_API_VERSION_1_2, {}, gDevice, {}));
+
+    // A newer instance doesn't raise the device version either
+    setupDevice(VK_API_VERSION_1_2, { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR });
+    DeviceFeatureBuilder limited;
+    limited.require(EDeviceFeature::Synchronization2);
+    CHECK(limited.negotiate(gInstance, VK_API_VERSION_1_3, {}, gDevice, makeExtensions({ VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME })));
+    CHECK(limited.getFeatures().mApiVersion == VK_API_VERSION_1_2);
+    CHECK(hasExtension(limited, VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME));
+}
+
+
+static void testUnsupportedBits()
+{
+    // An available extension isn't enough, the device must report the feature bits
+    setupDevice(VK_API_VERSION_1_2, { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR });
+    std::vector<VkExtensionProperties> device_extensions = makeExtensions({ VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME });
+
+    DeviceFeatureBuilder builder;
+    builder.request(EDeviceFeature::DynamicRendering);
+    builder.request(EDeviceFeature::TimelineSemaphore);
+    CHECK(builder.negotiate(gInstance, VK_API_VERSION_1_2, {}, gDevice, device_extensions));
+    CHECK(getStubState().mQueriedFeatures.size() == 2);
+    CHECK(!builder.getFeatures().mDynamicRendering && builder.getFeatures().mTimelineSemaphore);
+    CHECK(builder.getExtensions().empty());
+    CHECK(findStructure<VkPhysicalDeviceDynamicRenderingFeaturesKHR>(builder.getChain(),
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR) == nullptr);
+
+    // Required it fails the negotiation
+    DeviceFeatureBuilder required;
+    required.require(EDeviceFeature::DynamicRendering);
+    CHECK(!required.negotiate(gInstance, VK_API_VERSION_1_2, {}, gDevice, device_extensions));
+}
+
+
+static void testProperties2Extension()
+{
+    // A 1.0 instance queries through VK_KHR_get_physical_device_properties2, without it nothing can be negotiated
+    setupDevice(VK_API_VERSION_1_0, { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_16BIT_STORAGE_FEATURES_KHR });
+    std::vector<VkExtensionProperties> device_extensions = makeExtensions({ VK_KHR_16BIT_STORAGE_EXTENSION_NAME,
+        VK_KHR_STORAGE_BUFFER_STORAGE_CLASS_EXTENSION_NAME });
+
+    DeviceFeatureBuilder builder;
+    builder.require(EDeviceFeature::Storage16Bit);
+    CHECK(builder.negotiate(gInstance, VK_API_VERSION_1_0, { VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME }, gDevice, device_extensions));
+    CHECK(builder.getFeatures().mStorage16Bit);
+    CHECK(builder.getExtensions().size() == 2);
+    CHECK(getChainTypes(builder.getChain()).size() == 2);
+
+    DeviceFeatureBuilder missing;
+    missing.require(EDeviceFeature::Storage16Bit);
+    CHECK(!missing.negotiate(gInstance, VK_API_VERSION_1_0, {}, gDevice, device_extensions));
+}
+
+
+int main()
+{
+    RUN_TEST(testExtensionChain);
+    RUN_TEST(testCore);
+    RUN_TEST(testVersionLimit);
+    RUN_TEST(testUnsupportedBits);
+    RUN_TEST(testProperties2Extension);
+    return getTestResult();
+}
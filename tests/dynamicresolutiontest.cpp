@@ -0,0 +1,84 @@
+#include "test.h"
+#include "dynamicresolution.h"
+
+/**
+ * Feeds the same GPU time a number of times
+ * @return number of times the scale changed
+ */
+static unsigned int feed(DynamicResolution& resolution, double gpuTime, unsigned int frames)
+{
+    unsigned int changes = 0;
+    for (unsigned int i = 0; i < frames; i++)
+    {
+        if (resolution.update(gpuTime))
+            changes++;
+    }
+    return changes;
+}
+
+
+static void testLower()
+{
+    // Twice the target halves the pixels: the scale drops to 1 / sqrt(2), quantized down to 11/16
+    DynamicResolution resolution(10.0, 0.5f, 1.0f);
+    CHECK(resolution.getStats().mScale == 1.0f);
+    CHECK(resolution.update(20.0));
+    CHECK(resolution.getStats().mScale == 11.0f / 16.0f);
+
+    // Measurements are smoothed but no change happens until the cooldown passed
+    CHECK(feed(resolution, 20.0, 30) == 0);
+    CHECK(resolution.getStats().mChanges == 1);
+}
+
+
+static void testStable()
+{
+    // Within the target, without enough headroom to go up
+    DynamicResolution resolution(10.0, 0.5f, 1.0f);
+    resolution.update(20.0);
+    feed(resolution, 9.0, 30);
+    float scale = resolution.getStats().mScale;
+    CHECK(feed(resolution, 9.0, 200) == 0);
+    CHECK(resolution.getStats().mScale == scale);
+}
+
+
+static void testLimits()
+{
+    DynamicResolution resolution(10.0, 0.5f, 1.0f);
+    feed(resolution, 100.0, 200);
+    CHECK(resolution.getStats().mScale == 0.5f);
+    feed(resolution, 1.0, 400);
+    CHECK(resolution.getStats().mScale == 1.0f);
+}
+
+
+static void testIgnored()
+{
+    DynamicResolution resolution(10.0, 0.5f, 1.0f);
+    CHECK(!resolution.update(0.0));
+    CHECK(resolution.getStats().mGpuTime == 0.0);
+    CHECK(resolution.getStats().mScale == 1.0f);
+}
+
+
+static void testExtent()
+{
+    DynamicResolution resolution(10.0, 0.5f, 1.0f);
+    feed(resolution, 100.0, 200);
+    VkExtent2D extent = resolution.getExtent({ 1920, 1080 });
+    CHECK(extent.width == 960 && extent.height == 540);
+    extent = resolution.getExtent({ 1, 1 });
+    CHECK(extent.width == 1 && extent.height == 1);
+}
+
+
+int main()
+{
+    RUN_TEST(testLower);
+    RUN_TEST(testStable);
+    RUN_TEST(testLimits);
+    RUN_TEST(testIgnored);
+    RUN_TEST(testExtent);
+    return getTestResult();
+}
@@ -0,0 +1,153 @@
+#include "test.h"
+#include "eventqueue.h"
+
+#include <thread>
+
+/**
+ * @return a resize event of the given window, events of different windows are never coalesced
+ */
+static RenderEvent makeResize(uint32_t windowID, int32_t width, int32_t height)
+{
+    RenderEvent event;
+    event.mType = ERenderEventType::Resize;
+    event.mWindowID = windowID;
+    event.mX = width;
+    event.mY = height;
+    return event;
+}
+
+
+static void testEmpty()
+{
+    EventQueue queue(4);
+    RenderEvent event;
+    CHECK(!queue.pop(event));
+    CHECK(queue.flush());
+    CHECK(!queue.pop(event));
+}
+
+
+static void testFull()
+{
+    // A capacity of 3 is rounded up to 4, the events that don't fit stay pending until the next flush
+    EventQueue queue(3);
+    for (uint32_t i = 1; i <= 6; i++)
+        queue.post(makeResize(i, 0, 0));
+    CHECK(!queue.flush());
+    CHECK(queue.getStats().mPushed == 4);
+    CHECK(queue.getStats().mDeferred == 1);
+
+    RenderEvent event;
+    for (uint32_t i = 1; i <= 4; i++)
+    {
+        CHECK(queue.pop(event));
+        CHECK(event.mWindowID == i);
+    }
+    CHECK(!queue.pop(event));
+
+    CHECK(queue.flush());
+    for (uint32_t i = 5; i <= 6; i++)
+    {
+        CHECK(queue.pop(event));
+        CHECK(event.mWindowID == i);
+    }
+    CHECK(!queue.pop(event));
+}
+
+
+static void testWrap()
+{
+    // Head and tail run past the capacity many times, events come out in posting order
+    EventQueue queue(4);
+    uint32_t posted = 0;
+    uint32_t popped = 0;
+    for (int round = 0; round < 10; round++)
+    {
+        for (int i = 0; i < 3; i++)
+            queue.post(makeResize(++posted, 0, 0));
+        CHECK(queue.flush());
+
+        RenderEvent event;
+        while (queue.pop(event))
+            CHECK(event.mWindowID == ++popped);
+    }
+    CHECK(popped == posted);
+}
+
+
+static void testCoalesce()
+{
+    // Sizes are replaced, mouse deltas accumulate, only events of the same kind and window are merged
+    EventQueue queue(8);
+    queue.post(makeResize(1, 100, 100));
+    queue.post(makeResize(1, 200, 150));
+    queue.post(makeResize(2, 300, 300));
+
+    RenderEvent drag;
+    drag.mType = ERenderEventType::MouseDrag;
+    drag.mWindowID = 1;
+    drag.mX = 3;
+    drag.mY = -1;
+    queue.post(drag);
+    queue.post(drag);
+    CHECK(queue.getStats().mPosted == 5);
+    CHECK(queue.getStats().mCoalesced == 2);
+    CHECK(queue.flush());
+
+    RenderEvent event;
+    CHECK(queue.pop(event));
+    CHECK(event.mType == ERenderEventType::Resize && event.mWindowID == 1 && event.mX == 200 && event.mY == 150);
+    CHECK(queue.pop(event));
+    CHECK(event.mType == ERenderEventType::Resize && event.mWindowID == 2 && event.mX == 300);
+    CHECK(queue.pop(event));
+    CHECK(event.mType == ERenderEventType::MouseDrag && event.mX == 6 && event.mY == -2);
+    CHECK(!queue.pop(event));
+}
+
+
+static void testThreads()
+{
+    // A single producer and consumer on their own threads, a small ring forces the producer to defer
+    const uint32_t count = 5000;
+    EventQueue queue(16);
+    uint32_t received = 0;
+    bool ordered = true;
+    std::thread consumer([&queue, &received, &ordered]()
+    {
+        RenderEvent event;
+        while (received < count)
+        {
+            if (!queue.pop(event))
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            ordered = ordered && event.mWindowID == received + 1;
+            received++;
+        }
+    });
+
+    for (uint32_t i = 1; i <= count; i++)
+    {
+        queue.post(makeResize(i, 0, 0));
+        queue.flush();
+    }
+    while (!queue.flush())
+        std::this_thread::yield();
+    consumer.join();
+
+    CHECK(received == count);
+    CHECK(ordered);
+    CHECK(queue.getStats().mPushed == count);
+}
+
+
+int main()
+{
+    RUN_TEST(testEmpty);
+    RUN_TEST(testFull);
+    RUN_TEST(testWrap);
+    RUN_TEST(testCoalesce);
+    RUN_TEST(testThreads);
+    return getTestResult();
+}
@@ -0,0 +1,157 @@
+#include "test.h"
+#include "hostallocator.h"
+
+#include <cstring>
+
+/**
+ * Allocates through the callbacks of a scope, the way a driver does
+ */
+static void* allocate(const VkAllocationCallbacks* callbacks, size_t size, size_t alignment)
+{
+    return callbacks->pfnAllocation(callbacks->pUserData, size, alignment, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+}
+
+
+static void* reallocate(const VkAllocationCallbacks* callbacks, void* original, size_t size, size_t alignment)
+{
+    return callbacks->pfnReallocation(callbacks->pUserData, original, size, alignment, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+}
+
+
+static void release(const VkAllocationCallbacks* callbacks, void* memory)
+{
+    callbacks->pfnFree(callbacks->pUserData, memory);
+}
+
+
+static const HostScopeStats& getScopeStats(const HostAllocatorStats& stats, EHostScope scope)
+{
+    return stats.mScopes[static_cast<size_t>(scope)];
+}
+
+
+static void testSizeClasses()
+{
+    // Small allocations come from the arenas, anything beyond the largest class from the heap
+    HostAllocator allocator;
+    const VkAllocationCallbacks* callbacks = allocator.getCallbacks(EHostScope::Device);
+    void* small = allocate(callbacks, 16, 8);
+    void* medium = allocate(callbacks, 4000, 16);
+    void* large = allocate(callbacks, 64 * 1024, 16);
+    CHECK(small != nullptr && medium != nullptr && large != nullptr);
+
+    HostAllocatorStats stats = allocator.getStats();
+    const HostScopeStats& device = getScopeStats(stats, EHostScope::Device);
+    CHECK(device.mAllocations == 3);
+    CHECK(device.mPooled == 2);
+    CHECK(device.mLiveBytes == 16 + 4000 + 64 * 1024);
+    CHECK(stats.mArenaBytes > 0);
+
+    release(callbacks, small);
+    release(callbacks, medium);
+    release(callbacks, large);
+    stats = allocator.getStats();
+    CHECK(getScopeStats(stats, EHostScope::Device).mFrees == 3);
+    CHECK(getScopeStats(stats, EHostScope::Device).mLiveBytes == 0);
+    CHECK(getScopeStats(stats, EHostScope::Device).mPeakBytes == 16 + 4000 + 64 * 1024);
+}
+
+
+static void testSlotReuse()
+{
+    // A freed slot is the first one handed out again by its size class
+    HostAllocator allocator;
+    const VkAllocationCallbacks* callbacks = allocator.getCallbacks(EHostScope::Pipeline);
+    void* first = allocate(callbacks, 48, 8);
+    release(callbacks, first);
+    void* second = allocate(callbacks, 48, 8);
+    CHECK(first == second);
+    release(callbacks, second);
+}
+
+
+static void testAlignment()
+{
+    HostAllocator allocator;
+    const VkAllocationCallbacks* callbacks = allocator.getCallbacks(EHostScope::Device);
+    const size_t alignments[] = { 1, 8, 16, 64, 256, 4096 };
+    for (size_t alignment : alignments)
+    {
+        void* memory = allocate(callbacks, 24, alignment);
+        CHECK(memory != nullptr);
+        CHECK(reinterpret_cast<uintptr_t>(memory) % alignment == 0);
+        release(callbacks, memory);
+    }
+}
+
+
+static void testReallocation()
+{
+    // Contents are kept, the new allocation follows the alignment passed to the reallocation
+    HostAllocator allocator;
+    const VkAllocationCallbacks* callbacks = allocator.getCallbacks(EHostScope::Swapchain);
+    unsigned char* memory = static_cast<unsigned char*>(allocate(callbacks, 40, 8));
+    for (int i = 0; i < 40; i++)
+        memory[i] = static_cast<unsigned char>(i);
+
+    unsigned char* grown = static_cast<unsigned char*>(reallocate(callbacks, memory, 3000, 256));
+    CHECK(grown != nullptr);
+    CHECK(reinterpret_cast<uintptr_t>(grown) % 256 == 0);
+    bool kept = true;
+    for (int i = 0; i < 40; i++)
+        kept = kept && grown[i] == static_cast<unsigned char>(i);
+    CHECK(kept);
+
+    unsigned char* shrunk = static_cast<unsigned char*>(reallocate(callbacks, grown, 8, 64));
+    CHECK(reinterpret_cast<uintptr_t>(shrunk) % 64 == 0);
+    CHECK(std::memcmp(shrunk, "\0\1\2\3\4\5\6\7", 8) == 0);
+
+    HostAllocatorStats stats = allocator.getStats();
+    const HostScopeStats& swapchain = getScopeStats(stats, EHostScope::Swapchain);
+    CHECK(swapchain.mReallocations == 2);
+    CHECK(swapchain.mAllocations == 3);
+    CHECK(swapchain.mFrees == 2);
+    CHECK(swapchain.mLiveBytes == 8);
+
+    // A null original allocates, a size of 0 frees
+    CHECK(reallocate(callbacks, shrunk, 0, 8) == nullptr);
+    void* fresh = reallocate(callbacks, nullptr, 32, 8);
+    CHECK(fresh != nullptr);
+    release(callbacks, fresh);
+    stats = allocator.getStats();
+    CHECK(getScopeStats(stats, EHostScope::Swapchain).mLiveBytes == 0);
+}
+
+
+static void testScopes()
+{
+    // Every scope counts its own allocations, internal allocations are only reported
+    HostAllocator allocator;
+    const VkAllocationCallbacks* instance = allocator.getCallbacks(EHostScope::Instance);
+    const VkAllocationCallbacks* pipeline = allocator.getCallbacks(EHostScope::Pipeline);
+    void* memory = allocate(instance, 128, 8);
+    instance->pfnInternalAllocation(instance->pUserData, 512, VK_INTERNAL_ALLOCATION_TYPE_EXECUTABLE, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+
+    HostAllocatorStats stats = allocator.getStats();
+    CHECK(getScopeStats(stats, EHostScope::Instance).mAllocations == 1);
+    CHECK(getScopeStats(stats, EHostScope::Instance).mInternalBytes == 512);
+    CHECK(getScopeStats(stats, EHostScope::Pipeline).mAllocations == 0);
+
+    instance->pfnInternalFree(instance->pUserData, 512, VK_INTERNAL_ALLOCATION_TYPE_EXECUTABLE, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+    release(instance, memory);
+    release(pipeline, nullptr);
+    stats = allocator.getStats();
+    CHECK(getScopeStats(stats, EHostScope::Instance).mInternalBytes == 0);
+    CHECK(getScopeStats(stats, EHostScope::Pipeline).mFrees == 0);
+}
+
+
+int main()
+{
+    RUN_TEST(testSizeClasses);
+    RUN_TEST(testSlotReuse);
+    RUN_TEST(testAlignment);
+    RUN_TEST(testReallocation);
+    RUN_TEST(testScopes);
+    return getTestResult();
+}
@@ -0,0 +1,92 @@
+#include "test.h"
+#include "lineararena.h"
+
+#include <vector>
+
+static void testAlignment()
+{
+    LinearArena arena;
+    arena.init(1024);
+    void* a = arena.allocate(3, 1);
+    void* b = arena.allocate(8, 8);
+    void* c = arena.allocate(16, 64);
+    CHECK(reinterpret_cast<uintptr_t>(b) % 8 == 0);
+    CHECK(reinterpret_cast<uintptr_t>(c) % 64 == 0);
+    CHECK(static_cast<char*>(b) >= static_cast<char*>(a) + 3);
+    CHECK(static_cast<char*>(c) >= static_cast<char*>(b) + 8);
+    CHECK(arena.getStats().mOverflows == 0);
+}
+
+
+static void testReset()
+{
+    // Reset hands out the same memory again, the peak is kept
+    LinearArena arena;
+    arena.init(1024);
+    void* first = arena.allocate(100, 8);
+    CHECK(arena.allocate(200, 8) != nullptr);
+    size_t peak = arena.getStats().mPeak;
+    CHECK(peak >= 300);
+
+    arena.reset();
+    CHECK(arena.getMarker() == 0);
+    CHECK(arena.getStats().mResets == 1);
+    CHECK(arena.allocate(100, 8) == first);
+    CHECK(arena.getStats().mPeak == peak);
+}
+
+
+static void testRewind()
+{
+    LinearArena arena;
+    arena.init(1024);
+    CHECK(arena.allocate(64, 8) != nullptr);
+    LinearArena::Marker marker = arena.getMarker();
+    {
+        ArenaScope scope(arena);
+        std::pmr::vector<int> values(scope.get());
+        values.reserve(16);
+        CHECK(arena.getMarker() > marker);
+    }
+    CHECK(arena.getMarker() == marker);
+}
+
+
+static void testGrowth()
+{
+    // A growing vector leaves its previous buffers behind, all of them fit in the arena
+    LinearArena arena;
+    arena.init(4096);
+    std::pmr::vector<int> values(&arena);
+    for (int i = 0; i < 256; i++)
+        values.emplace_back(i);
+    CHECK(arena.getMarker() <= 4096);
+    CHECK(arena.getStats().mOverflows == 0);
+    CHECK(values[255] == 255);
+}
+
+
+static void testOverflow()
+{
+    // Allocations that don't fit come from upstream, they're counted and given back to upstream
+    LinearArena arena;
+    arena.init(64);
+    void* small = arena.allocate(32, 8);
+    void* large = arena.allocate(128, 8);
+    CHECK(small != nullptr && large != nullptr);
+    CHECK(arena.getStats().mOverflows == 1);
+    CHECK(arena.getMarker() == 32);
+    arena.deallocate(large, 128, 8);
+    CHECK(arena.getMarker() == 32);
+}
+
+
+int main()
+{
+    RUN_TEST(testAlignment);
+    RUN_TEST(testReset);
+    RUN_TEST(testRewind);
+    RUN_TEST(testGrowth);
+    RUN_TEST(testOverflow);
+    return getTestResult();
+}
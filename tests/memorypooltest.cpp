@@ -0,0 +1,203 @@
+#include "test.h"
+#include "vulkanstubs.h"
+#include "memorypool.h"
+
+/**
+ * Size of every pool block in the tests
+ */
+static const VkDeviceSize gBlockSize = 4096;
+
+
+/**
+ * Pool on a fake device, every test starts without any allocated memory
+ */
+struct PoolFixture
+{
+    PoolFixture()
+    {
+        resetStubs();
+        mPool.init(makeStubHandle<VkDevice>(1), 0, gBlockSize, 0);
+    }
+
+    ~PoolFixture()
+    {
+        mPool.destroy();
+        CHECK(getStubState().mLiveMemory == 0);
+    }
+
+    MemoryPool  mPool;
+};
+
+
+static void testAllocate()
+{
+    // Ranges are placed at the first fit, aligned, in a single block until it's full
+    PoolFixture fixture;
+    MemoryPool& pool = fixture.mPool;
+    MemoryAllocation a;
+    MemoryAllocation b;
+    MemoryAllocation c;
+    CHECK(pool.allocate(100, 16, a));
+    CHECK(pool.allocate(200, 256, b));
+    CHECK(pool.allocate(3000, 64, c));
+    CHECK(a.mBlock == 0 && a.mOffset == 0 && a.mSize == 100);
+    CHECK(b.mBlock == 0 && b.mOffset == 256 && b.mSize == 200);
+    CHECK(c.mBlock == 0 && c.mOffset == 512);
+    CHECK(getStubState().mLiveMemory == 1);
+    CHECK(pool.getMemory(a) == pool.getMemory(c));
+
+    // The padding between the first and second range is still free
+    MemoryAllocation d;
+    CHECK(pool.allocate(100, 4, d));
+    CHECK(d.mBlock == 0 && d.mOffset == 100);
+
+    MemoryPoolStats stats = pool.getStats();
+    CHECK(stats.mBlocks == 1);
+    CHECK(stats.mAllocations == 4);
+    CHECK(stats.mBlockBytes == gBlockSize);
+    CHECK(stats.mUsedBytes == 3400);
+}
+
+
+static void testNewBlocks()
+{
+    // A full block adds a new one, requests larger than the block size get a block of their own
+    PoolFixture fixture;
+    MemoryPool& pool = fixture.mPool;
+    MemoryAllocation full;
+    MemoryAllocation next;
+    MemoryAllocation large;
+    CHECK(pool.allocate(gBlockSize, 1, full));
+    CHECK(pool.allocate(16, 1, next));
+    CHECK(pool.allocate(3 * gBlockSize, 1, large));
+    CHECK(full.mBlock == 0 && next.mBlock == 1 && large.mBlock == 2);
+    CHECK(large.mOffset == 0);
+    CHECK(getStubState().mAllocationSizes.size() == 3);
+    CHECK(getStubState().mAllocationSizes.back() == 3 * gBlockSize);
+    CHECK(pool.getMemory(full) != pool.getMemory(next));
+}
+
+
+static void testFailure()
+{
+    PoolFixture fixture;
+    MemoryAllocation allocation;
+    getStubState().mFailAllocations = 1;
+    CHECK(!fixture.mPool.allocate(64, 16, allocation));
+    CHECK(fixture.mPool.getStats().mBlocks == 0);
+    CHECK(fixture.mPool.allocate(64, 16, allocation));
+}
+
+
+static void testMerge()
+{
+    // Freed ranges merge with free neighbours on both sides
+    PoolFixture fixture;
+    MemoryPool& pool = fixture.mPool;
+    MemoryAllocation ranges[4];
+    for (auto& range : ranges)
+        CHECK(pool.allocate(256, 256, range));
+
+    pool.free(ranges[0]);
+    pool.free(ranges[2]);
+    MemoryPoolStats stats = pool.getStats();
+    CHECK(stats.mAllocations == 2);
+    CHECK(stats.mLargestFree == gBlockSize - 1024);
+    CHECK(stats.mFragmentation > 0.0f);
+
+    // The middle range joins both neighbours, a 768 byte request fits at the start again
+    pool.free(ranges[1]);
+    stats = pool.getStats();
+    CHECK(stats.mLargestFree == gBlockSize - 1024);
+    MemoryAllocation merged;
+    CHECK(pool.allocate(768, 256, merged));
+    CHECK(merged.mBlock == 0 && merged.mOffset == 0);
+
+    // The last range merges with the free tail of the block
+    pool.free(ranges[3]);
+    stats = pool.getStats();
+    CHECK(stats.mLargestFree == gBlockSize - 768);
+    CHECK(stats.mFragmentation == 0.0f);
+}
+
+
+static void testPadding()
+{
+    // Alignment padding left free in front of a range merges back once its neighbour is freed
+    PoolFixture fixture;
+    MemoryPool& pool = fixture.mPool;
+    MemoryAllocation first;
+    MemoryAllocation aligned;
+    CHECK(pool.allocate(100, 1, first));
+    CHECK(pool.allocate(512, 512, aligned));
+    CHECK(aligned.mOffset == 512);
+
+    pool.free(first);
+    MemoryAllocation reused;
+    CHECK(pool.allocate(512, 1, reused));
+    CHECK(reused.mBlock == 0 && reused.mOffset == 0);
+}
+
+
+static void testRelease()
+{
+    // A block is freed with its last range, its slot is taken by the next block
+    PoolFixture fixture;
+    MemoryPool& pool = fixture.mPool;
+    MemoryAllocation a;
+    MemoryAllocation b;
+    CHECK(pool.allocate(gBlockSize, 1, a));
+    CHECK(pool.allocate(gBlockSize, 1, b));
+    CHECK(getStubState().mLiveMemory == 2);
+
+    pool.free(a);
+    CHECK(getStubState().mLiveMemory == 1);
+    CHECK(pool.getStats().mBlocks == 1);
+
+    MemoryAllocation c;
+    CHECK(pool.allocate(64, 16, c));
+    CHECK(c.mBlock == 0 && c.mOffset == 0);
+    CHECK(getStubState().mLiveMemory == 2);
+}
+
+
+static void testAllocateBelow()
+{
+    // Only ranges before the limit qualify, no block is ever added
+    PoolFixture fixture;
+    MemoryPool& pool = fixture.mPool;
+    MemoryAllocation ranges[3];
+    for (auto& range : ranges)
+        CHECK(pool.allocate(1024, 1024, range));
+    pool.free(ranges[0]);
+
+    MemoryAllocation moved;
+    CHECK(pool.allocateBelow(1024, 1024, ranges[2], moved));
+    CHECK(moved.mBlock == 0 && moved.mOffset == 0);
+
+    // The remaining free range lies after the limit
+    MemoryAllocation none;
+    CHECK(!pool.allocateBelow(1024, 1024, ranges[1], none));
+    CHECK(getStubState().mLiveMemory == 1);
+
+    // A range in a later block moves into the free space of an earlier one
+    MemoryAllocation later;
+    CHECK(pool.allocate(gBlockSize, 1, later));
+    CHECK(later.mBlock == 1);
+    pool.free(ranges[1]);
+    CHECK(pool.allocateBelow(1024, 1024, later, moved));
+    CHECK(moved.mBlock == 0 && moved.mOffset == 1024);
+}
+
+
+int main()
+{
+    RUN_TEST(testAllocate);
+    RUN_TEST(testNewBlocks);
+    RUN_TEST(testFailure);
+    RUN_TEST(testMerge);
+    RUN_TEST(testPadding);
+    RUN_TEST(testRelease);
+    RUN_TEST(testAllocateBelow);
+    return getTestResult();
+}
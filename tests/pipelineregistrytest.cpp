@@ -0,0 +1,182 @@
+#include "test.h"
+#include "vulkanstubs.h"
+#include "pipelineregistry.h"
+
+#include <unordered_set>
+
+/**
+ * A graphics description with a vertex and fragment stage and a single color attachment
+ */
+static PipelineDescription makeGraphicsDescription()
+{
+    PipelineDescription description;
+    description.mStages.resize(2);
+    description.mStages[0].mStage = VK_SHADER_STAGE_VERTEX_BIT;
+    description.mStages[0].mModule = makeStubHandle<VkShaderModule>(1);
+    description.mStages[1].mStage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    description.mStages[1].mModule = makeStubHandle<VkShaderModule>(2);
+
+    VkPipelineColorBlendAttachmentState blend = {};
+    blend.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    description.mBlendAttachments.emplace_back(blend);
+    description.mColorFormats.emplace_back(VK_FORMAT_B8G8R8A8_SRGB);
+    description.mLayout = makeStubHandle<VkPipelineLayout>(3);
+    description.mRenderPass = makeStubHandle<VkRenderPass>(4);
+    return description;
+}
+
+
+/**
+ * A compute description with a single stage
+ */
+static PipelineDescription makeComputeDescription()
+{
+    PipelineDescription description;
+    description.mStages.resize(1);
+    description.mStages[0].mStage = VK_SHADER_STAGE_COMPUTE_BIT;
+    description.mStages[0].mModule = makeStubHandle<VkShaderModule>(5);
+    description.mLayout = makeStubHandle<VkPipelineLayout>(3);
+    return description;
+}
+
+
+/**
+ * @return if the two descriptions are different keys: not equal and hashed differently
+ */
+static bool isDifferentKey(const PipelineDescription& lhs, const PipelineDescription& rhs)
+{
+    return lhs != rhs && hashPipelineDescription(lhs) != hashPipelineDescription(rhs);
+}
+
+
+static void testEqualDescriptions()
+{
+    // Descriptions built the same way are the same key, a copy as well
+    PipelineDescription a = makeGraphicsDescription();
+    PipelineDescription b = makeGraphicsDescription();
+    PipelineDescription c = a;
+    CHECK(a == b && a == c);
+    CHECK(hashPipelineDescription(a) == hashPipelineDescription(b));
+    CHECK(hashPipelineDescription(a) == hashPipelineDescription(c));
+    CHECK(PipelineDescriptionHasher()(a) == PipelineDescriptionHasher()(b));
+    CHECK(!isComputePipeline(a));
+    CHECK(isComputePipeline(makeComputeDescription()));
+}
+
+
+static void testChangedFields()
+{
+    // Every part of the description takes part in the key
+    const PipelineDescription base = makeGraphicsDescription();
+
+    PipelineDescription changed = base;
+    changed.mStages[1].mModule = makeStubHandle<VkShaderModule>(6);
+    CHECK(isDifferentKey(base, changed));
+
+    changed = base;
+    changed.mStages[0].mEntryPoint = "vertexMain";
+    CHECK(isDifferentKey(base, changed));
+
+    changed = base;
+    std::swap(changed.mStages[0], changed.mStages[1]);
+    CHECK(isDifferentKey(base, changed));
+
+    changed = base;
+    changed.mVertexBindings.emplace_back(VkVertexInputBindingDescription{ 0, 16, VK_VERTEX_INPUT_RATE_VERTEX });
+    CHECK(isDifferentKey(base, changed));
+
+    changed = base;
+    changed.mTopology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
+    CHECK(isDifferentKey(base, changed));
+
+    changed = base;
+    changed.mSamples = VK_SAMPLE_COUNT_4_BIT;
+    CHECK(isDifferentKey(base, changed));
+
+    changed = base;
+    changed.mDepthTest = true;
+    CHECK(isDifferentKey(base, changed));
+
+    changed = base;
+    changed.mBlendAttachments[0].blendEnable = VK_TRUE;
+    CHECK(isDifferentKey(base, changed));
+
+    changed = base;
+    changed.mColorFormats[0] = VK_FORMAT_B8G8R8A8_UNORM;
+    CHECK(isDifferentKey(base, changed));
+
+    changed = base;
+    changed.mDepthFormat = VK_FORMAT_D32_SFLOAT;
+    CHECK(isDifferentKey(base, changed));
+
+    changed = base;
+    changed.mRenderPass = makeStubHandle<VkRenderPass>(7);
+    CHECK(isDifferentKey(base, changed));
+
+    changed = base;
+    changed.mSubpass = 1;
+    CHECK(isDifferentKey(base, changed));
+}
+
+
+static void testUnorderedKey()
+{
+    // Equal descriptions collapse into a single entry of an unordered container
+    std::unordered_set<PipelineDescription, PipelineDescriptionHasher> keys;
+    keys.insert(makeGraphicsDescription());
+    keys.insert(makeGraphicsDescription());
+    keys.insert(makeComputeDescription());
+    PipelineDescription strip = makeGraphicsDescription();
+    strip.mTopology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
+    keys.insert(strip);
+    CHECK(keys.size() == 3);
+    CHECK(keys.count(makeGraphicsDescription()) == 1);
+}
+
+
+static void testDeduplication()
+{
+    // Identical descriptions resolve to the same pipeline, which is compiled only once
+    resetStubs();
+    PipelineRegistry registry;
+    CHECK(registry.init(makeStubHandle<VkDevice>(1), "", 1));
+
+    VkPipeline graphics = registry.acquireBlocking(makeGraphicsDescription());
+    CHECK(graphics != VK_NULL_HANDLE);
+    CHECK(registry.acquireBlocking(makeGraphicsDescription()) == graphics);
+    CHECK(registry.acquire(makeGraphicsDescription(), VK_NULL_HANDLE) == graphics);
+    CHECK(getStubState().mPipelinesCreated == 1);
+
+    VkPipeline compute = registry.acquireBlocking(makeComputeDescription());
+    CHECK(compute != VK_NULL_HANDLE && compute != graphics);
+    CHECK(getStubState().mPipelinesCreated == 2);
+
+    PipelineRegistryStats stats = registry.getStats();
+    CHECK(stats.mMisses == 2);
+    CHECK(stats.mHits == 4);
+    CHECK(stats.mFallbacks == 0);
+    CHECK(stats.mPending == 0);
+
+    // A new description returns the fallback until a worker compiled it
+    PipelineDescription strip = makeGraphicsDescription();
+    strip.mTopology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
+    VkPipeline fallback = makeStubHandle<VkPipeline>(8);
+    CHECK(registry.acquire(strip, fallback) == fallback);
+    VkPipeline compiled = registry.acquireBlocking(strip);
+    CHECK(compiled != VK_NULL_HANDLE && compiled != graphics && compiled != fallback);
+    CHECK(getStubState().mPipelinesCreated == 3);
+    CHECK(registry.getStats().mMisses == 3);
+
+    registry.destroy();
+    CHECK(getStubState().mLivePipelines == 0);
+}
+
+
+int main()
+{
+    RUN_TEST(testEqualDescriptions);
+    RUN_TEST(testChangedFields);
+    RUN_TEST(testUnorderedKey);
+    RUN_TEST(testDeduplication);
+    return getTestResult();
+}
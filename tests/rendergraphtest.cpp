@@ -0,0 +1,264 @@
+#include "test.h"
+#include "vulkanstubs.h"
+#include "rendergraph.h"
+
+#include <cstring>
+#include <vector>
+
+/**
+ * Graph, state tracker and a fake swap chain image, as set up by the renderer
+ */
+struct GraphFixture
+{
+    GraphFixture()
+    {
+        resetStubs();
+        CHECK(mTracker.init(mDevice));
+        CHECK(mGraph.init(makeStubHandle<VkPhysicalDevice>(1), mDevice, 0, 2, mTracker));
+        mTracker.registerImage(mSwapImage, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+        mDescription.mFormat = VK_FORMAT_B8G8R8A8_UNORM;
+        mDescription.mExtent = { 64, 64 };
+    }
+
+    ~GraphFixture()
+    {
+        mGraph.destroy();
+        CHECK(getStubState().mLiveImages == 0);
+        CHECK(getStubState().mLiveMemory == 0);
+    }
+
+    /**
+     * Declares a pass that appends its name to mExecuted when it runs
+     */
+    unsigned int addPass(const char* name)
+    {
+        std::vector<const char*>* executed = &mExecuted;
+        return mGraph.addPass(name, [executed, name](VkCommandBuffer, const RenderGraph&) { executed->emplace_back(name); });
+    }
+
+    bool executed(const char* name) const
+    {
+        for (const char* pass : mExecuted)
+        {
+            if (std::strcmp(pass, name) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    VkDevice                    mDevice = makeStubHandle<VkDevice>(1);
+    VkCommandBuffer             mCommandBuffer = makeStubHandle<VkCommandBuffer>(1);
+    VkImage                     mSwapImage = makeStubHandle<VkImage>(1);
+    RenderGraphImageDescription mDescription;
+    ResourceStateTracker        mTracker;
+    RenderGraph                 mGraph;
+    std::vector<const char*>    mExecuted;
+};
+
+
+/**
+ * @return the barrier of the image in the batch, null when the batch doesn't contain one
+ */
+static const VkImageMemoryBarrier2KHR* findBarrier(const StubBarrierBatch& batch, VkImage image)
+{
+    for (const auto& barrier : batch.mImageBarriers)
+    {
+        if (barrier.image == image)
+            return &barrier;
+    }
+    return nullptr;
+}
+
+
+static void testCulling()
+{
+    // The debug pass writes an image nobody reads, the readback pass is kept explicitly
+    GraphFixture fixture;
+    RenderGraph& graph = fixture.mGraph;
+    RenderGraphResource swap = graph.importImage("swapchain", fixture.mSwapImage, fixture.mDescription);
+    RenderGraphResource scene = graph.createImage("scene", fixture.mDescription);
+    RenderGraphResource debug = graph.createImage("debug", fixture.mDescription);
+    RenderGraphResource readback = graph.createImage("readback", fixture.mDescription);
+
+    unsigned int pass = fixture.addPass("scene");
+    graph.write(pass, scene, ERenderGraphAccess::ColorAttachment);
+    pass = fixture.addPass("debug");
+    graph.write(pass, debug, ERenderGraphAccess::ColorAttachment);
+    pass = fixture.addPass("compose");
+    graph.read(pass, scene, ERenderGraphAccess::Sampled);
+    graph.write(pass, swap, ERenderGraphAccess::ColorAttachment);
+    pass = fixture.addPass("readback");
+    graph.write(pass, readback, ERenderGraphAccess::TransferDst);
+    graph.keepPass(pass);
+    graph.addOutput(swap, ERenderGraphAccess::Present);
+
+    CHECK(graph.compile());
+    CHECK(graph.getStats().mPasses == 4);
+    CHECK(graph.getStats().mCulledPasses == 1);
+    CHECK(graph.getStats().mTransientImages == 2);
+    CHECK(graph.getImage(debug) == VK_NULL_HANDLE);
+    CHECK(graph.getImage(scene) != VK_NULL_HANDLE);
+
+    graph.execute(fixture.mCommandBuffer);
+    CHECK(fixture.mExecuted.size() == 3);
+    CHECK(fixture.executed("scene") && fixture.executed("compose") && fixture.executed("readback"));
+    CHECK(!fixture.executed("debug"));
+}
+
+
+static void testBarriers()
+{
+    // One batch before every pass with all of its transitions, one for the outputs
+    GraphFixture fixture;
+    RenderGraph& graph = fixture.mGraph;
+    RenderGraphResource swap = graph.importImage("swapchain", fixture.mSwapImage, fixture.mDescription);
+    RenderGraphResource scene = graph.createImage("scene", fixture.mDescription);
+    unsigned int pass = fixture.addPass("scene");
+    graph.write(pass, scene, ERenderGraphAccess::ColorAttachment);
+    pass = fixture.addPass("compose");
+    graph.read(pass, scene, ERenderGraphAccess::Sampled);
+    graph.write(pass, swap, ERenderGraphAccess::ColorAttachment);
+    graph.addOutput(swap, ERenderGraphAccess::Present);
+    CHECK(graph.compile());
+    graph.execute(fixture.mCommandBuffer);
+
+    const std::vector<StubBarrierBatch>& batches = getStubState().mBatches;
+    CHECK(batches.size() == 3);
+    if (batches.size() != 3)
+        return;
+
+    VkImage scene_image = graph.getImage(scene);
+    CHECK(batches[0].mImageBarriers.size() == 1);
+    const VkImageMemoryBarrier2KHR* barrier = findBarrier(batches[0], scene_image);
+    CHECK(barrier != nullptr && barrier->oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && barrier->newLayout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+
+    // The scene is read after it was written: the write is made available to the fragment shader
+    CHECK(batches[1].mImageBarriers.size() == 2);
+    barrier = findBarrier(batches[1], scene_image);
+    CHECK(barrier != nullptr && barrier->newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    CHECK(barrier != nullptr && (barrier->srcStageMask & VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT) != 0);
+    CHECK(barrier != nullptr && (barrier->srcAccessMask & VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT) != 0);
+    CHECK(barrier != nullptr && (barrier->dstStageMask & VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT) != 0);
+    barrier = findBarrier(batches[1], fixture.mSwapImage);
+    CHECK(barrier != nullptr && barrier->newLayout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+
+    CHECK(batches[2].mImageBarriers.size() == 1);
+    barrier = findBarrier(batches[2], fixture.mSwapImage);
+    CHECK(barrier != nullptr && barrier->oldLayout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL && barrier->newLayout == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+}
+
+
+static void testRelease()
+{
+    // An output used on another queue family is released to it
+    GraphFixture fixture;
+    RenderGraph& graph = fixture.mGraph;
+    RenderGraphResource swap = graph.importImage("swapchain", fixture.mSwapImage, fixture.mDescription);
+    unsigned int pass = fixture.addPass("clear");
+    graph.write(pass, swap, ERenderGraphAccess::TransferDst);
+    graph.addOutput(swap, ERenderGraphAccess::Present, 1);
+    CHECK(graph.compile());
+    graph.execute(fixture.mCommandBuffer);
+
+    const std::vector<StubBarrierBatch>& batches = getStubState().mBatches;
+    CHECK(batches.size() == 2);
+    const VkImageMemoryBarrier2KHR* barrier = batches.empty() ? nullptr : findBarrier(batches.back(), fixture.mSwapImage);
+    CHECK(barrier != nullptr && barrier->srcQueueFamilyIndex == 0 && barrier->dstQueueFamilyIndex == 1);
+    CHECK(barrier != nullptr && barrier->newLayout == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+}
+
+
+/**
+ * Declares a chain of three transient images, the first and last don't overlap in lifetime
+ */
+static void declareChain(GraphFixture& fixture, RenderGraphResource& outFirst, RenderGraphResource& outLast)
+{
+    RenderGraph& graph = fixture.mGraph;
+    graph.reset();
+    RenderGraphResource swap = graph.importImage("swapchain", fixture.mSwapImage, fixture.mDescription);
+    RenderGraphResource a = graph.createImage("a", fixture.mDescription);
+    RenderGraphResource b = graph.createImage("b", fixture.mDescription);
+    RenderGraphResource c = graph.createImage("c", fixture.mDescription);
+
+    unsigned int pass = fixture.addPass("write a");
+    graph.write(pass, a, ERenderGraphAccess::ColorAttachment);
+    pass = fixture.addPass("a to b");
+    graph.read(pass, a, ERenderGraphAccess::Sampled);
+    graph.write(pass, b, ERenderGraphAccess::ColorAttachment);
+    pass = fixture.addPass("b to c");
+    graph.read(pass, b, ERenderGraphAccess::Sampled);
+    graph.write(pass, c, ERenderGraphAccess::ColorAttachment);
+    pass = fixture.addPass("c to swap chain");
+    graph.read(pass, c, ERenderGraphAccess::Sampled);
+    graph.write(pass, swap, ERenderGraphAccess::ColorAttachment);
+    graph.addOutput(swap, ERenderGraphAccess::Present);
+    outFirst = a;
+    outLast = c;
+}
+
+
+static void testAliasing()
+{
+    GraphFixture fixture;
+    RenderGraph& graph = fixture.mGraph;
+    RenderGraphResource first;
+    RenderGraphResource last;
+    declareChain(fixture, first, last);
+    CHECK(graph.compile());
+    CHECK(graph.getStats().mTransientImages == 3);
+    CHECK(graph.getStats().mAllocations == 2);
+    CHECK(graph.getStats().mAllocatedBytes * 3 == graph.getStats().mRequestedBytes * 2);
+    CHECK(getStubState().mLiveMemory == 2);
+
+    // The last image takes over the memory of the first: its contents are discarded and it waits for the reads of the first
+    graph.execute(fixture.mCommandBuffer);
+    const std::vector<StubBarrierBatch>& batches = getStubState().mBatches;
+    CHECK(batches.size() == 5);
+    const VkImageMemoryBarrier2KHR* barrier = batches.size() < 3 ? nullptr : findBarrier(batches[2], graph.getImage(last));
+    CHECK(barrier != nullptr && barrier->oldLayout == VK_IMAGE_LAYOUT_UNDEFINED);
+    CHECK(barrier != nullptr && (barrier->srcStageMask & VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT) != 0);
+
+    // The same graph next frame reuses the transient images
+    VkImage image = graph.getImage(first);
+    declareChain(fixture, first, last);
+    CHECK(graph.compile());
+    CHECK(graph.getStats().mRebuilds == 1);
+    CHECK(graph.getImage(first) == image);
+    CHECK(getStubState().mLiveImages == 3);
+}
+
+
+static void testRebuild()
+{
+    // Changing an image recreates the transients, the old ones live until the frames in flight completed
+    GraphFixture fixture;
+    RenderGraph& graph = fixture.mGraph;
+    RenderGraphResource first;
+    RenderGraphResource last;
+    declareChain(fixture, first, last);
+    CHECK(graph.compile());
+
+    fixture.mDescription.mExtent = { 128, 128 };
+    declareChain(fixture, first, last);
+    CHECK(graph.compile());
+    CHECK(graph.getStats().mRebuilds == 2);
+    CHECK(getStubState().mLiveImages == 6);
+
+    for (int frame = 0; frame < 2; frame++)
+    {
+        declareChain(fixture, first, last);
+        CHECK(graph.compile());
+    }
+    CHECK(getStubState().mLiveImages == 3);
+}
+
+
+int main()
+{
+    RUN_TEST(testCulling);
+    RUN_TEST(testBarriers);
+    RUN_TEST(testRelease);
+    RUN_TEST(testAliasing);
+    RUN_TEST(testRebuild);
+    return getTestResult();
+}
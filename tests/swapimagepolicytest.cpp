@@ -0,0 +1,102 @@
+#include "test.h"
+#include "swapimagepolicy.h"
+
+/**
+ * Frames per evaluation window used by all tests
+ */
+static const unsigned int gWindowSize = 8;
+
+
+/**
+ * Records a full window of identical frames and evaluates it
+ * @return if the image count changed
+ */
+static bool recordWindow(SwapImagePolicy& policy, double interval, double cpu, double gpu, double acquire)
+{
+    for (unsigned int i = 0; i < gWindowSize; i++)
+    {
+        CHECK(!policy.update());
+        policy.recordFrame(interval, cpu, gpu, acquire);
+    }
+    return policy.update();
+}
+
+
+static void testInitialCount()
+{
+    CHECK(SwapImagePolicy(ELatencyMode::Low, gWindowSize).getImageCount() == 2);
+    CHECK(SwapImagePolicy(ELatencyMode::Balanced, gWindowSize).getImageCount() == 3);
+    CHECK(SwapImagePolicy(ELatencyMode::Throughput, gWindowSize).getImageCount() == 3);
+}
+
+
+static void testBalanced()
+{
+    // Headroom selects double buffering, but only after two windows agree
+    SwapImagePolicy policy(ELatencyMode::Balanced, gWindowSize);
+    CHECK(!recordWindow(policy, 16.6, 4.0, 5.0, 0.0));
+    CHECK(policy.getImageCount() == 3);
+    CHECK(recordWindow(policy, 16.6, 4.0, 5.0, 0.0));
+    CHECK(policy.getImageCount() == 2);
+    CHECK(policy.getStats().mChanges == 1);
+
+    // A single busy window is a hitch, two go back to triple buffering
+    CHECK(!recordWindow(policy, 16.6, 4.0, 14.0, 0.0));
+    CHECK(!recordWindow(policy, 16.6, 4.0, 5.0, 0.0));
+    CHECK(policy.getImageCount() == 2);
+    CHECK(!recordWindow(policy, 16.6, 4.0, 14.0, 0.0));
+    CHECK(recordWindow(policy, 16.6, 4.0, 14.0, 0.0));
+    CHECK(policy.getImageCount() == 3);
+}
+
+
+static void testLow()
+{
+    // Acquire blocking is expected with two images, only frames that don't fit add a third
+    SwapImagePolicy policy(ELatencyMode::Low, gWindowSize);
+    CHECK(!recordWindow(policy, 16.6, 4.0, 12.0, 4.0));
+    CHECK(!recordWindow(policy, 16.6, 4.0, 12.0, 4.0));
+    CHECK(policy.getImageCount() == 2);
+    CHECK(!recordWindow(policy, 16.6, 4.0, 16.0, 0.0));
+    CHECK(recordWindow(policy, 16.6, 4.0, 16.0, 0.0));
+    CHECK(policy.getImageCount() == 3);
+}
+
+
+static void testThroughput()
+{
+    // Quad buffering requires a busy frame and blocking acquires
+    SwapImagePolicy policy(ELatencyMode::Throughput, gWindowSize);
+    CHECK(!recordWindow(policy, 16.6, 4.0, 14.0, 0.0));
+    CHECK(!recordWindow(policy, 16.6, 4.0, 14.0, 0.0));
+    CHECK(policy.getImageCount() == 3);
+    CHECK(!recordWindow(policy, 16.6, 4.0, 14.0, 2.0));
+    CHECK(recordWindow(policy, 16.6, 4.0, 14.0, 2.0));
+    CHECK(policy.getImageCount() == 4);
+    CHECK(policy.getStats().mBlockedRatio == 1.0);
+    CHECK(policy.getStats().mBlockedFrames == 2 * gWindowSize);
+}
+
+
+static void testClamp()
+{
+    VkSurfaceCapabilitiesKHR capabilities = {};
+    capabilities.minImageCount = 3;
+    capabilities.maxImageCount = 0;
+    CHECK(clampSwapImageCount(2, capabilities) == 3);
+    CHECK(clampSwapImageCount(8, capabilities) == 8);
+    capabilities.maxImageCount = 4;
+    CHECK(clampSwapImageCount(8, capabilities) == 4);
+    CHECK(clampSwapImageCount(4, capabilities) == 4);
+}
+
+
+int main()
+{
+    RUN_TEST(testInitialCount);
+    RUN_TEST(testBalanced);
+    RUN_TEST(testLow);
+    RUN_TEST(testThroughput);
+    RUN_TEST(testClamp);
+    return getTestResult();
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdio>
+
+/**
+ * @return number of failed checks of the test executable
+ */
+inline int& getFailedChecks()
+{
+    static int failed = 0;
+    return failed;
+}
+
+
+/**
+ * Verifies a condition, a failure is printed and counted but doesn't stop the test.
+ * Unlike assert, checks stay active in release builds.
+ */
+#define CHECK(condition) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            std::printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            getFailedChecks()++; \
+        } \
+    } while (false)
+
+
+/**
+ * Runs a single test function and prints its name when one of its checks failed
+ */
+#define RUN_TEST(function) \
+    do \
+    { \
+        int failed = getFailedChecks(); \
+        function(); \
+        if (getFailedChecks() != failed) \
+            std::printf("%s failed\n", #function); \
+    } while (false)
+
+
+/**
+ * @return the exit code of the test executable, non zero when a check failed
+ */
+inline int getTestResult()
+{
+    if (getFailedChecks() == 0)
+        return 0;
+    std::printf("%d check(s) failed\n", getFailedChecks());
+    return 1;
+}
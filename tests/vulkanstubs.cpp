@@ -0,0 +1,345 @@
+#include "vulkanstubs.h"
+
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+
+/**
+ * Handles of stubbed objects start here, tests use lower values for handles they create themselves
+ */
+static uintptr_t gNextHandle = 0x10000;
+
+/**
+ * Bytes per pixel assumed for every format, only used to size fake images
+ */
+static const VkDeviceSize gStubPixelSize = 4;
+
+
+/**
+ * Memory size of every live image, derived from its create info
+ */
+static std::unordered_map<VkImage, VkDeviceSize> gImageSizes;
+
+
+/**
+ * Capacity and number of allocated sets of every live descriptor pool
+ */
+static std::unordered_map<VkDescriptorPool, std::pair<uint32_t, uint32_t>> gPoolSets;
+
+
+StubState& getStubState()
+{
+    static StubState state;
+    return state;
+}
+
+
+void resetStubs()
+{
+    getStubState() = StubState();
+}
+
+
+static void VKAPI_PTR stubCmdPipelineBarrier2(VkCommandBuffer commandBuffer, const VkDependencyInfoKHR* pDependencyInfo)
+{
+    StubBarrierBatch batch;
+    batch.mCommandBuffer = commandBuffer;
+    batch.mImageBarriers.assign(pDependencyInfo->pImageMemoryBarriers, pDependencyInfo->pImageMemoryBarriers + pDependencyInfo->imageMemoryBarrierCount);
+    batch.mBufferBarriers.assign(pDependencyInfo->pBufferMemoryBarriers, pDependencyInfo->pBufferMemoryBarriers + pDependencyInfo->bufferMemoryBarrierCount);
+    getStubState().mBatches.emplace_back(batch);
+}
+
+
+VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL vkGetDeviceProcAddr(VkDevice, const char* pName)
+{
+    if (std::strcmp(pName, "vkCmdPipelineBarrier2KHR") == 0 || std::strcmp(pName, "vkCmdPipelineBarrier2") == 0)
+        return reinterpret_cast<PFN_vkVoidFunction>(&stubCmdPipelineBarrier2);
+    return nullptr;
+}
+
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceMemoryProperties(VkPhysicalDevice, VkPhysicalDeviceMemoryProperties* pMemoryProperties)
+{
+    // A single device local type, enough for every module that only asks for device local memory
+    *pMemoryProperties = {};
+    pMemoryProperties->memoryTypeCount = 1;
+    pMemoryProperties->memoryTypes[0].propertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    pMemoryProperties->memoryTypes[0].heapIndex = 0;
+    pMemoryProperties->memoryHeapCount = 1;
+    pMemoryProperties->memoryHeaps[0].size = 1024 * 1024 * 1024;
+    pMemoryProperties->memoryHeaps[0].flags = VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+}
+
+
+VKAPI_ATTR VkResult VKAPI_CALL vkAllocateMemory(VkDevice, const VkMemoryAllocateInfo* pAllocateInfo, const VkAllocationCallbacks*, VkDeviceMemory* pMemory)
+{
+    StubState& state = getStubState();
+    if (state.mFailAllocations > 0)
+    {
+        state.mFailAllocations--;
+        return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    }
+
+    *pMemory = makeStubHandle<VkDeviceMemory>(gNextHandle++);
+    state.mAllocationSizes.emplace_back(pAllocateInfo->allocationSize);
+    state.mLiveMemory++;
+    return VK_SUCCESS;
+}
+
+
+VKAPI_ATTR void VKAPI_CALL vkFreeMemory(VkDevice, VkDeviceMemory memory, const VkAllocationCallbacks*)
+{
+    if (memory != VK_NULL_HANDLE)
+        getStubState().mLiveMemory--;
+}
+
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateImage(VkDevice, const VkImageCreateInfo* pCreateInfo, const VkAllocationCallbacks*, VkImage* pImage)
+{
+    *pImage = makeStubHandle<VkImage>(gNextHandle++);
+    gImageSizes[*pImage] = static_cast<VkDeviceSize>(pCreateInfo->extent.width) * pCreateInfo->extent.height * pCreateInfo->samples * gStubPixelSize;
+    getStubState().mLiveImages++;
+    return VK_SUCCESS;
+}
+
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyImage(VkDevice, VkImage image, const VkAllocationCallbacks*)
+{
+    if (image == VK_NULL_HANDLE)
+        return;
+    gImageSizes.erase(image);
+    getStubState().mLiveImages--;
+}
+
+
+VKAPI_ATTR void VKAPI_CALL vkGetImageMemoryRequirements(VkDevice, VkImage image, VkMemoryRequirements* pMemoryRequirements)
+{
+    VkDeviceSize alignment = getStubState().mImageAlignment;
+    pMemoryRequirements->size = (gImageSizes[image] + alignment - 1) / alignment * alignment;
+    pMemoryRequirements->alignment = alignment;
+    pMemoryRequirements->memoryTypeBits = 1;
+}
+
+
+VKAPI_ATTR VkResult VKAPI_CALL vkBindImageMemory(VkDevice, VkImage, VkDeviceMemory, VkDeviceSize)
+{
+    return VK_SUCCESS;
+}
+
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreatePipelineCache(VkDevice, const VkPipelineCacheCreateInfo*, const VkAllocationCallbacks*, VkPipelineCache* pPipelineCache)
+{
+    *pPipelineCache = makeStubHandle<VkPipelineCache>(gNextHandle++);
+    return VK_SUCCESS;
+}
+
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyPipelineCache(VkDevice, VkPipelineCache, const VkAllocationCallbacks*)
+{
+}
+
+
+VKAPI_ATTR VkResult VKAPI_CALL vkGetPipelineCacheData(VkDevice, VkPipelineCache, size_t* pDataSize, void*)
+{
+    *pDataSize = 0;
+    return VK_SUCCESS;
+}
+
+
+/**
+ * Creates count pipelines, shared by the graphics and compute entry points
+ */
+static VkResult createStubPipelines(uint32_t count, VkPipeline* pPipelines)
+{
+    StubState& state = getStubState();
+    for (uint32_t i = 0; i < count; i++)
+        pPipelines[i] = makeStubHandle<VkPipeline>(gNextHandle++);
+    state.mPipelinesCreated += count;
+    state.mLivePipelines += count;
+    return VK_SUCCESS;
+}
+
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateGraphicsPipelines(VkDevice, VkPipelineCache, uint32_t createInfoCount, const VkGraphicsPipelineCreateInfo*,
+    const VkAllocationCallbacks*, VkPipeline* pPipelines)
+{
+    return createStubPipelines(createInfoCount, pPipelines);
+}
+
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateComputePipelines(VkDevice, VkPipelineCache, uint32_t createInfoCount, const VkComputePipelineCreateInfo*,
+    const VkAllocationCallbacks*, VkPipeline* pPipelines)
+{
+    return createStubPipelines(createInfoCount, pPipelines);
+}
+
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyPipeline(VkDevice, VkPipeline pipeline, const VkAllocationCallbacks*)
+{
+    if (pipeline != VK_NULL_HANDLE)
+        getStubState().mLivePipelines--;
+}
+
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateDescriptorPool(VkDevice, const VkDescriptorPoolCreateInfo* pCreateInfo, const VkAllocationCallbacks*,
+    VkDescriptorPool* pDescriptorPool)
+{
+    StubState& state = getStubState();
+    *pDescriptorPool = makeStubHandle<VkDescriptorPool>(gNextHandle++);
+    gPoolSets[*pDescriptorPool] = std::make_pair(pCreateInfo->maxSets, 0u);
+    state.mPoolSizes.emplace_back(pCreateInfo->maxSets);
+    state.mLivePools++;
+    return VK_SUCCESS;
+}
+
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyDescriptorPool(VkDevice, VkDescriptorPool descriptorPool, const VkAllocationCallbacks*)
+{
+    if (descriptorPool == VK_NULL_HANDLE)
+        return;
+    gPoolSets.erase(descriptorPool);
+    getStubState().mLivePools--;
+}
+
+
+VKAPI_ATTR VkResult VKAPI_CALL vkResetDescriptorPool(VkDevice, VkDescriptorPool descriptorPool, VkDescriptorPoolResetFlags)
+{
+    gPoolSets[descriptorPool].second = 0;
+    getStubState().mPoolResets++;
+    return VK_SUCCESS;
+}
+
+
+VKAPI_ATTR VkResult VKAPI_CALL vkAllocateDescriptorSets(VkDevice, const VkDescriptorSetAllocateInfo* pAllocateInfo, VkDescriptorSet* pDescriptorSets)
+{
+    // A pool holds as many sets as it was created for, descriptor counts aren't tracked
+    std::pair<uint32_t, uint32_t>& sets = gPoolSets[pAllocateInfo->descriptorPool];
+    if (sets.first - sets.second < pAllocateInfo->descriptorSetCount)
+        return VK_ERROR_OUT_OF_POOL_MEMORY;
+    sets.second += pAllocateInfo->descriptorSetCount;
+    for (uint32_t i = 0; i < pAllocateInfo->descriptorSetCount; i++)
+        pDescriptorSets[i] = makeStubHandle<VkDescriptorSet>(gNextHandle++);
+    return VK_SUCCESS;
+}
+
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateDescriptorSetLayout(VkDevice, const VkDescriptorSetLayoutCreateInfo*, const VkAllocationCallbacks*,
+    VkDescriptorSetLayout* pSetLayout)
+{
+    *pSetLayout = makeStubHandle<VkDescriptorSetLayout>(gNextHandle++);
+    getStubState().mLiveLayouts++;
+    return VK_SUCCESS;
+}
+
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyDescriptorSetLayout(VkDevice, VkDescriptorSetLayout descriptorSetLayout, const VkAllocationCallbacks*)
+{
+    if (descriptorSetLayout != VK_NULL_HANDLE)
+        getStubState().mLiveLayouts--;
+}
+
+
+/**
+ * Implements the two call enumeration idiom: the count without an output array, otherwise up to count properties
+ */
+template<typename T>
+static VkResult enumerateStub(const std::vector<T>& properties, uint32_t* pCount, T* pProperties)
+{
+    if (pProperties == nullptr)
+    {
+        *pCount = static_cast<uint32_t>(properties.size());
+        return VK_SUCCESS;
+    }
+
+    getStubState().mEnumerations++;
+    uint32_t count = std::min(*pCount, static_cast<uint32_t>(properties.size()));
+    std::copy(properties.begin(), properties.begin() + count, pProperties);
+    *pCount = count;
+    return count < properties.size() ? VK_INCOMPLETE : VK_SUCCESS;
+}
+
+
+/**
+ * @return size of a feature structure the stubs can report, 0 for unknown structures
+ */
+static size_t getFeatureStructureSize(VkStructureType type)
+{
+    switch (type)
+    {
+    case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR:
+        return sizeof(VkPhysicalDeviceSynchronization2FeaturesKHR);
+    case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR:
+        return sizeof(VkPhysicalDeviceTimelineSemaphoreFeaturesKHR);
+    case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT:
+        return sizeof(VkPhysicalDeviceDescriptorIndexingFeaturesEXT);
+    case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR:
+        return sizeof(VkPhysicalDeviceDynamicRenderingFeaturesKHR);
+    case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_16BIT_STORAGE_FEATURES_KHR:
+        return sizeof(VkPhysicalDevice16BitStorageFeaturesKHR);
+    case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES_KHR:
+        return sizeof(VkPhysicalDeviceBufferDeviceAddressFeaturesKHR);
+    case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_EXT:
+        return sizeof(VkPhysicalDeviceSwapchainMaintenance1FeaturesEXT);
+    default:
+        return 0;
+    }
+}
+
+
+static void VKAPI_PTR stubGetPhysicalDeviceFeatures2(VkPhysicalDevice, VkPhysicalDeviceFeatures2* pFeatures)
+{
+    // Feature structures hold nothing but VkBool32 members after their header
+    StubState& state = getStubState();
+    state.mQueriedFeatures.clear();
+    for (VkBaseOutStructure* it = reinterpret_cast<VkBaseOutStructure*>(pFeatures->pNext); it != nullptr; it = it->pNext)
+    {
+        state.mQueriedFeatures.emplace_back(it->sType);
+        size_t size = getFeatureStructureSize(it->sType);
+        if (size == 0)
+            continue;
+        bool supported = std::find(state.mSupportedFeatures.begin(), state.mSupportedFeatures.end(), it->sType) != state.mSupportedFeatures.end();
+        VkBool32* bits = reinterpret_cast<VkBool32*>(it + 1);
+        for (size_t i = 0; i < (size - sizeof(VkBaseOutStructure)) / sizeof(VkBool32); i++)
+            bits[i] = supported ? VK_TRUE : VK_FALSE;
+    }
+}
+
+
+VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL vkGetInstanceProcAddr(VkInstance, const char* pName)
+{
+    if (std::strcmp(pName, "vkGetPhysicalDeviceFeatures2") == 0 || std::strcmp(pName, "vkGetPhysicalDeviceFeatures2KHR") == 0)
+        return reinterpret_cast<PFN_vkVoidFunction>(&stubGetPhysicalDeviceFeatures2);
+    return nullptr;
+}
+
+
+VKAPI_ATTR VkResult VKAPI_CALL vkEnumerateInstanceLayerProperties(uint32_t* pPropertyCount, VkLayerProperties* pProperties)
+{
+    return enumerateStub(getStubState().mLayers, pPropertyCount, pProperties);
+}
+
+
+VKAPI_ATTR VkResult VKAPI_CALL vkEnumerateInstanceExtensionProperties(const char*, uint32_t* pPropertyCount, VkExtensionProperties* pProperties)
+{
+    return enumerateStub(getStubState().mInstanceExtensions, pPropertyCount, pProperties);
+}
+
+
+VKAPI_ATTR VkResult VKAPI_CALL vkEnumerateDeviceExtensionProperties(VkPhysicalDevice, const char*, uint32_t* pPropertyCount,
+    VkExtensionProperties* pProperties)
+{
+    return enumerateStub(getStubState().mDeviceExtensions, pPropertyCount, pProperties);
+}
+
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceQueueFamilyProperties(VkPhysicalDevice, uint32_t* pQueueFamilyPropertyCount,
+    VkQueueFamilyProperties* pQueueFamilyProperties)
+{
+    enumerateStub(getStubState().mQueueFamilies, pQueueFamilyPropertyCount, pQueueFamilyProperties);
+}
+
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceProperties(VkPhysicalDevice, VkPhysicalDeviceProperties* pProperties)
+{
+    *pProperties = getStubState().mDeviceProperties;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+/**
+ * Device entry points used by the tested modules, implemented without a device.
+ *
+ * Test executables link vulkanstubs.cpp instead of the Vulkan loader. Memory and images are plain handles that are
+ * counted, barriers written by vkCmdPipelineBarrier2 are recorded so tests can check where they're placed.
+ * Handles returned by the stubs are never dereferenced, any non null device and command buffer can be passed.
+ */
+
+/**
+ * A single vkCmdPipelineBarrier2 call
+ */
+struct StubBarrierBatch
+{
+    VkCommandBuffer                         mCommandBuffer = VK_NULL_HANDLE;
+    std::vector<VkImageMemoryBarrier2KHR>   mImageBarriers;
+    std::vector<VkBufferMemoryBarrier2KHR>  mBufferBarriers;
+};
+
+
+/**
+ * Stub state, reset by resetStubs()
+ */
+struct StubState
+{
+    std::vector<StubBarrierBatch>           mBatches;                  ///< Every barrier call, in recording order
+    std::vector<VkDeviceSize>               mAllocationSizes;          ///< Size of every successful vkAllocateMemory call
+    unsigned int                            mLiveMemory = 0;           ///< Device memory allocated and not yet freed
+    unsigned int                            mLiveImages = 0;           ///< Images created and not yet destroyed
+    unsigned int                            mPipelinesCreated = 0;     ///< Number of graphics and compute pipelines created
+    unsigned int                            mLivePipelines = 0;        ///< Pipelines created and not yet destroyed
+    std::vector<uint32_t>                   mPoolSizes;                ///< Max sets of every created descriptor pool
+    unsigned int                            mLivePools = 0;            ///< Descriptor pools created and not yet destroyed
+    unsigned int                            mPoolResets = 0;           ///< Number of vkResetDescriptorPool calls
+    unsigned int                            mLiveLayouts = 0;          ///< Descriptor set layouts created and not yet destroyed
+    VkPhysicalDeviceProperties              mDeviceProperties = {};    ///< Properties reported for every physical device
+    std::vector<VkQueueFamilyProperties>    mQueueFamilies;            ///< Queue families reported for every physical device
+    std::vector<VkLayerProperties>          mLayers;                   ///< Available instance layers
+    std::vector<VkExtensionProperties>      mInstanceExtensions;       ///< Available instance extensions
+    std::vector<VkExtensionProperties>      mDeviceExtensions;         ///< Extensions reported for every physical device
+    unsigned int                            mEnumerations = 0;         ///< Number of layer, extension and queue family enumerations that copied properties
+    std::vector<VkStructureType>            mSupportedFeatures;        ///< Feature structures vkGetPhysicalDeviceFeatures2 reports every bit of as supported
+    std::vector<VkStructureType>            mQueriedFeatures;          ///< Chain of the last vkGetPhysicalDeviceFeatures2 call, without VkPhysicalDeviceFeatures2
+    unsigned int                            mFailAllocations = 0;      ///< Number of upcoming vkAllocateMemory calls that fail
+    VkDeviceSize                            mImageAlignment = 256;     ///< Alignment reported for every image
+};
+
+
+/**
+ * @return the state of the stubs, shared by all stubbed entry points
+ */
+StubState& getStubState();
+
+/**
+ * Clears all recorded calls and counters
+ */
+void resetStubs();
+
+/**
+ * @return a fake handle that is never returned by the stubs themselves, for devices and command buffers
+ */
+template<typename T>
+T makeStubHandle(uintptr_t value)
+{
+    return reinterpret_cast<T>(value);
+}